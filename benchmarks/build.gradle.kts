@@ -0,0 +1,54 @@
+plugins {
+    id("java-library")
+    id("org.jetbrains.kotlin.jvm")
+    alias(libs.plugins.allopen)
+    alias(libs.plugins.kotlinx.benchmark)
+}
+
+kotlin {
+    jvmToolchain(17)
+}
+
+java {
+    sourceCompatibility = JavaVersion.VERSION_17
+    targetCompatibility = JavaVersion.VERSION_17
+}
+
+// JMH requires benchmark state classes to be open.
+allOpen {
+    annotation("org.openjdk.jmh.annotations.State")
+}
+
+dependencies {
+    implementation(project(":identity"))
+    implementation(project(":identity-mdoc"))
+    implementation(project(":identity-doctypes"))
+
+    implementation(libs.kotlinx.benchmark.runtime)
+    implementation(libs.kotlinx.datetime)
+    implementation(libs.bouncy.castle.bcprov)
+    implementation(libs.bouncy.castle.bcpkix)
+}
+
+benchmark {
+    targets {
+        register("main")
+    }
+    configurations {
+        named("main") {
+            warmups = 3
+            iterations = 5
+            iterationTime = 1
+            iterationTimeUnit = "s"
+            reportFormat = "json"
+        }
+        // Quick sanity run, e.g. for CI: ./gradlew :benchmarks:smokeBenchmark
+        register("smoke") {
+            warmups = 1
+            iterations = 1
+            iterationTime = 200
+            iterationTimeUnit = "ms"
+            param("payloadSize", 1024)
+        }
+    }
+}
@@ -0,0 +1,47 @@
+package com.android.identity.benchmarks
+
+import com.android.identity.cbor.Cbor
+import com.android.identity.cbor.DataItem
+import kotlinx.benchmark.Benchmark
+import kotlinx.benchmark.BenchmarkMode
+import kotlinx.benchmark.BenchmarkTimeUnit
+import kotlinx.benchmark.Mode
+import kotlinx.benchmark.OutputTimeUnit
+import kotlinx.benchmark.Param
+import kotlinx.benchmark.Scope
+import kotlinx.benchmark.Setup
+import kotlinx.benchmark.State
+
+/**
+ * Encoding and decoding of all sample data elements of a document, as stored in a
+ * `Document`'s application data.
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(BenchmarkTimeUnit.MICROSECONDS)
+class CborBenchmark {
+    @Param("MDL", "EU_PID")
+    var documentType = "MDL"
+
+    private lateinit var dataItem: DataItem
+    private lateinit var encoded: ByteArray
+
+    @Setup
+    fun setup() {
+        val document = SampleDocument(SampleDocumentType.valueOf(documentType))
+        dataItem = document.nameSpacedData.toDataItem()
+        encoded = Cbor.encode(dataItem)
+    }
+
+    @Benchmark
+    fun encode(): ByteArray = Cbor.encode(dataItem)
+
+    @Benchmark
+    fun decode(): DataItem = Cbor.decode(encoded)
+
+    @Benchmark
+    fun decodeLazily(): DataItem = Cbor.decodeLazily(encoded)
+
+    @Benchmark
+    fun encodedSize(): Int = Cbor.encodedSize(dataItem)
+}
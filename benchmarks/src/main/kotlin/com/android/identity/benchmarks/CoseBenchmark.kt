@@ -0,0 +1,68 @@
+package com.android.identity.benchmarks
+
+import com.android.identity.cbor.Cbor
+import com.android.identity.cbor.DataItem
+import com.android.identity.cbor.toDataItem
+import com.android.identity.cose.Cose
+import com.android.identity.cose.CoseLabel
+import com.android.identity.cose.CoseNumberLabel
+import com.android.identity.cose.CoseSign1
+import com.android.identity.crypto.Algorithm
+import com.android.identity.crypto.Crypto
+import com.android.identity.crypto.EcCurve
+import com.android.identity.crypto.EcPrivateKey
+import kotlinx.benchmark.Benchmark
+import kotlinx.benchmark.BenchmarkMode
+import kotlinx.benchmark.BenchmarkTimeUnit
+import kotlinx.benchmark.Mode
+import kotlinx.benchmark.OutputTimeUnit
+import kotlinx.benchmark.Param
+import kotlinx.benchmark.Scope
+import kotlinx.benchmark.Setup
+import kotlinx.benchmark.State
+
+/**
+ * COSE_Sign1 signing and verification of a payload the size of an `IssuerAuth` MSO.
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(BenchmarkTimeUnit.MICROSECONDS)
+class CoseBenchmark {
+    @Param("P256", "P384", "ED25519")
+    var curve = "P256"
+
+    private lateinit var key: EcPrivateKey
+    private lateinit var algorithm: Algorithm
+    private lateinit var payload: ByteArray
+    private lateinit var protectedHeaders: Map<CoseLabel, DataItem>
+    private lateinit var signature: CoseSign1
+
+    @Setup
+    fun setup() {
+        SampleDocument.ensureProviderInstalled()
+        val (ecCurve, signatureAlgorithm) = when (curve) {
+            "P256" -> Pair(EcCurve.P256, Algorithm.ES256)
+            "P384" -> Pair(EcCurve.P384, Algorithm.ES384)
+            "ED25519" -> Pair(EcCurve.ED25519, Algorithm.EDDSA)
+            else -> throw IllegalArgumentException("Unsupported curve $curve")
+        }
+        key = Crypto.createEcPrivateKey(ecCurve)
+        algorithm = signatureAlgorithm
+        // The payload of IssuerAuth for the sample mDL, i.e. a realistically sized MSO.
+        payload = CoseSign1.fromDataItem(
+            Cbor.decode(SampleDocument(SampleDocumentType.MDL).encodedIssuerAuth)
+        ).payload!!
+        protectedHeaders = mapOf(
+            CoseNumberLabel(Cose.COSE_LABEL_ALG) to algorithm.coseAlgorithmIdentifier.toDataItem()
+        )
+        signature = sign()
+    }
+
+    @Benchmark
+    fun sign(): CoseSign1 =
+        Cose.coseSign1Sign(key, payload, true, algorithm, protectedHeaders, mapOf())
+
+    @Benchmark
+    fun verify(): Boolean =
+        Cose.coseSign1Check(key.publicKey, null, signature, algorithm)
+}
@@ -0,0 +1,65 @@
+package com.android.identity.benchmarks
+
+import com.android.identity.crypto.Algorithm
+import com.android.identity.document.NameSpacedData
+import com.android.identity.mdoc.response.DeviceResponseGenerator
+import com.android.identity.mdoc.response.DeviceResponseParser
+import com.android.identity.mdoc.response.DocumentGenerator
+import kotlinx.benchmark.Benchmark
+import kotlinx.benchmark.BenchmarkMode
+import kotlinx.benchmark.BenchmarkTimeUnit
+import kotlinx.benchmark.Mode
+import kotlinx.benchmark.OutputTimeUnit
+import kotlinx.benchmark.Param
+import kotlinx.benchmark.Scope
+import kotlinx.benchmark.Setup
+import kotlinx.benchmark.State
+
+/**
+ * Generating and parsing a `DeviceResponse` which discloses every sample data element of a
+ * document, with `DeviceSigned` authenticated by an ECDSA signature.
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(BenchmarkTimeUnit.MICROSECONDS)
+class DeviceResponseBenchmark {
+    @Param("MDL", "EU_PID")
+    var documentType = "MDL"
+
+    private lateinit var document: SampleDocument
+    private lateinit var encodedDeviceResponse: ByteArray
+
+    @Setup
+    fun setup() {
+        document = SampleDocument(SampleDocumentType.valueOf(documentType))
+        encodedDeviceResponse = generate()
+    }
+
+    @Benchmark
+    fun generate(): ByteArray =
+        DeviceResponseGenerator(0)
+            .addDocument(
+                DocumentGenerator(
+                    document.docType,
+                    document.encodedIssuerAuth,
+                    SampleDocument.ENCODED_SESSION_TRANSCRIPT
+                )
+                    .setIssuerNamespaces(document.issuerNameSpaces)
+                    .setDeviceNamespacesSignature(
+                        NameSpacedData.Builder().build(),
+                        document.secureArea,
+                        SampleDocument.DEVICE_KEY_ALIAS,
+                        null,
+                        Algorithm.ES256
+                    )
+                    .generate()
+            )
+            .generate()
+
+    @Benchmark
+    fun parse(): DeviceResponseParser.DeviceResponse =
+        DeviceResponseParser(
+            encodedDeviceResponse,
+            SampleDocument.ENCODED_SESSION_TRANSCRIPT
+        ).parse()
+}
@@ -0,0 +1,48 @@
+package com.android.identity.benchmarks
+
+import com.android.identity.crypto.Algorithm
+import com.android.identity.document.NameSpacedData
+import com.android.identity.mdoc.util.MdocUtil
+import kotlinx.benchmark.Benchmark
+import kotlinx.benchmark.BenchmarkMode
+import kotlinx.benchmark.BenchmarkTimeUnit
+import kotlinx.benchmark.Mode
+import kotlinx.benchmark.OutputTimeUnit
+import kotlinx.benchmark.Param
+import kotlinx.benchmark.Scope
+import kotlinx.benchmark.Setup
+import kotlinx.benchmark.State
+
+/**
+ * The issuer side of provisioning: building `IssuerNameSpaces` and their digests.
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(BenchmarkTimeUnit.MICROSECONDS)
+class MdocUtilBenchmark {
+    @Param("MDL", "EU_PID")
+    var documentType = "MDL"
+
+    private lateinit var document: SampleDocument
+    private lateinit var nameSpacedData: NameSpacedData
+
+    @Setup
+    fun setup() {
+        document = SampleDocument(SampleDocumentType.valueOf(documentType))
+        nameSpacedData = document.nameSpacedData
+    }
+
+    @Benchmark
+    fun generateIssuerNameSpaces(): Map<String, List<ByteArray>> =
+        document.generateIssuerNameSpaces(nameSpacedData)
+
+    @Benchmark
+    fun calculateDigestsForNameSpaces(): List<Map<Long, ByteArray>> =
+        document.issuerNameSpaces.keys.map { nameSpaceName ->
+            MdocUtil.calculateDigestsForNameSpace(
+                nameSpaceName,
+                document.issuerNameSpaces,
+                Algorithm.SHA256
+            )
+        }
+}
@@ -0,0 +1,153 @@
+package com.android.identity.benchmarks
+
+import com.android.identity.cbor.Bstr
+import com.android.identity.cbor.Cbor
+import com.android.identity.cbor.DataItem
+import com.android.identity.cbor.Tagged
+import com.android.identity.cbor.Tstr
+import com.android.identity.cbor.toDataItem
+import com.android.identity.cose.Cose
+import com.android.identity.cose.CoseLabel
+import com.android.identity.cose.CoseNumberLabel
+import com.android.identity.crypto.Algorithm
+import com.android.identity.crypto.Crypto
+import com.android.identity.crypto.EcCurve
+import com.android.identity.crypto.EcPrivateKey
+import com.android.identity.crypto.X509Cert
+import com.android.identity.crypto.X509CertChain
+import com.android.identity.crypto.create
+import com.android.identity.document.NameSpacedData
+import com.android.identity.documenttype.DocumentType
+import com.android.identity.documenttype.knowntypes.DrivingLicense
+import com.android.identity.documenttype.knowntypes.EUPersonalID
+import com.android.identity.mdoc.mso.MobileSecurityObjectGenerator
+import com.android.identity.mdoc.util.MdocUtil
+import com.android.identity.securearea.software.SoftwareCreateKeySettings
+import com.android.identity.securearea.software.SoftwareSecureArea
+import com.android.identity.storage.EphemeralStorageEngine
+import kotlinx.datetime.Instant
+import org.bouncycastle.jce.provider.BouncyCastleProvider
+import java.security.Security
+import kotlin.random.Random
+import kotlin.time.Duration.Companion.days
+
+/**
+ * Which sample document a benchmark operates on.
+ */
+enum class SampleDocumentType(val documentType: DocumentType) {
+    /** An ISO/IEC 18013-5 mDL, including the AAMVA name space. */
+    MDL(DrivingLicense.getDocumentType()),
+
+    /** An EU PID. */
+    EU_PID(EUPersonalID.getDocumentType());
+
+    val docType: String
+        get() = documentType.mdocDocumentType!!.docType
+}
+
+/**
+ * A fully provisioned mdoc built from the sample values in `identity-doctypes`.
+ *
+ * Everything here is deterministic except key generation so benchmark runs are comparable.
+ */
+class SampleDocument(val type: SampleDocumentType) {
+    val docType = type.docType
+
+    /** All data elements with a sample value, as [NameSpacedData]. */
+    val nameSpacedData: NameSpacedData
+
+    /** The `IssuerNameSpaces` for [nameSpacedData], keyed by name space. */
+    val issuerNameSpaces: Map<String, List<ByteArray>>
+
+    /** Bytes of the `IssuerAuth` COSE_Sign1 over the MSO for [issuerNameSpaces]. */
+    val encodedIssuerAuth: ByteArray
+
+    val documentSignerKey: EcPrivateKey
+    val documentSignerCert: X509Cert
+
+    /** The secure area holding the device key, under the alias [DEVICE_KEY_ALIAS]. */
+    val secureArea = SoftwareSecureArea(EphemeralStorageEngine())
+
+    init {
+        ensureProviderInstalled()
+
+        val builder = NameSpacedData.Builder()
+        for ((nameSpaceName, nameSpace) in type.documentType.mdocDocumentType!!.namespaces) {
+            for ((dataElementName, dataElement) in nameSpace.dataElements) {
+                val sampleValue = dataElement.attribute.sampleValue ?: continue
+                builder.putEntry(nameSpaceName, dataElementName, Cbor.encode(sampleValue))
+            }
+        }
+        nameSpacedData = builder.build()
+        issuerNameSpaces = generateIssuerNameSpaces(nameSpacedData)
+
+        secureArea.createKey(DEVICE_KEY_ALIAS, SoftwareCreateKeySettings.Builder().build())
+        val deviceKey = secureArea.getKeyInfo(DEVICE_KEY_ALIAS).publicKey
+
+        documentSignerKey = Crypto.createEcPrivateKey(EcCurve.P256)
+        documentSignerCert = X509Cert.create(
+            documentSignerKey.publicKey,
+            documentSignerKey,
+            null,
+            Algorithm.ES256,
+            "1",
+            "CN=Benchmark Issuer",
+            "CN=Benchmark Issuer",
+            TIME_SIGNED,
+            TIME_SIGNED + 365.days,
+            setOf(),
+            listOf()
+        )
+
+        val msoGenerator = MobileSecurityObjectGenerator("SHA-256", docType, deviceKey)
+        msoGenerator.setValidityInfo(TIME_SIGNED, TIME_SIGNED, TIME_SIGNED + 365.days, null)
+        for (nameSpaceName in issuerNameSpaces.keys) {
+            msoGenerator.addDigestIdsForNamespace(
+                nameSpaceName,
+                MdocUtil.calculateDigestsForNameSpace(
+                    nameSpaceName,
+                    issuerNameSpaces,
+                    Algorithm.SHA256
+                )
+            )
+        }
+        val taggedEncodedMso = Cbor.encode(Tagged(24, Bstr(msoGenerator.generate())))
+        encodedIssuerAuth = Cbor.encode(
+            Cose.coseSign1Sign(
+                documentSignerKey,
+                taggedEncodedMso,
+                true,
+                Algorithm.ES256,
+                mapOf<CoseLabel, DataItem>(
+                    CoseNumberLabel(Cose.COSE_LABEL_ALG) to
+                            Algorithm.ES256.coseAlgorithmIdentifier.toDataItem()
+                ),
+                mapOf<CoseLabel, DataItem>(
+                    CoseNumberLabel(Cose.COSE_LABEL_X5CHAIN) to
+                            X509CertChain(listOf(documentSignerCert)).toDataItem()
+                )
+            ).toDataItem()
+        )
+    }
+
+    /**
+     * Generates `IssuerNameSpaces` for [data] using a fixed seed.
+     */
+    fun generateIssuerNameSpaces(data: NameSpacedData): Map<String, List<ByteArray>> =
+        MdocUtil.generateIssuerNameSpaces(data, Random(42), 16, null)
+
+    companion object {
+        const val DEVICE_KEY_ALIAS = "deviceKey"
+
+        val TIME_SIGNED = Instant.fromEpochSeconds(1704067200)
+
+        /** A stand-in `SessionTranscript`; the parser treats it as opaque bytes. */
+        val ENCODED_SESSION_TRANSCRIPT = Cbor.encode(Tstr("Benchmark SessionTranscript"))
+
+        fun ensureProviderInstalled() {
+            if (Security.getProvider(BouncyCastleProvider.PROVIDER_NAME) == null) {
+                Security.insertProviderAt(BouncyCastleProvider(), 1)
+            }
+        }
+    }
+}
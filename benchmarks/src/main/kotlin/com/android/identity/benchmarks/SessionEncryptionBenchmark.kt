@@ -0,0 +1,65 @@
+package com.android.identity.benchmarks
+
+import com.android.identity.crypto.Crypto
+import com.android.identity.crypto.EcCurve
+import com.android.identity.mdoc.sessionencryption.SessionEncryption
+import kotlinx.benchmark.Benchmark
+import kotlinx.benchmark.BenchmarkMode
+import kotlinx.benchmark.BenchmarkTimeUnit
+import kotlinx.benchmark.Mode
+import kotlinx.benchmark.OutputTimeUnit
+import kotlinx.benchmark.Param
+import kotlinx.benchmark.Scope
+import kotlinx.benchmark.Setup
+import kotlinx.benchmark.State
+import org.openjdk.jmh.annotations.Level
+import kotlin.random.Random
+
+/**
+ * Session encryption of messages from 1 KiB to 1 MiB, i.e. from a small `DeviceRequest` to a
+ * `DeviceResponse` carrying a portrait and other large data elements.
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(BenchmarkTimeUnit.MICROSECONDS)
+class SessionEncryptionBenchmark {
+    @Param("1024", "65536", "1048576")
+    var payloadSize = 1024
+
+    private lateinit var payload: ByteArray
+    private lateinit var mdoc: SessionEncryption
+    private lateinit var reader: SessionEncryption
+    private lateinit var nextMessage: ByteArray
+
+    @Setup
+    fun setup() {
+        SampleDocument.ensureProviderInstalled()
+        payload = Random(42).nextBytes(payloadSize)
+        val eDeviceKey = Crypto.createEcPrivateKey(EcCurve.P256)
+        val eReaderKey = Crypto.createEcPrivateKey(EcCurve.P256)
+        mdoc = SessionEncryption(
+            SessionEncryption.Role.MDOC,
+            eDeviceKey,
+            eReaderKey.publicKey,
+            SampleDocument.ENCODED_SESSION_TRANSCRIPT
+        )
+        reader = SessionEncryption(
+            SessionEncryption.Role.MDOC_READER,
+            eReaderKey,
+            eDeviceKey.publicKey,
+            SampleDocument.ENCODED_SESSION_TRANSCRIPT
+        )
+    }
+
+    // The message counter is part of the IV so every decryption needs a fresh message.
+    @Setup(Level.Invocation)
+    fun prepareNextMessage() {
+        nextMessage = mdoc.encryptMessage(payload, null)
+    }
+
+    @Benchmark
+    fun encryptMessage(): ByteArray = reader.encryptMessage(payload, null)
+
+    @Benchmark
+    fun decryptMessage(): ByteArray? = reader.decryptMessage(nextMessage).first
+}
@@ -11,4 +11,6 @@ plugins {
     alias(libs.plugins.navigation.safe.args) apply false
     alias(libs.plugins.parcelable) apply false
     alias(libs.plugins.kapt) apply false
+    alias(libs.plugins.kotlinx.benchmark) apply false
+    alias(libs.plugins.allopen) apply false
 }
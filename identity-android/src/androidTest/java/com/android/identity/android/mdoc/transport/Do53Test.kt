@@ -0,0 +1,111 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.android.identity.android.mdoc.transport
+
+import androidx.test.filters.SmallTest
+import org.junit.Assert
+import org.junit.Test
+
+class Do53Test {
+    private fun roundTrip(
+        messageSize: Int,
+        chunkSize: Int,
+        assembler: Do53Assembler = Do53Assembler()
+    ) {
+        val data = ByteArray(messageSize) { (it * 7).toByte() }
+        val message = Do53Message(data)
+        // Copy chunks into the middle of a larger array, like the data field of an APDU.
+        val apdu = ByteArray(chunkSize + 10)
+        var offset = 0
+        while (offset < message.size) {
+            Assert.assertFalse(assembler.isComplete)
+            val size = minOf(chunkSize, message.size - offset)
+            message.copyInto(apdu, 7, offset, size)
+            assembler.append(apdu, 7, size)
+            offset += size
+        }
+        Assert.assertTrue(assembler.isComplete)
+        Assert.assertEquals((message.size + chunkSize - 1) / chunkSize, assembler.numChunks)
+        Assert.assertArrayEquals(data, assembler.finish())
+        Assert.assertEquals(0, assembler.numChunks)
+    }
+
+    @Test
+    @SmallTest
+    fun encoding() {
+        Assert.assertArrayEquals(
+            byteArrayOf(0x53, 0x02, 0x01, 0x02),
+            Do53Message(byteArrayOf(0x01, 0x02)).toByteArray()
+        )
+        Assert.assertEquals(2 + 0x7f, Do53Message(ByteArray(0x7f)).size)
+        Assert.assertEquals(3 + 0x80, Do53Message(ByteArray(0x80)).size)
+        Assert.assertEquals(4 + 0x100, Do53Message(ByteArray(0x100)).size)
+        val encoded = Do53Message(ByteArray(0x10000)).toByteArray()
+        Assert.assertArrayEquals(
+            byteArrayOf(0x53, 0x83.toByte(), 0x01, 0x00, 0x00),
+            encoded.copyOfRange(0, 5)
+        )
+    }
+
+    @Test
+    @SmallTest
+    fun roundTrips() {
+        for (messageSize in listOf(0, 1, 0x7f, 0x80, 0xff, 0x100, 5000, 0x10000)) {
+            // A chunk size of 1 splits the header across chunks.
+            for (chunkSize in listOf(1, 3, 255, 261, 65535)) {
+                if (messageSize / chunkSize > 10000) {
+                    continue
+                }
+                roundTrip(messageSize, chunkSize)
+            }
+        }
+    }
+
+    @Test
+    @SmallTest
+    fun growsBeyondPreallocation() {
+        for (messageSize in listOf(0, 15, 16, 17, 5000, 0x10000)) {
+            for (chunkSize in listOf(1, 255, 65535)) {
+                if (messageSize / chunkSize > 10000) {
+                    continue
+                }
+                roundTrip(messageSize, chunkSize, Do53Assembler(maxPreallocationSize = 16))
+            }
+        }
+    }
+
+    @Test
+    @SmallTest
+    fun malformed() {
+        val assembler = Do53Assembler()
+        Assert.assertThrows(IllegalArgumentException::class.java) {
+            assembler.append(byteArrayOf(0x54, 0x01, 0x00), 0, 3)
+        }
+        assembler.reset()
+        Assert.assertThrows(IllegalArgumentException::class.java) {
+            assembler.append(byteArrayOf(0x53, 0x84.toByte()), 0, 2)
+        }
+        assembler.reset()
+        Assert.assertThrows(IllegalArgumentException::class.java) {
+            assembler.append(byteArrayOf(0x53, 0x01, 0x00, 0x00), 0, 4)
+        }
+        assembler.reset()
+        assembler.append(byteArrayOf(0x53, 0x02, 0x00), 0, 3)
+        Assert.assertThrows(IllegalArgumentException::class.java) {
+            assembler.finish()
+        }
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.android.identity.android.mdoc.transport
+
+import androidx.test.filters.SmallTest
+import kotlinx.io.Buffer
+import org.junit.Assert
+import org.junit.Test
+import java.io.ByteArrayOutputStream
+
+class GattSendQueueTest {
+    private var now = 0L
+
+    // Drains the queue like GattServer/GattClient do, reassembling messages like the receiver.
+    private fun drain(queue: GattSendQueue, characteristicValueSize: Int): List<ByteArray> {
+        val messages = mutableListOf<ByteArray>()
+        val incoming = ByteArrayOutputStream()
+        while (true) {
+            val chunk = queue.nextChunk(characteristicValueSize) ?: break
+            Assert.assertTrue(chunk.size <= characteristicValueSize)
+            incoming.write(chunk, 1, chunk.size - 1)
+            if (chunk[0].toInt() == 0x00) {
+                messages.add(incoming.toByteArray())
+                incoming.reset()
+            } else {
+                Assert.assertEquals(0x01, chunk[0].toInt())
+                Assert.assertEquals(characteristicValueSize, chunk.size)
+            }
+            now += 10
+            queue.onChunkSent()
+        }
+        return messages
+    }
+
+    @Test
+    @SmallTest
+    fun chunking() {
+        val queue = GattSendQueue("GattSendQueueTest") { now }
+        val message1 = ByteArray(1000) { it.toByte() }
+        val message2 = ByteArray(99) { (it + 1).toByte() }
+        val message3 = ByteArray(1) { 42 }
+        queue.add(message1)
+        queue.add(Buffer().apply { write(message2) }, message2.size.toLong())
+        queue.add(message3)
+        Assert.assertFalse(queue.isEmpty)
+
+        val messages = drain(queue, 100)
+        Assert.assertEquals(3, messages.size)
+        Assert.assertArrayEquals(message1, messages[0])
+        Assert.assertArrayEquals(message2, messages[1])
+        Assert.assertArrayEquals(message3, messages[2])
+        Assert.assertTrue(queue.isEmpty)
+        Assert.assertEquals(
+            GattSendQueue.TransferStatistics(
+                messageSize = 1,
+                numChunks = 1,
+                chunkSize = 100,
+                durationMillis = 10
+            ),
+            queue.lastTransferStatistics
+        )
+    }
+
+    @Test
+    @SmallTest
+    fun statistics() {
+        val queue = GattSendQueue("GattSendQueueTest") { now }
+        Assert.assertNull(queue.lastTransferStatistics)
+        // 512 bytes of data per chunk makes for exactly 10 chunks.
+        queue.add(ByteArray(5120))
+        drain(queue, 513)
+        val statistics = queue.lastTransferStatistics!!
+        Assert.assertEquals(5120L, statistics.messageSize)
+        Assert.assertEquals(10, statistics.numChunks)
+        Assert.assertEquals(513, statistics.chunkSize)
+        Assert.assertEquals(100L, statistics.durationMillis)
+        Assert.assertEquals(51200L, statistics.bytesPerSecond)
+    }
+
+    @Test
+    @SmallTest
+    fun shutdownAfterPendingMessages() {
+        val queue = GattSendQueue("GattSendQueueTest") { now }
+        Assert.assertFalse(queue.takeShutdownRequest())
+        queue.add(ByteArray(10))
+        queue.requestShutdown()
+        Assert.assertFalse(queue.takeShutdownRequest())
+        drain(queue, 23)
+        Assert.assertTrue(queue.takeShutdownRequest())
+        Assert.assertFalse(queue.takeShutdownRequest())
+    }
+}
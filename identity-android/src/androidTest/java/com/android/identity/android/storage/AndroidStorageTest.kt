@@ -37,6 +37,7 @@ class AndroidStorageTest {
     fun setup() {
         val context = InstrumentationRegistry.getTargetContext()
         SystemFileSystem.delete(Path(context.dataDir.path, "testdata.bin"), false)
+        SystemFileSystem.delete(Path(context.dataDir.path, "testdata.bin.keys"), false)
     }
 
     @Test
@@ -99,8 +100,9 @@ class AndroidStorageTest {
         val fileContents = SystemFileSystem.source(storageFile).buffered().readByteArray()
         Assert.assertEquals(-1, (fileContents.toHex()).indexOf(data.toHex()).toLong())
 
-        // Try again without encryption. The data should start at offset 20 which is
-        // an implementation detail of how [GenericStorageEngine] stores the data.
+        // Try again without encryption. The data should start at offset 36 (in the hex
+        // string) which is an implementation detail of how [GenericStorageEngine] stores
+        // the data.
         val storageWithoutEncryption = AndroidStorageEngine.Builder(context, storageFile)
             .setUseEncryption(false)
             .build()
@@ -108,7 +110,7 @@ class AndroidStorageTest {
         storageWithoutEncryption.put("foo", data)
         val fileContentsWithoutEncryption = SystemFileSystem.source(storageFile).buffered().readByteArray()
         val idx = (fileContentsWithoutEncryption.toHex()).indexOf(data.toHex())
-        Assert.assertEquals(20, idx)
+        Assert.assertEquals(36, idx)
     }
 
     @Test
@@ -130,4 +132,37 @@ class AndroidStorageTest {
         val retrievedData = storage["foo"]
         Assert.assertArrayEquals(retrievedData, data)
     }
+
+    @Test
+    fun testDataEncryptionKey() {
+        val context = InstrumentationRegistry.getTargetContext()
+        val storageFile = Path(context.dataDir.path, "testdata.bin")
+        val data = "xyz123".toByteArray(StandardCharsets.UTF_8)
+
+        // Start with data encrypted directly with the hardware-backed key.
+        val storage = AndroidStorageEngine.Builder(context, storageFile)
+            .setUseEncryption(true)
+            .build()
+        storage.put("foo", data)
+
+        val storageWithDataKey = AndroidStorageEngine.Builder(context, storageFile)
+            .setUseEncryption(true)
+            .setUseDataEncryptionKey(true)
+            .build()
+        Assert.assertArrayEquals(data, storageWithDataKey["foo"])
+        storageWithDataKey.put("bar", data)
+        val fileContents = SystemFileSystem.source(storageFile).buffered().readByteArray()
+        Assert.assertEquals(-1, (fileContents.toHex()).indexOf(data.toHex()).toLong())
+
+        storageWithDataKey.rotateDataEncryptionKey()
+        Assert.assertArrayEquals(data, storageWithDataKey["foo"])
+        Assert.assertArrayEquals(data, storageWithDataKey["bar"])
+
+        // Readable by a new instance, with or without the data encryption key mode.
+        val storage2 = AndroidStorageEngine.Builder(context, storageFile)
+            .setUseEncryption(true)
+            .build()
+        Assert.assertArrayEquals(data, storage2["foo"])
+        Assert.assertArrayEquals(data, storage2["bar"])
+    }
 }
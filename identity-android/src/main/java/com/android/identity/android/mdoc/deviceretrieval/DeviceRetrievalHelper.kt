@@ -33,6 +33,7 @@ import com.android.identity.mdoc.sessionencryption.SessionEncryption
 import com.android.identity.util.Constants
 import com.android.identity.util.Logger
 import java.util.concurrent.Executor
+import kotlinx.io.Source
 
 /**
  * Helper used for establishing engagement with, interacting with, and presenting documents to a
@@ -374,9 +375,38 @@ class DeviceRetrievalHelper internal constructor(
             Logger.d(TAG, "sendDeviceResponse: ignoring because transport is unset")
             return
         }
+        transport!!.countMessageSent(sessionDataMessage.size.toLong())
         transport!!.sendMessage(sessionDataMessage)
     }
 
+    /**
+     * Send a response to the remote mdoc verifier, streaming it from a [Source].
+     *
+     * This is like [sendDeviceResponse] taking a [ByteArray] except that the response is
+     * encrypted while it's being sent. This is useful for large responses, e.g. ones containing
+     * portraits or other images, to avoid holding several copies of the response in memory
+     * and to start sending before all of it has been encrypted.
+     *
+     * @param deviceResponse the source to read the CBOR conforming to `DeviceResponse` from.
+     * @param deviceResponseSize the number of bytes to read from [deviceResponse].
+     * @param status optional status code to send.
+     */
+    fun sendDeviceResponse(
+        deviceResponse: Source,
+        deviceResponseSize: Long,
+        status: Long?
+    ) {
+        Logger.d(TAG, "sendDeviceResponse: status is $status and data is " +
+                "$deviceResponseSize bytes")
+        if (transport == null) {
+            Logger.d(TAG, "sendDeviceResponse: ignoring because transport is unset")
+            return
+        }
+        val message = sessionEncryption!!.encryptMessage(deviceResponse, deviceResponseSize, status)
+        transport!!.countMessageSent(message.size)
+        transport!!.sendMessage(message.data, message.size)
+    }
+
     /**
      * Stops the presentation and shuts down the transport.
      *
@@ -39,11 +39,13 @@ import com.android.identity.crypto.Crypto
 import com.android.identity.crypto.EcPrivateKey
 import com.android.identity.crypto.EcPublicKey
 import com.android.identity.mdoc.connectionmethod.ConnectionMethod
+import com.android.identity.mdoc.connectionmethod.ConnectionMethodStatistics
 import com.android.identity.mdoc.engagement.EngagementGenerator
 import com.android.identity.mdoc.engagement.EngagementParser
 import com.android.identity.mdoc.sessionencryption.SessionEncryption
 import com.android.identity.util.Constants
 import com.android.identity.util.Logger
+import com.android.identity.util.Tracing
 import kotlinx.datetime.Clock
 import java.io.IOException
 import java.util.Arrays
@@ -91,14 +93,32 @@ class VerificationHelper internal constructor(
     private var readerEngagementGenerator: EngagementGenerator? = null
     private var readerEngagement: ByteArray? = null
 
+    private var connectionMethodStatistics: ConnectionMethodStatistics? = null
+    private var connectionMethodForStatistics: ConnectionMethod? = null
+    private var timestampConnectStarted: Long = 0
+
     private var timestampNfcTap: Long = 0
     private var timestampEngagementReceived: Long = 0
     private var timestampRequestSent: Long = 0
     private var timestampResponseReceived: Long = 0
 
+    // From sending the request until the response is received, for tracing.
+    private var responseSpan: Tracing.Span = Tracing.NoopSpan
+
     var engagementMethod: EngagementMethod = EngagementMethod.NOT_ENGAGED
         private set
 
+    /**
+     * An identifier for the remote device used when recording and ranking connection methods
+     * with the statistics set using [Builder.setConnectionMethodStatistics], or `null` to use
+     * only the statistics across all devices.
+     *
+     * Engagement doesn't identify the remote device, so this has to come from the
+     * application, for example a reader which recognized a holder by the document presented
+     * in an earlier session can set this before engaging with it again.
+     */
+    var connectionMethodStatisticsPeer: String? = null
+
     /**
      * The session transcript.
      *
@@ -784,6 +804,14 @@ class VerificationHelper internal constructor(
         usingWarmedUpTransport: Boolean
     ) {
         dataTransport = transport
+        // For a warmed-up transport the connection may have been set up long ago, so the
+        // time it took isn't meaningful.
+        connectionMethodForStatistics = transport?.connectionMethodForTransport
+        timestampConnectStarted = if (usingWarmedUpTransport) {
+            0
+        } else {
+            Clock.System.now().toEpochMilliseconds()
+        }
         if (dataTransport is DataTransportNfc) {
             if (nfcIsoDep == null) {
                 // This can happen if using NFC data transfer with QR code engagement
@@ -821,17 +849,20 @@ class VerificationHelper internal constructor(
 
             override fun onConnected() {
                 Logger.d(TAG, "onConnected for $dataTransport")
+                recordConnectionStatistics(true)
                 reportDeviceConnected()
             }
 
             override fun onDisconnected() {
                 Logger.d(TAG, "onDisconnected for $dataTransport")
+                recordConnectionStatistics(false)
                 dataTransport!!.close()
                 reportError(Error("Peer disconnected without proper session termination"))
             }
 
             override fun onError(error: Throwable) {
                 Logger.d(TAG, "onError for $dataTransport: $error")
+                recordConnectionStatistics(false)
                 dataTransport!!.close()
                 reportError(error)
             }
@@ -866,6 +897,48 @@ class VerificationHelper internal constructor(
         }
     }
 
+    // Records an attempt to connect, at most once per connectWithDataTransport() call.
+    private fun recordConnectionStatistics(success: Boolean) {
+        val statistics = connectionMethodStatistics ?: return
+        val connectionMethod = connectionMethodForStatistics ?: return
+        if (timestampConnectStarted == 0L) {
+            return
+        }
+        val setupMillis = Clock.System.now().toEpochMilliseconds() - timestampConnectStarted
+        timestampConnectStarted = 0
+        synchronized(statistics) {
+            if (success) {
+                statistics.recordConnection(
+                    connectionMethod,
+                    connectionMethodStatisticsPeer,
+                    setupMillis
+                )
+            } else {
+                statistics.recordFailure(connectionMethod, connectionMethodStatisticsPeer)
+            }
+        }
+    }
+
+    // Records the throughput for a message which took [transferMillis] to receive. That is
+    // the time from its first part arriving, not from sending the request, which would
+    // include the time the holder took to respond, e.g. waiting for the user to consent.
+    private fun recordTransferStatistics(numBytes: Int, transferMillis: Long) {
+        val statistics = connectionMethodStatistics ?: return
+        val connectionMethod = connectionMethodForStatistics ?: return
+        if (transferMillis < 0) {
+            // Not measured by this transport.
+            return
+        }
+        synchronized(statistics) {
+            statistics.recordTransfer(
+                connectionMethod,
+                connectionMethodStatisticsPeer,
+                numBytes.toLong(),
+                transferMillis
+            )
+        }
+    }
+
     private fun handleReverseEngagementMessageData(data: ByteArray) {
         Logger.dCbor(TAG, "MessageData", data)
         val map = Cbor.decode(data)
@@ -888,6 +961,7 @@ class VerificationHelper internal constructor(
 
     private fun handleOnMessageReceived() {
         val data = dataTransport!!.getMessage()
+        val transferMillis = dataTransport!!.lastMessageTransferMillis
         if (data == null) {
             reportError(Error("onMessageReceived but no message"))
             return
@@ -921,6 +995,10 @@ class VerificationHelper internal constructor(
         if (decryptedMessage.first != null) {
             Logger.dCbor(TAG, "DeviceResponse received", decryptedMessage.first!!)
             timestampResponseReceived = Clock.System.now().toEpochMilliseconds()
+            responseSpan.setAttribute("responseSize", data.size.toLong())
+            responseSpan.end(null)
+            responseSpan = Tracing.NoopSpan
+            recordTransferStatistics(data.size, transferMillis)
             reportResponseReceived(decryptedMessage.first!!)
         } else {
             // No data, so status must be set...
@@ -978,7 +1056,15 @@ class VerificationHelper internal constructor(
         listenerExecutor.execute { listener.onReaderEngagementReady(readerEngagement) }
     }
 
-    fun reportDeviceEngagementReceived(connectionMethods: List<ConnectionMethod>) {
+    fun reportDeviceEngagementReceived(engagementConnectionMethods: List<ConnectionMethod>) {
+        val statistics = connectionMethodStatistics
+        val connectionMethods = if (statistics != null) {
+            synchronized(statistics) {
+                statistics.rank(engagementConnectionMethods, connectionMethodStatisticsPeer)
+            }
+        } else {
+            engagementConnectionMethods
+        }
         if (Logger.isDebugEnabled) {
             Logger.d(TAG, "reportDeviceEngagementReceived")
             for (cm in connectionMethods) {
@@ -1071,8 +1157,11 @@ class VerificationHelper internal constructor(
             deviceRequestBytes, null
         )
         Logger.dCbor(TAG, "SessionData to send", message)
+        dataTransport!!.countMessageSent(message.size.toLong())
         dataTransport!!.sendMessage(message)
         timestampRequestSent = Clock.System.now().toEpochMilliseconds()
+        responseSpan.end(null)
+        responseSpan = Tracing.startSpan("mdoc.reader.awaitResponse")
     }
 
     /**
@@ -1271,6 +1360,24 @@ class VerificationHelper internal constructor(
             return this
         }
 
+        /**
+         * Sets the statistics to use for ordering connection methods.
+         *
+         * If set, the time it takes to connect and the throughput when receiving responses
+         * is recorded for every connection method used and the list of connection methods
+         * passed to [Listener.onDeviceEngagementReceived] is ordered using
+         * [ConnectionMethodStatistics.rank], fastest first. Set
+         * [VerificationHelper.connectionMethodStatisticsPeer] to also keep statistics for the
+         * remote device.
+         *
+         * @param statistics the statistics to use.
+         * @return the builder.
+         */
+        fun setConnectionMethodStatistics(statistics: ConnectionMethodStatistics): Builder {
+            mHelper.connectionMethodStatistics = statistics
+            return this
+        }
+
         /**
          * Builds a [VerificationHelper] with the configuration specified in the builder.
          *
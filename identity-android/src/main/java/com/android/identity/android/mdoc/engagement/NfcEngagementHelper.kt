@@ -20,10 +20,12 @@ import com.android.identity.mdoc.connectionmethod.ConnectionMethod.Companion.com
 import com.android.identity.mdoc.connectionmethod.ConnectionMethod.Companion.disambiguate
 import com.android.identity.mdoc.engagement.EngagementGenerator
 import com.android.identity.util.Logger
+import com.android.identity.util.Tracing
 import java.io.ByteArrayOutputStream
 import java.io.IOException
 import java.util.Arrays
 import java.util.concurrent.Executor
+import java.util.concurrent.atomic.AtomicReference
 
 /**
  * Helper used for NFC engagement.
@@ -90,6 +92,9 @@ class NfcEngagementHelper private constructor(
     private var selectedNfcFile: ByteArray? = null
     private var testingDoNotStartTransports = false
 
+    // From the reader selecting the NDEF application until it has connected.
+    private val engagementSpan = AtomicReference<Tracing.Span>(Tracing.NoopSpan)
+
     /**
      * Close all transports currently being listened on.
      *
@@ -99,6 +104,7 @@ class NfcEngagementHelper private constructor(
      */
     fun close() {
         inhibitCallbacks = true
+        endEngagementSpan(null)
         if (!transports.isEmpty()) {
             var numTransportsClosed = 0
             for (transport in transports) {
@@ -211,6 +217,7 @@ class NfcEngagementHelper private constructor(
         if (Logger.isDebugEnabled) {
             Logger.dHex(TAG, "nfcProcessCommandApdu: apdu", apdu)
         }
+        Tracing.count("mdoc.engagement.nfc.apdus")
         val commandType = NfcUtil.nfcGetCommandType(apdu)
         return when (commandType) {
             NfcUtil.COMMAND_TYPE_SELECT_BY_AID -> handleSelectByAid(apdu)
@@ -236,6 +243,9 @@ class NfcEngagementHelper private constructor(
         ) {
             Logger.d(TAG, "handleSelectByAid: NDEF application selected")
             updateBinaryData = null
+            if (Tracing.isEnabled) {
+                engagementSpan.getAndSet(Tracing.startSpan("mdoc.engagement.nfc")).end(null)
+            }
             return NfcUtil.STATUS_WORD_OK
         }
         Logger.dHex(TAG, "handleSelectByAid: Unexpected AID selected in APDU", apdu)
@@ -690,9 +700,15 @@ class NfcEngagementHelper private constructor(
             }
         }
         transports.clear()
+        engagementSpan.get().setAttribute("transport", transport.javaClass.simpleName)
+        endEngagementSpan(null)
         reportDeviceConnected(transport)
     }
 
+    private fun endEngagementSpan(error: Throwable?) {
+        engagementSpan.getAndSet(Tracing.NoopSpan).end(error)
+    }
+
     // Note: The report*() methods are safe to call from any thread.
     fun reportTwoWayEngagementDetected() {
         Logger.d(TAG, "reportTwoWayEngagementDetected")
@@ -748,6 +764,7 @@ class NfcEngagementHelper private constructor(
 
     fun reportError(error: Throwable) {
         Logger.d(TAG, "reportError: error: ", error)
+        endEngagementSpan(error)
         val listener = listener
         val executor = executor
         if (listener != null && executor != null) {
@@ -16,7 +16,9 @@ import com.android.identity.mdoc.connectionmethod.ConnectionMethod
 import com.android.identity.mdoc.connectionmethod.ConnectionMethod.Companion.disambiguate
 import com.android.identity.mdoc.engagement.EngagementGenerator
 import com.android.identity.util.Logger
+import com.android.identity.util.Tracing
 import java.util.concurrent.Executor
+import java.util.concurrent.atomic.AtomicReference
 
 /**
  * Helper used for QR engagement.
@@ -64,6 +66,9 @@ class QrEngagementHelper internal constructor(
 
     private var reportedDeviceConnecting = false
 
+    // From showing the engagement until the reader has connected.
+    private val engagementSpan = AtomicReference(Tracing.startSpan("mdoc.engagement.qr"))
+
     init {
         val encodedEDeviceKeyBytes =
             Cbor.encode(Tagged(24, Bstr(Cbor.encode(eDeviceKey.toCoseKey().toDataItem()))))
@@ -153,6 +158,7 @@ class QrEngagementHelper internal constructor(
      */
     fun close() {
         inhibitCallbacks = true
+        endEngagementSpan(null)
         if (!transports.isEmpty()) {
             for (transport in transports) {
                 transport.close()
@@ -202,9 +208,15 @@ class QrEngagementHelper internal constructor(
         }
         transports.clear()
         transport.setListener(null, null)
+        engagementSpan.get().setAttribute("transport", transport.javaClass.simpleName)
+        endEngagementSpan(null)
         reportDeviceConnected(transport)
     }
 
+    private fun endEngagementSpan(error: Throwable?) {
+        engagementSpan.getAndSet(Tracing.NoopSpan).end(error)
+    }
+
     // Note: The report*() methods are safe to call from any thread.
 
     private fun reportDeviceConnecting() {
@@ -235,6 +247,7 @@ class QrEngagementHelper internal constructor(
 
     private fun reportError(error: Throwable) {
         Logger.d(TAG, "reportError: error: ", error)
+        endEngagementSpan(error)
         val listener = listener
         val executor = executor
         if (listener != null && executor != null) {
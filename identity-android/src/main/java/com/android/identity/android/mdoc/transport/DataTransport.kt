@@ -23,9 +23,14 @@ import com.android.identity.mdoc.connectionmethod.ConnectionMethodBle
 import com.android.identity.mdoc.connectionmethod.ConnectionMethodHttp
 import com.android.identity.mdoc.connectionmethod.ConnectionMethodNfc
 import com.android.identity.mdoc.connectionmethod.ConnectionMethodWifiAware
+import com.android.identity.util.Tracing
 import java.util.ArrayDeque
 import java.util.Queue
 import java.util.concurrent.Executor
+import java.util.concurrent.atomic.AtomicLong
+import java.util.concurrent.atomic.AtomicReference
+import kotlinx.io.Source
+import kotlinx.io.readByteArray
 
 /**
  * Abstraction for data transfer between prover and verifier devices.
@@ -69,6 +74,28 @@ abstract class DataTransport(
     private var listenerExecutor: Executor? = null
     private val messageReceivedQueue: Queue<ByteArray> = ArrayDeque()
 
+    // For tracing, see Tracing.
+    private val connectSpan = AtomicReference<Tracing.Span>(Tracing.NoopSpan)
+    private val sessionSpan = AtomicReference<Tracing.Span>(Tracing.NoopSpan)
+    private var sessionStartNanos = 0L
+    private val bytesSent = AtomicLong()
+    private val bytesReceived = AtomicLong()
+
+    // When the first part of the message being received arrived, or 0.
+    private val messageStartedNanos = AtomicLong()
+
+    /**
+     * How long it took to receive the last message, in milliseconds, from when its first part
+     * arrived until it was complete, or -1 if not known.
+     *
+     * Unlike the time from sending a request until the response is received, this doesn't
+     * include the time the remote device took to produce the message, e.g. waiting for the
+     * user to consent. It's only known for transports calling [reportMessageStarted].
+     */
+    @Volatile
+    internal var lastMessageTransferMillis = -1L
+        private set
+
     /**
      * A [ConnectionMethod] instance that can be used to connect to this transport.
      *
@@ -130,6 +157,26 @@ abstract class DataTransport(
      */
     abstract fun sendMessage(data: ByteArray)
 
+    /**
+     * Sends data read from a [Source] to the remote mdoc or mdoc reader.
+     *
+     * This is like [sendMessage] taking a [ByteArray] but transports may read [message]
+     * incrementally and start sending before all of it has been read, for example to send a
+     * large message while it's being encrypted. The default implementation reads all of
+     * [message] and calls [sendMessage].
+     *
+     * The transport may keep reading from [message] after this returns, possibly from another
+     * thread, so the caller must not use it afterwards. It's not closed.
+     *
+     * @param message the source to read the data to send from.
+     * @param messageSize the number of bytes to read from [message], must be at least one.
+     */
+    open fun sendMessage(message: Source, messageSize: Long) {
+        require(messageSize > 0) { "Data to send cannot be empty" }
+        require(messageSize <= Int.MAX_VALUE) { "Message of $messageSize bytes is too large" }
+        sendMessage(message.readByteArray(messageSize.toInt()))
+    }
+
     /**
      * Sends a transport-specific termination message.
      *
@@ -173,6 +220,36 @@ abstract class DataTransport(
     // from here on.
     protected fun inhibitCallbacks() {
         inhibitCallbacks = true
+        endSpans(null)
+    }
+
+    // Called by the users of the transport when sending a message, for tracing.
+    internal fun countMessageSent(size: Long) {
+        if (Tracing.isEnabled) {
+            bytesSent.addAndGet(size)
+            Tracing.count("mdoc.transport.bytesSent", size)
+        }
+    }
+
+    private fun startSpan(name: String): Tracing.Span =
+        Tracing.startSpan(name).apply {
+            setAttribute("transport", this@DataTransport.javaClass.simpleName)
+            setAttribute("role", role.name)
+        }
+
+    private fun endSpans(error: Throwable?) {
+        connectSpan.getAndSet(Tracing.NoopSpan).end(error)
+        val session = sessionSpan.getAndSet(Tracing.NoopSpan)
+        if (session !== Tracing.NoopSpan) {
+            val seconds = (System.nanoTime() - sessionStartNanos) / 1e9
+            val bytes = bytesSent.get() + bytesReceived.get()
+            session.setAttribute("bytesSent", bytesSent.get())
+            session.setAttribute("bytesReceived", bytesReceived.get())
+            if (seconds > 0) {
+                session.setAttribute("bytesPerSecond", (bytes / seconds).toLong())
+            }
+            session.end(error)
+        }
     }
 
     var isConnected = false
@@ -180,6 +257,9 @@ abstract class DataTransport(
 
     // Note: The report*() methods are safe to call from any thread.
     protected fun reportConnecting() {
+        if (Tracing.isEnabled) {
+            connectSpan.getAndSet(startSpan("mdoc.transport.connect")).end(null)
+        }
         val listener = listener
         val executor = listenerExecutor
         if (listener != null && executor != null) {
@@ -193,6 +273,11 @@ abstract class DataTransport(
 
     protected fun reportConnected() {
         isConnected = true
+        connectSpan.getAndSet(Tracing.NoopSpan).end(null)
+        if (Tracing.isEnabled) {
+            sessionStartNanos = System.nanoTime()
+            sessionSpan.getAndSet(startSpan("mdoc.transport.session")).end(null)
+        }
         val listener = listener
         val executor = listenerExecutor
         if (listener != null && executor != null) {
@@ -205,6 +290,7 @@ abstract class DataTransport(
     }
 
     protected fun reportDisconnected() {
+        endSpans(null)
         val listener = listener
         val executor = listenerExecutor
         if (listener != null && executor != null) {
@@ -216,8 +302,24 @@ abstract class DataTransport(
         }
     }
 
+    // Should be called by subclasses when the first part of a message arrives, for measuring
+    // the time spent transferring it, see [lastMessageTransferMillis].
+    protected fun reportMessageStarted() {
+        messageStartedNanos.compareAndSet(0, System.nanoTime())
+    }
+
     protected fun reportMessageReceived(data: ByteArray) {
+        val startedNanos = messageStartedNanos.getAndSet(0)
+        lastMessageTransferMillis = if (startedNanos != 0L) {
+            (System.nanoTime() - startedNanos) / 1_000_000
+        } else {
+            -1
+        }
         messageReceivedQueue.add(data)
+        if (Tracing.isEnabled) {
+            bytesReceived.addAndGet(data.size.toLong())
+            Tracing.count("mdoc.transport.bytesReceived", data.size.toLong())
+        }
         val listener = listener
         val executor = listenerExecutor
         if (listener != null && executor != null) {
@@ -242,6 +344,7 @@ abstract class DataTransport(
     }
 
     protected fun reportError(error: Throwable) {
+        endSpans(error)
         val listener = listener
         val executor = listenerExecutor
         if (listener != null && executor != null) {
@@ -34,6 +34,8 @@ import com.android.identity.mdoc.connectionmethod.ConnectionMethodBle
 import com.android.identity.util.Logger
 import com.android.identity.util.toJavaUuid
 import java.util.UUID
+import kotlinx.io.Source
+import kotlinx.io.readByteArray
 
 /**
  * BLE data transport implementation conforming to ISO 18013-5 mdoc
@@ -162,6 +164,10 @@ class DataTransportBleCentralClientMode(
                 reportMessageReceived(data)
             }
 
+            override fun onMessageStarted() {
+                reportMessageStarted()
+            }
+
             override fun onTransportSpecificSessionTermination() {
                 reportTransportSpecificSessionTermination()
             }
@@ -189,6 +195,10 @@ class DataTransportBleCentralClientMode(
                 reportMessageReceived(data)
             }
 
+            override fun onMessageStarted() {
+                reportMessageStarted()
+            }
+
             override fun onError(error: Throwable) {
                 reportError(error)
             }
@@ -278,6 +288,10 @@ class DataTransportBleCentralClientMode(
                 reportMessageReceived(data)
             }
 
+            override fun onMessageStarted() {
+                reportMessageStarted()
+            }
+
             override fun onError(error: Throwable) {
                 reportError(error)
             }
@@ -375,6 +389,18 @@ class DataTransportBleCentralClientMode(
         }
     }
 
+    override fun sendMessage(message: Source, messageSize: Long) {
+        require(messageSize > 0) { "Data to send cannot be empty" }
+        if (l2capClient != null) {
+            require(messageSize <= Int.MAX_VALUE) { "Message of $messageSize bytes is too large" }
+            l2capClient!!.sendMessage(message.readByteArray(messageSize.toInt()))
+        } else if (gattServer != null) {
+            gattServer!!.sendMessage(message, messageSize)
+        } else if (gattClient != null) {
+            gattClient!!.sendMessage(message, messageSize)
+        }
+    }
+
     override fun sendTransportSpecificTerminationMessage() {
         if (l2capClient != null) {
             reportError(Error("Transport-specific termination not available"))
@@ -34,6 +34,8 @@ import com.android.identity.mdoc.connectionmethod.ConnectionMethodBle
 import com.android.identity.util.Logger
 import com.android.identity.util.toJavaUuid
 import java.util.UUID
+import kotlinx.io.Source
+import kotlinx.io.readByteArray
 
 /**
  * BLE data transport implementation conforming to ISO 18013-5 mdoc
@@ -149,6 +151,10 @@ class DataTransportBlePeripheralServerMode(
                 reportMessageReceived(data)
             }
 
+            override fun onMessageStarted() {
+                reportMessageStarted()
+            }
+
             override fun onError(error: Throwable) {
                 reportError(error)
             }
@@ -186,6 +192,10 @@ class DataTransportBlePeripheralServerMode(
                 reportMessageReceived(data)
             }
 
+            override fun onMessageStarted() {
+                reportMessageStarted()
+            }
+
             override fun onTransportSpecificSessionTermination() {
                 reportTransportSpecificSessionTermination()
             }
@@ -250,6 +260,10 @@ class DataTransportBlePeripheralServerMode(
                 reportMessageReceived(data)
             }
 
+            override fun onMessageStarted() {
+                reportMessageStarted()
+            }
+
             override fun onTransportSpecificSessionTermination() {
                 Logger.d(TAG, "onTransportSpecificSessionTermination")
                 reportTransportSpecificSessionTermination()
@@ -377,6 +391,18 @@ class DataTransportBlePeripheralServerMode(
         }
     }
 
+    override fun sendMessage(message: Source, messageSize: Long) {
+        require(messageSize > 0) { "Data to send cannot be empty" }
+        if (l2capClient != null) {
+            require(messageSize <= Int.MAX_VALUE) { "Message of $messageSize bytes is too large" }
+            l2capClient!!.sendMessage(message.readByteArray(messageSize.toInt()))
+        } else if (gattServer != null) {
+            gattServer!!.sendMessage(message, messageSize)
+        } else if (gattClient != null) {
+            gattClient!!.sendMessage(message, messageSize)
+        }
+    }
+
     override fun sendTransportSpecificTerminationMessage() {
         if (gattServer == null) {
             if (gattClient == null) {
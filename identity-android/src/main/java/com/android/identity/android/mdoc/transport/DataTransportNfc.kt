@@ -45,15 +45,23 @@ class DataTransportNfc(
 ) : DataTransport(context, role, options) {
     var _isoDep: IsoDep? = null
 
-    var listenerRemainingChunks: ArrayList<ByteArray>? = null
-    var listenerTotalChunks = 0
-    var listenerRemainingBytesAvailable = 0
+    // The message being sent in responses to ENVELOPE and GET RESPONSE, and how far we are.
+    private var listenerOutgoingMessage: Do53Message? = null
+    private var listenerOutgoingOffset = 0
     var listenerLeReceived = -1
 
     var writerQueue: BlockingQueue<ByteArray> = LinkedTransferQueue()
     var listenerStillActive = false
-    var incomingMessage = ByteArrayOutputStream()
-    var numChunksReceived = 0
+    private val incomingMessage = Do53Assembler()
+
+    private var statisticsNumApdus = 0
+    private var statisticsNumBytes = 0L
+    private var statisticsDurationMillis = 0L
+    private var statisticsLastApduMillis = 0L
+
+    // Negotiated in connectAsMdocReader().
+    private var readerMaxCommandDataLength = 255
+    private var readerMaxResponseDataLength = 256
     private var dataTransferAidSelected = false
     private var hostApduService: HostApduService? = null
     private var connectedAsMdoc = false
@@ -96,43 +104,64 @@ class DataTransportNfc(
 
                     // First message we send will be a response to the reader's
                     // ENVELOPE command.. further messages will be in response
-                    // the GET RESPONSE commands. So we chop up this data in chunks
-                    // so it's easy to hand off responses...
-                    val chunks = ArrayList<ByteArray>()
-                    val data = encapsulateInDo53(messageToSend)
-                    var offset = 0
-                    val maxChunkSize = listenerLeReceived
-                    do {
-                        var size = data.size - offset
-                        if (size > maxChunkSize) {
-                            size = maxChunkSize
-                        }
-                        val chunk = ByteArray(size)
-                        System.arraycopy(data, offset, chunk, 0, size)
-                        chunks.add(chunk)
-                        offset += size
-                    } while (offset < data.size)
-                    Logger.d(TAG, "Have ${chunks.size} chunks..")
-                    listenerRemainingChunks = chunks
-                    listenerRemainingBytesAvailable = data.size
-                    listenerTotalChunks = chunks.size
-                    sendNextChunk()
+                    // the GET RESPONSE commands. Each response is sliced from the
+                    // message when it's sent, with the size requested by the reader.
+                    listenerOutgoingMessage = Do53Message(messageToSend)
+                    listenerOutgoingOffset = 0
+                    sendNextChunk(listenerLeReceived)
                 }
             }
         }
         transceiverThread.start()
     }
 
-    private fun buildApduResponse(data: ByteArray, sw1: Int, sw2: Int): ByteArray {
-        val baos = ByteArrayOutputStream()
-        try {
-            baos.write(data)
-        } catch (e: IOException) {
-            throw IllegalStateException(e)
-        }
-        baos.write(sw1)
-        baos.write(sw2)
-        return baos.toByteArray()
+    /**
+     * Statistics for the APDUs exchanged in this session.
+     *
+     * @param numApdus the number of command APDUs exchanged.
+     * @param numBytes the total size of the command and response APDUs.
+     * @param durationMillis the time spent exchanging APDUs. For the mdoc reader this is the
+     *   time spent in [IsoDep.transceive], for the mdoc it's the time from the first to the
+     *   last APDU of the session.
+     */
+    data class ApduStatistics(
+        val numApdus: Int,
+        val numBytes: Long,
+        val durationMillis: Long
+    ) {
+        /** The throughput, in bytes per second. */
+        val bytesPerSecond: Long
+            get() = numBytes * 1000 / maxOf(durationMillis, 1)
+    }
+
+    /** Statistics for the APDUs exchanged so far in this session. */
+    val apduStatistics: ApduStatistics
+        @Synchronized get() = ApduStatistics(
+            statisticsNumApdus,
+            statisticsNumBytes,
+            statisticsDurationMillis
+        )
+
+    @Synchronized
+    private fun recordApdu(commandSize: Int, responseSize: Int, durationMillis: Long) {
+        statisticsNumApdus += 1
+        statisticsNumBytes += commandSize + responseSize
+        statisticsDurationMillis += durationMillis
+    }
+
+    // For the mdoc, where APDUs are exchanged asynchronously, the time between APDUs is
+    // counted instead.
+    private fun recordListenerApdu(commandSize: Int, responseSize: Int) {
+        val now = System.currentTimeMillis()
+        val duration = if (statisticsLastApduMillis == 0L) 0 else now - statisticsLastApduMillis
+        statisticsLastApduMillis = now
+        recordApdu(commandSize, responseSize, duration)
+    }
+
+    private fun logApduStatistics() {
+        val statistics = apduStatistics
+        Logger.i(TAG, "Exchanged ${statistics.numApdus} APDUs with ${statistics.numBytes} " +
+                "bytes in ${statistics.durationMillis} ms (${statistics.bytesPerSecond} bytes/sec)")
     }
 
     /**
@@ -163,7 +192,7 @@ class DataTransportNfc(
         } else {
             ret = when (commandType) {
                 NfcUtil.COMMAND_TYPE_ENVELOPE -> handleEnvelope(apdu)
-                NfcUtil.COMMAND_TYPE_RESPONSE -> handleResponse()
+                NfcUtil.COMMAND_TYPE_RESPONSE -> handleResponse(apdu)
                 else -> {
                     Logger.w(TAG,"Unexpected APDU with commandType $commandType")
                     NfcUtil.STATUS_WORD_INSTRUCTION_NOT_SUPPORTED
@@ -199,37 +228,46 @@ class DataTransportNfc(
         return NfcUtil.STATUS_WORD_FILE_NOT_FOUND
     }
 
-    private fun sendNextChunk() {
-        val chunk = listenerRemainingChunks!!.removeAt(0)
-        listenerRemainingBytesAvailable -= chunk.size
-        val isLastChunk = listenerRemainingChunks!!.size == 0
-        if (isLastChunk) {
+    // Sends the next chunk of listenerOutgoingMessage with at most le bytes.
+    private fun sendNextChunk(le: Int) {
+        val message = listenerOutgoingMessage!!
+        val available = message.size - listenerOutgoingOffset
+        val size = minOf(available, le, connectionMethod.responseDataFieldMaxLength.toInt())
+        val response = ByteArray(size + 2)
+        message.copyInto(response, 0, listenerOutgoingOffset, size)
+        listenerOutgoingOffset += size
+        val remaining = available - size
+        if (remaining == 0) {
             /* If Le ≥ the number of available bytes, the mdoc shall include all
              * available bytes in the response and set the status words to ’90 00’.
              */
-            hostApduService!!.sendResponseApdu(buildApduResponse(chunk, 0x90, 0x00))
+            response[size] = 0x90.toByte()
+            response[size + 1] = 0x00
+            listenerOutgoingMessage = null
+        } else if (remaining <= 255) {
+            /* If Le < the number of available bytes ≤ Le + 255, the mdoc shall
+             * include as many bytes in the response as indicated by Le and shall
+             * set the status words to ’61 XX’, where XX is the number of available
+             * bytes remaining. The mdoc reader shall respond with a GET RESPONSE
+             * command where Le is set to XX.
+             */
+            response[size] = 0x61
+            response[size + 1] = remaining.toByte()
         } else {
-            if (listenerRemainingBytesAvailable <= listenerLeReceived + 255) {
-                /* If Le < the number of available bytes ≤ Le + 255, the mdoc shall
-                 * include as many bytes in the response as indicated by Le and shall
-                 * set the status words to ’61 XX’, where XX is the number of available
-                 * bytes remaining. The mdoc reader shall respond with a GET RESPONSE
-                 * command where Le is set to XX.
-                 */
-                val numBytesRemaining = listenerRemainingBytesAvailable - listenerLeReceived
-                hostApduService!!.sendResponseApdu(
-                    buildApduResponse(chunk, 0x61, numBytesRemaining and 0xff)
-                )
-            } else {
-                /* If the number of available bytes > Le + 255, the mdoc shall include
-                 * as many bytes in the response as indicated by Le and shall set the
-                 * status words to ’61 00’. The mdoc readershall respond with a GET
-                 * RESPONSE command where Le is set to the maximum length of the
-                 * response data field that is supported by both the mdoc and the mdoc
-                 * reader.
-                 */
-                hostApduService!!.sendResponseApdu(buildApduResponse(chunk, 0x61, 0x00))
-            }
+            /* If the number of available bytes > Le + 255, the mdoc shall include
+             * as many bytes in the response as indicated by Le and shall set the
+             * status words to ’61 00’. The mdoc reader shall respond with a GET
+             * RESPONSE command where Le is set to the maximum length of the
+             * response data field that is supported by both the mdoc and the mdoc
+             * reader.
+             */
+            response[size] = 0x61
+            response[size + 1] = 0x00
+        }
+        recordListenerApdu(0, response.size)
+        hostApduService!!.sendResponseApdu(response)
+        if (remaining == 0) {
+            logApduStatistics()
         }
     }
 
@@ -246,21 +284,27 @@ class DataTransportNfc(
             reportError(Error("Unexpected value $cla in CLA of APDU"))
             return NfcUtil.STATUS_WORD_FILE_NOT_FOUND
         }
-        val data = apduGetData(apdu)
-        if (data == null) {
+        val dataLength = apduGetDataLength(apdu)
+        val dataOffset = apduGetDataOffset(apdu)
+        if (apdu.size < dataOffset + dataLength) {
             reportError(Error("Malformed APDU"))
             return NfcUtil.STATUS_WORD_FILE_NOT_FOUND
         }
-        if (data.size == 0) {
+        if (dataLength == 0) {
             reportError(Error("Received ENVELOPE with no data"))
             return NfcUtil.STATUS_WORD_FILE_NOT_FOUND
         }
         val le = apduGetLe(apdu)
-        numChunksReceived += try {
-            incomingMessage.write(data)
-            1
-        } catch (e: IOException) {
-            reportError(e)
+        recordListenerApdu(apdu.size, if (moreChunksComing) 2 else 0)
+        try {
+            if (incomingMessage.numChunks == 0) {
+                reportMessageStarted()
+            }
+            // Copies straight into the array for the message.
+            incomingMessage.append(apdu, dataOffset, dataLength)
+        } catch (e: IllegalArgumentException) {
+            incomingMessage.reset()
+            reportError(Error("Error extracting message from DO53 encoding", e))
             return NfcUtil.STATUS_WORD_FILE_NOT_FOUND
         }
         if (moreChunksComing) {
@@ -281,33 +325,30 @@ class DataTransportNfc(
          */if (listenerLeReceived != 0) {
             listenerLeReceived = le
         }
-        val encapsulatedMessage = incomingMessage.toByteArray()
-        Logger.d(
-            TAG, String.format(
-                Locale.US, "Received %d bytes in %d chunk(s)",
-                encapsulatedMessage.size, numChunksReceived
-            )
-        )
-        incomingMessage.reset()
-        numChunksReceived = 0
-        val message = extractFromDo53(encapsulatedMessage)
-        if (message == null) {
-            reportError(Error("Error extracting message from DO53 encoding"))
+        val numChunks = incomingMessage.numChunks
+        val message = try {
+            incomingMessage.finish()
+        } catch (e: IllegalArgumentException) {
+            incomingMessage.reset()
+            reportError(Error("Error extracting message from DO53 encoding", e))
             return NfcUtil.STATUS_WORD_FILE_NOT_FOUND
         }
-        Logger.d(TAG, String.format(Locale.US, "reportMessage %d bytes", message.size))
+        Logger.d(TAG, "Received ${message.size} bytes in $numChunks chunk(s)")
         reportMessageReceived(message)
         // Defer response...
         return null
     }
 
-    private fun handleResponse(): ByteArray? {
+    private fun handleResponse(apdu: ByteArray): ByteArray? {
         Logger.d(TAG, "in handleResponse")
-        if (listenerRemainingChunks == null || listenerRemainingChunks!!.size == 0) {
+        if (listenerOutgoingMessage == null) {
             reportError(Error("GET RESPONSE but we have no outstanding chunks"))
             return null
         }
-        sendNextChunk()
+        recordListenerApdu(apdu.size, 0)
+        // The reader may ask for fewer bytes than in the ENVELOPE command, e.g. after ’61 XX’.
+        val le = apduGetLeNoData(apdu)
+        sendNextChunk(if (le > 0) le else listenerLeReceived)
         return null
     }
 
@@ -364,16 +405,8 @@ class DataTransportNfc(
         return length
     }
 
-    private fun apduGetData(apdu: ByteArray): ByteArray? {
-        val length = apduGetDataLength(apdu)
-        val offset = if (apdu[4].toInt() == 0x00) 7 else 5
-        if (apdu.size < offset + length) {
-            return null
-        }
-        val data = ByteArray(length)
-        System.arraycopy(apdu, offset, data, 0, length)
-        return data
-    }
+    private fun apduGetDataOffset(apdu: ByteArray): Int =
+        if (apdu[4].toInt() == 0x00) 7 else 5
 
     private fun buildApdu(
         cla: Int,
@@ -405,6 +438,74 @@ class DataTransportNfc(
                 throw IllegalStateException(e)
             }
         }
+        writeLe(baos, le, hasExtendedLc)
+        return baos.toByteArray()
+    }
+
+    // Builds an ENVELOPE command with a range of an encapsulated message as data, copied
+    // straight into the command.
+    private fun buildEnvelopeApdu(
+        moreChunksComing: Boolean,
+        message: Do53Message,
+        offset: Int,
+        length: Int,
+        le: Int
+    ): ByteArray {
+        // An extended Le requires an extended Lc, see ISO/IEC 7816-4 clause 5.1.
+        val hasExtendedLc = length >= 256 || le > 256
+        val lcSize = if (hasExtendedLc) 3 else 1
+        val leSize = when {
+            le <= 0 -> 0
+            hasExtendedLc -> 2
+            else -> 1
+        }
+        val apdu = ByteArray(4 + lcSize + length + leSize)
+        apdu[0] = (if (moreChunksComing) 0x10 else 0x00).toByte()
+        apdu[1] = 0xc3.toByte()
+        if (hasExtendedLc) {
+            apdu[5] = (length shr 8).toByte()
+            apdu[6] = length.toByte()
+        } else {
+            apdu[4] = length.toByte()
+        }
+        message.copyInto(apdu, 4 + lcSize, offset, length)
+        val leOffset = 4 + lcSize + length
+        // Le of 256 and 65536 are encoded as zeroes, which toByte() takes care of.
+        if (leSize == 1) {
+            apdu[leOffset] = le.toByte()
+        } else if (leSize == 2) {
+            apdu[leOffset] = (le shr 8).toByte()
+            apdu[leOffset + 1] = le.toByte()
+        }
+        return apdu
+    }
+
+    // Case 2 command, i.e. no data and only Le, which is extended if more than 256 bytes.
+    private fun buildGetResponseApdu(le: Int): ByteArray {
+        val apdu = ByteArray(if (le <= 256) 5 else 7)
+        apdu[1] = 0xc0.toByte()
+        // Le of 256 and 65536 are encoded as zeroes, which toByte() takes care of.
+        if (le <= 256) {
+            apdu[4] = le.toByte()
+        } else {
+            apdu[5] = (le shr 8).toByte()
+            apdu[6] = le.toByte()
+        }
+        return apdu
+    }
+
+    // Gets Le from a command without data, returns 0 if not present.
+    private fun apduGetLeNoData(apdu: ByteArray): Int =
+        when (apdu.size) {
+            5 -> if (apdu[4].toInt() == 0x00) 0x100 else apdu[4].toInt() and 0xff
+            7 -> if (apdu[4].toInt() != 0x00) 0 else {
+                val le = (apdu[5].toInt() and 0xff) * 0x100 + (apdu[6].toInt() and 0xff)
+                if (le == 0) 0x10000 else le
+            }
+            else -> 0
+        }
+
+    private fun writeLe(baos: ByteArrayOutputStream, le: Int, hasExtendedLc: Boolean) {
         if (le > 0) {
             if (le == 256) {
                 baos.write(0x00)
@@ -423,76 +524,6 @@ class DataTransportNfc(
                 }
             }
         }
-        return baos.toByteArray()
-    }
-
-    private fun encapsulateInDo53(data: ByteArray): ByteArray {
-        val baos = ByteArrayOutputStream()
-        baos.write(0x53)
-        if (data.size < 0x80) {
-            baos.write(data.size)
-        } else if (data.size < 0x100) {
-            baos.write(0x81)
-            baos.write(data.size)
-        } else if (data.size < 0x10000) {
-            baos.write(0x82)
-            baos.write(data.size / 0x100)
-            baos.write(data.size and 0xff)
-        } else if (data.size < 0x1000000) {
-            baos.write(0x83)
-            baos.write(data.size / 0x10000)
-            baos.write(data.size / 0x100 and 0xff)
-            baos.write(data.size and 0xff)
-        } else {
-            throw IllegalStateException("Data length cannot be bigger than 0x1000000")
-        }
-        try {
-            baos.write(data)
-        } catch (e: IOException) {
-            throw IllegalStateException(e)
-        }
-        return baos.toByteArray()
-    }
-
-    private fun extractFromDo53(encapsulatedData: ByteArray): ByteArray? {
-        if (encapsulatedData.size < 2) {
-            Logger.w(TAG, "DO53 length ${encapsulatedData.size}, expected at least 2")
-            return null
-        }
-        val tag = encapsulatedData[0].toInt() and 0xff
-        if (tag != 0x53) {
-            Logger.w(TAG, "DO53 first byte is $tag, expected 0x53")
-            return null
-        }
-        var length = encapsulatedData[1].toInt() and 0xff
-        if (length > 0x83) {
-            Logger.w(TAG, "DO53 first byte of length is $length")
-            return null
-        }
-        var offset = 2
-        if (length == 0x80) {
-            Logger.w(TAG, "DO53 first byte of length is 0x80")
-            return null
-        } else if (length == 0x81) {
-            length = encapsulatedData[2].toInt() and 0xff
-            offset = 3
-        } else if (length == 0x82) {
-            length = (encapsulatedData[2].toInt() and 0xff) * 0x100
-            length += encapsulatedData[3].toInt() and 0xff
-            offset = 4
-        } else if (length == 0x83) {
-            length = (encapsulatedData[2].toInt() and 0xff) * 0x10000
-            length += (encapsulatedData[3].toInt() and 0xff) * 0x100
-            length += encapsulatedData[4].toInt() and 0xff
-            offset = 5
-        }
-        if (encapsulatedData.size != offset + length) {
-            Logger.w(TAG, "Malformed BER-TLV encoding, ${encapsulatedData.size} $offset $length")
-            return null
-        }
-        val data = ByteArray(length)
-        System.arraycopy(encapsulatedData, offset, data, 0, length)
-        return data
     }
 
     override fun connect() {
@@ -509,8 +540,27 @@ class DataTransportNfc(
             return
         }
         val maxTransceiveLength = _isoDep!!.maxTransceiveLength
+        val extendedLength = _isoDep!!.isExtendedLengthApduSupported
         Logger.d(TAG, "maxTransceiveLength: $maxTransceiveLength")
-        Logger.d(TAG, "isExtendedLengthApduSupported: ${_isoDep!!.isExtendedLengthApduSupported}")
+        Logger.d(TAG, "isExtendedLengthApduSupported: $extendedLength")
+        if (extendedLength) {
+            // Less 7 for the APDU header and 3 for LE
+            //
+            readerMaxCommandDataLength =
+                minOf(maxTransceiveLength - 10, connectionMethod.commandDataFieldMaxLength.toInt())
+            readerMaxResponseDataLength =
+                minOf(maxTransceiveLength, connectionMethod.responseDataFieldMaxLength.toInt())
+        } else {
+            // Less 5 for the APDU header and 1 for LE
+            //
+            readerMaxCommandDataLength = minOf(
+                255, maxTransceiveLength - 6, connectionMethod.commandDataFieldMaxLength.toInt()
+            )
+            readerMaxResponseDataLength = 256
+        }
+        Logger.d(TAG, "Using ${if (extendedLength) "extended" else "short"} length APDUs with " +
+                "up to $readerMaxCommandDataLength bytes of command data and " +
+                "$readerMaxResponseDataLength bytes of response data")
         val transceiverThread: Thread = object : Thread() {
             override fun run() {
                 try {
@@ -543,146 +593,8 @@ class DataTransportNfc(
                             break
                         }
                         Logger.dHex(TAG, "Sending message", messageToSend)
-                        val data = encapsulateInDo53(messageToSend)
-
-                        // Less 7 for the APDU header and 3 for LE
-                        //
-                        val maxChunkSize = maxTransceiveLength - 10
-                        var offset = 0
-                        var lastEnvelopeResponse: ByteArray? = null
-                        do {
-                            val moreChunksComing = offset + maxChunkSize < data.size
-                            var size = data.size - offset
-                            if (size > maxChunkSize) {
-                                size = maxChunkSize
-                            }
-                            val chunk = ByteArray(size)
-                            System.arraycopy(data, offset, chunk, 0, size)
-                            var le = 0
-                            if (!moreChunksComing) {
-                                le = maxTransceiveLength
-                            }
-                            val envelopeCommand = buildApdu(
-                                if (moreChunksComing) 0x10 else 0x00,
-                                0xc3, 0x00, 0x00, chunk, le
-                            )
-                            Logger.dHex(TAG, "envelopeCommand", envelopeCommand)
-                            val t0 = System.currentTimeMillis()
-                            val envelopeResponse = _isoDep!!.transceive(envelopeCommand)
-                            val t1 = System.currentTimeMillis()
-                            val durationSec = (t1 - t0) / 1000.0
-                            val bitsPerSec =
-                                ((envelopeCommand.size + envelopeResponse.size) * 8 / durationSec).toInt()
-                            Logger.d(TAG, String.format(
-                                    "transceive() took %.2f sec for %d + %d bytes => %d bits/sec",
-                                    durationSec,
-                                    envelopeCommand.size,
-                                    envelopeResponse.size,
-                                    bitsPerSec
-                                )
-                            )
-                            Logger.dHex(TAG, "Received", envelopeResponse)
-                            offset += size
-                            if (moreChunksComing) {
-                                // Don't care about response.
-                                Logger.dHex(TAG, "envResponse (more chunks coming)", envelopeResponse)
-                            } else {
-                                lastEnvelopeResponse = envelopeResponse
-                            }
-                        } while (offset < data.size)
-                        val erl = lastEnvelopeResponse!!.size
-                        if (erl < 2) {
-                            reportError(Error("APDU response smaller than expected"))
-                            return
-                        }
-                        var encapsulatedMessage: ByteArray
-                        val status = ((lastEnvelopeResponse[erl - 2].toInt() and 0xff) * 0x100
-                                + (lastEnvelopeResponse[erl - 1].toInt() and 0xff))
-                        if (status == 0x9000) {
-                            // Woot, entire response fit in the response APDU
-                            //
-                            encapsulatedMessage = ByteArray(erl - 2)
-                            System.arraycopy(
-                                lastEnvelopeResponse, 0, encapsulatedMessage, 0,
-                                erl - 2
-                            )
-                        } else if (status and 0xff00 == 0x6100) {
-                            // More bytes are coming, have to use GET RESPONSE
-                            //
-                            val baos = ByteArrayOutputStream()
-                            baos.write(lastEnvelopeResponse, 0, erl - 2)
-                            var leForGetResponse = maxTransceiveLength - 10
-                            if (status and 0xff != 0) {
-                                leForGetResponse = status and 0xff
-                            }
-                            while (true) {
-                                val grCommand = buildApdu(
-                                    0x00,
-                                    0xc0, 0x00, 0x00, null, leForGetResponse
-                                )
-                                val t0 = System.currentTimeMillis()
-                                val grResponse = _isoDep!!.transceive(grCommand)
-                                val t1 = System.currentTimeMillis()
-                                val durationSec = (t1 - t0) / 1000.0
-                                val bitsPerSec =
-                                    ((grCommand.size + grResponse.size) * 8 / durationSec).toInt()
-                                Logger.d(
-                                    TAG, String.format(
-                                        "transceive() took %.2f sec for %d + %d bytes => %d bits/sec",
-                                        durationSec,
-                                        grCommand.size,
-                                        grResponse.size,
-                                        bitsPerSec
-                                    )
-                                )
-                                val grrl = grResponse.size
-                                if (grrl < 2) {
-                                    reportError(Error("GetResponse APDU response smaller than expected"))
-                                    return
-                                }
-                                val grrStatus =
-                                    (grResponse[grrl - 2].toInt() and 0xff) * 0x100 + (grResponse[grrl - 1].toInt() and 0xff)
-                                baos.write(grResponse, 0, grrl - 2)
-
-                                // TODO: add runaway check
-                                if (grrStatus == 0x9000) {
-                                    /* If Le ≥ the number of available bytes, the mdoc shall include
-                                     * all available bytes in the response and set the status words
-                                     * to ’90 00’.
-                                     */
-                                    break
-                                } else if (grrStatus == 0x6100) {
-                                    /* If the number of available bytes > Le + 255, the mdoc shall
-                                     * include as many bytes in the response as indicated by Le and
-                                     * shall set the status words to ’61 00’. The mdoc reader shall
-                                     * respond with a GET RESPONSE command where Le is set to the
-                                     * maximum length of the response data field that is supported
-                                     * by both the mdoc and the mdoc reader.
-                                     */
-                                    leForGetResponse = maxTransceiveLength - 10
-                                } else if (grrStatus and 0xff00 == 0x6100) {
-                                    /* If Le < the number of available bytes ≤ Le + 255, the
-                                     * mdoc shall include as many bytes in the response as
-                                     * indicated by Le and shall set the status words to ’61 XX’,
-                                     * where XX is the number of available bytes remaining. The
-                                     * mdoc reader shall respond with a GET RESPONSE command where
-                                     * Le is set to XX.
-                                     */
-                                    leForGetResponse = grrStatus and 0xff
-                                } else {
-                                    reportError(Error("Expected GetResponse APDU status $status"))
-                                }
-                            }
-                            encapsulatedMessage = baos.toByteArray()
-                        } else {
-                            reportError(Error("Expected APDU status $status"))
-                            return
-                        }
-                        val message = extractFromDo53(encapsulatedMessage)
-                        if (message == null) {
-                            reportError(Error("Error extracting message from DO53 encoding"))
-                            return
-                        }
+                        val message = transceiveMessage(Do53Message(messageToSend)) ?: return
+                        logApduStatistics()
                         reportMessageReceived(message)
                     }
                     reportDisconnected()
@@ -696,6 +608,95 @@ class DataTransportNfc(
         transceiverThread.start()
     }
 
+    // Sends a message in a chain of ENVELOPE commands and reads the response, using GET
+    // RESPONSE commands as needed. Returns null if an error was reported.
+    private fun transceiveMessage(messageToSend: Do53Message): ByteArray? {
+        val maxChunkSize = readerMaxCommandDataLength
+        var offset = 0
+        var lastEnvelopeResponse: ByteArray
+        do {
+            val size = minOf(messageToSend.size - offset, maxChunkSize)
+            val moreChunksComing = offset + size < messageToSend.size
+            val envelopeCommand = buildEnvelopeApdu(
+                moreChunksComing,
+                messageToSend,
+                offset,
+                size,
+                if (moreChunksComing) 0 else readerMaxResponseDataLength
+            )
+            lastEnvelopeResponse = transceive(envelopeCommand)
+            offset += size
+            if (moreChunksComing) {
+                // Don't care about response.
+                Logger.dHex(TAG, "envResponse (more chunks coming)", lastEnvelopeResponse)
+            }
+        } while (offset < messageToSend.size)
+
+        var response = lastEnvelopeResponse
+        while (true) {
+            val rl = response.size
+            if (rl < 2) {
+                reportError(Error("APDU response smaller than expected"))
+                return null
+            }
+            val status = (response[rl - 2].toInt() and 0xff) * 0x100 +
+                    (response[rl - 1].toInt() and 0xff)
+            if (status != 0x9000 && status and 0xff00 != 0x6100) {
+                reportError(Error("Expected APDU status $status"))
+                return null
+            }
+            try {
+                if (incomingMessage.numChunks == 0) {
+                    reportMessageStarted()
+                }
+                // Copies straight into the array for the message.
+                incomingMessage.append(response, 0, rl - 2)
+                if (status == 0x9000) {
+                    /* If Le ≥ the number of available bytes, the mdoc shall include
+                     * all available bytes in the response and set the status words
+                     * to ’90 00’.
+                     */
+                    val numChunks = incomingMessage.numChunks
+                    val message = incomingMessage.finish()
+                    Logger.d(TAG, "Received ${message.size} bytes in $numChunks chunk(s)")
+                    return message
+                }
+            } catch (e: IllegalArgumentException) {
+                incomingMessage.reset()
+                reportError(Error("Error extracting message from DO53 encoding", e))
+                return null
+            }
+            // TODO: add runaway check
+            val leForGetResponse = if (status == 0x6100) {
+                /* If the number of available bytes > Le + 255, the mdoc shall
+                 * include as many bytes in the response as indicated by Le and
+                 * shall set the status words to ’61 00’. The mdoc reader shall
+                 * respond with a GET RESPONSE command where Le is set to the
+                 * maximum length of the response data field that is supported
+                 * by both the mdoc and the mdoc reader.
+                 */
+                readerMaxResponseDataLength
+            } else {
+                /* If Le < the number of available bytes ≤ Le + 255, the
+                 * mdoc shall include as many bytes in the response as
+                 * indicated by Le and shall set the status words to ’61 XX’,
+                 * where XX is the number of available bytes remaining. The
+                 * mdoc reader shall respond with a GET RESPONSE command where
+                 * Le is set to XX.
+                 */
+                status and 0xff
+            }
+            response = transceive(buildGetResponseApdu(leForGetResponse))
+        }
+    }
+
+    private fun transceive(command: ByteArray): ByteArray {
+        val t0 = System.currentTimeMillis()
+        val response = _isoDep!!.transceive(command)
+        recordApdu(command.size, response.size, System.currentTimeMillis() - t0)
+        return response
+    }
+
     override fun close() {
         if (connectedAsMdoc) {
             removeActiveConnection(this)
@@ -827,7 +828,8 @@ class DataTransportNfc(
             role: Role,
             options: DataTransportOptions
         ): DataTransport {
-            // TODO: set mCommandDataFieldMaxLength and mResponseDataFieldMaxLength
+            // The data field limits in cm are used as the upper bounds for the APDUs
+            // exchanged, see connectAsMdocReader() and sendNextChunk().
             return DataTransportNfc(context, role, cm, options)
         }
 
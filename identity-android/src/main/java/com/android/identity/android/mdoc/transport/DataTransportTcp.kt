@@ -125,6 +125,7 @@ class DataTransportTcp(
                     errorToReport = Error("Maximum message size exceeded")
                     break
                 }
+                reportMessageStarted()
                 val data = readBytes(inputStream, dataLen)
                 if (data == null) {
                     // End Of Stream
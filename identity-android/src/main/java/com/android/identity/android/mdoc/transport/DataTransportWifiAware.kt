@@ -558,6 +558,7 @@ Content-Type: application/CBOR
                         TAG,
                         "Going to read $contentLength bytes, isListener=$isListener"
                     )
+                    reportMessageStarted()
                     val data = ByteArray(contentLength)
                     dis.readFully(data)
                     reportMessageReceived(data)
@@ -0,0 +1,194 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.android.identity.android.mdoc.transport
+
+/**
+ * A message encapsulated in a DO53 BER-TLV data object, as used for NFC data transfer in
+ * ISO/IEC 18013-5:2021 clause 8.3.3.1.2.
+ *
+ * The encapsulated message isn't materialized, instead [copyInto] copies a range of it
+ * straight from the header and the message into e.g. an APDU being built.
+ *
+ * @param data the message to encapsulate.
+ */
+internal class Do53Message(private val data: ByteArray) {
+    private val header: ByteArray = encodeHeader(data.size)
+
+    /** The size of the encapsulated message, including the header. */
+    val size: Int
+        get() = header.size + data.size
+
+    /**
+     * Copies a range of the encapsulated message.
+     *
+     * @param destination the array to copy into.
+     * @param destinationOffset the offset in [destination] to copy to.
+     * @param offset the offset in the encapsulated message to start copying from.
+     * @param length the number of bytes to copy.
+     */
+    fun copyInto(destination: ByteArray, destinationOffset: Int, offset: Int, length: Int) {
+        require(offset >= 0 && length >= 0 && offset + length <= size) {
+            "Range $offset+$length is out of bounds for size $size"
+        }
+        var copied = 0
+        if (offset < header.size) {
+            val n = minOf(length, header.size - offset)
+            header.copyInto(destination, destinationOffset, offset, offset + n)
+            copied = n
+        }
+        if (copied < length) {
+            val dataOffset = offset + copied - header.size
+            val n = length - copied
+            data.copyInto(destination, destinationOffset + copied, dataOffset, dataOffset + n)
+        }
+    }
+
+    /** Returns the encapsulated message as a single array. */
+    fun toByteArray(): ByteArray = ByteArray(size).also { copyInto(it, 0, 0, size) }
+
+    companion object {
+        private fun encodeHeader(length: Int): ByteArray =
+            when {
+                length < 0x80 -> byteArrayOf(0x53, length.toByte())
+                length < 0x100 -> byteArrayOf(0x53, 0x81.toByte(), length.toByte())
+                length < 0x10000 -> byteArrayOf(
+                    0x53, 0x82.toByte(), (length shr 8).toByte(), length.toByte()
+                )
+                length < 0x1000000 -> byteArrayOf(
+                    0x53, 0x83.toByte(),
+                    (length shr 16).toByte(), (length shr 8).toByte(), length.toByte()
+                )
+                else -> throw IllegalStateException("Data length cannot be bigger than 0x1000000")
+            }
+    }
+}
+
+/**
+ * Reassembles a message encapsulated in a DO53 data object from chunks, e.g. the data of a
+ * chain of ENVELOPE commands or GET RESPONSE responses.
+ *
+ * The length is decoded from the header as soon as it's been received. Since it comes from
+ * the remote device, at most [maxPreallocationSize] bytes are allocated for the message up
+ * front and the array grows as more data arrives, so a bogus length doesn't make us allocate
+ * up to 16 MiB.
+ *
+ * @param maxPreallocationSize the maximum number of bytes to allocate before data is received.
+ */
+internal class Do53Assembler(
+    private val maxPreallocationSize: Int = DEFAULT_MAX_PREALLOCATION_SIZE
+) {
+    private val header = ByteArray(MAX_HEADER_SIZE)
+    private var headerSize = 0
+    private var messageLength = -1
+    private var message = EMPTY
+    private var messageOffset = 0
+
+    /** The number of chunks appended since the last call to [finish] or [reset]. */
+    var numChunks = 0
+        private set
+
+    /** Whether all of the message has been received. */
+    val isComplete: Boolean
+        get() = messageLength >= 0 && messageOffset == messageLength
+
+    /**
+     * Appends a chunk.
+     *
+     * @param source the array holding the chunk.
+     * @param offset the offset of the chunk in [source].
+     * @param length the length of the chunk.
+     * @throws IllegalArgumentException if the data isn't a well-formed DO53 data object or
+     *   more data than the object holds is appended.
+     */
+    fun append(source: ByteArray, offset: Int, length: Int) {
+        numChunks += 1
+        var pos = offset
+        val end = offset + length
+        while (messageLength < 0 && pos < end) {
+            header[headerSize++] = source[pos++]
+            decodeHeader()?.let {
+                messageLength = it
+                message = ByteArray(minOf(it, maxPreallocationSize))
+            }
+        }
+        if (messageLength < 0) {
+            return
+        }
+        val n = end - pos
+        require(messageOffset + n <= messageLength) {
+            "DO53 holds $messageLength bytes but got ${messageOffset + n}"
+        }
+        if (messageOffset + n > message.size) {
+            val newSize = minOf(maxOf(messageOffset + n, message.size * 2), messageLength)
+            message = message.copyOf(newSize)
+        }
+        source.copyInto(message, messageOffset, pos, end)
+        messageOffset += n
+    }
+
+    /**
+     * Gets the message and resets the assembler.
+     *
+     * @return the message.
+     * @throws IllegalArgumentException if the message hasn't been received in its entirety.
+     */
+    fun finish(): ByteArray {
+        require(isComplete) {
+            "Incomplete DO53, got $messageOffset of ${if (messageLength >= 0) messageLength else "unknown"} bytes"
+        }
+        val result = message
+        reset()
+        return result
+    }
+
+    /** Discards any data appended so far. */
+    fun reset() {
+        headerSize = 0
+        messageLength = -1
+        message = EMPTY
+        messageOffset = 0
+        numChunks = 0
+    }
+
+    // Returns the length if the header has been received, null if more bytes are needed.
+    private fun decodeHeader(): Int? {
+        if (headerSize == 1) {
+            val tag = header[0].toInt() and 0xff
+            require(tag == 0x53) { "DO53 first byte is $tag, expected 0x53" }
+            return null
+        }
+        val first = header[1].toInt() and 0xff
+        if (first < 0x80) {
+            return first
+        }
+        require(first in 0x81..0x83) { "DO53 first byte of length is $first" }
+        val numLengthBytes = first - 0x80
+        if (headerSize < 2 + numLengthBytes) {
+            return null
+        }
+        var length = 0
+        for (n in 0 until numLengthBytes) {
+            length = length * 0x100 + (header[2 + n].toInt() and 0xff)
+        }
+        return length
+    }
+
+    companion object {
+        private const val MAX_HEADER_SIZE = 5
+        private const val DEFAULT_MAX_PREALLOCATION_SIZE = 0x10000
+        private val EMPTY = ByteArray(0)
+    }
+}
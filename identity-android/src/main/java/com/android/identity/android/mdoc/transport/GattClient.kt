@@ -21,7 +21,9 @@ import android.bluetooth.BluetoothGatt
 import android.bluetooth.BluetoothGattCallback
 import android.bluetooth.BluetoothGattCharacteristic
 import android.bluetooth.BluetoothGattDescriptor
+import android.bluetooth.BluetoothManager
 import android.bluetooth.BluetoothProfile
+import android.bluetooth.BluetoothStatusCodes
 import android.content.Context
 import android.os.Build
 import com.android.identity.crypto.Algorithm
@@ -31,10 +33,10 @@ import com.android.identity.util.toHex
 import java.io.ByteArrayOutputStream
 import java.lang.reflect.InvocationTargetException
 import java.nio.ByteBuffer
-import java.util.ArrayDeque
 import java.util.Arrays
-import java.util.Queue
 import java.util.UUID
+import kotlinx.io.Source
+import kotlinx.io.readByteArray
 
 @Suppress("deprecation")
 @SuppressLint("MissingPermission")
@@ -62,8 +64,7 @@ internal class GattClient(
     // This is what the 16-bit UUID 0x29 0x02 is encoded like.
     private var clientCharacteristicConfigUuid = UUID.fromString("00002902-0000-1000-8000-00805f9b34fb")
     private var incomingMessage = ByteArrayOutputStream()
-    private var writingQueue: Queue<ByteArray> = ArrayDeque()
-    private var writingQueueTotalChunks = 0
+    private val sendQueue = GattSendQueue(TAG)
     private var writeIsOutstanding = false
     private var inhibitCallbacks = false
     private var negotiatedMtu = 0
@@ -128,6 +129,7 @@ internal class GattClient(
                     clearCache(gatt)
                 }
                 gatt.requestConnectionPriority(BluetoothGatt.CONNECTION_PRIORITY_HIGH)
+                requestFastConnection(gatt)
                 gatt.discoverServices()
             } catch (e: SecurityException) {
                 reportError(e)
@@ -138,6 +140,28 @@ internal class GattClient(
         }
     }
 
+    // Asks for the LE 2M PHY, roughly doubling throughput compared to the 1M PHY. This
+    // is only a preference, the result is reported in onPhyUpdate().
+    @SuppressLint("NewApi")
+    private fun requestFastConnection(gatt: BluetoothGatt) {
+        if (Build.VERSION.SDK_INT < Build.VERSION_CODES.O) {
+            return
+        }
+        val adapter = context.getSystemService(BluetoothManager::class.java)?.adapter
+        if (adapter == null || !adapter.isLe2MPhySupported) {
+            return
+        }
+        gatt.setPreferredPhy(
+            BluetoothDevice.PHY_LE_2M_MASK,
+            BluetoothDevice.PHY_LE_2M_MASK,
+            BluetoothDevice.PHY_OPTION_NO_PREFERRED
+        )
+    }
+
+    override fun onPhyUpdate(gatt: BluetoothGatt, txPhy: Int, rxPhy: Int, status: Int) {
+        Logger.d(TAG, "onPhyUpdate: txPhy=$txPhy rxPhy=$rxPhy status=$status")
+    }
+
     override fun onServicesDiscovered(gatt: BluetoothGatt, status: Int) {
         Logger.d(TAG, "onServicesDiscovered: status=$status")
         if (status == BluetoothGatt.GATT_SUCCESS) {
@@ -161,6 +185,10 @@ internal class GattClient(
                     reportError(Error("Client2Server characteristic not found"))
                     return
                 }
+                // Client2Server only supports write without response, being explicit about it
+                // means we're not waiting for a round-trip for each chunk.
+                characteristicClient2Server!!.writeType =
+                    BluetoothGattCharacteristic.WRITE_TYPE_NO_RESPONSE
                 characteristicServer2Client = s.getCharacteristic(
                     characteristicServer2ClientUuid
                 )
@@ -215,6 +243,7 @@ internal class GattClient(
 
     override fun onMtuChanged(gatt: BluetoothGatt, mtu: Int, status: Int) {
         negotiatedMtu = mtu
+        mCharacteristicValueSize = 0
         if (status != BluetoothGatt.GATT_SUCCESS) {
             reportError(Error("Error changing MTU, status: $status"))
             return
@@ -245,12 +274,12 @@ internal class GattClient(
             if (mCharacteristicValueSize > 0) {
                 return mCharacteristicValueSize
             }
-            var mtuSize = negotiatedMtu
-            if (mtuSize == 0) {
+            if (negotiatedMtu == 0) {
+                // Don't memoize the default, see onMtuChanged().
                 Logger.w(TAG, "MTU not negotiated, defaulting to 23. Performance will suffer.")
-                mtuSize = 23
+                return DataTransportBle.bleCalculateAttributeValueSize(23)
             }
-            mCharacteristicValueSize = DataTransportBle.bleCalculateAttributeValueSize(mtuSize)
+            mCharacteristicValueSize = DataTransportBle.bleCalculateAttributeValueSize(negotiatedMtu)
             return mCharacteristicValueSize
         }
 
@@ -295,6 +324,10 @@ internal class GattClient(
                     reportMessageReceived(data)
                 }
 
+                override fun onMessageStarted() {
+                    reportMessageStarted()
+                }
+
                 override fun onError(error: Throwable) {
                     reportError(error)
                 }
@@ -424,11 +457,7 @@ internal class GattClient(
                 )
                 return
             }
-            if (writingQueueTotalChunks > 0) {
-                if (writingQueue.size == 0) {
-                    writingQueueTotalChunks = 0
-                }
-            }
+            sendQueue.onChunkSent()
             writeIsOutstanding = false
             drainWritingQueue()
         }
@@ -445,6 +474,9 @@ internal class GattClient(
                 reportError(Error("Invalid data length ${data.size} for Server2Client characteristic"))
                 return
             }
+            if (incomingMessage.size() == 0) {
+                reportMessageStarted()
+            }
             incomingMessage.write(data, 1, data.size - 1)
             val isLast = (data[0].toInt() == 0x00)
             Logger.d(TAG,
@@ -480,14 +512,14 @@ internal class GattClient(
         }
     }
 
+    @SuppressLint("NewApi")
     private fun drainWritingQueue() {
         Logger.d(TAG, "drainWritingQueue $writeIsOutstanding")
-        if (writeIsOutstanding) {
+        if (writeIsOutstanding || gatt == null) {
             return
         }
-        val chunk = writingQueue.poll() ?: return
-        if (chunk.size == 0) {
-            Logger.d(TAG, "Chunk is length 0, shutting down GattClient in 1000ms")
+        if (sendQueue.takeShutdownRequest()) {
+            Logger.d(TAG, "Shutting down GattClient in 1000ms")
             // TODO: On some devices we lose messages already sent if we don't have a delay like
             //  this. Need to properly investigate if this is a problem in our stack or the
             //  underlying BLE subsystem.
@@ -502,11 +534,23 @@ internal class GattClient(
             gatt = null
             return
         }
+        val chunk = sendQueue.nextChunk(characteristicValueSize) ?: return
         val isLast = chunk[0].toInt() == 0x00
         Logger.d(TAG,"Sending chunk with ${chunk.size} bytes (last=$isLast)")
-        characteristicClient2Server!!.setValue(chunk)
         try {
-            if (!gatt!!.writeCharacteristic(characteristicClient2Server)) {
+            // The chunk array is reused by the queue, this is safe since the value is copied
+            // before writeCharacteristic() returns.
+            val success = if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.TIRAMISU) {
+                gatt!!.writeCharacteristic(
+                    characteristicClient2Server!!,
+                    chunk,
+                    BluetoothGattCharacteristic.WRITE_TYPE_NO_RESPONSE
+                ) == BluetoothStatusCodes.SUCCESS
+            } else {
+                characteristicClient2Server!!.setValue(chunk)
+                gatt!!.writeCharacteristic(characteristicClient2Server)
+            }
+            if (!success) {
                 reportError(Error("Error writing to Client2Server characteristic"))
                 return
             }
@@ -517,6 +561,10 @@ internal class GattClient(
         writeIsOutstanding = true
     }
 
+    /** Statistics for the most recent message sent to the server using GATT. */
+    val lastTransferStatistics: GattSendQueue.TransferStatistics?
+        get() = sendQueue.lastTransferStatistics
+
     fun sendMessage(data: ByteArray) {
         // Use socket for L2CAP if applicable
         if (l2capClient != null) {
@@ -525,26 +573,22 @@ internal class GattClient(
         }
         if (data.size == 0) {
             // Data of length 0 is used to signal we should shut down.
-            writingQueue.add(data)
+            sendQueue.requestShutdown()
         } else {
-            // Also need room for the leading 0x00 or 0x01.
-            //
-            val maxDataSize = characteristicValueSize - 1
-            var offset = 0
-            do {
-                val moreDataComing = offset + maxDataSize < data.size
-                var size = data.size - offset
-                if (size > maxDataSize) {
-                    size = maxDataSize
-                }
-                val chunk = ByteArray(size + 1)
-                chunk[0] = if (moreDataComing) 0x01.toByte() else 0x00.toByte()
-                System.arraycopy(data, offset, chunk, 1, size)
-                writingQueue.add(chunk)
-                offset += size
-            } while (offset < data.size)
+            sendQueue.add(data)
         }
-        writingQueueTotalChunks = writingQueue.size
+        drainWritingQueue()
+    }
+
+    fun sendMessage(message: Source, messageSize: Long) {
+        require(messageSize > 0) { "Data to send cannot be empty" }
+        if (l2capClient != null) {
+            require(messageSize <= Int.MAX_VALUE) { "Message of $messageSize bytes is too large" }
+            l2capClient!!.sendMessage(message.readByteArray(messageSize.toInt()))
+            return
+        }
+        // The message is read from the source as chunks are sent.
+        sendQueue.add(message, messageSize)
         drainWritingQueue()
     }
 
@@ -583,6 +627,12 @@ internal class GattClient(
         }
     }
 
+    private fun reportMessageStarted() {
+        if (listener != null && !inhibitCallbacks) {
+            listener!!.onMessageStarted()
+        }
+    }
+
     private fun reportTransportSpecificSessionTermination() {
         if (listener != null && !inhibitCallbacks) {
             listener!!.onTransportSpecificSessionTermination()
@@ -599,6 +649,8 @@ internal class GattClient(
         fun onPeerConnected()
         fun onPeerDisconnected()
         fun onMessageReceived(data: ByteArray)
+        // Called when the first part of a message arrives, for measuring the transfer time.
+        fun onMessageStarted() {}
         fun onTransportSpecificSessionTermination()
         fun onError(error: Throwable)
     }
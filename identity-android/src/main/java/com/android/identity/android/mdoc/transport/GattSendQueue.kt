@@ -0,0 +1,201 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.android.identity.android.mdoc.transport
+
+import android.os.SystemClock
+import com.android.identity.util.Logger
+import java.util.ArrayDeque
+import java.util.Queue
+import kotlinx.io.Source
+import kotlinx.io.readTo
+
+/**
+ * Queue of messages to be sent over the Client2Server or Server2Client characteristic.
+ *
+ * Messages are split into chunks as specified in ISO/IEC 18013-5:2021 clause 8.3.3.1.1.6
+ * only when they're about to be sent, that is, the chunks are read straight from the
+ * [ByteArray] or [Source] passed to [add] instead of copying the entire message into the
+ * queue first. The array for full-sized chunks is reused so sending a message only allocates
+ * an array for its last chunk.
+ *
+ * The chunk returned by [nextChunk] must have been handed to the Bluetooth stack before
+ * [nextChunk] is called again. The caller reports chunks confirmed by the stack using
+ * [onChunkSent] which is used for collecting [TransferStatistics].
+ *
+ * This is not thread-safe, callers must provide their own synchronization.
+ *
+ * @param tag the tag to use for logging.
+ * @param clock the clock used for measuring transfers, in milliseconds.
+ */
+internal class GattSendQueue(
+    private val tag: String,
+    private val clock: () -> Long = { SystemClock.elapsedRealtime() }
+) {
+    /**
+     * Statistics for a message which has been sent.
+     *
+     * @param messageSize the size of the message, in bytes.
+     * @param numChunks number of chunks the message was sent in.
+     * @param chunkSize the size of each chunk except the last, including the leading byte.
+     * @param durationMillis time from sending the first chunk until the last was confirmed.
+     */
+    data class TransferStatistics(
+        val messageSize: Long,
+        val numChunks: Int,
+        val chunkSize: Int,
+        val durationMillis: Long
+    ) {
+        /** The throughput of the transfer, in bytes per second. */
+        val bytesPerSecond: Long
+            get() = messageSize * 1000 / maxOf(durationMillis, 1)
+    }
+
+    private class Message(
+        val size: Long,
+        val read: (dest: ByteArray, startIndex: Int, endIndex: Int) -> Unit
+    )
+
+    private val messages: Queue<Message> = ArrayDeque()
+    private var current: Message? = null
+    private var remaining = 0L
+    private var chunkSize = 0
+    private var fullChunk: ByteArray? = null
+    private var chunksSent = 0
+    private var chunksConfirmed = 0
+    private var lastChunkSent = false
+    private var transferStart = 0L
+    private var transferSize = 0L
+    private var shutdownRequested = false
+
+    /** Statistics for the most recently sent message or `null` if none has been sent. */
+    var lastTransferStatistics: TransferStatistics? = null
+        private set
+
+    /** Whether there are no chunks waiting to be sent. */
+    val isEmpty: Boolean
+        get() = current == null && messages.isEmpty()
+
+    /**
+     * Adds a message to the queue.
+     *
+     * The array must not be modified until the message has been sent.
+     *
+     * @param data the message, must be at least one byte.
+     */
+    fun add(data: ByteArray) {
+        require(data.isNotEmpty()) { "Data to send cannot be empty" }
+        var offset = 0
+        messages.add(Message(data.size.toLong()) { dest, startIndex, endIndex ->
+            data.copyInto(dest, startIndex, offset, offset + endIndex - startIndex)
+            offset += endIndex - startIndex
+        })
+    }
+
+    /**
+     * Adds a message to the queue, read from [source] as it's being sent.
+     *
+     * @param source the source to read the message from, must not be used by the caller
+     *   until the message has been sent.
+     * @param size the size of the message, must be at least one byte.
+     */
+    fun add(source: Source, size: Long) {
+        require(size > 0) { "Data to send cannot be empty" }
+        messages.add(Message(size) { dest, startIndex, endIndex ->
+            source.readTo(dest, startIndex, endIndex)
+        })
+    }
+
+    /**
+     * Gets the next chunk to send.
+     *
+     * @param characteristicValueSize the maximum size of a chunk, including the leading
+     *   0x00 or 0x01 byte. It's only used when starting a new message so all chunks of a
+     *   message except the last have the same size.
+     * @return the chunk or `null` if there's nothing to send.
+     */
+    fun nextChunk(characteristicValueSize: Int): ByteArray? {
+        var message = current
+        if (message == null) {
+            message = messages.poll() ?: return null
+            current = message
+            remaining = message.size
+            if (chunkSize != characteristicValueSize) {
+                chunkSize = characteristicValueSize
+                fullChunk = null
+            }
+            chunksSent = 0
+            chunksConfirmed = 0
+            lastChunkSent = false
+            transferStart = clock()
+            transferSize = message.size
+        }
+        val maxDataSize = chunkSize - 1
+        val chunk = if (remaining > maxDataSize) {
+            fullChunk ?: ByteArray(chunkSize).also { fullChunk = it }
+        } else {
+            ByteArray(remaining.toInt() + 1)
+        }
+        remaining -= chunk.size - 1
+        chunk[0] = if (remaining > 0) 0x01.toByte() else 0x00.toByte()
+        message.read(chunk, 1, chunk.size)
+        chunksSent += 1
+        if (remaining == 0L) {
+            lastChunkSent = true
+            current = null
+        }
+        return chunk
+    }
+
+    /**
+     * Should be called when the Bluetooth stack has confirmed a chunk returned by
+     * [nextChunk] was sent.
+     */
+    fun onChunkSent() {
+        chunksConfirmed += 1
+        if (lastChunkSent && chunksConfirmed == chunksSent) {
+            lastChunkSent = false
+            val statistics = TransferStatistics(
+                messageSize = transferSize,
+                numChunks = chunksSent,
+                chunkSize = chunkSize,
+                durationMillis = clock() - transferStart
+            )
+            lastTransferStatistics = statistics
+            Logger.i(tag, "Sent ${statistics.messageSize} bytes in ${statistics.numChunks} " +
+                    "chunks of ${statistics.chunkSize} bytes in ${statistics.durationMillis} ms " +
+                    "(${statistics.bytesPerSecond} bytes/sec)")
+        }
+    }
+
+    /**
+     * Requests that the connection is shut down once all queued messages have been sent.
+     */
+    fun requestShutdown() {
+        shutdownRequested = true
+    }
+
+    /**
+     * Returns `true` exactly once, when shutdown has been requested and all messages have
+     * been sent.
+     */
+    fun takeShutdownRequest(): Boolean {
+        if (!shutdownRequested || !isEmpty) {
+            return false
+        }
+        shutdownRequested = false
+        return true
+    }
+}
@@ -138,6 +138,9 @@ internal class L2CAPClient(private val context: Context, val listener: Listener)
                     reportPeerDisconnected()
                     break
                 }
+                if (pendingDataBaos.size() == 0) {
+                    reportMessageStarted()
+                }
                 pendingDataBaos.write(buf, 0, numBytesRead)
                 try {
                     val pendingData = pendingDataBaos.toByteArray()
@@ -178,6 +181,12 @@ internal class L2CAPClient(private val context: Context, val listener: Listener)
         }
     }
 
+    fun reportMessageStarted() {
+        if (!inhibitCallbacks) {
+            listener.onMessageStarted()
+        }
+    }
+
     fun reportError(error: Throwable) {
         if (!inhibitCallbacks) {
             listener.onError(error)
@@ -188,6 +197,8 @@ internal class L2CAPClient(private val context: Context, val listener: Listener)
         fun onPeerConnected()
         fun onPeerDisconnected()
         fun onMessageReceived(data: ByteArray)
+        // Called when the first part of a message arrives, for measuring the transfer time.
+        fun onMessageStarted() {}
         fun onError(error: Throwable)
     }
 
@@ -148,6 +148,9 @@ internal class L2CAPServer(val listener: Listener) {
                     reportPeerDisconnected()
                     break
                 }
+                if (pendingDataBaos.size() == 0) {
+                    reportMessageStarted()
+                }
                 pendingDataBaos.write(buf, 0, numBytesRead)
                 try {
                     val pendingData = pendingDataBaos.toByteArray()
@@ -188,6 +191,12 @@ internal class L2CAPServer(val listener: Listener) {
         }
     }
 
+    fun reportMessageStarted() {
+        if (!inhibitCallbacks) {
+            listener.onMessageStarted()
+        }
+    }
+
     fun reportError(error: Throwable) {
         if (!inhibitCallbacks) {
             listener.onError(error)
@@ -198,6 +207,8 @@ internal class L2CAPServer(val listener: Listener) {
         fun onPeerConnected()
         fun onPeerDisconnected()
         fun onMessageReceived(data: ByteArray)
+        // Called when the first part of a message arrives, for measuring the transfer time.
+        fun onMessageStarted() {}
         fun onError(error: Throwable)
     }
 
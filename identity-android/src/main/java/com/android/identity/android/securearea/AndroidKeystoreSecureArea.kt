@@ -20,6 +20,7 @@ import android.content.Context
 import android.content.pm.FeatureInfo
 import android.content.pm.PackageManager
 import android.os.Build
+import android.os.SystemClock
 import android.security.keystore.KeyGenParameterSpec
 import android.security.keystore.KeyProperties
 import android.security.keystore.UserNotAuthenticatedException
@@ -42,6 +43,7 @@ import com.android.identity.securearea.SecureArea
 import com.android.identity.securearea.keyPurposeSet
 import com.android.identity.storage.StorageEngine
 import com.android.identity.util.Logger
+import com.android.identity.util.Tracing
 import java.io.IOException
 import java.nio.charset.StandardCharsets
 import java.security.InvalidAlgorithmParameterException
@@ -59,6 +61,9 @@ import java.security.cert.CertificateException
 import java.security.spec.ECGenParameterSpec
 import java.security.spec.InvalidKeySpecException
 import java.sql.Date
+import java.util.concurrent.Callable
+import java.util.concurrent.ExecutionException
+import java.util.concurrent.Executors
 import javax.crypto.KeyAgreement
 import kotlinx.datetime.Instant
 import org.bouncycastle.asn1.ASN1InputStream
@@ -134,13 +139,71 @@ class AndroidKeystoreSecureArea(
         alias: String,
         createKeySettings: com.android.identity.securearea.CreateKeySettings
     ) {
-        val aSettings: AndroidKeystoreCreateKeySettings
-        aSettings = if (createKeySettings is AndroidKeystoreCreateKeySettings) {
+        val aSettings = toAndroidKeystoreCreateKeySettings(createKeySettings)
+        val attestation = generateKey(alias, aSettings)
+        saveKeyMetadata(alias, aSettings, attestation)
+    }
+
+    /**
+     * Creates several new keys with the same settings.
+     *
+     * Keys are generated in parallel, except for StrongBox where the secure hardware
+     * handles one request at a time anyway, and the metadata for all keys is persisted in
+     * a single [StorageEngine.transaction]. Each key still gets its own attestation.
+     */
+    override fun batchCreateKey(
+        aliases: List<String>,
+        createKeySettings: com.android.identity.securearea.CreateKeySettings
+    ) {
+        val aSettings = toAndroidKeystoreCreateKeySettings(createKeySettings)
+        if (aliases.isEmpty()) {
+            return
+        }
+        val startMillis = SystemClock.elapsedRealtime()
+        val numThreads = if (aSettings.useStrongBox) {
+            1
+        } else {
+            minOf(aliases.size, MAX_PARALLEL_KEY_GENERATIONS)
+        }
+        val executor = Executors.newFixedThreadPool(numThreads)
+        val attestations = try {
+            aliases
+                .map { alias -> executor.submit(Callable { generateKey(alias, aSettings) }) }
+                .map { future ->
+                    try {
+                        future.get()
+                    } catch (e: ExecutionException) {
+                        throw e.cause ?: e
+                    }
+                }
+        } finally {
+            executor.shutdown()
+        }
+        storageEngine.transaction {
+            for ((alias, attestation) in aliases.zip(attestations)) {
+                saveKeyMetadata(alias, aSettings, attestation)
+            }
+        }
+        val durationMillis = SystemClock.elapsedRealtime() - startMillis
+        Logger.i(TAG, "Created ${aliases.size} keys in $durationMillis ms using $numThreads threads")
+    }
+
+    private fun toAndroidKeystoreCreateKeySettings(
+        createKeySettings: com.android.identity.securearea.CreateKeySettings
+    ): AndroidKeystoreCreateKeySettings =
+        if (createKeySettings is AndroidKeystoreCreateKeySettings) {
             createKeySettings
         } else {
             // Use default settings if user passed in a generic SecureArea.CreateKeySettings.
             AndroidKeystoreCreateKeySettings.Builder("".toByteArray()).build()
         }
+
+    // Generates a key in Android Keystore and returns its attestation. This doesn't touch
+    // storageEngine so it can be called from several threads at once.
+    private fun generateKey(
+        alias: String,
+        aSettings: AndroidKeystoreCreateKeySettings
+    ): X509CertChain {
         var kpg: KeyPairGenerator? = null
         try {
             kpg = KeyPairGenerator.getInstance(
@@ -274,7 +337,7 @@ class AndroidKeystoreSecureArea(
             throw IllegalStateException(e)
         }
         Logger.d(TAG, "EC key with alias '$alias' created")
-        saveKeyMetadata(alias, aSettings, X509CertChain(attestationCerts))
+        return X509CertChain(attestationCerts)
     }
 
     /**
@@ -406,6 +469,16 @@ class AndroidKeystoreSecureArea(
         signatureAlgorithm: Algorithm,
         dataToSign: ByteArray,
         keyUnlockData: com.android.identity.securearea.KeyUnlockData?
+    ): EcSignature = Tracing.span("securearea.sign") { span ->
+        span.setAttribute("secureArea", identifier)
+        signWithKeystore(alias, signatureAlgorithm, dataToSign, keyUnlockData)
+    }
+
+    private fun signWithKeystore(
+        alias: String,
+        signatureAlgorithm: Algorithm,
+        dataToSign: ByteArray,
+        keyUnlockData: com.android.identity.securearea.KeyUnlockData?
     ): EcSignature {
         val (entry, data) = loadKey(alias)
         val decodedData = Cbor.decode(data)
@@ -696,6 +769,9 @@ class AndroidKeystoreSecureArea(
          */
         private const val TAG = "AndroidKeystoreSA" // limit to <= 23 chars
 
+        // Keymint only has so much parallelism, beyond this there's nothing to gain.
+        private const val MAX_PARALLEL_KEY_GENERATIONS = 4
+
         // Prefix used for storage items, the key alias follows.
         private const val PREFIX = "IC_AndroidKeystore_"
 
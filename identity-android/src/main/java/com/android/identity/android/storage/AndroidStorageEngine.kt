@@ -21,17 +21,24 @@ import android.security.keystore.KeyGenParameterSpec
 import android.security.keystore.KeyProperties
 import com.android.identity.cbor.Cbor
 import com.android.identity.cbor.CborArray
+import com.android.identity.cbor.CborMap
 import com.android.identity.storage.GenericStorageEngine
 import com.android.identity.util.toHex
+import kotlinx.io.buffered
 import kotlinx.io.bytestring.ByteStringBuilder
+import kotlinx.io.files.FileNotFoundException
 import java.io.ByteArrayOutputStream
 import java.io.File
 import java.security.KeyStore
+import java.security.SecureRandom
 import javax.crypto.Cipher
 import javax.crypto.KeyGenerator
 import javax.crypto.SecretKey
 import javax.crypto.spec.GCMParameterSpec
+import javax.crypto.spec.SecretKeySpec
 import kotlinx.io.files.Path
+import kotlinx.io.files.SystemFileSystem
+import kotlinx.io.readByteArray
 
 /**
  * A storage engine on Android.
@@ -41,15 +48,30 @@ import kotlinx.io.files.Path
  *
  * Note that data is stored in a way so it's still available to the application even if when
  * encryption is toggled on and off.
+ *
+ * If [Builder.setUseDataEncryptionKey] is set, records are instead encrypted in software
+ * with a data encryption key which is itself stored next to the backing file, encrypted
+ * using the hardware-backed key. The hardware-backed key is then only used once per process,
+ * to decrypt the data encryption key, and saving a record doesn't involve Android Keystore.
+ * The data encryption key can be replaced using [rotateDataEncryptionKey].
  */
 class AndroidStorageEngine internal constructor(
     private val context: Context,
     private val storageFile: Path,
-    private val useEncryption: Boolean
+    private val useEncryption: Boolean,
+    private val useDataEncryptionKey: Boolean
 ) : GenericStorageEngine(Path(storageFile)) {
 
     private val secretKey by lazy { ensureSecretKey() }
 
+    private val dataKeysFile = Path("$storageFile.keys")
+    private var dataKeys: DataKeys? = null
+
+    // Reused for all records, this is software AES-GCM which uses the AES instructions of
+    // the CPU if available.
+    private val dataCipher by lazy { Cipher.getInstance("AES/GCM/NoPadding") }
+    private val random by lazy { SecureRandom() }
+
     override fun transform(data: ByteArray, isLoading: Boolean): ByteArray {
         if (isLoading) {
             check(data.size >= MAGIC_SIZE) { "File too short for magic" }
@@ -57,13 +79,17 @@ class AndroidStorageEngine internal constructor(
             val dataAfterMagic = data.sliceArray(IntRange(MAGIC_SIZE, data.size - 1))
             if (magic contentEquals MAGIC_ENCRYPTED) {
                 return decrypt(secretKey, dataAfterMagic)
+            } else if (magic contentEquals MAGIC_ENCRYPTED_WITH_DATA_KEY) {
+                return decryptWithDataKey(dataAfterMagic)
             } else if (magic contentEquals MAGIC_NOT_ENCRYPTED) {
                 return dataAfterMagic
             } else {
                 throw IllegalStateException("Unexpected magic ${magic.toHex()}")
             }
         } else {
-            if (useEncryption) {
+            if (useEncryption && useDataEncryptionKey) {
+                return MAGIC_ENCRYPTED_WITH_DATA_KEY + encryptWithDataKey(data)
+            } else if (useEncryption) {
                 return MAGIC_ENCRYPTED + encrypt(secretKey, data)
             } else {
                 return MAGIC_NOT_ENCRYPTED + data
@@ -71,6 +97,125 @@ class AndroidStorageEngine internal constructor(
         }
     }
 
+    /**
+     * Replaces the data encryption key with a new one and re-encrypts all data with it.
+     *
+     * Once this returns, the previous key is no longer needed and has been deleted.
+     *
+     * This requires encryption and [Builder.setUseDataEncryptionKey] to be enabled.
+     */
+    fun rotateDataEncryptionKey() {
+        check(useEncryption && useDataEncryptionKey) { "Data encryption key not in use" }
+        val keys = ensureDataKeys()
+        // Persist the new key along with the old ones before using it, so records written
+        // with either can be decrypted if the process dies half-way.
+        val newKeyId = keys.keys.keys.max() + 1
+        keys.keys[newKeyId] = generateDataKey()
+        keys.currentKeyId = newKeyId
+        saveDataKeys(keys)
+        rewriteAll()
+        keys.keys.keys.retainAll(setOf(newKeyId))
+        saveDataKeys(keys)
+    }
+
+    private fun encryptWithDataKey(data: ByteArray): ByteArray {
+        val keys = ensureDataKeys()
+        val iv = ByteArray(12)
+        random.nextBytes(iv)
+        val encrypted = synchronized(dataCipher) {
+            dataCipher.init(
+                Cipher.ENCRYPT_MODE,
+                keys.keys[keys.currentKeyId]!!,
+                GCMParameterSpec(128, iv)
+            )
+            dataCipher.doFinal(data)
+        }
+        // Stored as the key id as a 32-bit big-endian integer, then the IV and the ciphertext,
+        // which includes the auth tag.
+        val keyId = keys.currentKeyId
+        return byteArrayOf(
+            (keyId ushr 24).toByte(),
+            (keyId ushr 16).toByte(),
+            (keyId ushr 8).toByte(),
+            keyId.toByte()
+        ) + iv + encrypted
+    }
+
+    private fun decryptWithDataKey(encryptedData: ByteArray): ByteArray {
+        check(encryptedData.size >= 16) { "Encrypted data too short" }
+        val keyId = (encryptedData[0].toInt() and 0xff shl 24) or
+                (encryptedData[1].toInt() and 0xff shl 16) or
+                (encryptedData[2].toInt() and 0xff shl 8) or
+                (encryptedData[3].toInt() and 0xff)
+        val key = ensureDataKeys().keys[keyId]
+            ?: throw IllegalStateException("Unknown data encryption key $keyId")
+        return try {
+            synchronized(dataCipher) {
+                dataCipher.init(
+                    Cipher.DECRYPT_MODE,
+                    key,
+                    GCMParameterSpec(128, encryptedData, 4, 12)
+                )
+                dataCipher.doFinal(encryptedData, 16, encryptedData.size - 16)
+            }
+        } catch (e: Exception) {
+            throw IllegalStateException("Error decrypting data", e)
+        }
+    }
+
+    private fun generateDataKey(): SecretKey {
+        val kg = KeyGenerator.getInstance(KeyProperties.KEY_ALGORITHM_AES)
+        kg.init(256, random)
+        return kg.generateKey()
+    }
+
+    // The data encryption keys are stored using the following CDDL, each key encrypted with
+    // the hardware-backed key in the same way as records are
+    //
+    //  DataKeys = {
+    //    "current" : uint,
+    //    "keys" : { + uint => bstr }
+    //  }
+    //
+    private fun ensureDataKeys(): DataKeys {
+        dataKeys?.let { return it }
+        val keys = try {
+            val map = Cbor.decode(
+                SystemFileSystem.source(dataKeysFile).buffered().readByteArray())
+            val keys = mutableMapOf<Int, SecretKey>()
+            for ((keyId, encryptedKey) in map["keys"].asMap) {
+                keys[keyId.asNumber.toInt()] =
+                    SecretKeySpec(decrypt(secretKey, encryptedKey.asBstr), "AES")
+            }
+            DataKeys(map["current"].asNumber.toInt(), keys)
+        } catch (e: FileNotFoundException) {
+            DataKeys(0, mutableMapOf(0 to generateDataKey())).also { saveDataKeys(it) }
+        }
+        dataKeys = keys
+        return keys
+    }
+
+    private fun saveDataKeys(keys: DataKeys) {
+        val builder = CborMap.builder()
+        builder.put("current", keys.currentKeyId.toLong())
+        val keysBuilder = builder.putMap("keys")
+        for ((keyId, key) in keys.keys) {
+            keysBuilder.put(keyId.toLong(), encrypt(secretKey, key.encoded))
+        }
+        keysBuilder.end()
+        val newPath = Path("$dataKeysFile.tmp")
+        val sink = SystemFileSystem.sink(newPath).buffered()
+        sink.write(Cbor.encode(builder.end().build()))
+        sink.flush()
+        sink.close()
+        SystemFileSystem.atomicMove(newPath, dataKeysFile)
+    }
+
+    private class DataKeys(
+        var currentKeyId: Int,
+        val keys: MutableMap<Int, SecretKey>
+    )
+
     private fun ensureSecretKey(): SecretKey {
         val keyAlias = PREFIX + "_KeyFor_" + storageFile.name
         return try {
@@ -110,6 +255,7 @@ class AndroidStorageEngine internal constructor(
         private var useEncryption =
             !((context.getSystemService(StorageManager::class.java) as StorageManager)
                 .isEncrypted(File(storageFile.toString())))
+        private var useDataEncryptionKey = false
 
         /**
          * Sets whether to encrypt the backing file on disk.
@@ -126,13 +272,29 @@ class AndroidStorageEngine internal constructor(
             this.useEncryption = useEncryption
         }
 
+        /**
+         * Sets whether to encrypt data using a data encryption key rather than directly with
+         * the hardware-backed key.
+         *
+         * This only has an effect if encryption is used. It makes saving data much faster,
+         * at the cost of the data encryption key being in memory while the storage engine is
+         * in use. Data encrypted either way can be read regardless of this setting. This is
+         * set to `false` by default.
+         *
+         * @param useDataEncryptionKey whether to use a data encryption key.
+         * @return the builder.
+         */
+        fun setUseDataEncryptionKey(useDataEncryptionKey: Boolean) = apply {
+            this.useDataEncryptionKey = useDataEncryptionKey
+        }
+
         /**
          * Builds the [AndroidStorageEngine].
          *
          * @return a [AndroidStorageEngine].
          */
         fun build(): AndroidStorageEngine {
-            return AndroidStorageEngine(context, storageFile, useEncryption)
+            return AndroidStorageEngine(context, storageFile, useEncryption, useDataEncryptionKey)
         }
     }
 
@@ -143,6 +305,7 @@ class AndroidStorageEngine internal constructor(
         private const val MAGIC_SIZE = 4
         private val MAGIC_ENCRYPTED = "Ienc".encodeToByteArray()
         private val MAGIC_NOT_ENCRYPTED = "Iraw".encodeToByteArray()
+        private val MAGIC_ENCRYPTED_WITH_DATA_KEY = "Idek".encodeToByteArray()
 
         private const val PREFIX = "IC_AndroidStorageEngine_"
 
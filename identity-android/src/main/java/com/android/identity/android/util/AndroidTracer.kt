@@ -0,0 +1,65 @@
+package com.android.identity.android.util
+
+import android.os.Build
+import android.os.Trace
+import androidx.annotation.RequiresApi
+import com.android.identity.util.Tracing
+import java.util.concurrent.ConcurrentHashMap
+import java.util.concurrent.atomic.AtomicBoolean
+import java.util.concurrent.atomic.AtomicInteger
+import java.util.concurrent.atomic.AtomicLong
+
+/**
+ * Android implementation of [Tracing.Tracer] recording to system tracing, so spans and
+ * counters show up in Perfetto and Android Studio's profiler.
+ *
+ * Spans are recorded as async sections since they may end on another thread than the one
+ * they started on. Span attributes are not supported by system tracing and are dropped.
+ * Counters are recorded as running totals.
+ *
+ * Nothing is recorded unless system tracing is active, see [Trace.isEnabled].
+ */
+@RequiresApi(Build.VERSION_CODES.Q)
+class AndroidTracer : Tracing.Tracer {
+    private val nextCookie = AtomicInteger()
+    private val counters = ConcurrentHashMap<String, AtomicLong>()
+
+    override fun startSpan(name: String): Tracing.Span {
+        if (!Trace.isEnabled()) {
+            return Tracing.NoopSpan
+        }
+        val sectionName = name.take(MAX_SECTION_NAME_LENGTH)
+        val cookie = nextCookie.incrementAndGet()
+        Trace.beginAsyncSection(sectionName, cookie)
+        return AsyncSection(sectionName, cookie)
+    }
+
+    override fun addToCounter(name: String, delta: Long) {
+        val total = counters.getOrPut(name) { AtomicLong() }.addAndGet(delta)
+        if (Trace.isEnabled()) {
+            Trace.setCounter(name.take(MAX_SECTION_NAME_LENGTH), total)
+        }
+    }
+
+    private class AsyncSection(
+        private val sectionName: String,
+        private val cookie: Int
+    ) : Tracing.Span {
+        private val ended = AtomicBoolean(false)
+
+        override fun setAttribute(key: String, value: String) {}
+
+        override fun setAttribute(key: String, value: Long) {}
+
+        override fun end(error: Throwable?) {
+            if (ended.compareAndSet(false, true)) {
+                Trace.endAsyncSection(sectionName, cookie)
+            }
+        }
+    }
+
+    companion object {
+        // Longer names are rejected by android.os.Trace.
+        private const val MAX_SECTION_NAME_LENGTH = 127
+    }
+}
@@ -0,0 +1,57 @@
+package com.android.identity.flow.handler
+
+import com.android.identity.cbor.CborArray
+import com.android.identity.cbor.DataItem
+import com.android.identity.cbor.Tstr
+import com.android.identity.cbor.toDataItem
+
+/**
+ * A flow method call, for dispatching several calls at once using
+ * [FlowDispatcher.dispatchBatch].
+ *
+ * @param flow flow name/path.
+ * @param method method name/path.
+ * @param args method arguments, the first one is the flow state.
+ * @param stateFrom if not `null`, the index of an earlier call in the same batch. The flow
+ *   state returned by that call is used instead of the first element of [args], so that the
+ *   calls can be chained.
+ */
+data class FlowCall(
+    val flow: String,
+    val method: String,
+    val args: List<DataItem>,
+    val stateFrom: Int? = null
+) {
+    /**
+     * Gets the arguments for this call, with the flow state taken from the response to the
+     * earlier call when chained.
+     */
+    internal fun resolveArgs(earlierResponses: List<List<DataItem>>): List<DataItem> {
+        val index = stateFrom ?: return args
+        require(index in earlierResponses.indices) {
+            "Call can only be chained to an earlier call, got $index"
+        }
+        return listOf(earlierResponses[index][0]) + args.subList(1, args.size)
+    }
+
+    internal fun toDataItem(): DataItem =
+        CborArray(mutableListOf(
+            Tstr(flow),
+            Tstr(method),
+            (stateFrom ?: -1).toDataItem(),
+            CborArray(args.toMutableList())
+        ))
+
+    internal companion object {
+        fun fromDataItem(dataItem: DataItem): FlowCall {
+            val array = dataItem.asArray
+            val stateFrom = array[2].asNumber.toInt()
+            return FlowCall(
+                flow = array[0].asTstr,
+                method = array[1].asTstr,
+                args = array[3].asArray,
+                stateFrom = if (stateFrom < 0) null else stateFrom
+            )
+        }
+    }
+}
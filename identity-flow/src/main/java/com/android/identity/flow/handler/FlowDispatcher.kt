@@ -9,4 +9,19 @@ import com.android.identity.cbor.DataItem
 interface FlowDispatcher {
     val exceptionMap: FlowExceptionMap
     suspend fun dispatch(flow: String, method: String, args: List<DataItem>): List<DataItem>
-}
\ No newline at end of file
+
+    /**
+     * Dispatches several method calls in order and returns their responses, as returned by
+     * [dispatch], in the same order. Implementations which go across the network send all
+     * of the calls at once.
+     *
+     * The default implementation calls [dispatch] for each call.
+     */
+    suspend fun dispatchBatch(calls: List<FlowCall>): List<List<DataItem>> {
+        val responses = mutableListOf<List<DataItem>>()
+        for (call in calls) {
+            responses.add(dispatch(call.flow, call.method, call.resolveArgs(responses)))
+        }
+        return responses
+    }
+}
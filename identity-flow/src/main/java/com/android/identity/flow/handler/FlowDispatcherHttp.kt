@@ -4,17 +4,114 @@ import com.android.identity.cbor.Cbor
 import com.android.identity.cbor.CborArray
 import com.android.identity.cbor.DataItem
 import com.android.identity.flow.transport.HttpTransport
+import kotlinx.coroutines.CompletableDeferred
+import kotlinx.coroutines.NonCancellable
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.sync.Mutex
+import kotlinx.coroutines.sync.withLock
+import kotlinx.coroutines.withContext
+import kotlinx.coroutines.yield
 import kotlinx.io.bytestring.ByteString
+import kotlin.time.Duration
 
-/** [FlowDispatcher] implementation that dispatches flow method calls through HTTP. */
+/**
+ * [FlowDispatcher] implementation that dispatches flow method calls through HTTP.
+ *
+ * [dispatchBatch] sends all of the calls in a single request. In addition, if
+ * [coalesceWindow] is set, calls to [dispatch] made concurrently, e.g. from different
+ * coroutines, are queued and sent together in a single request as well. This requires a
+ * server using a version of [HttpHandler] that supports batches.
+ *
+ * @param transport the transport to use.
+ * @param exceptionMap the exceptions which can be thrown by the flows.
+ * @param coalesceWindow how long to wait for more calls to [dispatch] before sending the
+ *   queued calls, or `null` to send every call to [dispatch] in a request of its own.
+ * @param maxBatchSize the maximum number of calls to send in a single request.
+ */
 class FlowDispatcherHttp(
     private val transport: HttpTransport,
-    override val exceptionMap: FlowExceptionMap
+    override val exceptionMap: FlowExceptionMap,
+    private val coalesceWindow: Duration? = null,
+    private val maxBatchSize: Int = DEFAULT_MAX_BATCH_SIZE
 ) : FlowDispatcher {
+    private val queueLock = Mutex()
+    private val queue = mutableListOf<QueuedCall>()
+
+    init {
+        require(maxBatchSize > 0) { "maxBatchSize must be positive" }
+    }
+
+    companion object {
+        /** The default for `maxBatchSize`. */
+        const val DEFAULT_MAX_BATCH_SIZE = 32
+    }
+
     override suspend fun dispatch(flow: String, method: String, args: List<DataItem>): List<DataItem> {
+        if (coalesceWindow == null) {
+            return post(flow, method, args)
+        }
+        val queuedCall = QueuedCall(FlowCall(flow, method, args))
+        // The first call queued sends the queue once the window is over.
+        val first = queueLock.withLock {
+            queue.add(queuedCall)
+            queue.size == 1
+        }
+        if (first) {
+            try {
+                if (coalesceWindow.isPositive()) {
+                    delay(coalesceWindow)
+                } else {
+                    yield()
+                }
+            } finally {
+                // Other callers are waiting for the queue to be sent, so send it even if this
+                // one was cancelled.
+                withContext(NonCancellable) {
+                    sendQueue()
+                }
+            }
+        }
+        return queuedCall.response.await()
+    }
+
+    override suspend fun dispatchBatch(calls: List<FlowCall>): List<List<DataItem>> {
+        if (calls.size == 1 && calls[0].stateFrom == null) {
+            return listOf(post(calls[0].flow, calls[0].method, calls[0].args))
+        }
+        val builder = CborArray.builder()
+        calls.forEach { builder.add(it.toDataItem()) }
+        val response = transport.post("_/batch", ByteString(Cbor.encode(builder.end().build())))
+        val responses = Cbor.decode(response.toByteArray()).asArray.map { it.asArray }
+        check(responses.size == calls.size) {
+            "Expected ${calls.size} responses, got ${responses.size}"
+        }
+        return responses
+    }
+
+    private suspend fun post(flow: String, method: String, args: List<DataItem>): List<DataItem> {
         val builder = CborArray.builder()
         args.forEach { builder.add(it) }
         val response = transport.post("$flow/$method", ByteString(Cbor.encode(builder.end().build())))
         return Cbor.decode(response.toByteArray()).asArray
     }
-}
\ No newline at end of file
+
+    private suspend fun sendQueue() {
+        val queuedCalls = queueLock.withLock {
+            queue.toList().also { queue.clear() }
+        }
+        for (batch in queuedCalls.chunked(maxBatchSize)) {
+            try {
+                val responses = dispatchBatch(batch.map { it.call })
+                batch.zip(responses).forEach { (queuedCall, response) ->
+                    queuedCall.response.complete(response)
+                }
+            } catch (err: Throwable) {
+                batch.forEach { it.response.completeExceptionally(err) }
+            }
+        }
+    }
+
+    private class QueuedCall(val call: FlowCall) {
+        val response = CompletableDeferred<List<DataItem>>()
+    }
+}
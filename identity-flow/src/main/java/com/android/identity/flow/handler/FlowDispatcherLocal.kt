@@ -7,6 +7,7 @@ import com.android.identity.cbor.DataItem
 import com.android.identity.cbor.Tstr
 import com.android.identity.cbor.toDataItem
 import com.android.identity.flow.server.FlowEnvironment
+import kotlinx.io.bytestring.ByteString
 import kotlin.reflect.KClass
 import kotlin.reflect.cast
 
@@ -21,39 +22,83 @@ class FlowDispatcherLocal private constructor(
     val environment: FlowEnvironment,
     private val cipher: SimpleCipher,
     private val flowMap: Map<String, FlowItem<*>>,
-    override val exceptionMap: FlowExceptionMap
+    override val exceptionMap: FlowExceptionMap,
+    private val stateCacheSize: Int
 ) : FlowDispatcher {
     private val stateMap = flowMap.toList().mapIndexed { _, pair ->
         Pair(pair.second.stateClass, pair.first)
     }.toMap()
 
+    // Decrypted flow states keyed by their encrypted form, most recently used last. A flow
+    // state typically goes back and forth between the client and the server many times, so
+    // this saves decrypting it on every call. Only states that were decrypted or encrypted
+    // by this dispatcher are added, so just like decrypting, hitting the cache guarantees
+    // the state came from the server.
+    //
+    // The decrypted states are cached as encoded CBOR rather than as state objects, as flow
+    // methods modify the state objects in place.
+    private val stateCache = object : LinkedHashMap<ByteString, ByteArray>(16, 0.75f, true) {
+        override fun removeEldestEntry(eldest: MutableMap.MutableEntry<ByteString, ByteArray>) =
+            size > stateCacheSize
+    }
+
+    companion object {
+        /** The default for `stateCacheSize` in [Builder.build]. */
+        const val DEFAULT_STATE_CACHE_SIZE = 1024
+    }
+
     class Builder {
         private val flowMap = mutableMapOf<String, FlowItem<*>>()
 
+        /**
+         * Registers a flow.
+         *
+         * [stateEncoder] and [stateDecoder], if given, must produce and accept the same bytes
+         * as encoding the result of [stateSerializer] and decoding into [stateDeserializer],
+         * they are used to save building a [DataItem] for every state going back and forth.
+         */
         fun<StateT: Any> addFlow(
             flowName: String,
             stateClass: KClass<StateT>,
             stateSerializer: (StateT) -> DataItem,
             stateDeserializer: (DataItem) -> StateT,
+            stateEncoder: ((StateT) -> ByteArray)? = null,
+            stateDecoder: ((ByteArray) -> StateT)? = null,
             block: FlowBuilder<StateT>.() -> Unit) {
-            val builder = FlowBuilder(stateClass, stateSerializer, stateDeserializer)
+            val builder = FlowBuilder(stateClass, stateSerializer, stateDeserializer,
+                stateEncoder ?: { state -> Cbor.encode(stateSerializer(state)) },
+                stateDecoder ?: { data -> stateDeserializer(Cbor.decode(data)) })
             builder.block()
             flowMap[flowName] = builder.build()
         }
 
+        /**
+         * Builds the dispatcher.
+         *
+         * @param environment the environment passed to the flow methods.
+         * @param cipher the cipher used to protect the flow states.
+         * @param exceptionMap the exceptions which can be thrown by the flows.
+         * @param stateCacheSize the maximum number of decrypted flow states to keep in memory,
+         *   0 to always decrypt.
+         */
         fun build(
             environment: FlowEnvironment,
             cipher: SimpleCipher,
-            exceptionMap: FlowExceptionMap
+            exceptionMap: FlowExceptionMap,
+            stateCacheSize: Int = DEFAULT_STATE_CACHE_SIZE
         ): FlowDispatcherLocal {
-            return FlowDispatcherLocal(environment, cipher, flowMap.toMap(), exceptionMap)
+            require(stateCacheSize >= 0) { "stateCacheSize cannot be negative" }
+            return FlowDispatcherLocal(
+                environment, cipher, flowMap.toMap(), exceptionMap, stateCacheSize)
         }
     }
 
     class FlowBuilder<StateT: Any>(
         private val stateClass: KClass<StateT>,
         private val stateSerializer: (StateT) -> DataItem,
-        private val stateDeserializer: (DataItem) -> StateT
+        private val stateDeserializer: (DataItem) -> StateT,
+        private val stateEncoder: (StateT) -> ByteArray,
+        private val stateDecoder: (ByteArray) -> StateT
     ) {
         private var creatable = false
         private val postMap = mutableMapOf<String, suspend (FlowDispatcherLocal, StateT, List<DataItem>) -> DataItem>()
@@ -68,7 +113,7 @@ class FlowDispatcherLocal private constructor(
 
         internal fun build(): FlowItem<StateT> {
             return FlowItem(stateClass, creatable, postMap.toMap(), stateSerializer,
-                stateDeserializer)
+                stateDeserializer, stateEncoder, stateDecoder)
         }
     }
 
@@ -81,7 +126,7 @@ class FlowDispatcherLocal private constructor(
     fun decodeStateParameter(stateParameter: DataItem): Any {
         val stateArray = stateParameter.asArray
         val flowItem = flowMap[stateArray[0].asTstr]!!
-        return (flowItem.stateDeserializer)(Cbor.decode(cipher.decrypt(stateArray[1].asBstr)))
+        return (flowItem.stateDecoder)(decryptState(stateArray[1].asBstr))
     }
 
     fun encodeStateResult(result: Any, joinName: String?): DataItem {
@@ -90,16 +135,37 @@ class FlowDispatcherLocal private constructor(
         return CborArray(mutableListOf(
             Tstr(flowName),
             Tstr(joinName ?: ""),
-            Bstr(cipher.encrypt(Cbor.encode(flowMap[flowName]!!.serialize(result))))
+            Bstr(encryptState(flowMap[flowName]!!.encode(result)))
         ))
     }
 
+    private fun decryptState(ciphertext: ByteArray): ByteArray {
+        if (stateCacheSize == 0) {
+            return cipher.decrypt(ciphertext)
+        }
+        val key = ByteString(ciphertext)
+        synchronized(stateCache) { stateCache[key] }?.let { return it }
+        val plaintext = cipher.decrypt(ciphertext)
+        synchronized(stateCache) { stateCache[key] = plaintext }
+        return plaintext
+    }
+
+    private fun encryptState(plaintext: ByteArray): ByteArray {
+        val ciphertext = cipher.encrypt(plaintext)
+        if (stateCacheSize > 0) {
+            synchronized(stateCache) { stateCache[ByteString(ciphertext)] = plaintext }
+        }
+        return ciphertext
+    }
+
     internal class FlowItem<StateT: Any>(
         internal val stateClass: KClass<StateT>,
         private val creatable: Boolean,
         private val handlerMap: Map<String, suspend (FlowDispatcherLocal, StateT, List<DataItem>) -> DataItem>,
         internal val stateSerializer: (StateT) -> DataItem,
-        internal val stateDeserializer: (DataItem) -> StateT
+        internal val stateDeserializer: (DataItem) -> StateT,
+        internal val stateEncoder: (StateT) -> ByteArray,
+        internal val stateDecoder: (ByteArray) -> StateT
     ) {
         suspend fun dispatch(
             owner: FlowDispatcherLocal,
@@ -109,49 +175,47 @@ class FlowDispatcherLocal private constructor(
             val handler = handlerMap[method]
                 ?: throw UnsupportedOperationException("operation $method not found")
             val stateBlob = args[0].asBstr
-            val cipher = owner.cipher
             val decryptedState = if (stateBlob.isEmpty()) {
                 byteArrayOf()
             } else {
-                cipher.decrypt(stateBlob)
+                owner.decryptState(stateBlob)
             }
-            val state = stateDeserializer(
-                if (stateBlob.isEmpty()) {
-                    if (creatable) {
-                        args[0]  // empty bstr
-                    } else {
-                        throw IllegalStateException("this flow is not creatable")
-                    }
+            val state = if (stateBlob.isEmpty()) {
+                if (creatable) {
+                    stateDeserializer(args[0])  // empty bstr
                 } else {
-                    Cbor.decode(decryptedState)
-                })
+                    throw IllegalStateException("this flow is not creatable")
+                }
+            } else {
+                stateDecoder(decryptedState)
+            }
             try {
                 val result = handler(owner, state, args.subList(1, args.size))
-                val newStateBlob = stateDataItem(cipher, args[0], decryptedState, state)
+                val newStateBlob = stateDataItem(owner, args[0], decryptedState, state)
                 return listOf(newStateBlob, FlowReturnCode.RESULT.ordinal.toDataItem(), result)
             } catch (err: Throwable) {
-                val newStateBlob = stateDataItem(cipher, args[0], decryptedState, state)
+                val newStateBlob = stateDataItem(owner, args[0], decryptedState, state)
                 return owner.exceptionMap.exceptionReturn(newStateBlob, err)
             }
         }
 
         private fun stateDataItem(
-            cipher: SimpleCipher,
+            owner: FlowDispatcherLocal,
             previous: DataItem,
             previousDecryptedState: ByteArray,
             newState: StateT
         ): DataItem {
-            val newDecryptedState = Cbor.encode(stateSerializer(newState))
+            val newDecryptedState = stateEncoder(newState)
             // Don't re-encrypt if the state did not change
             return if (newDecryptedState contentEquals previousDecryptedState) {
                 previous
             } else {
-                Bstr(cipher.encrypt(newDecryptedState))
+                Bstr(owner.encryptState(newDecryptedState))
             }
         }
 
-        internal fun serialize(value: Any): DataItem {
-            return stateSerializer(stateClass.cast(value))
+        internal fun encode(value: Any): ByteArray {
+            return stateEncoder(stateClass.cast(value))
         }
     }
 }
\ No newline at end of file
@@ -0,0 +1,27 @@
+package com.android.identity.flow.handler
+
+/**
+ * Carries messages between the nodes of a server that runs as several processes, e.g.
+ * replicas behind a load balancer.
+ *
+ * This is used by [FlowNotificationsLocalPoll] so that a notification emitted on one node
+ * can be delivered by any node the client polls. [FlowNotificationBusStorage] implements it
+ * on top of [com.android.identity.flow.server.Storage]; implementations backed by a message
+ * broker, such as Redis pub/sub, can be plugged in the same way.
+ *
+ * Delivery is best effort, but a message published while a node is subscribed should reach
+ * it, typically within a fraction of a second. Messages are delivered to all subscribers,
+ * including the ones on the publishing node.
+ */
+interface FlowNotificationBus {
+    /**
+     * Sends a message to all subscribed nodes.
+     */
+    suspend fun publish(message: ByteArray)
+
+    /**
+     * Receives the messages published by any node, calling [onMessage] for each of them,
+     * until the call is cancelled.
+     */
+    suspend fun subscribe(onMessage: suspend (ByteArray) -> Unit)
+}
@@ -0,0 +1,102 @@
+package com.android.identity.flow.handler
+
+import com.android.identity.flow.server.Storage
+import com.android.identity.util.Logger
+import com.android.identity.util.toHex
+import kotlinx.coroutines.delay
+import kotlinx.datetime.Clock
+import kotlinx.datetime.Instant
+import kotlinx.io.bytestring.ByteString
+import kotlin.random.Random
+import kotlin.time.Duration
+import kotlin.time.Duration.Companion.milliseconds
+import kotlin.time.Duration.Companion.minutes
+import kotlin.time.Duration.Companion.seconds
+
+/**
+ * [FlowNotificationBus] implementation on top of a [Storage] shared by all nodes, e.g. the
+ * SQL database of the server.
+ *
+ * Each message is a record keyed by the time it was published, subscribers read the records
+ * published since they last looked every [pollInterval]. This needs no infrastructure beyond
+ * the database, at the cost of some latency and database load, which makes it a good fit for
+ * a handful of nodes.
+ *
+ * @param storage the storage shared by all nodes.
+ * @param pollInterval how often subscribers look for new messages.
+ * @param maxClockSkew how far apart the clocks of the nodes may be; messages published by a
+ *   node with a clock further behind may be missed.
+ * @param retention how long messages are kept in the storage.
+ */
+class FlowNotificationBusStorage(
+    private val storage: Storage,
+    private val pollInterval: Duration = 250.milliseconds,
+    private val maxClockSkew: Duration = 5.seconds,
+    private val retention: Duration = 5.minutes
+): FlowNotificationBus {
+    init {
+        require(pollInterval.isPositive()) { "pollInterval must be positive" }
+        require(retention > maxClockSkew) { "retention must be longer than maxClockSkew" }
+    }
+
+    companion object {
+        private const val TAG = "FlowNotificationBusStorage"
+
+        private const val TABLE = "NotificationBus"
+        private const val TIME_DIGITS = 15
+        private const val CLEANUP_BATCH_SIZE = 100
+
+        // Record keys start with the time so that they are ordered by it.
+        private fun keyPrefix(time: Instant): String =
+            time.toEpochMilliseconds().toString().padStart(TIME_DIGITS, '0')
+
+        private fun keyTime(key: String): Instant =
+            Instant.fromEpochMilliseconds(key.substring(0, TIME_DIGITS).toLong())
+    }
+
+    override suspend fun publish(message: ByteArray) {
+        val key = keyPrefix(Clock.System.now()) + "-" + Random.Default.nextBytes(12).toHex()
+        storage.insert(TABLE, "", ByteString(message), key)
+    }
+
+    override suspend fun subscribe(onMessage: suspend (ByteArray) -> Unit) {
+        val start = Clock.System.now()
+        var lastCleanup = start
+        // Messages already delivered which are still within the clock skew window.
+        val seen = mutableSetOf<String>()
+        while (true) {
+            val now = Clock.System.now()
+            val notBefore = maxOf(start, now - maxClockSkew)
+            seen.removeAll { key -> keyTime(key) < notBefore }
+            storage.enumerateWithData(TABLE, "", keyPrefix(notBefore)).collect { (key, data) ->
+                if (seen.add(key)) {
+                    try {
+                        onMessage(data.toByteArray())
+                    } catch (err: IllegalArgumentException) {
+                        Logger.e(TAG, "Error handling message $key", err)
+                    }
+                }
+            }
+            if (now - lastCleanup > retention / 2) {
+                lastCleanup = now
+                cleanup(now - retention)
+            }
+            delay(pollInterval)
+        }
+    }
+
+    // Deletes the messages published before the given time. Several nodes may do this at
+    // the same time, which is harmless.
+    private suspend fun cleanup(before: Instant) {
+        while (true) {
+            val keys = storage.enumerate(TABLE, "", "", CLEANUP_BATCH_SIZE)
+            val expired = keys.filter { key -> keyTime(key) < before }
+            for (key in expired) {
+                storage.delete(TABLE, "", key)
+            }
+            if (expired.size < CLEANUP_BATCH_SIZE) {
+                break
+            }
+        }
+    }
+}
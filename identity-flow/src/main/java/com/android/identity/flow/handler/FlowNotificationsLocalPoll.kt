@@ -1,16 +1,15 @@
 package com.android.identity.flow.handler
 
 import com.android.identity.cbor.Cbor
+import com.android.identity.cbor.CborArray
 import com.android.identity.cbor.DataItem
+import com.android.identity.cbor.toDataItem
 import com.android.identity.util.Logger
-import kotlinx.coroutines.FlowPreview
+import kotlinx.coroutines.CompletableDeferred
 import kotlinx.coroutines.TimeoutCancellationException
-import kotlinx.coroutines.channels.BufferOverflow
-import kotlinx.coroutines.flow.MutableSharedFlow
-import kotlinx.coroutines.flow.take
-import kotlinx.coroutines.flow.timeout
 import kotlinx.coroutines.sync.Mutex
 import kotlinx.coroutines.sync.withLock
+import kotlinx.coroutines.withTimeout
 import kotlinx.datetime.Clock
 import kotlin.io.encoding.Base64
 import kotlin.io.encoding.ExperimentalEncodingApi
@@ -20,117 +19,236 @@ import kotlin.time.Duration.Companion.minutes
 /**
  * Implementation for [FlowNotifications] that also implements [FlowPoll] interface to handle
  * long poll method for notification propagation.
+ *
+ * Notifications and waiting [poll] calls are indexed by [FlowNotificationKey] and spread
+ * over [numShards] shards, each with its own lock, so that [emit] only locks one shard and
+ * only wakes up the [poll] calls waiting on the flow that the notification was emitted for.
+ *
+ * When the server runs as several nodes, pass the same kind of [bus] on every node and keep
+ * [relay] running. Notifications emitted and consumed on one node are then forwarded to all
+ * other nodes, so that clients may poll any node and the consume token returned by one node
+ * is valid on all of them. As forwarding takes a moment, a notification may occasionally be
+ * delivered twice.
+ *
+ * @param cipher the cipher used to decrypt flow states in [FlowPoll.PollKey.opaqueState].
+ * @param numShards the number of shards, more shards means less lock contention.
+ * @param bus the bus connecting the nodes of the server or `null` if there is only one.
  */
-class FlowNotificationsLocalPoll(private val cipher: SimpleCipher): FlowNotifications, FlowPoll {
-    private val mutex = Mutex()
-    private val notificationFlow = MutableSharedFlow<Boolean>(
-        extraBufferCapacity = 10,
-        onBufferOverflow = BufferOverflow.DROP_OLDEST)
-    private var current = mutableMapOf<FlowNotificationKey, MutableSet<DataItem>>()
-    private var last = mutableMapOf<FlowNotificationKey, MutableSet<DataItem>>()
-    private var consumed = mutableMapOf<String, ConsumedItem>()
-    private var lastConsumed = mutableMapOf<String, ConsumedItem>()
-    private var lastRotation = Clock.System.now()
+class FlowNotificationsLocalPoll(
+    private val cipher: SimpleCipher,
+    private val numShards: Int = DEFAULT_NUM_SHARDS,
+    private val bus: FlowNotificationBus? = null
+): FlowNotifications, FlowPoll {
+    init {
+        require(numShards > 0) { "numShards must be positive" }
+    }
+
+    private val shards = Array(numShards) { Shard() }
+
+    // Identifies this node in the messages sent through the bus.
+    @OptIn(ExperimentalEncodingApi::class)
+    private val nodeId = Base64.encode(Random.Default.nextBytes(9))
 
     companion object {
         private val TAG = "FlowNotificationsLocalPoll"
+
+        /** The default for `numShards`. */
+        const val DEFAULT_NUM_SHARDS = 64
+
+        private const val MESSAGE_EMIT = 0L
+        private const val MESSAGE_CONSUME = 1L
     }
 
+    @OptIn(ExperimentalEncodingApi::class)
     override suspend fun emit(flowName: String, state: DataItem, notification: DataItem) {
-        val ref = FlowNotificationKey(flowName, state)
-        val dropped = mutableSetOf<String>()
-        mutex.withLock {
-            maybeRotate(dropped)
-            current.getOrPut(ref) { mutableSetOf() }.add(notification)
+        // The id of the notification also serves as its consume token.
+        val id = Base64.encode(Random.Default.nextBytes(15))
+        add(FlowNotificationKey(flowName, state), id, notification)
+        bus?.publish(Cbor.encode(CborArray(mutableListOf(
+            MESSAGE_EMIT.toDataItem(),
+            nodeId.toDataItem(),
+            id.toDataItem(),
+            flowName.toDataItem(),
+            state,
+            notification
+        ))))
+    }
+
+    /**
+     * Receives the notifications emitted and consumed on the other nodes through [bus],
+     * suspending until cancelled.
+     *
+     * This must be kept running on every node for notifications to be delivered across nodes.
+     */
+    suspend fun relay() {
+        val bus = this.bus ?: throw IllegalStateException("No bus to relay from")
+        bus.subscribe { message ->
+            val items = Cbor.decode(message).asArray
+            if (items[1].asTstr == nodeId) {
+                return@subscribe
+            }
+            val id = items[2].asTstr
+            when (items[0].asNumber) {
+                MESSAGE_EMIT -> add(FlowNotificationKey(items[3].asTstr, items[4]), id, items[5])
+                MESSAGE_CONSUME -> remove(id)
+                else -> Logger.w(TAG, "unknown message type ${items[0].asNumber}")
+            }
         }
-        notificationFlow.tryEmit(true)
-        logDropped(dropped)
     }
 
-    @OptIn(FlowPreview::class, ExperimentalEncodingApi::class)
     override suspend fun poll(consumeToken: String, flows: List<FlowPoll.PollKey>): FlowPoll.PollResult {
-        val dropped = mutableSetOf<String>()
         val start = Clock.System.now()
         Logger.i(TAG, "polling flows: ${flows.map { flowRef -> flowRef.flowName }.joinToString(",")}")
+        val flowRefs = flows.map { pollKey ->
+            FlowNotificationKey(
+                pollKey.flowName,
+                Cbor.decode(cipher.decrypt(pollKey.opaqueState.asBstr))
+            )
+        }
+        consume(consumeToken)
+        val dropped = mutableSetOf<String>()
         do {
-            var result: FlowPoll.PollResult? = null
-            var notificationKey: FlowNotificationKey? = null
-            mutex.withLock {
-                val consumedItem = consumed.remove(consumeToken) ?: lastConsumed.remove(consumeToken)
-                if (consumedItem != null) {
-                    current[consumedItem.flowNotificationKey]?.remove(consumedItem.notification)
-                    last[consumedItem.flowNotificationKey]?.remove(consumedItem.notification)
-                }
-                maybeRotate(dropped)
-                for ((index, pollKey) in flows.withIndex()) {
-                    val flowRef = FlowNotificationKey(
-                        pollKey.flowName,
-                        Cbor.decode(cipher.decrypt(pollKey.opaqueState.asBstr))
-                    )
-                    val currentList = current[flowRef]
-                    val lastList = last[flowRef]
-                    val notification = if (!currentList.isNullOrEmpty()) {
-                        currentList.first()
-                    } else if (!lastList.isNullOrEmpty()) {
-                        lastList.first()
-                    } else {
-                        continue
+            // The waiter is registered for each flow found empty while holding the lock of its
+            // shard, so a notification emitted right after the check still completes it.
+            val waiter = CompletableDeferred<Unit>()
+            try {
+                for ((index, flowRef) in flowRefs.withIndex()) {
+                    val shard = shardFor(flowRef)
+                    val entry = shard.mutex.withLock {
+                        shard.maybeRotate(dropped)
+                        val entry = shard.current[flowRef]?.entries?.firstOrNull()
+                            ?: shard.last[flowRef]?.entries?.firstOrNull()
+                        if (entry == null) {
+                            shard.waiters.getOrPut(flowRef) { mutableSetOf() }.add(waiter)
+                        }
+                        entry
+                    } ?: continue
+                    // The id may have been rotated out separately from the notification.
+                    val idShard = shardFor(entry.key)
+                    idShard.mutex.withLock {
+                        idShard.maybeRotate(dropped)
+                        idShard.ids[entry.key] = flowRef
                     }
+                    logDropped(dropped)
                     Logger.i(TAG, "pushing notification for flow ${flowRef.flowName}")
-                    result = FlowPoll.PollResult(
-                        consumeToken = Base64.encode(Random.Default.nextBytes(15)),
+                    return FlowPoll.PollResult(
+                        consumeToken = entry.key,
                         index = index,
-                        notification = notification
+                        notification = entry.value
                     )
-                    notificationKey = flowRef
-                    break
                 }
-            }
-            logDropped(dropped)
-            if (result != null) {
-                mutex.withLock {
-                    lastConsumed.put(result!!.consumeToken, ConsumedItem(
-                        flowNotificationKey = notificationKey!!,
-                        notification = result!!.notification
-                    ))
+                logDropped(dropped)
+                try {
+                    withTimeout(1.minutes) { waiter.await() }
+                } catch (exception: TimeoutCancellationException) {
+                    // ignore
                 }
-                return result!!
-            }
-            try {
-                notificationFlow.timeout(1.minutes).take(1).collect {}
-            } catch(exception: TimeoutCancellationException) {
-                // ignore
+            } finally {
+                removeWaiter(waiter, flowRefs)
             }
         } while (Clock.System.now() - start < 3.minutes)
         throw FlowPoll.TimeoutException()
     }
 
-    private fun maybeRotate(dropped: MutableSet<String>) {
-        val now = Clock.System.now()
-        if (now - lastRotation > 1.minutes) {
-            for (key in last.keys) {
-                dropped.add(key.flowName)
+    private suspend fun add(ref: FlowNotificationKey, id: String, notification: DataItem) {
+        // Index the id first, so that the notification can be consumed as soon as it is seen.
+        val dropped = mutableSetOf<String>()
+        val idShard = shardFor(id)
+        idShard.mutex.withLock {
+            idShard.maybeRotate(dropped)
+            idShard.ids[id] = ref
+        }
+        val shard = shardFor(ref)
+        val waiters = shard.mutex.withLock {
+            shard.maybeRotate(dropped)
+            shard.current.getOrPut(ref) { linkedMapOf() }[id] = notification
+            shard.waiters.remove(ref)
+        }
+        waiters?.forEach { it.complete(Unit) }
+        logDropped(dropped)
+    }
+
+    private suspend fun consume(consumeToken: String) {
+        if (consumeToken.isEmpty()) {
+            return
+        }
+        // Only forwarded when found here, clients keep sending the token of the last
+        // notification they received until there is a new one.
+        if (remove(consumeToken)) {
+            bus?.publish(Cbor.encode(CborArray(mutableListOf(
+                MESSAGE_CONSUME.toDataItem(),
+                nodeId.toDataItem(),
+                consumeToken.toDataItem()
+            ))))
+        }
+    }
+
+    private suspend fun remove(id: String): Boolean {
+        val idShard = shardFor(id)
+        val ref = idShard.mutex.withLock {
+            idShard.ids.remove(id) ?: idShard.lastIds.remove(id)
+        } ?: return false
+        val shard = shardFor(ref)
+        shard.mutex.withLock {
+            shard.current[ref]?.remove(id)
+            shard.last[ref]?.remove(id)
+        }
+        return true
+    }
+
+    private suspend fun removeWaiter(
+        waiter: CompletableDeferred<Unit>,
+        flowRefs: List<FlowNotificationKey>
+    ) {
+        for (flowRef in flowRefs) {
+            val shard = shardFor(flowRef)
+            shard.mutex.withLock {
+                val waiters = shard.waiters[flowRef] ?: return@withLock
+                waiters.remove(waiter)
+                if (waiters.isEmpty()) {
+                    shard.waiters.remove(flowRef)
+                }
             }
-            last.clear()
-            val tmp = current
-            current = last
-            last = tmp
-            lastRotation = now
-            lastConsumed.clear()
-            val tmpConsumed = consumed
-            consumed = lastConsumed
-            lastConsumed = tmpConsumed
         }
     }
 
-    private fun logDropped(dropped: Set<String>) {
+    private fun shardFor(key: Any): Shard = shards[key.hashCode().mod(numShards)]
+
+    private fun logDropped(dropped: MutableSet<String>) {
         for (flowName in dropped) {
             Logger.w(TAG, "dropped notification for $flowName")
         }
+        dropped.clear()
     }
 
-    private data class ConsumedItem(
-        val flowNotificationKey: FlowNotificationKey,
-        val notification: DataItem
-    )
-}
\ No newline at end of file
+    private class Shard {
+        val mutex = Mutex()
+        // Notifications by id, in the order they were emitted.
+        var current = mutableMapOf<FlowNotificationKey, LinkedHashMap<String, DataItem>>()
+        var last = mutableMapOf<FlowNotificationKey, LinkedHashMap<String, DataItem>>()
+        var ids = mutableMapOf<String, FlowNotificationKey>()
+        var lastIds = mutableMapOf<String, FlowNotificationKey>()
+        val waiters = mutableMapOf<FlowNotificationKey, MutableSet<CompletableDeferred<Unit>>>()
+        var lastRotation = Clock.System.now()
+
+        fun maybeRotate(dropped: MutableSet<String>) {
+            val now = Clock.System.now()
+            if (now - lastRotation > 1.minutes) {
+                for ((key, notifications) in last) {
+                    if (notifications.isNotEmpty()) {
+                        dropped.add(key.flowName)
+                    }
+                }
+                last.clear()
+                val tmp = current
+                current = last
+                last = tmp
+                lastRotation = now
+                lastIds.clear()
+                val tmpIds = ids
+                ids = lastIds
+                lastIds = tmpIds
+            }
+        }
+    }
+}
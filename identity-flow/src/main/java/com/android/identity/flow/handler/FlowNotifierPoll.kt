@@ -49,8 +49,12 @@ class FlowNotifierPoll(private val poll: FlowPoll) : FlowNotifier {
         }.collectLatest { list ->
             val refs = list.map { item -> item.first }
             do {
-                val result = try {
-                    poll.poll(consumeToken, refs)
+                try {
+                    poll.stream(consumeToken, refs) { result ->
+                        // don't want to have duplicate notifications
+                        consumeToken = result.consumeToken
+                        list[result.index].second.emit(result.notification)
+                    }
                 } catch (_: FlowPoll.TimeoutException) {
                     continue
                 } catch (e: CancellationException) {
@@ -62,9 +66,6 @@ class FlowNotifierPoll(private val poll: FlowPoll) : FlowNotifier {
                     delay(5.seconds)
                     continue
                 }
-                // don't want to have duplicate notifications
-                consumeToken = result.consumeToken
-                list[result.index].second.emit(result.notification)
             } while (true)
         }
     }
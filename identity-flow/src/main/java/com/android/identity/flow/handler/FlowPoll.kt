@@ -15,6 +15,31 @@ interface FlowPoll {
      */
     suspend fun poll(consumeToken: String, flows: List<PollKey>): PollResult
 
+    /**
+     * Waits for events/notifications on the specified flows and passes each of them to
+     * [onResult], until the call is cancelled or, for implementations that push notifications
+     * over a connection, the connection is closed. Notifications passed to [onResult] are
+     * considered processed once the next one is delivered.
+     *
+     * The default implementation calls [poll] repeatedly.
+     */
+    suspend fun stream(
+        consumeToken: String,
+        flows: List<PollKey>,
+        onResult: suspend (PollResult) -> Unit
+    ) {
+        var token = consumeToken
+        while (true) {
+            val result = try {
+                poll(token, flows)
+            } catch (err: TimeoutException) {
+                continue
+            }
+            token = result.consumeToken
+            onResult(result)
+        }
+    }
+
     data class PollKey(val flowName: String, val opaqueState: DataItem)
 
     data class PollResult(
@@ -2,26 +2,79 @@ package com.android.identity.flow.handler
 
 import com.android.identity.cbor.Cbor
 import com.android.identity.cbor.CborArray
+import com.android.identity.cbor.DataItem
 import com.android.identity.flow.transport.HttpTransport
+import com.android.identity.util.Logger
 import kotlinx.io.bytestring.ByteString
 
-/** [FlowPoll] implementation that works through HTTP. */
-class FlowPollHttp(private val transport: HttpTransport): FlowPoll {
+/**
+ * [FlowPoll] implementation that works through HTTP.
+ *
+ * @param transport the transport to use.
+ * @param usePush if `true`, [stream] asks the server to push notifications over a single
+ *   connection using [HttpTransport.stream] instead of long polling, falling back to long
+ *   polling if either the transport or the server does not support it.
+ */
+class FlowPollHttp(
+    private val transport: HttpTransport,
+    private val usePush: Boolean = false
+): FlowPoll {
+    private var pushSupported = usePush
+
+    companion object {
+        private const val TAG = "FlowPollHttp"
+    }
+
     override suspend fun poll(consumeToken: String, flows: List<FlowPoll.PollKey>): FlowPoll.PollResult {
+        val result = try {
+            val response = transport.post("_/poll", encodeRequest(consumeToken, flows))
+            Cbor.decode(response.toByteArray()).asArray
+        } catch(err: HttpTransport.TimeoutException) {
+            throw FlowPoll.TimeoutException()
+        }
+        return decodeResult(result) ?: throw FlowPoll.TimeoutException()
+    }
+
+    override suspend fun stream(
+        consumeToken: String,
+        flows: List<FlowPoll.PollKey>,
+        onResult: suspend (FlowPoll.PollResult) -> Unit
+    ) {
+        if (!pushSupported) {
+            return super.stream(consumeToken, flows, onResult)
+        }
+        var token = consumeToken
+        try {
+            transport.stream("_/stream", encodeRequest(consumeToken, flows)) { event ->
+                // Empty events only keep the connection alive.
+                val result = decodeResult(Cbor.decode(event.toByteArray()).asArray)
+                if (result != null) {
+                    token = result.consumeToken
+                    onResult(result)
+                }
+            }
+        } catch (err: UnsupportedOperationException) {
+            Logger.i(TAG, "Push is not supported, falling back to long poll")
+            pushSupported = false
+            super.stream(token, flows, onResult)
+        } catch (err: HttpTransport.TimeoutException) {
+            throw FlowPoll.TimeoutException()
+        }
+    }
+
+    private fun encodeRequest(consumeToken: String, flows: List<FlowPoll.PollKey>): ByteString {
         val builder = CborArray.builder()
         builder.add(consumeToken)
         flows.forEach {flowRef ->
             builder.add(flowRef.flowName)
             builder.add(flowRef.opaqueState)
         }
-        val result = try {
-            val response = transport.post("_/poll", ByteString(Cbor.encode(builder.end().build())))
-            Cbor.decode(response.toByteArray()).asArray
-        } catch(err: HttpTransport.TimeoutException) {
-            throw FlowPoll.TimeoutException()
-        }
+        return ByteString(Cbor.encode(builder.end().build()))
+    }
+
+    private fun decodeResult(result: List<DataItem>): FlowPoll.PollResult? {
         if (result.isEmpty()) {
-            throw FlowPoll.TimeoutException()
+            return null
         }
         return FlowPoll.PollResult(
             consumeToken = result[0].asTstr,
@@ -29,4 +82,4 @@ class FlowPollHttp(private val transport: HttpTransport): FlowPoll {
             notification = result[2]
         )
     }
-}
\ No newline at end of file
+}
@@ -5,11 +5,16 @@ import com.android.identity.cbor.CborArray
 import com.android.identity.cbor.DataItem
 import com.android.identity.cbor.toDataItem
 import com.android.identity.flow.transport.HttpTransport
+import com.android.identity.util.Tracing
 import kotlinx.io.bytestring.ByteString
 
 /**
  * Implements [HttpTransport] based on the given [FlowDispatcher] and [FlowPoll]. Useful
  * to route incoming HTTP requests on the server.
+ *
+ * Besides single flow method calls, [post] handles batches of calls sent by
+ * [FlowDispatcherHttp.dispatchBatch]. Notifications are delivered using long poll through
+ * [post] and, optionally, pushed through [stream].
  */
 class HttpHandler(
     private val dispatcher: FlowDispatcher,
@@ -19,17 +24,71 @@ class HttpHandler(
         val (target, method) = url.split("/")
         val args = Cbor.decode(data.toByteArray()).asArray
         val result = if (target == "_") {
-            handlePoll(args)
+            if (method == "batch") handleBatch(args) else handlePoll(args)
         } else {
-            dispatcher.dispatch(target, method, args)
+            Tracing.span("flow.call") { span ->
+                span.setAttribute("method", url)
+                dispatcher.dispatch(target, method, args)
+            }
         }
         val builder = CborArray.builder()
         result.forEach { builder.add(it) }
         return ByteString(Cbor.encode(builder.end().build()))
     }
 
+    /**
+     * Handles a request for pushing notifications to the client, the push counterpart of
+     * the long poll handled by [post].
+     *
+     * The request has the same format as a long poll request and is posted to `_/stream`.
+     * Every notification is passed to [onEvent] encoded like a long poll response, the
+     * previous one is considered processed by the client once [onEvent] returns for the next
+     * one. When no notification arrives before the long poll times out an empty message is
+     * sent, which keeps the connection from being closed as idle. This continues until
+     * [onEvent] throws, e.g. because the client closed the connection.
+     */
+    override suspend fun stream(
+        url: String,
+        data: ByteString,
+        onEvent: suspend (ByteString) -> Unit
+    ) {
+        if (url != "_/stream") {
+            throw UnsupportedOperationException("Streaming is not supported for $url")
+        }
+        val args = Cbor.decode(data.toByteArray()).asArray
+        var consumeToken = args[0].asTstr
+        val pollKeys = parsePollKeys(args)
+        while (true) {
+            val result = try {
+                flowPoll.poll(consumeToken, pollKeys)
+            } catch (err: FlowPoll.TimeoutException) {
+                null
+            }
+            onEvent(encodeResult(result))
+            if (result != null) {
+                consumeToken = result.consumeToken
+            }
+        }
+    }
+
+    private suspend fun handleBatch(args: List<DataItem>): List<DataItem> {
+        val calls = args.map { FlowCall.fromDataItem(it) }
+        return dispatcher.dispatchBatch(calls).map { CborArray(it.toMutableList()) }
+    }
+
     private suspend fun handlePoll(args: List<DataItem>): List<DataItem> {
         val consumedToken = args[0].asTstr
+        val pollKeys = parsePollKeys(args)
+        try {
+            val result = flowPoll.poll(consumedToken, pollKeys)
+            return resultToList(result)
+        } catch (err: FlowPoll.TimeoutException) {
+            // Signal using empty message with 200 status
+            return listOf()
+        }
+    }
+
+    private fun parsePollKeys(args: List<DataItem>): List<FlowPoll.PollKey> {
         val pollKeys = mutableListOf<FlowPoll.PollKey>()
         for (i in 1..<args.size step 2) {
             pollKeys.add(FlowPoll.PollKey(
@@ -37,16 +96,22 @@ class HttpHandler(
                 opaqueState = args[i+1]
             ))
         }
-        try {
-            val result = flowPoll.poll(consumedToken, pollKeys)
-            val resultList = mutableListOf<DataItem>()
-            resultList.add(result.consumeToken.toDataItem())
-            resultList.add(result.index.toDataItem())
-            resultList.add(result.notification)
-            return resultList.toList()
-        } catch (err: FlowPoll.TimeoutException) {
-            // Signal using empty message with 200 status
-            return listOf()
+        return pollKeys
+    }
+
+    private fun resultToList(result: FlowPoll.PollResult): List<DataItem> {
+        val resultList = mutableListOf<DataItem>()
+        resultList.add(result.consumeToken.toDataItem())
+        resultList.add(result.index.toDataItem())
+        resultList.add(result.notification)
+        return resultList.toList()
+    }
+
+    private fun encodeResult(result: FlowPoll.PollResult?): ByteString {
+        val builder = CborArray.builder()
+        if (result != null) {
+            resultToList(result).forEach { builder.add(it) }
         }
+        return ByteString(Cbor.encode(builder.end().build()))
     }
 }
\ No newline at end of file
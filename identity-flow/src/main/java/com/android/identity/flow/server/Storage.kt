@@ -1,5 +1,7 @@
 package com.android.identity.flow.server
 
+import kotlinx.coroutines.flow.Flow
+import kotlinx.coroutines.flow.flow
 import kotlinx.io.bytestring.ByteString
 
 /**
@@ -14,6 +16,10 @@ import kotlinx.io.bytestring.ByteString
  *
  * Payload of the record is always just a blob of data. Storage does not interpret that data
  * in any way.
+ *
+ * Bulk operations ([getMany], [insertMany], and [enumerateWithData]) have default
+ * implementations in terms of the single-record operations, implementations backed by a
+ * database should override them to use a single query per call or page.
  */
 interface Storage {
     /**
@@ -52,4 +58,60 @@ interface Storage {
      */
     suspend fun enumerate(table: String, peerId: String,
                           notBeforeKey: String = "", limit: Int = Int.MAX_VALUE): List<String>
-}
\ No newline at end of file
+
+    /**
+     * Retrieves data for multiple records from storage.
+     *
+     * Returns a list with the data for each of the given [keys], in the same order, with null
+     * for records that are not found.
+     */
+    suspend fun getMany(table: String, peerId: String, keys: List<String>): List<ByteString?> {
+        return keys.map { key -> get(table, peerId, key) }
+    }
+
+    /**
+     * Inserts multiple new records.
+     *
+     * [keys] must be of the same size as [data], for each empty key a new unique key is
+     * generated. Returns the keys of the inserted records, in the same order as [data].
+     */
+    suspend fun insertMany(
+        table: String,
+        peerId: String,
+        data: List<ByteString>,
+        keys: List<String> = List(data.size) { "" }
+    ): List<String> {
+        require(keys.size == data.size) { "keys and data must be of the same size" }
+        return data.indices.map { i -> insert(table, peerId, data[i], keys[i]) }
+    }
+
+    /**
+     * Enumerate keys and data of the records with given table and peerId in key lexicographic
+     * order.
+     *
+     * Records are fetched lazily from storage in pages of [pageSize] records as the returned
+     * flow is collected. If [notBeforeKey] is given only records with keys that follow the
+     * given key are returned.
+     */
+    fun enumerateWithData(
+        table: String,
+        peerId: String,
+        notBeforeKey: String = "",
+        pageSize: Int = 100
+    ): Flow<Pair<String, ByteString>> = flow {
+        require(pageSize > 0) { "pageSize must be positive" }
+        var lastKey = notBeforeKey
+        while (true) {
+            val keys = enumerate(table, peerId, lastKey, pageSize)
+            val data = getMany(table, peerId, keys)
+            for (i in keys.indices) {
+                // Records deleted in the meantime are skipped.
+                data[i]?.let { emit(Pair(keys[i], it)) }
+            }
+            if (keys.size < pageSize) {
+                break
+            }
+            lastKey = keys.last()
+        }
+    }
+}
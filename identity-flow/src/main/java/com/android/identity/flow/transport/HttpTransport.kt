@@ -11,6 +11,17 @@ import kotlinx.io.bytestring.ByteString
 interface HttpTransport {
     suspend fun post(url: String, data: ByteString): ByteString
 
+    /**
+     * Posts [data] to [url] and passes each event pushed by the server in the response, e.g.
+     * as server-sent events, to [onEvent] until the server closes the connection.
+     *
+     * Support for this is optional, the default implementation throws
+     * [UnsupportedOperationException].
+     */
+    suspend fun stream(url: String, data: ByteString, onEvent: suspend (ByteString) -> Unit) {
+        throw UnsupportedOperationException("Streaming is not supported")
+    }
+
     /**
      * Base class for all exceptions thrown by [HttpTransport]
      */
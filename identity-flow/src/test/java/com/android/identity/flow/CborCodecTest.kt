@@ -0,0 +1,137 @@
+package com.android.identity.flow
+
+import com.android.identity.cbor.Cbor
+import com.android.identity.cbor.CborArray
+import com.android.identity.cbor.CborMap
+import com.android.identity.cbor.DataItem
+import com.android.identity.cbor.annotation.CborSerializable
+import com.android.identity.cbor.toDataItem
+import kotlinx.datetime.Instant
+import kotlinx.io.bytestring.ByteString
+import org.junit.Assert
+import org.junit.Test
+
+// Data structures covering the kinds of fields the generated codecs handle differently.
+
+enum class CodecTestColor { RED, GREEN, BLUE }
+
+@CborSerializable(typeKey = "kind")
+sealed class CodecTestShape {
+    companion object
+}
+
+data class CodecTestShapeCircle(val radius: Double) : CodecTestShape()
+
+data class CodecTestShapeSquare(
+    val side: Long,
+    val label: String? = null
+) : CodecTestShape()
+
+// Not generated, serialized by hand.
+data class CodecTestPoint(val x: Long, val y: Long) {
+    fun toDataItem(): DataItem =
+        CborArray.builder().add(x).add(y).end().build()
+
+    companion object {
+        fun fromDataItem(dataItem: DataItem): CodecTestPoint =
+            CodecTestPoint(dataItem[0].asNumber, dataItem[1].asNumber)
+    }
+}
+
+@CborSerializable
+data class CodecTestData(
+    val name: String,
+    val count: Int,
+    val nickname: String? = null,
+    val color: CodecTestColor,
+    val favoriteColor: CodecTestColor? = null,
+    val shape: CodecTestShape,
+    val shapes: List<CodecTestShape>,
+    val tags: Map<String, Long>,
+    val ratio: Double,
+    val created: Instant? = null,
+    val data: ByteString,
+    val points: List<CodecTestPoint>,
+    val origin: CodecTestPoint? = null
+) {
+    companion object
+}
+
+class CborCodecTest {
+    private val full = CodecTestData(
+        name = "full",
+        count = -3,
+        nickname = "nick",
+        color = CodecTestColor.GREEN,
+        favoriteColor = CodecTestColor.BLUE,
+        shape = CodecTestShapeSquare(4, "four"),
+        shapes = listOf(CodecTestShapeCircle(1.5), CodecTestShapeSquare(2)),
+        tags = mapOf("a" to 1L, "b" to Long.MAX_VALUE, "c" to Long.MIN_VALUE),
+        ratio = 0.25,
+        created = Instant.fromEpochSeconds(1700000000),
+        data = ByteString(1, 2, 3),
+        points = listOf(CodecTestPoint(1, 2), CodecTestPoint(-3, 4)),
+        origin = CodecTestPoint(0, 0)
+    )
+
+    private val minimal = CodecTestData(
+        name = "",
+        count = 0,
+        color = CodecTestColor.RED,
+        shape = CodecTestShapeCircle(0.0),
+        shapes = listOf(),
+        tags = mapOf(),
+        ratio = -1.0e300,
+        data = ByteString(),
+        points = listOf()
+    )
+
+    @Test
+    fun encodingMatchesDataItem() {
+        for (value in listOf(full, minimal)) {
+            Assert.assertArrayEquals(Cbor.encode(value.toDataItem()), value.toCbor())
+        }
+        val shape: CodecTestShape = CodecTestShapeSquare(1)
+        Assert.assertArrayEquals(Cbor.encode(shape.toDataItem()), shape.toCbor())
+    }
+
+    @Test
+    fun decodesDataItemEncoding() {
+        for (value in listOf(full, minimal)) {
+            Assert.assertEquals(value, CodecTestData.fromCbor(Cbor.encode(value.toDataItem())))
+            Assert.assertEquals(value, CodecTestData.fromDataItem(Cbor.decode(value.toCbor())))
+        }
+    }
+
+    @Test
+    fun decodesKeysInAnyOrder() {
+        // Put the keys, including the type key of the shape, in reverse order.
+        fun reversed(dataItem: DataItem): DataItem = if (dataItem is CborMap) {
+            val items = mutableMapOf<DataItem, DataItem>()
+            for ((key, item) in dataItem.items.entries.reversed()) {
+                items[key] = reversed(item)
+            }
+            CborMap(items)
+        } else {
+            dataItem
+        }
+        val encoded = Cbor.encode(reversed(full.toDataItem()))
+        Assert.assertEquals(full, CodecTestData.fromCbor(encoded))
+    }
+
+    @Test
+    fun skipsUnknownKeys() {
+        val dataItem = minimal.toDataItem() as CborMap
+        dataItem.items["unknown".toDataItem()] = CborArray.builder().add(1).end().build()
+        Assert.assertEquals(minimal, CodecTestData.fromCbor(Cbor.encode(dataItem)))
+    }
+
+    @Test
+    fun missingFieldThrows() {
+        val dataItem = minimal.toDataItem() as CborMap
+        dataItem.items.remove("name".toDataItem())
+        Assert.assertThrows(IllegalArgumentException::class.java) {
+            CodecTestData.fromCbor(Cbor.encode(dataItem))
+        }
+    }
+}
@@ -9,6 +9,7 @@ import com.android.identity.flow.annotation.FlowMethod
 import com.android.identity.flow.annotation.FlowState
 import com.android.identity.flow.client.FlowBase
 import com.android.identity.flow.handler.AesGcmCipher
+import com.android.identity.flow.handler.FlowCall
 import com.android.identity.flow.handler.FlowDispatcherHttp
 import com.android.identity.flow.handler.FlowDispatcherLocal
 import com.android.identity.flow.handler.FlowExceptionMap
@@ -16,13 +17,20 @@ import com.android.identity.flow.handler.FlowNotifier
 import com.android.identity.flow.handler.FlowNotifierPoll
 import com.android.identity.flow.handler.FlowPoll
 import com.android.identity.flow.handler.FlowPollHttp
+import com.android.identity.flow.handler.FlowReturnCode
 import com.android.identity.flow.server.FlowEnvironment
 import com.android.identity.flow.handler.HttpHandler
+import com.android.identity.flow.handler.SimpleCipher
+import com.android.identity.flow.transport.HttpTransport
+import kotlinx.coroutines.async
+import kotlinx.coroutines.awaitAll
 import kotlinx.coroutines.runBlocking
+import kotlinx.io.bytestring.ByteString
 import org.junit.Assert
 import org.junit.Test
 import kotlin.math.sqrt
 import kotlin.random.Random
+import kotlin.time.Duration.Companion.milliseconds
 
 // The following data structures are shared between the client and the server. They can be
 // used as method parameters and return values.
@@ -274,6 +282,108 @@ class FlowProcessorTest {
         }
     }
 
+    @Test
+    fun remoteBatch() {
+        val http = CountingHttpTransport(HttpHandler(localDispatcher, FlowPoll.SILENT))
+        val dispatcher = FlowDispatcherHttp(http, exceptionMap)
+        runBlocking {
+            val factory = SolverFactoryFlowImpl(
+                "factory",
+                Bstr(byteArrayOf()),
+                dispatcher,
+                FlowNotifier.SILENT
+            )
+            val solver = factory.createQuadraticSolver("Direct")
+            http.urls.clear()
+            // Each call gets the state returned by the previous one.
+            val equation = QuadraticEquation(a = 1.0, b = -6.0, c = 9.0).toDataItem()
+            val responses = dispatcher.dispatchBatch(listOf(
+                FlowCall("direct", "solve", listOf(solver.flowState, equation)),
+                FlowCall("direct", "solve", listOf(Bstr(byteArrayOf()), equation), stateFrom = 0),
+                FlowCall("direct", "getCount", listOf(Bstr(byteArrayOf())), stateFrom = 1)
+            ))
+            Assert.assertEquals(listOf("_/batch"), http.urls)
+            Assert.assertEquals(3, responses.size)
+            Assert.assertEquals(FlowReturnCode.RESULT.ordinal, responses[0][1].asNumber.toInt())
+            Assert.assertEquals(2, responses[2][2].asNumber.toInt())
+        }
+    }
+
+    @Test
+    fun remoteCoalesced() {
+        val http = CountingHttpTransport(HttpHandler(localDispatcher, FlowPoll.SILENT))
+        val dispatcher = FlowDispatcherHttp(http, exceptionMap, coalesceWindow = 10.milliseconds)
+        val factory = SolverFactoryFlowImpl(
+            "factory",
+            Bstr(byteArrayOf()),
+            dispatcher,
+            FlowNotifier.SILENT
+        )
+        runBlocking {
+            val solvers = listOf("Direct", "Mock").map { name ->
+                async { factory.createQuadraticSolver(name) }
+            }.awaitAll()
+            Assert.assertEquals(listOf("_/batch"), http.urls)
+            Assert.assertEquals(listOf("Direct", "Mock"), solvers.map { it.getName() })
+        }
+    }
+
+    @Test
+    fun localStateCache() {
+        for (stateCacheSize in listOf(0, FlowDispatcherLocal.DEFAULT_STATE_CACHE_SIZE)) {
+            val cipher = CountingCipher(AesGcmCipher(Random.Default.nextBytes(16)))
+            val builder = FlowDispatcherLocal.Builder()
+            DirectQuadraticSolverState.register(builder)
+            MockQuadraticSolverState.register(builder)
+            SolverFactoryState.register(builder)
+            val dispatcher = builder.build(
+                FlowEnvironment.EMPTY,
+                cipher,
+                exceptionMap,
+                stateCacheSize
+            )
+            val factory = SolverFactoryFlowImpl(
+                "factory",
+                Bstr(byteArrayOf()),
+                dispatcher,
+                FlowNotifier.SILENT
+            )
+            runBlocking {
+                val solver = factory.createQuadraticSolver("Direct")
+                solver.solve(QuadraticEquation(a = 1.0, b = -6.0, c = 9.0))
+                solver.complete()
+                Assert.assertEquals(1, factory.getCount())
+            }
+            // All of the states were encrypted by the dispatcher, so with the cache they
+            // never need to be decrypted.
+            if (stateCacheSize == 0) {
+                Assert.assertTrue(cipher.numDecrypts > 0)
+            } else {
+                Assert.assertEquals(0, cipher.numDecrypts)
+            }
+        }
+    }
+
+    class CountingCipher(private val cipher: SimpleCipher) : SimpleCipher {
+        var numDecrypts = 0
+
+        override fun encrypt(plaintext: ByteArray): ByteArray = cipher.encrypt(plaintext)
+
+        override fun decrypt(ciphertext: ByteArray): ByteArray {
+            numDecrypts++
+            return cipher.decrypt(ciphertext)
+        }
+    }
+
+    class CountingHttpTransport(private val transport: HttpTransport) : HttpTransport {
+        val urls = mutableListOf<String>()
+
+        override suspend fun post(url: String, data: ByteString): ByteString {
+            urls.add(url)
+            return transport.post(url, data)
+        }
+    }
+
     fun localFactory(): SolverFactoryFlow {
         return SolverFactoryFlowImpl(
             "factory",
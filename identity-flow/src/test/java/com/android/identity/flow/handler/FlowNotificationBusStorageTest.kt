@@ -0,0 +1,201 @@
+package com.android.identity.flow.handler
+
+import com.android.identity.cbor.Bstr
+import com.android.identity.cbor.Cbor
+import com.android.identity.cbor.DataItem
+import com.android.identity.cbor.Tstr
+import com.android.identity.flow.server.Storage
+import kotlinx.coroutines.async
+import kotlinx.coroutines.channels.Channel
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.runBlocking
+import kotlinx.coroutines.sync.Mutex
+import kotlinx.coroutines.sync.withLock
+import kotlinx.coroutines.withTimeoutOrNull
+import kotlinx.datetime.Clock
+import kotlinx.io.bytestring.ByteString
+import org.junit.Assert
+import org.junit.Test
+import java.util.TreeMap
+import kotlin.time.Duration.Companion.milliseconds
+import kotlin.time.Duration.Companion.seconds
+
+class FlowNotificationBusStorageTest {
+    private val noopCipher = object : SimpleCipher {
+        override fun encrypt(plaintext: ByteArray): ByteArray = plaintext
+        override fun decrypt(ciphertext: ByteArray): ByteArray = ciphertext
+    }
+
+    // Keeps the records of all tables in memory, ordered by key.
+    private class InMemoryStorage : Storage {
+        private val lock = Mutex()
+        private val tables = mutableMapOf<String, TreeMap<String, ByteString>>()
+        private var nextKey = 0
+
+        private fun records(table: String, peerId: String) =
+            tables.getOrPut("$table/$peerId") { TreeMap() }
+
+        override suspend fun get(table: String, peerId: String, key: String): ByteString? =
+            lock.withLock { records(table, peerId)[key] }
+
+        override suspend fun insert(
+            table: String,
+            peerId: String,
+            data: ByteString,
+            key: String
+        ): String = lock.withLock {
+            val records = records(table, peerId)
+            val recordKey = key.ifEmpty { "key${nextKey++}" }
+            check(!records.containsKey(recordKey)) { "Record $recordKey already exists" }
+            records[recordKey] = data
+            recordKey
+        }
+
+        override suspend fun update(table: String, peerId: String, key: String, data: ByteString) {
+            lock.withLock {
+                val records = records(table, peerId)
+                check(records.containsKey(key)) { "No record $key" }
+                records[key] = data
+            }
+        }
+
+        override suspend fun delete(table: String, peerId: String, key: String): Boolean =
+            lock.withLock { records(table, peerId).remove(key) != null }
+
+        override suspend fun enumerate(
+            table: String,
+            peerId: String,
+            notBeforeKey: String,
+            limit: Int
+        ): List<String> = lock.withLock {
+            records(table, peerId).tailMap(notBeforeKey, false).keys.take(limit)
+        }
+    }
+
+    private fun pollKey(flowName: String, state: DataItem) =
+        FlowPoll.PollKey(flowName, Bstr(noopCipher.encrypt(Cbor.encode(state))))
+
+    @Test
+    fun acrossNodes() = runBlocking {
+        val storage = InMemoryStorage()
+        val nodeA = FlowNotificationsLocalPoll(
+            noopCipher,
+            bus = FlowNotificationBusStorage(storage, pollInterval = 10.milliseconds)
+        )
+        val nodeB = FlowNotificationsLocalPoll(
+            noopCipher,
+            bus = FlowNotificationBusStorage(storage, pollInterval = 10.milliseconds)
+        )
+        val relayA = launch { nodeA.relay() }
+        val relayB = launch { nodeB.relay() }
+        delay(50.milliseconds)
+
+        // Emitted on A, polled on B.
+        val pollB = async { nodeB.poll("", listOf(pollKey("flow", Tstr("a")))) }
+        nodeA.emit("flow", Tstr("a"), Tstr("hello"))
+        val result = withTimeoutOrNull(5.seconds) { pollB.await() }!!
+        Assert.assertEquals(Tstr("hello"), result.notification)
+
+        // Consumed on B, gone on A as well.
+        val waitingB = withTimeoutOrNull(100.milliseconds) {
+            nodeB.poll(result.consumeToken, listOf(pollKey("flow", Tstr("a"))))
+        }
+        Assert.assertNull(waitingB)
+        val waitingA = withTimeoutOrNull(100.milliseconds) {
+            nodeA.poll("", listOf(pollKey("flow", Tstr("a"))))
+        }
+        Assert.assertNull(waitingA)
+
+        // The messages are read again on every poll while they are within the clock skew
+        // window, but only delivered once, so the notification doesn't come back on B.
+        delay(100.milliseconds)
+        val waitingAgainB = withTimeoutOrNull(100.milliseconds) {
+            nodeB.poll("", listOf(pollKey("flow", Tstr("a"))))
+        }
+        Assert.assertNull(waitingAgainB)
+
+        relayA.cancel()
+        relayB.cancel()
+    }
+
+    @Test
+    fun deliversEachMessageOnce() = runBlocking {
+        val storage = InMemoryStorage()
+        val bus = FlowNotificationBusStorage(storage, pollInterval = 10.milliseconds)
+        val received = Channel<String>(Channel.UNLIMITED)
+        bus.publish("before".encodeToByteArray())
+        delay(10.milliseconds)
+        val subscriber = launch {
+            bus.subscribe { received.send(it.decodeToString()) }
+        }
+        delay(300.milliseconds)
+
+        for (n in 0 until 3) {
+            bus.publish("message$n".encodeToByteArray())
+        }
+        // A message from a node whose clock is behind, published with a time the subscriber
+        // has already read past but still within maxClockSkew.
+        val skewedTime = Clock.System.now() - 200.milliseconds
+        storage.insert(
+            "NotificationBus",
+            "",
+            ByteString("skewed".encodeToByteArray()),
+            skewedTime.toEpochMilliseconds().toString().padStart(15, '0') + "-skewed"
+        )
+        delay(200.milliseconds)
+        subscriber.cancel()
+
+        // Messages published before subscribing aren't delivered.
+        val messages = mutableListOf<String>()
+        while (true) {
+            messages.add(received.tryReceive().getOrNull() ?: break)
+        }
+        Assert.assertEquals(
+            listOf("message0", "message1", "message2", "skewed").sorted(),
+            messages.sorted()
+        )
+
+        // Keys start with the time of publication, so they are ordered by it.
+        val keys = storage.enumerate("NotificationBus", "")
+        Assert.assertEquals(5, keys.size)
+        val keyByMessage = keys.associateBy { key ->
+            storage.get("NotificationBus", "", key)!!.toByteArray().decodeToString()
+        }
+        val publishedKeys = listOf("before", "message0", "message1", "message2").map { message ->
+            keyByMessage[message]!!
+        }
+        for (key in publishedKeys) {
+            Assert.assertTrue(key, Regex("[0-9]{15}-[0-9a-f]{24}").matches(key))
+        }
+        val publishedTimes = publishedKeys.map { key -> key.substring(0, 15).toLong() }
+        Assert.assertEquals(publishedTimes.sorted(), publishedTimes)
+        Assert.assertTrue(publishedKeys[0] < publishedKeys[1])
+    }
+
+    @Test
+    fun cleanup() = runBlocking {
+        val storage = InMemoryStorage()
+        val bus = FlowNotificationBusStorage(
+            storage,
+            pollInterval = 10.milliseconds,
+            maxClockSkew = 50.milliseconds,
+            retention = 200.milliseconds
+        )
+        val subscriber = launch { bus.subscribe { } }
+        bus.publish("old".encodeToByteArray())
+        Assert.assertEquals(1, storage.enumerate("NotificationBus", "").size)
+
+        // Removed once older than the retention time.
+        delay(500.milliseconds)
+        bus.publish("new".encodeToByteArray())
+        val keys = storage.enumerate("NotificationBus", "")
+        Assert.assertEquals(1, keys.size)
+        Assert.assertEquals(
+            "new",
+            storage.get("NotificationBus", "", keys[0])!!.toByteArray().decodeToString()
+        )
+
+        subscriber.cancel()
+    }
+}
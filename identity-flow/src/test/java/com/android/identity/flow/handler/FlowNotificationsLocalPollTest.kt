@@ -0,0 +1,132 @@
+package com.android.identity.flow.handler
+
+import com.android.identity.cbor.Bstr
+import com.android.identity.cbor.Cbor
+import com.android.identity.cbor.DataItem
+import com.android.identity.cbor.Tstr
+import com.android.identity.flow.server.FlowEnvironment
+import kotlinx.coroutines.async
+import kotlinx.coroutines.channels.Channel
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.flow.MutableSharedFlow
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.runBlocking
+import kotlinx.coroutines.withTimeoutOrNull
+import org.junit.Assert
+import org.junit.Test
+import kotlin.time.Duration.Companion.milliseconds
+import kotlin.time.Duration.Companion.seconds
+
+class FlowNotificationsLocalPollTest {
+    private val noopCipher = object : SimpleCipher {
+        override fun encrypt(plaintext: ByteArray): ByteArray = plaintext
+        override fun decrypt(ciphertext: ByteArray): ByteArray = ciphertext
+    }
+
+    // Delivers messages to all subscribers in this process.
+    private class InMemoryBus : FlowNotificationBus {
+        private val messages = MutableSharedFlow<ByteArray>(extraBufferCapacity = 100)
+
+        override suspend fun publish(message: ByteArray) {
+            messages.emit(message)
+        }
+
+        override suspend fun subscribe(onMessage: suspend (ByteArray) -> Unit) {
+            messages.collect { onMessage(it) }
+        }
+    }
+
+    private fun pollKey(flowName: String, state: DataItem) =
+        FlowPoll.PollKey(flowName, Bstr(noopCipher.encrypt(Cbor.encode(state))))
+
+    @Test
+    fun pendingNotification() = runBlocking {
+        val hub = FlowNotificationsLocalPoll(noopCipher)
+        hub.emit("flow", Tstr("b"), Tstr("hello"))
+        val result = hub.poll("", listOf(pollKey("flow", Tstr("a")), pollKey("flow", Tstr("b"))))
+        Assert.assertEquals(1, result.index)
+        Assert.assertEquals(Tstr("hello"), result.notification)
+
+        // Not consumed yet, so returned again.
+        val again = hub.poll("", listOf(pollKey("flow", Tstr("b"))))
+        Assert.assertEquals(Tstr("hello"), again.notification)
+
+        // Once consumed it's gone.
+        val waiting = withTimeoutOrNull(100.milliseconds) {
+            hub.poll(again.consumeToken, listOf(pollKey("flow", Tstr("b"))))
+        }
+        Assert.assertNull(waiting)
+    }
+
+    @Test
+    fun onlyMatchingWaitersWake() = runBlocking {
+        // A single shard, so that both waiters share it.
+        val hub = FlowNotificationsLocalPoll(noopCipher, numShards = 1)
+        val pollA = async { hub.poll("", listOf(pollKey("flow", Tstr("a")))) }
+        val pollB = async { hub.poll("", listOf(pollKey("flow", Tstr("b")))) }
+        delay(50.milliseconds)
+
+        hub.emit("flow", Tstr("a"), Tstr("for a"))
+        Assert.assertEquals(Tstr("for a"), withTimeoutOrNull(5.seconds) { pollA.await() }!!.notification)
+        delay(50.milliseconds)
+        Assert.assertTrue(pollB.isActive)
+
+        hub.emit("other", Tstr("b"), Tstr("for other"))
+        delay(50.milliseconds)
+        Assert.assertTrue(pollB.isActive)
+
+        hub.emit("flow", Tstr("b"), Tstr("for b"))
+        Assert.assertEquals(Tstr("for b"), withTimeoutOrNull(5.seconds) { pollB.await() }!!.notification)
+    }
+
+    @Test
+    fun push() = runBlocking {
+        val hub = FlowNotificationsLocalPoll(noopCipher)
+        val handler = HttpHandler(FlowDispatcherLocal.Builder().build(
+            FlowEnvironment.EMPTY,
+            noopCipher,
+            FlowExceptionMap.Builder().build()
+        ), hub)
+        val received = Channel<DataItem>(Channel.UNLIMITED)
+        val job = launch {
+            FlowPollHttp(handler, usePush = true).stream("", listOf(pollKey("flow", Tstr("a")))) {
+                received.send(it.notification)
+            }
+        }
+        hub.emit("flow", Tstr("a"), Tstr("first"))
+        Assert.assertEquals(Tstr("first"), withTimeoutOrNull(5.seconds) { received.receive() })
+        // Receiving the first notification consumed it, so only the second one is sent next.
+        hub.emit("flow", Tstr("a"), Tstr("second"))
+        Assert.assertEquals(Tstr("second"), withTimeoutOrNull(5.seconds) { received.receive() })
+        job.cancel()
+    }
+
+    @Test
+    fun acrossNodes() = runBlocking {
+        val bus = InMemoryBus()
+        val nodeA = FlowNotificationsLocalPoll(noopCipher, bus = bus)
+        val nodeB = FlowNotificationsLocalPoll(noopCipher, bus = bus)
+        val relayA = launch { nodeA.relay() }
+        val relayB = launch { nodeB.relay() }
+        delay(50.milliseconds)
+
+        // Emitted on A, polled on B.
+        val pollB = async { nodeB.poll("", listOf(pollKey("flow", Tstr("a")))) }
+        nodeA.emit("flow", Tstr("a"), Tstr("hello"))
+        val result = withTimeoutOrNull(5.seconds) { pollB.await() }!!
+        Assert.assertEquals(Tstr("hello"), result.notification)
+
+        // Consumed on B, gone on A as well.
+        val waitingB = withTimeoutOrNull(100.milliseconds) {
+            nodeB.poll(result.consumeToken, listOf(pollKey("flow", Tstr("a"))))
+        }
+        Assert.assertNull(waitingB)
+        val waitingA = withTimeoutOrNull(100.milliseconds) {
+            nodeA.poll("", listOf(pollKey("flow", Tstr("a"))))
+        }
+        Assert.assertNull(waitingA)
+
+        relayA.cancel()
+        relayB.cancel()
+    }
+}
@@ -32,8 +32,29 @@ class WalletServerSettings(private val conf: Configuration) {
     val databasePassword: String?
         get() = getString("databasePassword")
 
+    val databaseConnectionPoolSize: Int?
+        get() = getInt("databaseConnectionPoolSize")
+
+    // "storage" to pass notifications between the nodes of the server through the database.
+    val notificationBus: String?
+        get() = getString("notificationBus")
+
+    // "opentelemetry" to export tracing spans and counters through OpenTelemetry, see
+    // com.android.identity.util.Tracing.
+    val tracing: String?
+        get() = getString("tracing")
+
     fun getString(key: String) = conf.getValue(key)
 
+    fun getInt(key: String): Int? {
+        val value = conf.getValue(key) ?: return null
+        val intValue = value.toIntOrNull()
+        if (intValue == null) {
+            Logger.d(TAG, "getInt: Unexpected value '$value' with key $key")
+        }
+        return intValue
+    }
+
     fun getBool(name: String, defaultValue: Boolean = false): Boolean {
         val value = conf.getValue(name)
         if (value == null) {
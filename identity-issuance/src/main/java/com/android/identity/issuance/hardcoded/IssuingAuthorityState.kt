@@ -47,7 +47,6 @@ import com.android.identity.issuance.evidence.EvidenceResponseIcaoPassiveAuthent
 import com.android.identity.issuance.evidence.EvidenceResponseQuestionMultipleChoice
 import com.android.identity.issuance.proofing.defaultCredentialConfiguration
 import com.android.identity.mdoc.mso.MobileSecurityObjectGenerator
-import com.android.identity.mdoc.mso.StaticAuthDataGenerator
 import com.android.identity.mdoc.util.MdocUtil
 import com.android.identity.mrtd.MrtdNfcData
 import com.android.identity.mrtd.MrtdNfcDataDecoder
@@ -250,22 +249,27 @@ class IssuingAuthorityState(
         val now = Clock.System.now()
 
         val issuerDocument = loadIssuerDocument(env, state.documentId)
+        val authenticationKeys = mutableListOf<EcPublicKey>()
         for (request in state.credentialRequests) {
-            // Skip if we already have a request for the authentication key
-            if (hasCpoRequestForAuthenticationKey(issuerDocument,
-                    request.secureAreaBoundKeyAttestation.publicKey)) {
+            // Skip if we already have a request for the authentication key, including one
+            // earlier in this batch.
+            val authenticationKey = request.secureAreaBoundKeyAttestation.publicKey
+            if (hasCpoRequestForAuthenticationKey(issuerDocument, authenticationKey) ||
+                authenticationKeys.contains(authenticationKey)) {
                 continue
             }
-            val authenticationKey = request.secureAreaBoundKeyAttestation.publicKey
-            val presentationData = createPresentationData(
-                env,
-                issuerDocument.documentConfiguration!!,
-                authenticationKey
-            )
+            authenticationKeys.add(authenticationKey)
+        }
+        val presentationData = createPresentationData(
+            env,
+            issuerDocument.documentConfiguration!!,
+            authenticationKeys
+        )
+        for ((authenticationKey, data) in authenticationKeys.zip(presentationData)) {
             val simpleCredentialRequest = SimpleCredentialRequest(
                 authenticationKey,
                 CredentialFormat.MDOC_MSO,
-                presentationData,
+                data,
             )
             issuerDocument.simpleCredentialRequests.add(simpleCredentialRequest)
         }
@@ -384,11 +388,16 @@ class IssuingAuthorityState(
         updateIssuerDocument(env, documentId, issuerDocument, true)
     }
 
-    private fun createPresentationData(
+    // Creates the issuer-provided data for each of the authentication keys, in one pass
+    // since this is where most of the time goes when issuing many credentials.
+    private suspend fun createPresentationData(
         env: FlowEnvironment,
         documentConfiguration: DocumentConfiguration,
-        authenticationKey: EcPublicKey
-    ): ByteArray {
+        authenticationKeys: List<EcPublicKey>
+    ): List<ByteArray> {
+        if (authenticationKeys.isEmpty()) {
+            return listOf()
+        }
         val now = Clock.System.now()
 
         val settings = WalletServerSettings(env.getInterface(Configuration::class)!!)
@@ -400,29 +409,17 @@ class IssuingAuthorityState(
         val validFrom = now
         val validUntil = Instant.fromEpochMilliseconds(validFrom.toEpochMilliseconds() + 365*24*3600*1000L)
 
-        // Generate an MSO and issuer-signed data for this authentication key.
+        // Generate issuer-signed data for all authentication keys.
         val docType = if (type == TYPE_EU_PID) EUPID_DOCTYPE else MDL_DOCTYPE
-        val msoGenerator = MobileSecurityObjectGenerator(
-            "SHA-256",
-            docType,
-            authenticationKey
-        )
-        msoGenerator.setValidityInfo(timeSigned, validFrom, validUntil, null)
         val randomProvider = Random.Default
-        val issuerNameSpaces = MdocUtil.generateIssuerNameSpaces(
+        val issuerSignedData = MdocUtil.generateIssuerSignedData(
             documentConfiguration.mdocConfiguration!!.staticData,
+            authenticationKeys.size,
             randomProvider,
             16,
-            null
+            null,
+            Algorithm.SHA256
         )
-        for (nameSpaceName in issuerNameSpaces.keys) {
-            val digests = MdocUtil.calculateDigestsForNameSpace(
-                nameSpaceName,
-                issuerNameSpaces,
-                Algorithm.SHA256
-            )
-            msoGenerator.addDigestIdsForNamespace(nameSpaceName, digests)
-        }
 
         val resources = env.getInterface(Resources::class)!!
         val documentSigningKeyCert = X509Cert.fromPem(
@@ -431,9 +428,6 @@ class IssuingAuthorityState(
             resources.getStringResource("ds_private_key.pem")!!,
             documentSigningKeyCert.ecPublicKey
         )
-
-        val mso = msoGenerator.generate()
-        val taggedEncodedMso = Cbor.encode(Tagged(Tagged.ENCODED_CBOR, Bstr(mso)))
         val protectedHeaders = mapOf<CoseLabel, DataItem>(Pair(
             CoseNumberLabel(Cose.COSE_LABEL_ALG),
             Algorithm.ES256.coseAlgorithmIdentifier.toDataItem()
@@ -444,23 +438,34 @@ class IssuingAuthorityState(
                 X509Cert(documentSigningKeyCert.encodedCertificate))
             ).toDataItem()
         ))
-        val encodedIssuerAuth = Cbor.encode(
-            Cose.coseSign1Sign(
-                documentSigningKey,
-                taggedEncodedMso,
-                true,
-                Algorithm.ES256,
-                protectedHeaders,
-                unprotectedHeaders
-            ).toDataItem()
-        )
 
-        val issuerProvidedAuthenticationData = StaticAuthDataGenerator(
-            issuerNameSpaces,
-            encodedIssuerAuth
-        ).generate()
+        return authenticationKeys.zip(issuerSignedData) { authenticationKey, data ->
+            // Generate an MSO for this authentication key.
+            val msoGenerator = MobileSecurityObjectGenerator(
+                "SHA-256",
+                docType,
+                authenticationKey
+            )
+            msoGenerator.setValidityInfo(timeSigned, validFrom, validUntil, null)
+            for ((nameSpaceName, digests) in data.digests) {
+                msoGenerator.addDigestIdsForNamespace(nameSpaceName, digests)
+            }
+
+            val mso = msoGenerator.generate()
+            val taggedEncodedMso = Cbor.encode(Tagged(Tagged.ENCODED_CBOR, Bstr(mso)))
+            val encodedIssuerAuth = Cbor.encode(
+                Cose.coseSign1Sign(
+                    documentSigningKey,
+                    taggedEncodedMso,
+                    true,
+                    Algorithm.ES256,
+                    protectedHeaders,
+                    unprotectedHeaders
+                ).toDataItem()
+            )
 
-        return issuerProvidedAuthenticationData
+            data.generateStaticAuthData(encodedIssuerAuth)
+        }
     }
 
     private suspend fun generateDocumentConfiguration(
@@ -31,6 +31,8 @@ kotlin {
                 implementation(project(":identity"))
                 implementation(libs.kotlinx.datetime)
                 implementation(libs.kotlinx.io.bytestring)
+                implementation(libs.kotlinx.io.core)
+                implementation(libs.kotlinx.coroutines.core)
             }
         }
 
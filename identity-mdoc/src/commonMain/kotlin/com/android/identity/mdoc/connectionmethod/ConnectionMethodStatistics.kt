@@ -0,0 +1,314 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.android.identity.mdoc.connectionmethod
+
+import com.android.identity.cbor.Cbor
+import com.android.identity.cbor.CborMap
+import com.android.identity.cbor.DataItem
+import com.android.identity.storage.StorageEngine
+import com.android.identity.util.Logger
+import kotlinx.datetime.Clock
+
+/**
+ * Measured performance of connection methods, used for ordering them at engagement time.
+ *
+ * For every connection method the time it took to set up a connection, the number of
+ * failed connection attempts and the throughput of transfers over established connections
+ * are recorded. Statistics are kept both across all peers and, when a peer identifier is
+ * given, for individual peers. The latter is useful for example for a holder using the same
+ * reader repeatedly, where the reader can be identified by its reader authentication
+ * certificate.
+ *
+ * The statistics are persisted in [storageEngine] and used by [rank] to put the methods
+ * expected to be fastest first, e.g. before passing them to
+ * [com.android.identity.mdoc.engagement.EngagementGenerator.addConnectionMethods].
+ *
+ * Connection methods are identified by their type and, for BLE, the mode. Statistics should
+ * be recorded for the method actually used, e.g. BLE central client mode, while [rank]
+ * accepts methods offering several modes and uses the best of them.
+ *
+ * This class is not thread-safe.
+ *
+ * @param storageEngine the [StorageEngine] to persist statistics in.
+ * @param typicalMessageSize the message size, in bytes, used for estimating how long a
+ *   transaction takes using a given connection method.
+ * @param maxPeers the maximum number of peers to keep statistics for. Statistics for the
+ *   least recently used peer are dropped when this is exceeded.
+ * @param clock the clock used for tracking when peers were last used.
+ */
+class ConnectionMethodStatistics(
+    private val storageEngine: StorageEngine,
+    private val typicalMessageSize: Long = DEFAULT_TYPICAL_MESSAGE_SIZE,
+    private val maxPeers: Int = DEFAULT_MAX_PEERS,
+    private val clock: Clock = Clock.System
+) {
+    /**
+     * Statistics for a connection method.
+     *
+     * @param numConnections the number of successfully established connections.
+     * @param numFailures the number of connection attempts which failed.
+     * @param setupMillis the average time to establish a connection, in milliseconds, or 0
+     *   if no connection has been established.
+     * @param bytesPerSecond the average transfer throughput or 0 if no transfer has been
+     *   recorded.
+     */
+    data class Entry(
+        val numConnections: Long,
+        val numFailures: Long,
+        val setupMillis: Long,
+        val bytesPerSecond: Long
+    ) {
+        internal fun toDataItem(): DataItem =
+            CborMap.builder()
+                .put("numConnections", numConnections)
+                .put("numFailures", numFailures)
+                .put("setupMillis", setupMillis)
+                .put("bytesPerSecond", bytesPerSecond)
+                .end()
+                .build()
+
+        internal companion object {
+            val EMPTY = Entry(0, 0, 0, 0)
+
+            fun fromDataItem(dataItem: DataItem): Entry =
+                Entry(
+                    dataItem["numConnections"].asNumber,
+                    dataItem["numFailures"].asNumber,
+                    dataItem["setupMillis"].asNumber,
+                    dataItem["bytesPerSecond"].asNumber
+                )
+        }
+    }
+
+    private class Peer(
+        var lastUsedMillis: Long,
+        val methods: MutableMap<String, Entry>
+    )
+
+    // Keyed by peer identifier, with GLOBAL_PEER for the statistics across all peers.
+    private val peers: MutableMap<String, Peer> by lazy { load() }
+
+    /**
+     * Records that a connection was established.
+     *
+     * @param connectionMethod the connection method used.
+     * @param peer an identifier for the remote device or `null` if not known.
+     * @param setupMillis the time it took to establish the connection, in milliseconds.
+     */
+    fun recordConnection(connectionMethod: ConnectionMethod, peer: String?, setupMillis: Long) {
+        require(setupMillis >= 0) { "setupMillis cannot be negative" }
+        update(connectionMethod, peer) { entry ->
+            entry.copy(
+                numConnections = entry.numConnections + 1,
+                setupMillis = average(entry.setupMillis, entry.numConnections, setupMillis)
+            )
+        }
+    }
+
+    /**
+     * Records that a connection attempt failed.
+     *
+     * @param connectionMethod the connection method used.
+     * @param peer an identifier for the remote device or `null` if not known.
+     */
+    fun recordFailure(connectionMethod: ConnectionMethod, peer: String?) {
+        update(connectionMethod, peer) { entry ->
+            entry.copy(numFailures = entry.numFailures + 1)
+        }
+    }
+
+    /**
+     * Records a transfer over an established connection.
+     *
+     * @param connectionMethod the connection method used.
+     * @param peer an identifier for the remote device or `null` if not known.
+     * @param numBytes the number of bytes transferred.
+     * @param durationMillis how long the transfer took, in milliseconds.
+     */
+    fun recordTransfer(
+        connectionMethod: ConnectionMethod,
+        peer: String?,
+        numBytes: Long,
+        durationMillis: Long
+    ) {
+        require(numBytes >= 0) { "numBytes cannot be negative" }
+        require(durationMillis >= 0) { "durationMillis cannot be negative" }
+        val bytesPerSecond = numBytes * 1000 / maxOf(durationMillis, 1)
+        update(connectionMethod, peer) { entry ->
+            val numTransfers = if (entry.bytesPerSecond == 0L) 0L else 1L
+            entry.copy(
+                bytesPerSecond = average(entry.bytesPerSecond, numTransfers, bytesPerSecond)
+            )
+        }
+    }
+
+    /**
+     * Gets the statistics for a connection method.
+     *
+     * @param connectionMethod the connection method.
+     * @param peer an identifier for the remote device or `null` to get the statistics across
+     *   all peers.
+     * @return the statistics or `null` if nothing has been recorded.
+     */
+    fun getStatistics(connectionMethod: ConnectionMethod, peer: String? = null): Entry? =
+        peers[peer ?: GLOBAL_PEER]?.methods?.get(keyFor(connectionMethod))
+
+    /**
+     * Orders connection methods by how fast they're expected to be.
+     *
+     * Methods are compared by the estimated time for connecting and transferring a message of
+     * `typicalMessageSize` bytes, scaled by the rate of failed connection attempts. The
+     * statistics for [peer] are used if available, otherwise those across all peers.
+     *
+     * Methods without any statistics keep their position in the list, only the methods with
+     * statistics are reordered among themselves. This way the order chosen by the
+     * application is used until there is data to improve on it.
+     *
+     * @param connectionMethods the connection methods to order.
+     * @param peer an identifier for the remote device or `null` if not known.
+     * @return the methods in [connectionMethods], fastest first.
+     */
+    fun rank(connectionMethods: List<ConnectionMethod>, peer: String? = null): List<ConnectionMethod> {
+        val estimates = connectionMethods.map { estimateMillis(it, peer) }
+        val measured = connectionMethods.indices
+            .filter { estimates[it] != null }
+            .sortedBy { estimates[it]!! }
+            .map { connectionMethods[it] }
+            .iterator()
+        return connectionMethods.mapIndexed { n, connectionMethod ->
+            if (estimates[n] != null) measured.next() else connectionMethod
+        }
+    }
+
+    /**
+     * Deletes all statistics.
+     */
+    fun clear() {
+        peers.clear()
+        storageEngine.delete(STORAGE_KEY)
+    }
+
+    private fun estimateMillis(connectionMethod: ConnectionMethod, peer: String?): Double? {
+        // Transports record statistics for the specific method used, e.g. BLE central
+        // client mode, so for a method offering several options use the best one.
+        val methods = ConnectionMethod.disambiguate(listOf(connectionMethod))
+        return methods.mapNotNull { method ->
+            val entry = peer?.let { getStatistics(method, it) } ?: getStatistics(method)
+            entry?.let { estimateMillis(it) }
+        }.minOrNull()
+    }
+
+    private fun estimateMillis(entry: Entry): Double {
+        // A method which never connected is worse than all methods which did.
+        if (entry.numConnections == 0L) {
+            return Double.MAX_VALUE
+        }
+        var estimate = entry.setupMillis.toDouble()
+        if (entry.bytesPerSecond > 0) {
+            estimate += typicalMessageSize * 1000.0 / entry.bytesPerSecond
+        }
+        val successRate = entry.numConnections.toDouble() /
+                (entry.numConnections + entry.numFailures)
+        return estimate / successRate
+    }
+
+    private fun update(connectionMethod: ConnectionMethod, peer: String?, block: (Entry) -> Entry) {
+        val key = keyFor(connectionMethod)
+        val now = clock.now().toEpochMilliseconds()
+        for (peerKey in listOfNotNull(GLOBAL_PEER, peer)) {
+            val p = peers.getOrPut(peerKey) { Peer(now, mutableMapOf()) }
+            p.lastUsedMillis = now
+            p.methods[key] = block(p.methods[key] ?: Entry.EMPTY)
+        }
+        while (peers.size > maxPeers + 1) {
+            val oldest = peers.entries
+                .filter { it.key != GLOBAL_PEER }
+                .minBy { it.value.lastUsedMillis }
+            peers.remove(oldest.key)
+        }
+        save()
+    }
+
+    private fun load(): MutableMap<String, Peer> {
+        val result = mutableMapOf<String, Peer>()
+        val data = storageEngine[STORAGE_KEY] ?: return result
+        try {
+            for ((peerKey, peerDataItem) in Cbor.decode(data).asMap) {
+                val methods = mutableMapOf<String, Entry>()
+                for ((methodKey, entryDataItem) in peerDataItem["methods"].asMap) {
+                    methods[methodKey.asTstr] = Entry.fromDataItem(entryDataItem)
+                }
+                result[peerKey.asTstr] = Peer(peerDataItem["lastUsed"].asNumber, methods)
+            }
+        } catch (e: Exception) {
+            Logger.w(TAG, "Error decoding stored statistics, starting over", e)
+            result.clear()
+        }
+        return result
+    }
+
+    private fun save() {
+        val builder = CborMap.builder()
+        for ((peerKey, peer) in peers) {
+            val methodsBuilder = CborMap.builder()
+            for ((methodKey, entry) in peer.methods) {
+                methodsBuilder.put(methodKey, entry.toDataItem())
+            }
+            builder.putMap(peerKey)
+                .put("lastUsed", peer.lastUsedMillis)
+                .put("methods", methodsBuilder.end().build())
+                .end()
+        }
+        storageEngine.put(STORAGE_KEY, Cbor.encode(builder.end().build()))
+    }
+
+    companion object {
+        private const val TAG = "ConnectionMethodStatistics"
+        private const val STORAGE_KEY = "IC_ConnectionMethodStatistics"
+        private const val GLOBAL_PEER = ""
+
+        /** The default for `typicalMessageSize`, a response with a portrait. */
+        const val DEFAULT_TYPICAL_MESSAGE_SIZE = 64L * 1024
+
+        /** The default for `maxPeers`. */
+        const val DEFAULT_MAX_PEERS = 32
+
+        // Exponentially weighted moving average, this way recent measurements count more
+        // than old ones, e.g. if the environment changes.
+        private fun average(current: Long, numSamples: Long, sample: Long): Long =
+            if (numSamples == 0L) sample else (current * 3 + sample) / 4
+
+        /**
+         * Gets the key used for identifying a connection method in the statistics.
+         *
+         * The key identifies the kind of connection method rather than a specific address,
+         * since addresses such as BLE UUIDs are typically ephemeral.
+         */
+        internal fun keyFor(connectionMethod: ConnectionMethod): String =
+            when (connectionMethod) {
+                is ConnectionMethodBle -> when {
+                    connectionMethod.supportsCentralClientMode &&
+                            connectionMethod.supportsPeripheralServerMode -> "ble"
+                    connectionMethod.supportsCentralClientMode -> "ble_central_client"
+                    else -> "ble_peripheral_server"
+                }
+                is ConnectionMethodNfc -> "nfc"
+                is ConnectionMethodWifiAware -> "wifi_aware"
+                is ConnectionMethodHttp -> "http"
+                else -> connectionMethod::class.simpleName ?: "unknown"
+            }
+    }
+}
@@ -22,6 +22,7 @@ import com.android.identity.cbor.CborBuilder
 import com.android.identity.cbor.CborMap
 import com.android.identity.crypto.EcPublicKey
 import com.android.identity.mdoc.connectionmethod.ConnectionMethod
+import com.android.identity.mdoc.connectionmethod.ConnectionMethodStatistics
 import com.android.identity.mdoc.origininfo.OriginInfo
 
 /**
@@ -52,6 +53,24 @@ class EngagementGenerator(
         return this
     }
 
+    /**
+     * Adds connection methods to the engagement, ordered by measured performance.
+     *
+     * This is like [addConnectionMethods] except that the connection methods are first
+     * ordered using [ConnectionMethodStatistics.rank] so the methods expected to be the
+     * fastest are listed first.
+     *
+     * @param connectionMethods A list with instances derived from [ConnectionMethod].
+     * @param statistics the statistics to use for ordering the methods.
+     * @param peer an identifier for the remote device or `null` if not known.
+     * @return the generator.
+     */
+    fun addConnectionMethods(
+        connectionMethods: List<ConnectionMethod>,
+        statistics: ConnectionMethodStatistics,
+        peer: String? = null
+    ): EngagementGenerator = addConnectionMethods(statistics.rank(connectionMethods, peer))
+
     /**
      * Adds origin infos to the engagement.
      *
@@ -15,7 +15,6 @@
  */
 package com.android.identity.mdoc.mso
 
-import com.android.identity.cbor.Cbor
 import com.android.identity.cbor.CborBuilder
 import com.android.identity.cbor.CborMap
 import com.android.identity.cbor.toDataItemDateTimeString
@@ -270,7 +269,6 @@ class MobileSecurityObjectGenerator(
             put("valueDigests", mValueDigestsOuter.end().build())
             put("deviceKeyInfo", generateDeviceKeyBuilder().build())
             put("validityInfo", generateValidityInfoBuilder().build())
-            end()
-            Cbor.encode(end().build())
+            end().encode()
         }
 }
@@ -15,8 +15,8 @@
  */
 package com.android.identity.mdoc.mso
 
-import com.android.identity.cbor.Cbor
 import com.android.identity.cbor.CborArray
+import com.android.identity.cbor.CborReader
 import com.android.identity.cbor.DataItem
 import com.android.identity.crypto.EcPublicKey
 import kotlinx.datetime.Instant
@@ -139,17 +139,17 @@ class MobileSecurityObjectParser(
         val deviceKeyInfo: Map<Long, ByteArray>?
             get() = _deviceKeyInfo
 
-        private fun parseValueDigests(valueDigests: DataItem) {
+        private fun parseValueDigests(reader: CborReader) {
             this.valueDigests = HashMap()
-            for (namespaceDataItem in valueDigests.asMap.keys) {
-                val namespace = namespaceDataItem.asTstr
-                val digestIDsDataItem = valueDigests.asMap[namespaceDataItem]
+            reader.readMapWithTstrKeys { namespace ->
                 val digestIDs: MutableMap<Long, ByteArray> = HashMap()
-                for (digestIDDataItem in digestIDsDataItem!!.asMap.keys) {
-                    val digestID = digestIDDataItem.asNumber
-                    digestIDs[digestID] = digestIDsDataItem[digestID].asBstr
+                val numPairs = readMapLength()
+                    ?: throw IllegalArgumentException("Indefinite length DigestIDs not supported")
+                for (n in 0 until numPairs) {
+                    val digestID = readNumber()
+                    digestIDs[digestID] = readBstr()
                 }
-                this.valueDigests[namespace] = digestIDs
+                valueDigests[namespace] = digestIDs
             }
         }
 
@@ -217,23 +217,54 @@ class MobileSecurityObjectParser(
         }
 
         fun parse(encodedMobileSecurityObject: ByteArray) {
-            val mso = Cbor.decode(encodedMobileSecurityObject)
-            version = mso["version"].asTstr
+            // Walk the top-level map directly instead of decoding the whole MSO since the
+            // ValueDigests map is by far the largest part and we don't need a tree for it.
+            var versionValue: String? = null
+            var digestAlgorithmValue: String? = null
+            var docTypeValue: String? = null
+            var hasValueDigests = false
+            var deviceKeyInfo: DataItem? = null
+            var validityInfo: DataItem? = null
+            val reader = CborReader(encodedMobileSecurityObject)
+            reader.readMapWithTstrKeys { key ->
+                when (key) {
+                    "version" -> versionValue = readTstr()
+                    "digestAlgorithm" -> digestAlgorithmValue = readTstr()
+                    "docType" -> docTypeValue = readTstr()
+                    "valueDigests" -> {
+                        parseValueDigests(this)
+                        hasValueDigests = true
+                    }
+                    "deviceKeyInfo" -> deviceKeyInfo = readDataItem()
+                    "validityInfo" -> validityInfo = readDataItem()
+                    else -> skip()
+                }
+            }
+            require(!reader.hasMore) {
+                "${reader.endOffset - reader.offset} bytes leftover after decoding"
+            }
+
+            version = versionValue ?: throw IllegalStateException("Key version doesn't exist in map")
             require(version.compareTo("1.0") >= 0) {
                 "Given version '$version' not >= '1.0'"
             }
 
-            digestAlgorithm = mso["digestAlgorithm"].asTstr
+            digestAlgorithm = digestAlgorithmValue
+                ?: throw IllegalStateException("Key digestAlgorithm doesn't exist in map")
             val allowableDigestAlgorithms: List<String> =
                 mutableListOf("SHA-256", "SHA-384", "SHA-512")
             require(allowableDigestAlgorithms.contains(digestAlgorithm)) {
                 "Given digest algorithm '" + digestAlgorithm +
                         "' one of " + allowableDigestAlgorithms
             }
-            docType = mso["docType"].asTstr
-            parseValueDigests(mso["valueDigests"])
-            parseDeviceKeyInfo(mso["deviceKeyInfo"])
-            parseValidityInfo(mso["validityInfo"])
+            docType = docTypeValue ?: throw IllegalStateException("Key docType doesn't exist in map")
+            check(hasValueDigests) { "Key valueDigests doesn't exist in map" }
+            parseDeviceKeyInfo(
+                deviceKeyInfo ?: throw IllegalStateException("Key deviceKeyInfo doesn't exist in map")
+            )
+            parseValidityInfo(
+                validityInfo ?: throw IllegalStateException("Key validityInfo doesn't exist in map")
+            )
         }
     }
 }
@@ -15,7 +15,6 @@
  */
 package com.android.identity.mdoc.mso
 
-import com.android.identity.cbor.Cbor
 import com.android.identity.cbor.CborMap
 import com.android.identity.cbor.RawCbor
 
@@ -87,12 +86,10 @@ class StaticAuthDataGenerator(
                 }
             }
         }.end().build().let { digestIdMappingItem ->
-            Cbor.encode(
-                CborMap.builder()
-                    .put("digestIdMapping", digestIdMappingItem)
-                    .put("issuerAuth", RawCbor(encodedIssuerAuth))
-                    .end()
-                    .build()
-            )
+            CborMap.builder()
+                .put("digestIdMapping", digestIdMappingItem)
+                .put("issuerAuth", RawCbor(encodedIssuerAuth))
+                .end()
+                .encode()
         }
 }
\ No newline at end of file
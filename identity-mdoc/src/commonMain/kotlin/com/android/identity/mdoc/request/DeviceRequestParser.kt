@@ -18,12 +18,15 @@ package com.android.identity.mdoc.request
 import com.android.identity.cbor.Bstr
 import com.android.identity.cbor.Cbor
 import com.android.identity.cbor.CborArray
+import com.android.identity.cbor.CborReader
 import com.android.identity.cbor.DataItem
+import com.android.identity.cbor.RawCbor
 import com.android.identity.cbor.Tagged
 import com.android.identity.cose.Cose
 import com.android.identity.cose.CoseNumberLabel
 import com.android.identity.crypto.Algorithm
 import com.android.identity.crypto.X509CertChain
+import com.android.identity.util.Tracing
 
 /**
  * Helper class for parsing the bytes of `DeviceRequest`
@@ -77,12 +80,15 @@ class DeviceRequestParser(
      * @throws IllegalStateException    if required data hasn't been set using the setter
      * methods on this class.
      */
-    fun parse(): DeviceRequest = DeviceRequest().apply {
-        parse(
-            encodedDeviceRequest,
-            Cbor.decode(encodedSessionTranscript),
-            skipReaderAuthParseAndCheck
-        )
+    fun parse(): DeviceRequest = Tracing.span("mdoc.request.parse") { span ->
+        span.setAttribute("size", encodedDeviceRequest.size.toLong())
+        DeviceRequest().apply {
+            parse(
+                encodedDeviceRequest,
+                Cbor.decode(encodedSessionTranscript),
+                skipReaderAuthParseAndCheck
+            )
+        }
     }
 
     /**
@@ -109,79 +115,117 @@ class DeviceRequestParser(
             sessionTranscript: DataItem,
             skipReaderAuthParseAndCheck: Boolean
         ) {
-            val request = Cbor.decode(encodedDeviceRequest)
-            version = request["version"].asTstr
+            var versionValue: String? = null
+            val docRequestSlices = mutableListOf<CborReader.Slice>()
+            val reader = CborReader(encodedDeviceRequest)
+            reader.readMapWithTstrKeys { key ->
+                when (key) {
+                    "version" -> versionValue = readTstr()
+                    "docRequests" -> readArray { docRequestSlices.add(readRawSlice()) }
+                    else -> skip()
+                }
+            }
+            require(!reader.hasMore) {
+                "${reader.endOffset - reader.offset} bytes leftover after decoding"
+            }
+            version = versionValue ?: throw IllegalStateException("Key version doesn't exist in map")
             require(version.compareTo("1.0") >= 0) { "Given version '$version' not >= '1.0'" }
             var readerCertChain: X509CertChain? = null
-            request.getOrNull("docRequests")?.let { docRequests ->
-                val docRequestsDataItems = docRequests.asArray
-                for (docRequestDataItem in docRequestsDataItems) {
-                    val itemsRequestBytesDataItem = docRequestDataItem["itemsRequest"]
-                    val itemsRequest = itemsRequestBytesDataItem.asTaggedEncodedCbor
-                    val readerAuth = docRequestDataItem.getOrNull("readerAuth")
-                    var encodedReaderAuth: ByteArray? = null
-                    var readerAuthenticated = false
-                    if (!skipReaderAuthParseAndCheck && readerAuth != null) {
-                        encodedReaderAuth = Cbor.encode(readerAuth)
-                        val readerAuthCoseSign1 = readerAuth.asCoseSign1
-                        val readerCertChainDataItem =
-                            readerAuthCoseSign1.unprotectedHeaders[CoseNumberLabel(Cose.COSE_LABEL_X5CHAIN)]
-                        val signatureAlgorithm = Algorithm.fromInt(
-                            readerAuthCoseSign1.protectedHeaders[
-                                CoseNumberLabel(Cose.COSE_LABEL_ALG)
-                            ]!!.asNumber.toInt()
-                        )
-                        readerCertChain = readerCertChainDataItem!!.asX509CertChain
-                        val readerKey = readerCertChain!!.certificates[0].ecPublicKey
-                        val encodedReaderAuthentication = Cbor.encode(
-                            CborArray.builder()
-                                .add("ReaderAuthentication")
-                                .add(sessionTranscript)
-                                .add(itemsRequestBytesDataItem)
-                                .end()
-                                .build()
-                        )
-                        val readerAuthenticationBytes =
-                            Cbor.encode(Tagged(24, Bstr(encodedReaderAuthentication)))
-                        readerAuthenticated = Cose.coseSign1Check(
-                            readerKey,
-                            readerAuthenticationBytes,
-                            readerAuthCoseSign1,
-                            signatureAlgorithm
-                        )
-                    }
-                    val requestInfo: MutableMap<String, ByteArray> = HashMap()
-                    itemsRequest.getOrNull("requestInfo")?.let { requestInfoDataItem ->
-                        for (keyDataItem in requestInfoDataItem.asMap.keys) {
-                            val key = keyDataItem.asTstr
-                            val encodedValue = Cbor.encode(requestInfoDataItem[keyDataItem])
-                            requestInfo[key] = encodedValue
+            for (docRequestSlice in docRequestSlices) {
+                var itemsRequestBytesSlice: CborReader.Slice? = null
+                var readerAuth: DataItem? = null
+                docRequestSlice.reader().readMapWithTstrKeys { key ->
+                    when (key) {
+                        "itemsRequest" -> itemsRequestBytesSlice = readRawSlice()
+                        "readerAuth" -> if (skipReaderAuthParseAndCheck) {
+                            skip()
+                        } else {
+                            readerAuth = readDataItem()
                         }
+                        else -> skip()
                     }
-                    val docType = itemsRequest["docType"].asTstr
-                    val builder = DocRequest.Builder(
-                        docType,
-                        Cbor.encode(itemsRequest),
-                        requestInfo,
-                        encodedReaderAuth,
-                        readerCertChain,
-                        readerAuthenticated
+                }
+
+                // Use the bytes of ItemsRequestBytes exactly as received, both for
+                // ReaderAuthentication and for the encoded ItemsRequest.
+                val itemsRequestBytes = itemsRequestBytesSlice
+                    ?: throw IllegalStateException("Key itemsRequest doesn't exist in map")
+                val itemsRequestBytesReader = itemsRequestBytes.reader()
+                require(itemsRequestBytesReader.readTag() == Tagged.ENCODED_CBOR) {
+                    "ItemsRequestBytes is not tagged with tag 24"
+                }
+                val encodedItemsRequest = itemsRequestBytesReader.readBstr()
+
+                var encodedReaderAuth: ByteArray? = null
+                var readerAuthenticated = false
+                readerAuth?.let { readerAuthDataItem ->
+                    encodedReaderAuth = Cbor.encode(readerAuthDataItem)
+                    val readerAuthCoseSign1 = readerAuthDataItem.asCoseSign1
+                    val readerCertChainDataItem =
+                        readerAuthCoseSign1.unprotectedHeaders[CoseNumberLabel(Cose.COSE_LABEL_X5CHAIN)]
+                    val signatureAlgorithm = Algorithm.fromInt(
+                        readerAuthCoseSign1.protectedHeaders[
+                            CoseNumberLabel(Cose.COSE_LABEL_ALG)
+                        ]!!.asNumber.toInt()
+                    )
+                    readerCertChain = readerCertChainDataItem!!.asX509CertChain
+                    val readerKey = readerCertChain!!.certificates[0].ecPublicKey
+                    val encodedReaderAuthentication = Cbor.encode(
+                        CborArray.builder()
+                            .add("ReaderAuthentication")
+                            .add(sessionTranscript)
+                            .add(RawCbor(itemsRequestBytes.toByteArray()))
+                            .end()
+                            .build()
+                    )
+                    val readerAuthenticationBytes =
+                        Cbor.encode(Tagged(24, Bstr(encodedReaderAuthentication)))
+                    readerAuthenticated = Cose.coseSign1Check(
+                        readerKey,
+                        readerAuthenticationBytes,
+                        readerAuthCoseSign1,
+                        signatureAlgorithm
                     )
+                }
 
-                    // parse nameSpaces
-                    val nameSpaces = itemsRequest["nameSpaces"]
-                    parseNamespaces(nameSpaces, builder)
-                    _docRequests.add(builder.build())
+                var docTypeValue: String? = null
+                var nameSpacesSlice: CborReader.Slice? = null
+                val requestInfo: MutableMap<String, ByteArray> = HashMap()
+                CborReader(encodedItemsRequest).readMapWithTstrKeys { key ->
+                    when (key) {
+                        "docType" -> docTypeValue = readTstr()
+                        "nameSpaces" -> nameSpacesSlice = readRawSlice()
+                        "requestInfo" -> readMapWithTstrKeys { requestInfoKey ->
+                            requestInfo[requestInfoKey] = readRawSlice().toByteArray()
+                        }
+                        else -> skip()
+                    }
                 }
+                val docType = docTypeValue
+                    ?: throw IllegalStateException("Key docType doesn't exist in map")
+                val builder = DocRequest.Builder(
+                    docType,
+                    encodedItemsRequest,
+                    requestInfo,
+                    encodedReaderAuth,
+                    readerCertChain,
+                    readerAuthenticated
+                )
+
+                // parse nameSpaces
+                parseNamespaces(
+                    nameSpacesSlice
+                        ?: throw IllegalStateException("Key nameSpaces doesn't exist in map"),
+                    builder
+                )
+                _docRequests.add(builder.build())
             }
         }
 
-        private fun parseNamespaces(nameSpaces: DataItem, builder: DocRequest.Builder) {
-            for ((nameSpaceDataItem, itemsMap) in nameSpaces.asMap) {
-                val nameSpace = nameSpaceDataItem.asTstr
-                for ((itemKeyDataItem, itemValDataItem) in itemsMap.asMap) {
-                    val itemKey = itemKeyDataItem.asTstr
-                    val intentToRetain = itemValDataItem.asBoolean
+        private fun parseNamespaces(nameSpaces: CborReader.Slice, builder: DocRequest.Builder) {
+            nameSpaces.reader().readMapWithTstrKeys { nameSpace ->
+                readMapWithTstrKeys { itemKey ->
+                    val intentToRetain = readBoolean()
                     builder.addEntry(nameSpace, itemKey, intentToRetain)
                 }
             }
@@ -21,6 +21,7 @@ import com.android.identity.cbor.CborArray
 import com.android.identity.cbor.CborMap
 import com.android.identity.cbor.RawCbor
 import com.android.identity.cbor.Tagged
+import com.android.identity.util.Tracing
 
 /**
  * Helper class for building `DeviceResponse` [CBOR](http://cbor.io/)
@@ -158,7 +159,7 @@ class DeviceResponseGenerator(private val mStatusCode: Long) {
      *
      * @return the bytes of `DeviceResponse` CBOR.
      */
-    fun generate(): ByteArray =
+    fun generate(): ByteArray = Tracing.span("mdoc.response.generate") { span ->
         CborMap.builder().run {
             put("version", "1.0")
             put("documents", mDocumentsBuilder.end().build())
@@ -169,5 +170,6 @@ class DeviceResponseGenerator(private val mStatusCode: Long) {
             put("status", mStatusCode)
             end()
             Cbor.encode(end().build())
-        }
+        }.also { span.setAttribute("size", it.size.toLong()) }
+    }
 }
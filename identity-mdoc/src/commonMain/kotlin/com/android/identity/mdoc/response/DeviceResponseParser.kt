@@ -18,21 +18,31 @@ package com.android.identity.mdoc.response
 import com.android.identity.cbor.Bstr
 import com.android.identity.cbor.Cbor
 import com.android.identity.cbor.CborArray
+import com.android.identity.cbor.CborReader
 import com.android.identity.cbor.DataItem
+import com.android.identity.cbor.MajorType
 import com.android.identity.cbor.RawCbor
 import com.android.identity.cbor.Tagged
 import com.android.identity.cbor.toDataItem
 import com.android.identity.cose.Cose
 import com.android.identity.cose.CoseNumberLabel
+import com.android.identity.cose.CoseSign1
 import com.android.identity.crypto.Algorithm
 import com.android.identity.crypto.X509CertChain
+import com.android.identity.crypto.X509CertChainCache
 import com.android.identity.crypto.Crypto
 import com.android.identity.crypto.EcPrivateKey
 import com.android.identity.crypto.EcPublicKey
 import com.android.identity.mdoc.mso.MobileSecurityObjectParser
 import com.android.identity.util.Constants
 import com.android.identity.util.Logger
+import com.android.identity.util.Tracing
 import com.android.identity.util.toHex
+import kotlinx.coroutines.CoroutineDispatcher
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.async
+import kotlinx.coroutines.awaitAll
+import kotlinx.coroutines.coroutineScope
 import kotlinx.datetime.Instant
 
 /**
@@ -48,6 +58,7 @@ class DeviceResponseParser(
     val encodedSessionTranscript: ByteArray
 ) {
     private var eReaderKey: EcPrivateKey? = null
+    private var issuerCertificateChainCache: X509CertChainCache? = null
 
     /**
      * Sets the private part of the ephemeral key used in the session where the
@@ -63,6 +74,21 @@ class DeviceResponseParser(
         this.eReaderKey = eReaderKey
     }
 
+    /**
+     * Sets a cache to use for issuer certificate chains.
+     *
+     * If set, issuer certificate chains are looked up in the cache instead of being parsed
+     * for every document. If the cache has a verifier, the result of verifying the chain is
+     * available in [Document.issuerCertificateChainVerified] and repeated verification of the
+     * same chain is avoided. The same cache can be shared between multiple parsers.
+     *
+     * @param cache the cache to use.
+     * @return the `DeviceResponseParser`.
+     */
+    fun setIssuerCertificateChainCache(cache: X509CertChainCache) = apply {
+        this.issuerCertificateChainCache = cache
+    }
+
     /**
      * Parses the device response.
      *
@@ -83,12 +109,67 @@ class DeviceResponseParser(
      * @exception IllegalStateException if required data hasn't been set using the setter
      * methods on this class.
      */
-    fun parse(): DeviceResponse =
-    // mEReaderKey may be omitted if the response is using ECDSA instead of MAC
+    fun parse(): DeviceResponse = Tracing.span("mdoc.response.parse") { span ->
+        span.setAttribute("size", encodedDeviceResponse.size.toLong())
+        // mEReaderKey may be omitted if the response is using ECDSA instead of MAC
         // for device authentication.
         DeviceResponse().apply {
-            parse(encodedDeviceResponse, encodedSessionTranscript, eReaderKey)
+            parse(encodedDeviceResponse, encodedSessionTranscript, eReaderKey, issuerCertificateChainCache)
+        }
+    }
+
+    /**
+     * Parses the device response, verifying documents concurrently.
+     *
+     * This is like [parse] and returns the same result, except that the issuer signature, the
+     * digests of the issuer-signed data elements in each namespace, and the device
+     * authentication of each document are checked concurrently using [dispatcher]. This
+     * is useful for responses with several documents or many data elements.
+     *
+     * @param dispatcher the [CoroutineDispatcher] to run verifications on.
+     * @return a [DeviceResponseParser.DeviceResponse] with the parsed data.
+     * @exception IllegalArgumentException if the given data isn't valid CBOR or not conforming
+     * to the CDDL for its type.
+     * @exception IllegalStateException if required data hasn't been set using the setter
+     * methods on this class.
+     */
+    suspend fun parseConcurrently(
+        dispatcher: CoroutineDispatcher = Dispatchers.Default
+    ): DeviceResponse = Tracing.span("mdoc.response.parse") { span ->
+        span.setAttribute("size", encodedDeviceResponse.size.toLong())
+        DeviceResponse().apply {
+            parseConcurrently(
+                encodedDeviceResponse,
+                encodedSessionTranscript,
+                eReaderKey,
+                issuerCertificateChainCache,
+                dispatcher
+            )
         }
+    }
+
+    companion object {
+        /**
+         * Parses a batch of device responses concurrently.
+         *
+         * Each response is parsed as with [parseConcurrently] and all verifications for
+         * all of the responses run concurrently on [dispatcher].
+         *
+         * @param parsers the parsers for the responses to parse.
+         * @param dispatcher the [CoroutineDispatcher] to run verifications on.
+         * @return the parsed responses, in the same order as [parsers].
+         * @exception IllegalArgumentException if any of the responses isn't valid CBOR or not
+         * conforming to the CDDL for its type.
+         */
+        suspend fun parseBatch(
+            parsers: List<DeviceResponseParser>,
+            dispatcher: CoroutineDispatcher = Dispatchers.Default
+        ): List<DeviceResponse> = coroutineScope {
+            parsers.map { parser ->
+                async(dispatcher) { parser.parseConcurrently(dispatcher) }
+            }.awaitAll()
+        }
+    }
 
 
     /**
@@ -112,49 +193,97 @@ class DeviceResponseParser(
          */
         lateinit var version: String
 
-        // Returns the DeviceKey from the MSO
+        // The parts of a document which have been decoded but not yet verified.
         //
-        private fun parseIssuerSigned(
-            expectedDocType: String,
-            issuerSigned: DataItem,
-            builder: Document.Builder
-        ): EcPublicKey {
-            val issuerAuth = issuerSigned["issuerAuth"].asCoseSign1
+        private class UnverifiedDocument(
+            val docType: String,
+            val issuerAuth: CoseSign1,
+            val issuerCertificateChain: X509CertChain,
+            val documentSigningKey: EcPublicKey,
+            val issuerCertificateChainVerified: Boolean?,
+            val issuerSignatureAlgorithm: Algorithm,
+            val mso: MobileSecurityObjectParser.MobileSecurityObject,
+            val digestAlgorithm: Algorithm,
+            // Namespace name and the encoded IssuerSignedItemBytes in it, in received order.
+            val issuerNameSpaces: List<Pair<String, List<CborReader.Slice>>>,
+            val deviceSigned: DataItem
+        )
+
+        private class IssuerEntry(
+            val nameSpace: String,
+            val name: String,
+            val value: ByteArray,
+            val digestMatch: Boolean
+        )
+
+        private class DeviceSignedResult(
+            val authenticated: Boolean,
+            val authenticatedViaSignature: Boolean,
+            val nameSpaces: DataItem
+        )
+
+        private fun decodeDocument(
+            documentSlice: CborReader.Slice,
+            issuerCertificateChainCache: X509CertChainCache?
+        ): UnverifiedDocument {
+            var docTypeValue: String? = null
+            var issuerSignedSlice: CborReader.Slice? = null
+            var deviceSignedDataItem: DataItem? = null
+            documentSlice.reader().readMapWithTstrKeys { key ->
+                when (key) {
+                    "docType" -> docTypeValue = readTstr()
+                    "issuerSigned" -> issuerSignedSlice = readRawSlice()
+                    // The DeviceSigned data item is lazily decoded so DeviceNameSpacesBytes
+                    // is included in DeviceAuthentication exactly as received.
+                    "deviceSigned" -> deviceSignedDataItem = readDataItemLazily()
+                    else -> skip()
+                }
+            }
+            val docType = docTypeValue
+                ?: throw IllegalStateException("Key docType doesn't exist in map")
+            val issuerSigned = issuerSignedSlice
+                ?: throw IllegalStateException("Key issuerSigned doesn't exist in map")
+            val deviceSigned = deviceSignedDataItem
+                ?: throw IllegalStateException("Key deviceSigned doesn't exist in map")
+
+            var issuerAuthDataItem: DataItem? = null
+            var nameSpacesSlice: CborReader.Slice? = null
+            issuerSigned.reader().readMapWithTstrKeys { key ->
+                when (key) {
+                    "issuerAuth" -> issuerAuthDataItem = readDataItem()
+                    "nameSpaces" -> nameSpacesSlice = readRawSlice()
+                    else -> skip()
+                }
+            }
+            val issuerAuth = (issuerAuthDataItem
+                ?: throw IllegalStateException("Key issuerAuth doesn't exist in map")).asCoseSign1
 
             // 18013-5 clause "9.1.2.4 Signing method and structure for MSO" guarantees
             // that x5chain is in the unprotected headers and that alg is in the
             // protected headers...
-            val issuerAuthorityCertChain =
-                issuerAuth.unprotectedHeaders[
-                    CoseNumberLabel(Cose.COSE_LABEL_X5CHAIN)
-                ]!!.asX509CertChain
+            val x5chain = issuerAuth.unprotectedHeaders[
+                CoseNumberLabel(Cose.COSE_LABEL_X5CHAIN)
+            ]!!
+            val issuerAuthorityCertChain: X509CertChain
+            val documentSigningKey: EcPublicKey
+            var issuerCertificateChainVerified: Boolean? = null
+            if (issuerCertificateChainCache != null) {
+                val cached = issuerCertificateChainCache.lookup(x5chain)
+                issuerAuthorityCertChain = cached.certificateChain
+                documentSigningKey = cached.leafPublicKey
+                issuerCertificateChainVerified = cached.verified
+            } else {
+                issuerAuthorityCertChain = x5chain.asX509CertChain
+                documentSigningKey = issuerAuthorityCertChain.certificates[0].ecPublicKey
+            }
             val signatureAlgorithm = Algorithm.fromInt(
                 issuerAuth.protectedHeaders[
                     CoseNumberLabel(Cose.COSE_LABEL_ALG)
                 ]!!.asNumber.toInt()
             )
-            val documentSigningKey = issuerAuthorityCertChain.certificates[0].ecPublicKey
-            val issuerSignedAuthenticated = Cose.coseSign1Check(
-                documentSigningKey,
-                null,
-                issuerAuth,
-                signatureAlgorithm
-            )
             val encodedMobileSecurityObject = Cbor.decode(issuerAuth.payload!!).asTagged.asBstr
             val parsedMso = MobileSecurityObjectParser(encodedMobileSecurityObject).parse()
 
-            builder.apply {
-                setIssuerSignedAuthenticated(issuerSignedAuthenticated)
-                setIssuerCertificateChain(issuerAuthorityCertChain)
-                setValidityInfoSigned(parsedMso.signed)
-                setValidityInfoValidFrom(parsedMso.validFrom)
-                setValidityInfoValidUntil(parsedMso.validUntil)
-            }
-
-            if (parsedMso.expectedUpdate != null) {
-                builder.setValidityInfoExpectedUpdate(parsedMso.expectedUpdate!!)
-            }
-
             /* don't care about version for now */
             val digestAlgorithm = when (parsedMso.digestAlgorithm) {
                 "SHA-256" -> Algorithm.SHA256
@@ -163,78 +292,111 @@ class DeviceResponseParser(
                 else -> throw IllegalStateException("Unexpected digest algorithm ${parsedMso.digestAlgorithm}")
             }
             val msoDocType = parsedMso.docType
-            require(msoDocType == expectedDocType) {
+            require(msoDocType == docType) {
                 ("docType in MSO '$msoDocType' does not match docType from Document")
             }
-            val nameSpaceNames = parsedMso.valueDigestNamespaces
-            val digestMapping: MutableMap<String, Map<Long, ByteArray>?> = HashMap()
-            for (nameSpaceName in nameSpaceNames) {
-                digestMapping[nameSpaceName] = parsedMso.getDigestIDs(nameSpaceName)
-            }
-            val deviceKey = parsedMso.deviceKey
 
             // nameSpaces may be absent...
-            val nameSpaces = issuerSigned.getOrNull("nameSpaces")
-            if (nameSpaces != null) {
-                for (nameSpaceDataItem in nameSpaces.asMap.keys) {
-                    val nameSpace = nameSpaceDataItem.asTstr
-                    val innerDigestMapping = digestMapping[nameSpace]
-                        ?: throw IllegalArgumentException(
-                            "No digestID MSO entry for namespace $nameSpace"
-                        )
-                    val elementsDataItem = nameSpaces[nameSpaceDataItem]
-                    for (elem in elementsDataItem.asArray) {
-                        require(
-                            elem is Tagged && elem.tagNumber == 24L &&
-                                    elem.asTagged is Bstr
-                        ) { "issuerSignedItemBytes is not a tagged ByteString" }
-
-                        // We need the encoded representation with the tag.
-                        val encodedIssuerSignedItemBytes = Cbor.encode(elem)
-                        val expectedDigest =
-                            Crypto.digest(digestAlgorithm, encodedIssuerSignedItemBytes)
-                        val issuerSignedItem = Cbor.decode(elem.asTagged.asBstr)
-                        val elementName = issuerSignedItem["elementIdentifier"].asTstr
-                        val elementValue = issuerSignedItem["elementValue"]
-                        val digestId = issuerSignedItem["digestID"].asNumber
-                        val digest = innerDigestMapping[digestId]
-                            ?: throw IllegalArgumentException(
-                                "No digestID MSO entry for ID $digestId in namespace $nameSpace"
-                            )
-                        val digestMatch = expectedDigest contentEquals digest
-                        builder.addIssuerEntry(
-                            nameSpace, elementName,
-                            Cbor.encode(elementValue),
-                            digestMatch
-                        )
+            val issuerNameSpaces = mutableListOf<Pair<String, List<CborReader.Slice>>>()
+            nameSpacesSlice?.reader()?.readMapWithTstrKeys { nameSpace ->
+                val items = mutableListOf<CborReader.Slice>()
+                // We need the encoded representation with the tag, use the bytes
+                // exactly as received instead of re-encoding the decoded item.
+                readArray { items.add(readRawSlice()) }
+                issuerNameSpaces.add(Pair(nameSpace, items))
+            }
+
+            return UnverifiedDocument(
+                docType,
+                issuerAuth,
+                issuerAuthorityCertChain,
+                documentSigningKey,
+                issuerCertificateChainVerified,
+                signatureAlgorithm,
+                parsedMso,
+                digestAlgorithm,
+                issuerNameSpaces,
+                deviceSigned
+            )
+        }
+
+        private fun verifyIssuerAuth(document: UnverifiedDocument): Boolean =
+            Cose.coseSign1Check(
+                document.documentSigningKey,
+                null,
+                document.issuerAuth,
+                document.issuerSignatureAlgorithm
+            )
+
+        private fun verifyIssuerNameSpace(
+            document: UnverifiedDocument,
+            nameSpace: String,
+            encodedItems: List<CborReader.Slice>
+        ): List<IssuerEntry> {
+            val innerDigestMapping = document.mso.getDigestIDs(nameSpace)
+                ?: throw IllegalArgumentException(
+                    "No digestID MSO entry for namespace $nameSpace"
+                )
+            return encodedItems.map { encodedIssuerSignedItemBytes ->
+                val issuerSignedItemBytesReader = encodedIssuerSignedItemBytes.reader()
+                require(
+                    issuerSignedItemBytesReader.peekMajorType() == MajorType.TAG &&
+                            issuerSignedItemBytesReader.readTag() == Tagged.ENCODED_CBOR &&
+                            issuerSignedItemBytesReader.peekMajorType() == MajorType.BYTE_STRING &&
+                            issuerSignedItemBytesReader.peekAdditionalInformation() != 31
+                ) { "issuerSignedItemBytes is not a tagged ByteString" }
+                val expectedDigest = Crypto.digest(
+                    document.digestAlgorithm,
+                    encodedIssuerSignedItemBytes.toByteArray()
+                )
+
+                var elementName: String? = null
+                var elementValue: ByteArray? = null
+                var digestId: Long? = null
+                issuerSignedItemBytesReader.readBstrSlice().reader().readMapWithTstrKeys { key ->
+                    when (key) {
+                        "elementIdentifier" -> elementName = readTstr()
+                        "elementValue" -> elementValue = readRawSlice().toByteArray()
+                        "digestID" -> digestId = readNumber()
+                        else -> skip()
                     }
                 }
+                val digest = innerDigestMapping[
+                    digestId ?: throw IllegalStateException("Key digestID doesn't exist in map")
+                ] ?: throw IllegalArgumentException(
+                    "No digestID MSO entry for ID $digestId in namespace $nameSpace"
+                )
+                IssuerEntry(
+                    nameSpace,
+                    elementName
+                        ?: throw IllegalStateException("Key elementIdentifier doesn't exist in map"),
+                    elementValue
+                        ?: throw IllegalStateException("Key elementValue doesn't exist in map"),
+                    expectedDigest contentEquals digest
+                )
             }
-            return deviceKey
         }
 
-        private fun parseDeviceSigned(
-            deviceSigned: DataItem,
-            docType: String,
+        private fun verifyDeviceSigned(
+            document: UnverifiedDocument,
             encodedSessionTranscript: ByteArray,
-            deviceKey: EcPublicKey,
-            eReaderKey: EcPrivateKey?,
-            builder: Document.Builder
-        ) {
+            eReaderKey: EcPrivateKey?
+        ): DeviceSignedResult {
+            val deviceSigned = document.deviceSigned
+            val deviceKey = document.mso.deviceKey
             val nameSpacesBytes = deviceSigned["nameSpaces"]
             val nameSpaces = nameSpacesBytes.asTaggedEncodedCbor
             val deviceAuth = deviceSigned["deviceAuth"]
             val deviceAuthentication = CborArray.builder()
                 .add("DeviceAuthentication")
                 .add(RawCbor(encodedSessionTranscript))
-                .add(docType)
+                .add(document.docType)
                 .add(nameSpacesBytes)
                 .end()
                 .build()
             val deviceAuthenticationBytes = Cbor.encode(
                 Tagged(24, Bstr(Cbor.encode(deviceAuthentication)))
             )
-            val deviceSignedAuthenticated: Boolean
             val deviceSignature = deviceAuth.getOrNull("deviceSignature")
             if (deviceSignature != null) {
                 val deviceSignatureCoseSign1 = deviceSignature.asCoseSign1
@@ -247,48 +409,78 @@ class DeviceResponseParser(
                         CoseNumberLabel(Cose.COSE_LABEL_ALG)
                     ]!!.asNumber.toInt()
                 )
-                deviceSignedAuthenticated = Cose.coseSign1Check(
+                val deviceSignedAuthenticated = Cose.coseSign1Check(
                     deviceKey,
                     deviceAuthenticationBytes,
                     deviceSignatureCoseSign1,
                     signatureAlgorithm
                 )
-                builder.setDeviceSignedAuthenticatedViaSignature(true)
-            } else {
-                val deviceMacDataItem = deviceAuth.getOrNull("deviceMac")
-                    ?: throw IllegalArgumentException(
-                        "Neither deviceSignature nor deviceMac in deviceAuth"
-                    )
-                val tagInResponse = deviceMacDataItem.asCoseMac0.tag
-                val sharedSecret = Crypto.keyAgreement(eReaderKey!!, deviceKey)
-                val sessionTranscriptBytes = Cbor.encode(Tagged(24, Bstr(encodedSessionTranscript)))
-                val salt = Crypto.digest(Algorithm.SHA256, sessionTranscriptBytes)
-                val info = "EMacKey".encodeToByteArray()
-                val eMacKey = Crypto.hkdf(Algorithm.HMAC_SHA256, sharedSecret, salt, info, 32)
-                val expectedTag = Cose.coseMac0(
-                    Algorithm.HMAC_SHA256,
-                    eMacKey,
-                    deviceAuthenticationBytes,
-                    false,
-                    mapOf(
-                        Pair(
-                            CoseNumberLabel(Cose.COSE_LABEL_ALG),
-                            Algorithm.HMAC_SHA256.coseAlgorithmIdentifier.toDataItem()
-                        )
-                    ),
-                    mapOf()
-                ).tag
-                deviceSignedAuthenticated = expectedTag contentEquals tagInResponse
-                if (deviceSignedAuthenticated) {
-                    Logger.d(TAG, "Verified DeviceSigned using MAC")
-                } else {
-                    Logger.d(
-                        TAG, "Device MAC mismatch, got ${tagInResponse.toHex()}"
-                                + " expected ${expectedTag.toHex()}"
+                return DeviceSignedResult(deviceSignedAuthenticated, true, nameSpaces)
+            }
+            val deviceMacDataItem = deviceAuth.getOrNull("deviceMac")
+                ?: throw IllegalArgumentException(
+                    "Neither deviceSignature nor deviceMac in deviceAuth"
+                )
+            val tagInResponse = deviceMacDataItem.asCoseMac0.tag
+            val sharedSecret = Crypto.keyAgreement(eReaderKey!!, deviceKey)
+            val sessionTranscriptBytes = Cbor.encode(Tagged(24, Bstr(encodedSessionTranscript)))
+            val salt = Crypto.digest(Algorithm.SHA256, sessionTranscriptBytes)
+            val info = "EMacKey".encodeToByteArray()
+            val eMacKey = Crypto.hkdf(Algorithm.HMAC_SHA256, sharedSecret, salt, info, 32)
+            val expectedTag = Cose.coseMac0(
+                Algorithm.HMAC_SHA256,
+                eMacKey,
+                deviceAuthenticationBytes,
+                false,
+                mapOf(
+                    Pair(
+                        CoseNumberLabel(Cose.COSE_LABEL_ALG),
+                        Algorithm.HMAC_SHA256.coseAlgorithmIdentifier.toDataItem()
                     )
+                ),
+                mapOf()
+            ).tag
+            val deviceSignedAuthenticated = expectedTag contentEquals tagInResponse
+            if (deviceSignedAuthenticated) {
+                Logger.d(TAG, "Verified DeviceSigned using MAC")
+            } else {
+                Logger.d(
+                    TAG, "Device MAC mismatch, got ${tagInResponse.toHex()}"
+                            + " expected ${expectedTag.toHex()}"
+                )
+            }
+            return DeviceSignedResult(deviceSignedAuthenticated, false, nameSpaces)
+        }
+
+        private fun buildDocument(
+            document: UnverifiedDocument,
+            issuerSignedAuthenticated: Boolean,
+            issuerEntries: List<List<IssuerEntry>>,
+            deviceSignedResult: DeviceSignedResult
+        ): Document {
+            val parsedMso = document.mso
+            val builder = Document.Builder(document.docType).apply {
+                setIssuerSignedAuthenticated(issuerSignedAuthenticated)
+                setIssuerCertificateChain(document.issuerCertificateChain)
+                setIssuerCertificateChainVerified(document.issuerCertificateChainVerified)
+                setValidityInfoSigned(parsedMso.signed)
+                setValidityInfoValidFrom(parsedMso.validFrom)
+                setValidityInfoValidUntil(parsedMso.validUntil)
+            }
+            if (parsedMso.expectedUpdate != null) {
+                builder.setValidityInfoExpectedUpdate(parsedMso.expectedUpdate!!)
+            }
+            for (entries in issuerEntries) {
+                for (entry in entries) {
+                    builder.addIssuerEntry(entry.nameSpace, entry.name, entry.value, entry.digestMatch)
                 }
             }
-            builder.setDeviceSignedAuthenticated(deviceSignedAuthenticated)
+            builder.setDeviceKey(parsedMso.deviceKey)
+            if (deviceSignedResult.authenticatedViaSignature) {
+                builder.setDeviceSignedAuthenticatedViaSignature(true)
+            }
+            builder.setDeviceSignedAuthenticated(deviceSignedResult.authenticated)
+            val nameSpaces = deviceSignedResult.nameSpaces
             for (nameSpaceDataItem in nameSpaces.asMap.keys) {
                 val nameSpace = nameSpaceDataItem.asTstr
                 val innerMap = nameSpaces[nameSpaceDataItem]
@@ -298,40 +490,84 @@ class DeviceResponseParser(
                     builder.addDeviceEntry(nameSpace, elementName, Cbor.encode(elementValue))
                 }
             }
+            return builder.build()
+        }
+
+        // Walks the top-level structure and returns the slices of the DeviceResponse
+        // containing each document, these are parsed on their own.
+        private fun decodeDeviceResponse(encodedDeviceResponse: ByteArray): List<CborReader.Slice> {
+            var versionValue: String? = null
+            var statusValue: Long? = null
+            val documentSlices = mutableListOf<CborReader.Slice>()
+            val reader = CborReader(encodedDeviceResponse)
+            reader.readMapWithTstrKeys { key ->
+                when (key) {
+                    "version" -> versionValue = readTstr()
+                    "documents" -> readArray { documentSlices.add(readRawSlice()) }
+                    "status" -> statusValue = readNumber()
+                    else -> skip()
+                }
+            }
+            require(!reader.hasMore) {
+                "${reader.endOffset - reader.offset} bytes leftover after decoding"
+            }
+            version = versionValue ?: throw IllegalStateException("Key version doesn't exist in map")
+            require(version.compareTo("1.0") >= 0) { "Given version '$version' not >= '1.0'" }
+            status = statusValue ?: throw IllegalStateException("Key status doesn't exist in map")
+
+            // TODO: maybe also parse + convey "documentErrors" and "errors" keys in
+            //  DeviceResponse map.
+            return documentSlices
         }
 
         internal fun parse(
             encodedDeviceResponse: ByteArray?,
             encodedSessionTranscript: ByteArray,
-            eReaderKey: EcPrivateKey?
+            eReaderKey: EcPrivateKey?,
+            issuerCertificateChainCache: X509CertChainCache? = null
         ) {
-            val deviceResponse = Cbor.decode(encodedDeviceResponse!!)
-            version = deviceResponse["version"].asTstr
-            require(version.compareTo("1.0") >= 0) { "Given version '$version' not >= '1.0'" }
-            val documentsDataItem = deviceResponse.getOrNull("documents")
-            if (documentsDataItem != null) {
-                for (documentItem in documentsDataItem.asArray) {
-                    val docType = documentItem["docType"].asTstr
-                    val builder = Document.Builder(docType)
-                    val issuerSignedItem = documentItem["issuerSigned"]
-                    val deviceKey = parseIssuerSigned(docType, issuerSignedItem, builder)
-                    builder.setDeviceKey(deviceKey)
-                    val deviceSigned = documentItem["deviceSigned"]
-                    parseDeviceSigned(
-                        deviceSigned,
-                        docType,
-                        encodedSessionTranscript,
-                        deviceKey,
-                        eReaderKey,
-                        builder
-                    )
-                    _documents.add(builder.build())
+            for (documentSlice in decodeDeviceResponse(encodedDeviceResponse!!)) {
+                val document = decodeDocument(documentSlice, issuerCertificateChainCache)
+                val issuerSignedAuthenticated = verifyIssuerAuth(document)
+                val issuerEntries = document.issuerNameSpaces.map { (nameSpace, encodedItems) ->
+                    verifyIssuerNameSpace(document, nameSpace, encodedItems)
                 }
+                val deviceSignedResult =
+                    verifyDeviceSigned(document, encodedSessionTranscript, eReaderKey)
+                _documents.add(
+                    buildDocument(document, issuerSignedAuthenticated, issuerEntries, deviceSignedResult)
+                )
             }
-            status = deviceResponse["status"].asNumber
+        }
 
-            // TODO: maybe also parse + convey "documentErrors" and "errors" keys in
-            //  DeviceResponse map.
+        // Like parse() but the issuer signature, the digests for each namespace, and the
+        // device authentication of every document are checked concurrently on [dispatcher].
+        internal suspend fun parseConcurrently(
+            encodedDeviceResponse: ByteArray,
+            encodedSessionTranscript: ByteArray,
+            eReaderKey: EcPrivateKey?,
+            issuerCertificateChainCache: X509CertChainCache?,
+            dispatcher: CoroutineDispatcher
+        ) = coroutineScope {
+            val documents = decodeDeviceResponse(encodedDeviceResponse).map { documentSlice ->
+                async(dispatcher) {
+                    val document = decodeDocument(documentSlice, issuerCertificateChainCache)
+                    val issuerSignedAuthenticated = async(dispatcher) { verifyIssuerAuth(document) }
+                    val issuerEntries = document.issuerNameSpaces.map { (nameSpace, encodedItems) ->
+                        async(dispatcher) { verifyIssuerNameSpace(document, nameSpace, encodedItems) }
+                    }
+                    val deviceSignedResult = async(dispatcher) {
+                        verifyDeviceSigned(document, encodedSessionTranscript, eReaderKey)
+                    }
+                    buildDocument(
+                        document,
+                        issuerSignedAuthenticated.await(),
+                        issuerEntries.awaitAll(),
+                        deviceSignedResult.await()
+                    )
+                }
+            }
+            _documents.addAll(documents.awaitAll())
         }
 
         /**
@@ -370,6 +606,14 @@ class DeviceResponseParser(
          */
         lateinit var issuerCertificateChain: X509CertChain
 
+        /**
+         * Whether the issuer certificate chain was verified.
+         *
+         * This is only set if a [X509CertChainCache] with a verifier was set using
+         * [DeviceResponseParser.setIssuerCertificateChainCache], otherwise it's `null`.
+         */
+        var issuerCertificateChainVerified: Boolean? = null
+
         private data class EntryData(var value: ByteArray, var digestMatch: Boolean)
 
         private var deviceData = mutableMapOf<String, MutableMap<String, EntryData>>()
@@ -710,6 +954,10 @@ class DeviceResponseParser(
                 result.issuerCertificateChain = certificateChain
             }
 
+            fun setIssuerCertificateChainVerified(verified: Boolean?) {
+                result.issuerCertificateChainVerified = verified
+            }
+
             fun addDeviceEntry(namespaceName: String, name: String, value: ByteArray) = apply {
                 var innerMap = result.deviceData[namespaceName]
                 if (innerMap == null) {
@@ -19,12 +19,20 @@ import com.android.identity.cbor.Bstr
 import com.android.identity.cbor.Cbor
 import com.android.identity.cbor.CborMap
 import com.android.identity.cbor.Tagged
+import com.android.identity.cbor.Tstr
+import com.android.identity.cbor.toDataItem
 import com.android.identity.crypto.Algorithm
 import com.android.identity.crypto.Crypto
 import com.android.identity.crypto.EcPrivateKey
 import com.android.identity.crypto.EcPublicKey
+import com.android.identity.crypto.StreamingEncryptor
 import com.android.identity.mdoc.sessionencryption.SessionEncryption.Role
-import kotlinx.io.bytestring.ByteStringBuilder
+import com.android.identity.util.Tracing
+import kotlinx.io.Buffer
+import kotlinx.io.RawSource
+import kotlinx.io.Source
+import kotlinx.io.buffered
+import kotlinx.io.readByteArray
 
 /**
  * Helper class for implementing session encryption according to ISO/IEC 18013-5:2021
@@ -68,14 +76,30 @@ class SessionEncryption(
     private var encryptedCounter = 1
     private var sendSessionEstablishment = true
 
+    // The IV is specified in ISO/IEC 18013-5:2021 clause 9.1.1.5, it's the identifier of the
+    // sender followed by the message counter. Only the counter changes between messages so
+    // the arrays are reused.
+    private val encryptionIv = ByteArray(12).apply { this[7] = if (role == Role.MDOC) 1 else 0 }
+    private val decryptionIv = ByteArray(12).apply { this[7] = if (role == Role.MDOC) 0 else 1 }
+
+    private fun ByteArray.withCounter(counter: Int) = apply {
+        this[8] = (counter ushr 24).toByte()
+        this[9] = (counter ushr 16).toByte()
+        this[10] = (counter ushr 8).toByte()
+        this[11] = counter.toByte()
+    }
+
     init {
-        val sharedSecret = Crypto.keyAgreement(eSelfKey, remotePublicKey)
-        val sessionTranscriptBytes = Cbor.encode(Tagged(24, Bstr(encodedSessionTranscript)))
-        val salt = Crypto.digest(Algorithm.SHA256, sessionTranscriptBytes)
-        var info = "SKDevice".encodeToByteArray()
-        val deviceSK = Crypto.hkdf(Algorithm.HMAC_SHA256, sharedSecret, salt, info, 32)
-        info = "SKReader".encodeToByteArray()
-        val readerSK = Crypto.hkdf(Algorithm.HMAC_SHA256, sharedSecret, salt, info, 32)
+        val (deviceSK, readerSK) = Tracing.span("mdoc.session.deriveKeys") {
+            val sharedSecret = Crypto.keyAgreement(eSelfKey, remotePublicKey)
+            val sessionTranscriptBytes = Cbor.encode(Tagged(24, Bstr(encodedSessionTranscript)))
+            val salt = Crypto.digest(Algorithm.SHA256, sessionTranscriptBytes)
+            var info = "SKDevice".encodeToByteArray()
+            val deviceSK = Crypto.hkdf(Algorithm.HMAC_SHA256, sharedSecret, salt, info, 32)
+            info = "SKReader".encodeToByteArray()
+            val readerSK = Crypto.hkdf(Algorithm.HMAC_SHA256, sharedSecret, salt, info, 32)
+            Pair(deviceSK, readerSK)
+        }
         if (role == Role.MDOC) {
             skSelf = deviceSK
             skRemote = readerSK
@@ -126,18 +150,15 @@ class SessionEncryption(
     ): ByteArray {
         var messageCiphertext: ByteArray? = null
         if (messagePlaintext != null) {
-            // The IV and these constants are specified in ISO/IEC 18013-5:2021 clause 9.1.1.5.
-            val iv = ByteStringBuilder(12)
-            iv.append(0x00000000U)
-            val ivIdentifier = if (role == Role.MDOC) 0x00000001U else 0x00000000U
-            iv.append(ivIdentifier)
-            iv.append(encryptedCounter.toUInt())
-            messageCiphertext = Crypto.encrypt(
-                Algorithm.A128GCM,
-                skSelf,
-                iv.toByteString().toByteArray(),
-                messagePlaintext
-            )
+            messageCiphertext = Tracing.span("mdoc.session.encrypt") { span ->
+                span.setAttribute("size", messagePlaintext.size.toLong())
+                Crypto.encrypt(
+                    Algorithm.A128GCM,
+                    skSelf,
+                    encryptionIv.withCounter(encryptedCounter),
+                    messagePlaintext
+                )
+            }
             encryptedCounter += 1
         }
         val mapBuilder = CborMap.builder()
@@ -161,6 +182,137 @@ class SessionEncryption(
         return messageData
     }
 
+    /**
+     * A message encrypted with [encryptMessage], produced while it's being read.
+     *
+     * @param size the size of the message, in bytes.
+     * @param data the bytes of the `SessionEstablishment` or `SessionData` CBOR.
+     */
+    class EncryptedMessage(
+        val size: Long,
+        val data: Source
+    )
+
+    /**
+     * Encrypt a message intended for the remote device, without holding it in memory.
+     *
+     * This is like the variant which takes a [ByteArray] except that the plaintext is read
+     * from [messagePlaintext] and encrypted as the returned [EncryptedMessage.data] is read.
+     * This way large messages, for example a `DeviceResponse` with portraits, can be sent
+     * using e.g. [Source]-based APIs of the transport while they're being encrypted, without
+     * several copies of the message in memory.
+     *
+     * The message counter is increased when this is called, messages must be sent in the
+     * order they are created.
+     *
+     * @param messagePlaintext the source to read the message to encrypt from. It's closed
+     * when the returned [EncryptedMessage.data] is closed.
+     * @param messagePlaintextSize the number of bytes to read from [messagePlaintext].
+     * @param statusCode if set, the status code to include in `SessionData`.
+     * @return an [EncryptedMessage] with the `SessionEstablishment` or `SessionData` CBOR.
+     */
+    fun encryptMessage(
+        messagePlaintext: RawSource,
+        messagePlaintextSize: Long,
+        statusCode: Long?
+    ): EncryptedMessage {
+        require(messagePlaintextSize >= 0) { "messagePlaintextSize cannot be negative" }
+        val encryptor = Crypto.createStreamingEncryptor(
+            Algorithm.A128GCM,
+            skSelf,
+            // Copied since the encryptor may use it after the next message was encrypted.
+            encryptionIv.copyOf().withCounter(encryptedCounter)
+        )
+        encryptedCounter += 1
+
+        // Write all of SessionEstablishment/SessionData except the cipher text ourselves,
+        // in the same order used by encryptMessage() above.
+        val includeEReaderKey =
+            !sessionEstablishmentSent && sendSessionEstablishment && role == Role.MDOC_READER
+        val prefix = Buffer()
+        val numEntries = 1 + (if (includeEReaderKey) 1 else 0) + (if (statusCode != null) 1 else 0)
+        prefix.writeCborHeader(MAJOR_TYPE_MAP, numEntries.toLong())
+        if (includeEReaderKey) {
+            prefix.write(Cbor.encode(Tstr("eReaderKey")))
+            prefix.write(Cbor.encode(Tagged(
+                Tagged.ENCODED_CBOR,
+                Bstr(Cbor.encode(eSelfKey.publicKey.toCoseKey().toDataItem()))
+            )))
+        }
+        prefix.write(Cbor.encode(Tstr("data")))
+        prefix.writeCborHeader(MAJOR_TYPE_BSTR, messagePlaintextSize + GCM_TAG_SIZE)
+        val suffix = Buffer()
+        if (statusCode != null) {
+            suffix.write(Cbor.encode(Tstr("status")))
+            suffix.write(Cbor.encode(statusCode.toDataItem()))
+        }
+        sessionEstablishmentSent = true
+
+        val size = prefix.size + messagePlaintextSize + GCM_TAG_SIZE + suffix.size
+        return EncryptedMessage(
+            size,
+            EncryptingSource(prefix, messagePlaintext, messagePlaintextSize, encryptor, suffix)
+                .buffered()
+        )
+    }
+
+    // Produces [prefix], the encryption of [plaintextSize] bytes of [plaintext], and [suffix].
+    private class EncryptingSource(
+        private val prefix: Buffer,
+        private val plaintext: RawSource,
+        private var plaintextRemaining: Long,
+        private val encryptor: StreamingEncryptor,
+        private val suffix: Buffer
+    ) : RawSource {
+        private val plaintextBuffer = Buffer()
+        // Cipher text produced but not read yet.
+        private val ciphertextBuffer = Buffer()
+        private var finished = false
+
+        override fun readAtMostTo(sink: Buffer, byteCount: Long): Long {
+            require(byteCount >= 0) { "byteCount cannot be negative" }
+            if (byteCount == 0L) {
+                return 0
+            }
+            if (prefix.size > 0) {
+                return prefix.readAtMostTo(sink, byteCount)
+            }
+            while (ciphertextBuffer.size == 0L && plaintextRemaining > 0) {
+                if (plaintextBuffer.size == 0L) {
+                    val read = plaintext.readAtMostTo(
+                        plaintextBuffer,
+                        minOf(plaintextRemaining, CHUNK_SIZE.toLong())
+                    )
+                    if (read < 0) {
+                        throw IllegalStateException(
+                            "Plaintext ended with $plaintextRemaining bytes remaining"
+                        )
+                    }
+                }
+                val chunk = plaintextBuffer.readByteArray(
+                    minOf(plaintextBuffer.size, plaintextRemaining).toInt()
+                )
+                plaintextRemaining -= chunk.size
+                ciphertextBuffer.write(encryptor.update(chunk))
+            }
+            if (ciphertextBuffer.size == 0L && !finished) {
+                finished = true
+                ciphertextBuffer.write(encryptor.finish())
+            }
+            if (ciphertextBuffer.size > 0) {
+                return ciphertextBuffer.readAtMostTo(sink, byteCount)
+            }
+            if (suffix.size > 0) {
+                return suffix.readAtMostTo(sink, byteCount)
+            }
+            return -1
+        }
+
+        override fun close() {
+            plaintext.close()
+        }
+    }
+
     /**
      * Decrypts a message received from the remote device.
      *
@@ -186,17 +338,15 @@ class SessionEncryption(
         val status = statusDataItem?.asNumber
         var plainText: ByteArray? = null
         if (messageCiphertext != null) {
-            val iv = ByteStringBuilder(12)
-            iv.append(0x00000000U)
-            val ivIdentifier = if (role == Role.MDOC) 0x00000000U else 0x00000001U
-            iv.append(ivIdentifier)
-            iv.append(decryptedCounter.toUInt())
-            plainText = Crypto.decrypt(
-                Algorithm.A128GCM,
-                skRemote,
-                iv.toByteString().toByteArray(),
-                messageCiphertext
-            )
+            plainText = Tracing.span("mdoc.session.decrypt") { span ->
+                span.setAttribute("size", messageCiphertext.size.toLong())
+                Crypto.decrypt(
+                    Algorithm.A128GCM,
+                    skRemote,
+                    decryptionIv.withCounter(decryptedCounter),
+                    messageCiphertext
+                )
+            }
             decryptedCounter += 1
         }
         return Pair(plainText, status)
@@ -215,6 +365,36 @@ class SessionEncryption(
         get() = decryptedCounter - 1
 
     companion object {
+        private const val MAJOR_TYPE_BSTR = 2
+        private const val MAJOR_TYPE_MAP = 5
+        private const val GCM_TAG_SIZE = 16L
+        private const val CHUNK_SIZE = 16 * 1024
+
+        // Writes the initial byte and argument of a CBOR data item, using the shortest
+        // encoding as Cbor.encode() does.
+        private fun Buffer.writeCborHeader(majorType: Int, value: Long) {
+            val initialByte = majorType shl 5
+            when {
+                value < 24 -> writeByte((initialByte or value.toInt()).toByte())
+                value <= 0xff -> {
+                    writeByte((initialByte or 24).toByte())
+                    writeByte(value.toByte())
+                }
+                value <= 0xffff -> {
+                    writeByte((initialByte or 25).toByte())
+                    writeShort(value.toShort())
+                }
+                value <= 0xffffffffL -> {
+                    writeByte((initialByte or 26).toByte())
+                    writeInt(value.toInt())
+                }
+                else -> {
+                    writeByte((initialByte or 27).toByte())
+                    writeLong(value)
+                }
+            }
+        }
+
         /**
          * Create a SessionData message (as defined in ISO/IEC 18013-5 9.1.1.4 Procedure) with a status
          * code and no data.
@@ -230,11 +410,3 @@ class SessionEncryption(
             }
     }
 }
-
-private fun ByteStringBuilder.append(value: UInt) = apply {
-    append((value shr 24).and(0xffU).toByte())
-    append((value shr 16).and(0xffU).toByte())
-    append((value shr 8).and(0xffU).toByte())
-    append((value shr 0).and(0xffU).toByte())
-}
-
@@ -18,17 +18,25 @@ package com.android.identity.mdoc.util
 import com.android.identity.cbor.Bstr
 import com.android.identity.cbor.Cbor
 import com.android.identity.cbor.CborMap
+import com.android.identity.cbor.DataItem
 import com.android.identity.cbor.RawCbor
 import com.android.identity.cbor.Simple
 import com.android.identity.cbor.Tagged
+import com.android.identity.cbor.Tstr
+import com.android.identity.cbor.Uint
 import com.android.identity.document.DocumentRequest
 import com.android.identity.document.DocumentRequest.DataElement
 import com.android.identity.document.NameSpacedData
 import com.android.identity.crypto.Algorithm
 import com.android.identity.crypto.Crypto
+import com.android.identity.mdoc.mso.StaticAuthDataGenerator
 import com.android.identity.mdoc.mso.StaticAuthDataParser.StaticAuthData
 import com.android.identity.mdoc.request.DeviceRequestParser
 import com.android.identity.util.Logger
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.async
+import kotlinx.coroutines.awaitAll
+import kotlinx.coroutines.coroutineScope
 import kotlin.random.Random
 
 /**
@@ -37,7 +45,8 @@ import kotlin.random.Random
  * On the issuance-side, [generateIssuerNameSpaces] and [stripIssuerNameSpaces] can be used with
  * [com.android.identity.mdoc.mso.MobileSecurityObjectGenerator] and
  * [calculateDigestsForNameSpace] can be used to prepare PII and multiple static authentication
- * data packages (each including signed MSOs).
+ * data packages (each including signed MSOs). When issuing many credentials at once,
+ * [generateIssuerSignedData] does all of this in one pass.
  *
  * On the device-side, [mergeIssuerNamesSpaces] can be used to generate the `DeviceResponse` CBOR
  * from the above-mentioned PII and static authentication data packages.
@@ -135,6 +144,212 @@ object MdocUtil {
         return ret
     }
 
+    /**
+     * Issuer-signed data for a single credential, as generated by [generateIssuerSignedData].
+     *
+     * @param issuerNameSpaces a map from name spaces into a list of `IssuerSignedItemBytes`,
+     * as returned by [generateIssuerNameSpaces].
+     * @param digests a map from name spaces into digest identifiers into digests, that is,
+     * what [calculateDigestsForNameSpace] returns for each name space. This can be passed to
+     * [com.android.identity.mdoc.mso.MobileSecurityObjectGenerator.addDigestIdsForNamespace].
+     * @param digestIdMapping the `IssuerSignedItemBytes` to include in `StaticAuthData`, either
+     * [issuerNameSpaces] or the result of applying [stripIssuerNameSpaces] to it.
+     */
+    class IssuerSignedData(
+        val issuerNameSpaces: Map<String, List<ByteArray>>,
+        val digests: Map<String, Map<Long, ByteArray>>,
+        val digestIdMapping: Map<String, List<ByteArray>>
+    ) {
+        /**
+         * Generates the `StaticAuthData` for the credential.
+         *
+         * @param encodedIssuerAuth A COSE_Sign1 object with a payload of MobileSecurityObjectBytes
+         * for an MSO with [digests].
+         * @return the bytes of `StaticAuthData` CBOR, see [StaticAuthDataGenerator].
+         */
+        fun generateStaticAuthData(encodedIssuerAuth: ByteArray): ByteArray =
+            StaticAuthDataGenerator(digestIdMapping, encodedIssuerAuth).generate()
+    }
+
+    /**
+     * Generates issuer-signed data for many credentials of the same document at once.
+     *
+     * For each credential the result is the same as calling [generateIssuerNameSpaces],
+     * [calculateDigestsForNameSpace] for every name space and, if [strip] is `true`,
+     * [stripIssuerNameSpaces], in that order, with the same [randomProvider]. It's however a
+     * lot faster since
+     * - only the digest identifier and random differ between credentials so the rest of each
+     *   `IssuerSignedItem`, including the element value, is encoded once and reused,
+     * - items are written in their final `IssuerSignedItemBytes` encoding directly instead of
+     *   being encoded, decoded and re-encoded, and
+     * - credentials are encoded and hashed in parallel on [Dispatchers.Default].
+     *
+     * Randoms and digest identifiers are all drawn from [randomProvider] before work is
+     * handed off to other threads, so it doesn't need to be thread-safe and the result is
+     * deterministic for a given [randomProvider].
+     *
+     * @param data The name spaced data.
+     * @param numCredentials the number of credentials to generate data for.
+     * @param randomProvider A random provider used for generating digest identifiers and salts.
+     * @param dataElementRandomSize The number of bytes to use for the salt for each data elements,
+     * must be at least 16.
+     * @param overrides Optionally, a map of namespaces into data element names into values for
+     * overriding data in the provided [NameSpacedData] parameter.
+     * @param digestAlgorithm the digest algorithm to use, for example [Algorithm.SHA256].
+     * @param strip whether to set `elementValue` to `null` in
+     * [IssuerSignedData.digestIdMapping], as [stripIssuerNameSpaces] does.
+     * @param stripExceptions if [strip] is `true`, a map from name spaces into a list of data
+     * element names for where the `elementValue` should not be removed.
+     * @return an [IssuerSignedData] for each credential.
+     * @throws IllegalArgumentException if `dataElementRandomSize` is less than 16 or the
+     * digest algorithm isn't supported.
+     */
+    suspend fun generateIssuerSignedData(
+        data: NameSpacedData,
+        numCredentials: Int,
+        randomProvider: Random,
+        dataElementRandomSize: Int,
+        overrides: Map<String, Map<String, ByteArray>>?,
+        digestAlgorithm: Algorithm,
+        strip: Boolean = false,
+        stripExceptions: Map<String, List<String>>? = null
+    ): List<IssuerSignedData> {
+        require(dataElementRandomSize >= 16) {
+            "Random size must be at least 16 bytes"
+        }
+        require(numCredentials >= 0) { "numCredentials cannot be negative" }
+
+        // Everything after the digest identifier and random, which is the same for all
+        // credentials.
+        class Element(
+            val nameSpaceName: String,
+            val suffix: ByteArray,
+            val strippedSuffix: ByteArray?
+        )
+        val encodedNull = Cbor.encode(Simple.NULL)
+        val elements = mutableListOf<Element>()
+        for (nsName in data.nameSpaceNames) {
+            val overridesByNameSpace = overrides?.get(nsName)
+            for (elemName in data.getDataElementNames(nsName)) {
+                val encodedValue = overridesByNameSpace?.get(elemName)
+                    ?: data.getDataElement(nsName, elemName)
+                val keep = !strip || stripExceptions?.get(nsName)?.contains(elemName) == true
+                elements.add(Element(
+                    nsName,
+                    encodeIssuerSignedItemSuffix(elemName, encodedValue),
+                    if (keep) null else encodeIssuerSignedItemSuffix(elemName, encodedNull)
+                ))
+            }
+        }
+
+        // Draw randoms in the same order as calling generateIssuerNameSpaces() for each
+        // credential would.
+        val digestIds = mutableListOf<List<Long>>()
+        val randoms = mutableListOf<List<ByteArray>>()
+        repeat(numCredentials) {
+            digestIds.add((0L until elements.size).toMutableList().apply { shuffle(randomProvider) })
+            randoms.add(List(elements.size) { randomProvider.nextBytes(dataElementRandomSize) })
+        }
+
+        return coroutineScope {
+            (0 until numCredentials).map { n ->
+                async(Dispatchers.Default) {
+                    // Name spaces without data elements are included too, with no items.
+                    val issuerNameSpaces = mutableMapOf<String, MutableList<ByteArray>>()
+                    val digestIdMapping = mutableMapOf<String, MutableList<ByteArray>>()
+                    val digests = mutableMapOf<String, MutableMap<Long, ByteArray>>()
+                    for (nsName in data.nameSpaceNames) {
+                        issuerNameSpaces[nsName] = ArrayList()
+                        digestIdMapping[nsName] = ArrayList()
+                        digests[nsName] = LinkedHashMap()
+                    }
+                    for ((index, element) in elements.withIndex()) {
+                        val digestId = digestIds[n][index]
+                        val random = randoms[n][index]
+                        val encodedIssuerSignedItemBytes =
+                            encodeIssuerSignedItemBytes(digestId, random, element.suffix)
+                        issuerNameSpaces[element.nameSpaceName]!!.add(encodedIssuerSignedItemBytes)
+                        digests[element.nameSpaceName]!![digestId] =
+                            Crypto.digest(digestAlgorithm, encodedIssuerSignedItemBytes)
+                        digestIdMapping[element.nameSpaceName]!!.add(
+                            element.strippedSuffix
+                                ?.let { encodeIssuerSignedItemBytes(digestId, random, it) }
+                                ?: encodedIssuerSignedItemBytes
+                        )
+                    }
+                    IssuerSignedData(issuerNameSpaces, digests, digestIdMapping)
+                }
+            }.awaitAll()
+        }
+    }
+
+    private val encodedDigestIdKey = Cbor.encode(Tstr("digestID"))
+    private val encodedRandomKey = Cbor.encode(Tstr("random"))
+
+    // The encoding of the "elementIdentifier" and "elementValue" entries of IssuerSignedItem.
+    private fun encodeIssuerSignedItemSuffix(
+        elementIdentifier: String,
+        encodedElementValue: ByteArray
+    ): ByteArray =
+        Cbor.encode(Tstr("elementIdentifier")) +
+                Cbor.encode(Tstr(elementIdentifier)) +
+                Cbor.encode(Tstr("elementValue")) +
+                encodedElementValue
+
+    // Writes IssuerSignedItemBytes, i.e. #6.24(bstr .cbor IssuerSignedItem), into a single
+    // array, with the same encoding as generateIssuerNameSpaces().
+    private fun encodeIssuerSignedItemBytes(
+        digestId: Long,
+        random: ByteArray,
+        suffix: ByteArray
+    ): ByteArray {
+        val digestIdItem = Uint(digestId.toULong())
+        val randomItem = Bstr(random)
+        val itemSize = 1 + encodedDigestIdKey.size + Cbor.encodedSize(digestIdItem) +
+                encodedRandomKey.size + Cbor.encodedSize(randomItem) + suffix.size
+        val bstrHeaderSize = when {
+            itemSize < 24 -> 1
+            itemSize < 0x100 -> 2
+            itemSize < 0x10000 -> 3
+            else -> 5
+        }
+        val result = ByteArray(2 + bstrHeaderSize + itemSize)
+        var offset = 0
+        // Tag 24
+        result[offset++] = 0xd8.toByte()
+        result[offset++] = 24
+        // Major type 2, byte string
+        when (bstrHeaderSize) {
+            1 -> result[offset++] = (0x40 + itemSize).toByte()
+            2 -> {
+                result[offset++] = 0x58
+                result[offset++] = itemSize.toByte()
+            }
+            3 -> {
+                result[offset++] = 0x59
+                result[offset++] = (itemSize shr 8).toByte()
+                result[offset++] = itemSize.toByte()
+            }
+            else -> {
+                result[offset++] = 0x5a
+                result[offset++] = (itemSize shr 24).toByte()
+                result[offset++] = (itemSize shr 16).toByte()
+                result[offset++] = (itemSize shr 8).toByte()
+                result[offset++] = itemSize.toByte()
+            }
+        }
+        // Map with four entries
+        result[offset++] = 0xa4.toByte()
+        encodedDigestIdKey.copyInto(result, offset)
+        offset += encodedDigestIdKey.size
+        offset += Cbor.encode(digestIdItem, result, offset)
+        encodedRandomKey.copyInto(result, offset)
+        offset += encodedRandomKey.size
+        offset += Cbor.encode(randomItem, result, offset)
+        suffix.copyInto(result, offset)
+        return result
+    }
+
     /**
      * Strips issuer name spaces.
      *
@@ -160,7 +375,8 @@ object MdocUtil {
                 exceptionsForNamespace = exceptions[nameSpaceName]
             }
             for (encodedIssuerSignedItemBytes in issuerNameSpaces[nameSpaceName]!!) {
-                val issuerSignedItem = Cbor.decode(encodedIssuerSignedItemBytes).asTaggedEncodedCbor
+                val issuerSignedItem =
+                    Cbor.decodeLazily(encodedIssuerSignedItemBytes).asTaggedEncodedCbor
                 if (exceptionsForNamespace != null) {
                     val elementIdentifier = issuerSignedItem["elementIdentifier"].asTstr
                     if (exceptionsForNamespace.contains(elementIdentifier)) {
@@ -168,9 +384,7 @@ object MdocUtil {
                         continue
                     }
                 }
-                val encodedIssuerSignedItem = Cbor.encode(issuerSignedItem)
-                val modifiedEncodedIssuerSignedItem =
-                    issuerSignedItemClearValue(encodedIssuerSignedItem)
+                val modifiedEncodedIssuerSignedItem = issuerSignedItemClearValue(issuerSignedItem)
                 val modifiedEncodedIssuerSignedItemBytes = Cbor.encode(
                     Tagged(24, Bstr(modifiedEncodedIssuerSignedItem))
                 )
@@ -199,7 +413,8 @@ object MdocUtil {
             ?: throw IllegalArgumentException("No namespace $nameSpaceName in IssuerNameSpaces")
         val ret: MutableMap<Long, ByteArray> = LinkedHashMap()
         for (encodedIssuerSignedItemBytes in list) {
-            val issuerSignedItem = Cbor.decode(encodedIssuerSignedItemBytes).asTaggedEncodedCbor
+            val issuerSignedItem =
+                Cbor.decodeLazily(encodedIssuerSignedItemBytes).asTaggedEncodedCbor
             val digestId = issuerSignedItem["digestID"].asNumber
             ret[digestId] = Crypto.digest(digestAlgorithm, encodedIssuerSignedItemBytes)
         }
@@ -214,9 +429,12 @@ object MdocUtil {
         for (nameSpaceName in issuerNameSpaces.keys) {
             val innerMap: MutableMap<String, ByteArray> = LinkedHashMap()
             for (encodedIssuerSignedItemBytes in issuerNameSpaces[nameSpaceName]!!) {
-                val issuerSignedItem = Cbor.decode(encodedIssuerSignedItemBytes).asTaggedEncodedCbor
+                // No need to re-encode IssuerSignedItem, the embedded bstr has its encoding.
+                val encodedIssuerSignedItem = Cbor.decodeLazily(encodedIssuerSignedItemBytes)
+                    .asTagged.asBstr
+                val issuerSignedItem = Cbor.decodeLazily(encodedIssuerSignedItem)
                 val elementIdentifier = issuerSignedItem["elementIdentifier"].asTstr
-                innerMap[elementIdentifier] = Cbor.encode(issuerSignedItem)
+                innerMap[elementIdentifier] = encodedIssuerSignedItem
             }
             ret[nameSpaceName] = innerMap
         }
@@ -276,24 +494,98 @@ object MdocUtil {
                 Logger.w(TAG, "No IssuerSignedItem for $nameSpaceName $dataElementName")
                 continue
             }
-            var encodedIssuerSignedItem: ByteArray?
-            encodedIssuerSignedItem =
-                if (hasElementValue(encodedIssuerSignedItemMaybeWithoutValue)) {
-                    encodedIssuerSignedItemMaybeWithoutValue
-                } else {
-                    issuerSignedItemSetValue(encodedIssuerSignedItemMaybeWithoutValue, value)
-                }
             val list = issuerSignedData.getOrPut(nameSpaceName) { ArrayList() }
+            list.add(taggedIssuerSignedItem(encodedIssuerSignedItemMaybeWithoutValue, value))
+        }
+        return issuerSignedData
+    }
+
+    /**
+     * Prepares the `IssuerSignedItemBytes` CBOR for all data elements of a credential.
+     *
+     * This does the work of [mergeIssuerNamesSpaces] once for every data element in the
+     * document, so it can be done ahead of time, e.g. while the connection to the reader is
+     * being set up, and the result cached for the credential. The data for a request is then
+     * picked with [selectIssuerNameSpaces], whatever data elements are requested.
+     *
+     * @param documentData Document data, organized by name space.
+     * @param staticAuthData Static authentication data.
+     * @return a map from name spaces into maps from data element names into the bytes of the
+     * `IssuerSignedItemBytes` CBOR.
+     */
+    fun prepareIssuerNameSpaces(
+        documentData: NameSpacedData,
+        staticAuthData: StaticAuthData
+    ): Map<String, Map<String, ByteArray>> {
+        val issuerSignedItemMap = calcIssuerSignedItemMap(staticAuthData.digestIdMapping)
+        val prepared = LinkedHashMap<String, Map<String, ByteArray>>()
+        for (nameSpaceName in documentData.nameSpaceNames) {
+            val items = LinkedHashMap<String, ByteArray>()
+            for (dataElementName in documentData.getDataElementNames(nameSpaceName)) {
+                val encodedIssuerSignedItemMaybeWithoutValue =
+                    lookupIssuerSignedMap(issuerSignedItemMap, nameSpaceName, dataElementName)
+                        ?: continue
+                items[dataElementName] = taggedIssuerSignedItem(
+                    encodedIssuerSignedItemMaybeWithoutValue,
+                    documentData.getDataElement(nameSpaceName, dataElementName)
+                )
+            }
+            prepared[nameSpaceName] = items
+        }
+        return prepared
+    }
 
-            // We need a tagged bstr here
-            val taggedEncodedIssuerSignedItem = Cbor.encode(Tagged(24, Bstr(encodedIssuerSignedItem)))
-            list.add(taggedEncodedIssuerSignedItem)
+    /**
+     * Picks the data for a request from data prepared with [prepareIssuerNameSpaces].
+     *
+     * The result is the same as what [mergeIssuerNamesSpaces] returns for the request and
+     * the data the preparation was done for.
+     *
+     * @param request a [DocumentRequest] indicating which name spaces and data
+     * element names to include in the result.
+     * @param preparedIssuerNameSpaces the data returned by [prepareIssuerNameSpaces].
+     * @return a map from name spaces into a list of the bytes of the `IssuerSignedItemBytes`
+     * CBOR, as returned by [mergeIssuerNamesSpaces].
+     */
+    fun selectIssuerNameSpaces(
+        request: DocumentRequest,
+        preparedIssuerNameSpaces: Map<String, Map<String, ByteArray>>
+    ): Map<String, MutableList<ByteArray>> {
+        val issuerSignedData: MutableMap<String, MutableList<ByteArray>> = LinkedHashMap()
+        for ((nameSpaceName, dataElementName, _, doNotSend) in request.requestedDataElements) {
+            if (doNotSend) {
+                continue
+            }
+            val taggedEncodedIssuerSignedItem =
+                lookupIssuerSignedMap(preparedIssuerNameSpaces, nameSpaceName, dataElementName)
+            if (taggedEncodedIssuerSignedItem == null) {
+                Logger.d(TAG, "No IssuerSignedItem for $nameSpaceName $dataElementName")
+                continue
+            }
+            issuerSignedData.getOrPut(nameSpaceName) { ArrayList() }
+                .add(taggedEncodedIssuerSignedItem)
         }
         return issuerSignedData
     }
 
+    // Returns the IssuerSignedItemBytes for an IssuerSignedItem, adding the value if it was
+    // stripped.
+    private fun taggedIssuerSignedItem(
+        encodedIssuerSignedItemMaybeWithoutValue: ByteArray,
+        value: ByteArray
+    ): ByteArray {
+        val encodedIssuerSignedItem =
+            if (hasElementValue(encodedIssuerSignedItemMaybeWithoutValue)) {
+                encodedIssuerSignedItemMaybeWithoutValue
+            } else {
+                issuerSignedItemSetValue(encodedIssuerSignedItemMaybeWithoutValue, value)
+            }
+        // We need a tagged bstr here
+        return Cbor.encode(Tagged(24, Bstr(encodedIssuerSignedItem)))
+    }
+
     private fun hasElementValue(encodedIssuerSignedItem: ByteArray): Boolean =
-        Cbor.decode(encodedIssuerSignedItem)["elementValue"] != Simple.NULL
+        Cbor.decodeLazily(encodedIssuerSignedItem)["elementValue"] != Simple.NULL
 
     /**
      * Helper function to generate a [DocumentRequest].
@@ -315,16 +607,22 @@ object MdocUtil {
         return DocumentRequest(elements)
     }
 
-    private fun issuerSignedItemClearValue(encodedIssuerSignedItem: ByteArray): ByteArray {
+    private fun issuerSignedItemClearValue(issuerSignedItem: DataItem): ByteArray {
         val encodedNullValue = Cbor.encode(Simple.NULL)
-        return issuerSignedItemSetValue(encodedIssuerSignedItem, encodedNullValue)
+        return issuerSignedItemSetValue(issuerSignedItem, encodedNullValue)
     }
 
     private fun issuerSignedItemSetValue(
         encodedIssuerSignedItem: ByteArray,
         encodedElementValue: ByteArray
+    ): ByteArray =
+        issuerSignedItemSetValue(Cbor.decodeLazily(encodedIssuerSignedItem), encodedElementValue)
+
+    // Values other than elementValue are lazily decoded and will be re-encoded as-is.
+    private fun issuerSignedItemSetValue(
+        map: DataItem,
+        encodedElementValue: ByteArray
     ): ByteArray {
-        val map = Cbor.decode(encodedIssuerSignedItem)
         val builder = CborMap.builder()
         for (key in map.asMap.keys) {
             if (key.asTstr == "elementValue") {
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.android.identity.mdoc.connectionmethod
+
+import com.android.identity.storage.EphemeralStorageEngine
+import com.android.identity.util.UUID
+import kotlinx.datetime.Clock
+import kotlinx.datetime.Instant
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertNotNull
+import kotlin.test.assertNull
+
+class ConnectionMethodStatisticsTest {
+    private var nowMillis = 0L
+    private val clock = object : Clock {
+        override fun now() = Instant.fromEpochMilliseconds(nowMillis)
+    }
+
+    private val uuid = UUID.randomUUID()
+    private val nfc = ConnectionMethodNfc(4096, 32768)
+    private val bleCentral = ConnectionMethodBle(false, true, null, uuid)
+    private val blePeripheral = ConnectionMethodBle(true, false, uuid, null)
+    private val bleBoth = ConnectionMethodBle(true, true, uuid, uuid)
+    private val http = ConnectionMethodHttp("https://www.example.com/mdocReader")
+
+    @Test
+    fun testRecordAndPersist() {
+        val storageEngine = EphemeralStorageEngine()
+        val statistics = ConnectionMethodStatistics(storageEngine, clock = clock)
+        assertNull(statistics.getStatistics(nfc))
+
+        statistics.recordConnection(nfc, null, 100)
+        statistics.recordConnection(nfc, null, 200)
+        statistics.recordFailure(nfc, null)
+        statistics.recordTransfer(nfc, null, 10_000, 1000)
+        assertEquals(
+            ConnectionMethodStatistics.Entry(
+                numConnections = 2,
+                numFailures = 1,
+                setupMillis = 125,
+                bytesPerSecond = 10_000
+            ),
+            statistics.getStatistics(nfc)
+        )
+
+        // Check it's loaded from storage.
+        val loaded = ConnectionMethodStatistics(storageEngine, clock = clock)
+        assertEquals(statistics.getStatistics(nfc), loaded.getStatistics(nfc))
+
+        loaded.clear()
+        assertNull(loaded.getStatistics(nfc))
+        assertNull(ConnectionMethodStatistics(storageEngine, clock = clock).getStatistics(nfc))
+    }
+
+    @Test
+    fun testRank() {
+        val statistics = ConnectionMethodStatistics(EphemeralStorageEngine(), clock = clock)
+        val methods = listOf(nfc, http, blePeripheral)
+        assertEquals(methods, statistics.rank(methods))
+
+        // NFC connects quickly but is slow, BLE takes longer to connect but is a lot faster.
+        statistics.recordConnection(nfc, null, 50)
+        statistics.recordTransfer(nfc, null, 32 * 1024, 4000)
+        statistics.recordConnection(blePeripheral, null, 400)
+        statistics.recordTransfer(blePeripheral, null, 32 * 1024, 400)
+
+        // HTTP has no statistics so it keeps its place.
+        assertEquals(listOf(blePeripheral, http, nfc), statistics.rank(methods))
+
+        // A method which keeps failing is ranked last.
+        repeat(10) { statistics.recordFailure(blePeripheral, null) }
+        assertEquals(listOf(nfc, http, blePeripheral), statistics.rank(methods))
+
+        // A method offering both BLE modes is ranked using the best of them.
+        statistics.recordConnection(bleCentral, null, 100)
+        statistics.recordTransfer(bleCentral, null, 32 * 1024, 100)
+        assertEquals(listOf(bleBoth, nfc), statistics.rank(listOf(nfc, bleBoth)))
+    }
+
+    @Test
+    fun testPeers() {
+        val statistics = ConnectionMethodStatistics(
+            EphemeralStorageEngine(),
+            maxPeers = 2,
+            clock = clock
+        )
+        val methods = listOf(nfc, blePeripheral)
+        statistics.recordConnection(nfc, null, 100)
+        statistics.recordConnection(blePeripheral, null, 200)
+        assertEquals(listOf(nfc, blePeripheral), statistics.rank(methods))
+
+        // For this peer BLE is faster, for others the global statistics are used.
+        nowMillis = 1
+        statistics.recordConnection(blePeripheral, "reader1", 10)
+        statistics.recordConnection(nfc, "reader1", 100)
+        assertEquals(listOf(blePeripheral, nfc), statistics.rank(methods, "reader1"))
+        assertEquals(listOf(nfc, blePeripheral), statistics.rank(methods, "reader2"))
+        assertNotNull(statistics.getStatistics(nfc, "reader1"))
+
+        // Only the two most recently used peers are kept.
+        nowMillis = 2
+        statistics.recordConnection(nfc, "reader2", 100)
+        nowMillis = 3
+        statistics.recordConnection(nfc, "reader3", 100)
+        assertNull(statistics.getStatistics(nfc, "reader1"))
+        assertNotNull(statistics.getStatistics(nfc, "reader2"))
+        assertNotNull(statistics.getStatistics(nfc, "reader3"))
+        assertEquals(4, statistics.getStatistics(nfc)!!.numConnections)
+    }
+}
@@ -21,9 +21,13 @@ import com.android.identity.crypto.EcCurve
 import com.android.identity.crypto.EcPrivateKey
 import com.android.identity.crypto.EcPrivateKeyDoubleCoordinate
 import com.android.identity.crypto.EcPublicKeyDoubleCoordinate
+import com.android.identity.crypto.X509CertChain
+import com.android.identity.crypto.X509CertChainCache
 import com.android.identity.mdoc.TestVectors
 import com.android.identity.util.Constants
 import com.android.identity.util.fromHex
+import kotlinx.coroutines.test.runTest
+import kotlinx.datetime.Instant
 import kotlin.test.Test
 import kotlin.test.assertContentEquals
 import kotlin.test.assertEquals
@@ -310,4 +314,125 @@ class DeviceResponseParserTest {
         private const val MDL_DOCTYPE = "org.iso.18013.5.1.mDL"
         private const val MDL_NAMESPACE = "org.iso.18013.5.1"
     }
+
+    private fun assertSameDocument(
+        expected: DeviceResponseParser.Document,
+        actual: DeviceResponseParser.Document
+    ) {
+        assertEquals(expected.docType, actual.docType)
+        assertEquals(expected.issuerSignedAuthenticated, actual.issuerSignedAuthenticated)
+        assertEquals(expected.deviceSignedAuthenticated, actual.deviceSignedAuthenticated)
+        assertEquals(
+            expected.deviceSignedAuthenticatedViaSignature,
+            actual.deviceSignedAuthenticatedViaSignature
+        )
+        assertEquals(expected.numIssuerEntryDigestMatchFailures, actual.numIssuerEntryDigestMatchFailures)
+        assertEquals(expected.deviceKey, actual.deviceKey)
+        assertEquals(expected.issuerCertificateChain, actual.issuerCertificateChain)
+        assertEquals(expected.validityInfoValidUntil, actual.validityInfoValidUntil)
+        assertEquals(expected.issuerNamespaces, actual.issuerNamespaces)
+        for (nameSpace in expected.issuerNamespaces) {
+            assertEquals(
+                expected.getIssuerEntryNames(nameSpace),
+                actual.getIssuerEntryNames(nameSpace)
+            )
+            for (name in expected.getIssuerEntryNames(nameSpace)) {
+                assertContentEquals(
+                    expected.getIssuerEntryData(nameSpace, name),
+                    actual.getIssuerEntryData(nameSpace, name)
+                )
+                assertEquals(
+                    expected.getIssuerEntryDigestMatch(nameSpace, name),
+                    actual.getIssuerEntryDigestMatch(nameSpace, name)
+                )
+            }
+        }
+        assertEquals(expected.deviceNamespaces, actual.deviceNamespaces)
+    }
+
+    @Test
+    fun testParseConcurrentlyMatchesParse() = runTest {
+        val encodedDeviceResponse = TestVectors.ISO_18013_5_ANNEX_D_DEVICE_RESPONSE.fromHex()
+        val encodedSessionTranscript = Cbor.encode(
+            Cbor.decode(
+                TestVectors.ISO_18013_5_ANNEX_D_SESSION_TRANSCRIPT_BYTES.fromHex()
+            ).asTaggedEncodedCbor
+        )
+        val eReaderKey: EcPrivateKey = EcPrivateKeyDoubleCoordinate(
+            EcCurve.P256,
+            TestVectors.ISO_18013_5_ANNEX_D_EPHEMERAL_READER_KEY_D.fromHex(),
+            TestVectors.ISO_18013_5_ANNEX_D_EPHEMERAL_READER_KEY_X.fromHex(),
+            TestVectors.ISO_18013_5_ANNEX_D_EPHEMERAL_READER_KEY_Y.fromHex()
+        )
+        val parser = DeviceResponseParser(encodedDeviceResponse, encodedSessionTranscript)
+            .setEphemeralReaderKey(eReaderKey)
+        val expected = parser.parse()
+
+        val actual = parser.parseConcurrently()
+        assertEquals(expected.version, actual.version)
+        assertEquals(expected.status, actual.status)
+        assertEquals(1, actual.documents.size)
+        assertSameDocument(expected.documents[0], actual.documents[0])
+        assertTrue(actual.documents[0].deviceSignedAuthenticated)
+        assertTrue(actual.documents[0].issuerSignedAuthenticated)
+
+        val batch = DeviceResponseParser.parseBatch(List(3) { parser })
+        assertEquals(3, batch.size)
+        for (response in batch) {
+            assertSameDocument(expected.documents[0], response.documents[0])
+        }
+    }
+
+    @Test
+    fun testIssuerCertificateChainCache() {
+        val encodedDeviceResponse = TestVectors.ISO_18013_5_ANNEX_D_DEVICE_RESPONSE.fromHex()
+        val encodedSessionTranscript = Cbor.encode(
+            Cbor.decode(
+                TestVectors.ISO_18013_5_ANNEX_D_SESSION_TRANSCRIPT_BYTES.fromHex()
+            ).asTaggedEncodedCbor
+        )
+        val eReaderKey: EcPrivateKey = EcPrivateKeyDoubleCoordinate(
+            EcCurve.P256,
+            TestVectors.ISO_18013_5_ANNEX_D_EPHEMERAL_READER_KEY_D.fromHex(),
+            TestVectors.ISO_18013_5_ANNEX_D_EPHEMERAL_READER_KEY_X.fromHex(),
+            TestVectors.ISO_18013_5_ANNEX_D_EPHEMERAL_READER_KEY_Y.fromHex()
+        )
+        val expected = DeviceResponseParser(encodedDeviceResponse, encodedSessionTranscript)
+            .setEphemeralReaderKey(eReaderKey)
+            .parse()
+        assertNull(expected.documents[0].issuerCertificateChainVerified)
+
+        var now = Instant.fromEpochMilliseconds(1601559002000L)
+        val verifiedChains = mutableListOf<X509CertChain>()
+        val cache = X509CertChainCache(
+            verifier = { chain ->
+                verifiedChains.add(chain)
+                Instant.fromEpochMilliseconds(1633095002000L)
+            },
+            clock = { now }
+        )
+        repeat(3) {
+            val dr = DeviceResponseParser(encodedDeviceResponse, encodedSessionTranscript)
+                .setEphemeralReaderKey(eReaderKey)
+                .setIssuerCertificateChainCache(cache)
+                .parse()
+            assertSameDocument(expected.documents[0], dr.documents[0])
+            assertEquals(true, dr.documents[0].issuerCertificateChainVerified)
+        }
+        assertEquals(1, verifiedChains.size)
+        assertEquals(expected.documents[0].issuerCertificateChain, verifiedChains[0])
+        assertEquals(1L, cache.misses)
+        assertEquals(2L, cache.hits)
+
+        // Once the verification has expired, the chain is verified again...
+        now = Instant.fromEpochMilliseconds(1633095002000L)
+        val dr = DeviceResponseParser(encodedDeviceResponse, encodedSessionTranscript)
+            .setEphemeralReaderKey(eReaderKey)
+            .setIssuerCertificateChainCache(cache)
+            .parse()
+        assertEquals(false, dr.documents[0].issuerCertificateChainVerified)
+        assertEquals(2, verifiedChains.size)
+        assertEquals(2L, cache.misses)
+        assertEquals(1, cache.size)
+    }
 }
@@ -28,6 +28,9 @@ import kotlin.test.Test
 import kotlin.test.assertContentEquals
 import kotlin.test.assertEquals
 import kotlin.test.assertNull
+import kotlin.test.assertTrue
+import kotlinx.io.Buffer
+import kotlinx.io.readByteArray
 
 class SessionEncryptionTest {
     @Test
@@ -150,6 +153,178 @@ class SessionEncryptionTest {
         )
     }
 
+    private fun SessionEncryption.encryptMessageStreaming(
+        messagePlaintext: ByteArray,
+        statusCode: Long?
+    ): ByteArray {
+        val source = Buffer().apply { write(messagePlaintext) }
+        val message = encryptMessage(source, messagePlaintext.size.toLong(), statusCode)
+        val encoded = message.data.readByteArray()
+        assertEquals(message.size, encoded.size.toLong())
+        return encoded
+    }
+
+    @Test
+    fun testStreamingAgainstVectors() {
+        val eReaderKey: EcPrivateKey = EcPrivateKeyDoubleCoordinate(
+            EcCurve.P256,
+            TestVectors.ISO_18013_5_ANNEX_D_EPHEMERAL_READER_KEY_D.fromHex(),
+            TestVectors.ISO_18013_5_ANNEX_D_EPHEMERAL_READER_KEY_X.fromHex(),
+            TestVectors.ISO_18013_5_ANNEX_D_EPHEMERAL_READER_KEY_Y.fromHex()
+        )
+        val eDeviceKey: EcPrivateKey = EcPrivateKeyDoubleCoordinate(
+            EcCurve.P256,
+            TestVectors.ISO_18013_5_ANNEX_D_EPHEMERAL_DEVICE_KEY_D.fromHex(),
+            TestVectors.ISO_18013_5_ANNEX_D_EPHEMERAL_DEVICE_KEY_X.fromHex(),
+            TestVectors.ISO_18013_5_ANNEX_D_EPHEMERAL_DEVICE_KEY_Y.fromHex()
+        )
+        val sessionTranscript = Cbor.decode(
+            TestVectors.ISO_18013_5_ANNEX_D_SESSION_TRANSCRIPT_BYTES.fromHex()
+        ).asTaggedEncodedCbor
+        val sessionEncryptionReader = SessionEncryption(
+            SessionEncryption.Role.MDOC_READER,
+            eReaderKey,
+            eDeviceKey.publicKey,
+            Cbor.encode(sessionTranscript)
+        )
+        val sessionEncryptionDevice = SessionEncryption(
+            SessionEncryption.Role.MDOC,
+            eDeviceKey,
+            eReaderKey.publicKey,
+            Cbor.encode(sessionTranscript)
+        )
+
+        assertContentEquals(
+            TestVectors.ISO_18013_5_ANNEX_D_SESSION_ESTABLISHMENT.fromHex(),
+            sessionEncryptionReader.encryptMessageStreaming(
+                TestVectors.ISO_18013_5_ANNEX_D_DEVICE_REQUEST.fromHex(),
+                null
+            )
+        )
+        assertContentEquals(
+            TestVectors.ISO_18013_5_ANNEX_D_SESSION_DATA.fromHex(),
+            sessionEncryptionDevice.encryptMessageStreaming(
+                TestVectors.ISO_18013_5_ANNEX_D_DEVICE_RESPONSE.fromHex(),
+                null
+            )
+        )
+        assertEquals(1, sessionEncryptionReader.numMessagesEncrypted)
+        assertEquals(1, sessionEncryptionDevice.numMessagesEncrypted)
+    }
+
+    @Test
+    fun testStreamingLargeMessage() {
+        val eReaderKey = Crypto.createEcPrivateKey(EcCurve.P256)
+        val eDeviceKey = Crypto.createEcPrivateKey(EcCurve.P256)
+        val encodedSessionTranscript = byteArrayOf(1, 2, 3)
+        val sessionEncryptionHolder = SessionEncryption(
+            SessionEncryption.Role.MDOC,
+            eDeviceKey,
+            eReaderKey.publicKey,
+            encodedSessionTranscript
+        )
+        val sessionEncryptionHolderStreaming = SessionEncryption(
+            SessionEncryption.Role.MDOC,
+            eDeviceKey,
+            eReaderKey.publicKey,
+            encodedSessionTranscript
+        )
+        val sessionEncryptionReader = SessionEncryption(
+            SessionEncryption.Role.MDOC_READER,
+            eReaderKey,
+            eDeviceKey.publicKey,
+            encodedSessionTranscript
+        )
+
+        // Large enough to need several chunks and a 32-bit bstr length.
+        val deviceResponse = ByteArray(100_000) { it.toByte() }
+        for (status in listOf(null, Constants.SESSION_DATA_STATUS_SESSION_TERMINATION)) {
+            val expected = sessionEncryptionHolder.encryptMessage(deviceResponse, status)
+            val encrypted = sessionEncryptionHolderStreaming.encryptMessageStreaming(
+                deviceResponse,
+                status
+            )
+            assertContentEquals(expected, encrypted)
+            val result = sessionEncryptionReader.decryptMessage(encrypted)
+            assertEquals(status, result.second)
+            assertContentEquals(deviceResponse, result.first)
+        }
+    }
+
+    @Test
+    fun testStreamingMessagesReadAfterNextOneCreated() {
+        val eReaderKey = Crypto.createEcPrivateKey(EcCurve.P256)
+        val eDeviceKey = Crypto.createEcPrivateKey(EcCurve.P256)
+        val encodedSessionTranscript = byteArrayOf(1, 2, 3)
+        val sessionEncryptionHolder = SessionEncryption(
+            SessionEncryption.Role.MDOC,
+            eDeviceKey,
+            eReaderKey.publicKey,
+            encodedSessionTranscript
+        )
+        val sessionEncryptionReader = SessionEncryption(
+            SessionEncryption.Role.MDOC_READER,
+            eReaderKey,
+            eDeviceKey.publicKey,
+            encodedSessionTranscript
+        )
+
+        // Each message must be encrypted with its own counter, even if it's read only after
+        // the next one was created.
+        val plaintexts = listOf(ByteArray(1000) { 1 }, ByteArray(1000) { 2 })
+        val messages = plaintexts.map { plaintext ->
+            sessionEncryptionHolder.encryptMessage(
+                Buffer().apply { write(plaintext) },
+                plaintext.size.toLong(),
+                null
+            )
+        }
+        for ((plaintext, message) in plaintexts.zip(messages)) {
+            val result = sessionEncryptionReader.decryptMessage(message.data.readByteArray())
+            assertContentEquals(plaintext, result.first)
+        }
+    }
+
+    @Test
+    fun testStreamingReadsAtMostByteCount() {
+        val eReaderKey = Crypto.createEcPrivateKey(EcCurve.P256)
+        val eDeviceKey = Crypto.createEcPrivateKey(EcCurve.P256)
+        val encodedSessionTranscript = byteArrayOf(1, 2, 3)
+        val sessionEncryptionHolder = SessionEncryption(
+            SessionEncryption.Role.MDOC,
+            eDeviceKey,
+            eReaderKey.publicKey,
+            encodedSessionTranscript
+        )
+        val sessionEncryptionReader = SessionEncryption(
+            SessionEncryption.Role.MDOC_READER,
+            eReaderKey,
+            eDeviceKey.publicKey,
+            encodedSessionTranscript
+        )
+
+        val deviceResponse = ByteArray(100_000) { it.toByte() }
+        val message = sessionEncryptionHolder.encryptMessage(
+            Buffer().apply { write(deviceResponse) },
+            deviceResponse.size.toLong(),
+            Constants.SESSION_DATA_STATUS_SESSION_TERMINATION
+        )
+        val encrypted = Buffer()
+        while (true) {
+            val buffer = Buffer()
+            val read = message.data.readAtMostTo(buffer, 100)
+            if (read < 0) {
+                break
+            }
+            assertTrue(read <= 100)
+            assertEquals(read, buffer.size)
+            encrypted.write(buffer, buffer.size)
+        }
+        assertEquals(message.size, encrypted.size)
+        val result = sessionEncryptionReader.decryptMessage(encrypted.readByteArray())
+        assertContentEquals(deviceResponse, result.first)
+    }
+
     private fun testCurve(curve: EcCurve) {
         // TODO: use assumeTrue() when available in kotlin-test
         if (!Crypto.supportedCurves.contains(curve)) {
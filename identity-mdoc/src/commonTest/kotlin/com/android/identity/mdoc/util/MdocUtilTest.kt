@@ -16,6 +16,7 @@
 package com.android.identity.mdoc.util
 
 import com.android.identity.cbor.Cbor
+import com.android.identity.cbor.CborMap
 import com.android.identity.cbor.DiagnosticOption
 import com.android.identity.cbor.Tstr
 import com.android.identity.document.DocumentRequest.DataElement
@@ -30,6 +31,7 @@ import com.android.identity.mdoc.util.MdocUtil.generateIssuerNameSpaces
 import com.android.identity.mdoc.util.MdocUtil.stripIssuerNameSpaces
 import com.android.identity.util.fromHex
 import com.android.identity.util.toHex
+import kotlinx.coroutines.test.runTest
 import kotlin.random.Random
 import kotlin.test.Test
 import kotlin.test.assertContentEquals
@@ -219,6 +221,85 @@ class MdocUtilTest {
         )
     }
 
+    @Test
+    fun testGenerateIssuerSignedDataMatchesSeparateCalls() = runTest {
+        val nameSpacedData = NameSpacedData.Builder()
+            .putEntryString("ns1", "foo1", "bar1")
+            .putEntryString("ns1", "foo2", "bar2")
+            .putEntryByteString("ns1", "portrait", ByteArray(70000) { it.toByte() })
+            .putEntryByteString("ns2", "medium", ByteArray(300) { it.toByte() })
+            .putEntryString("ns2", "bar2", "foo2")
+            .build()
+        val overrides = mapOf("ns1" to mapOf("foo2" to Cbor.encode(Tstr("bar2_override"))))
+        val exceptions = mapOf("ns2" to listOf("bar2"))
+
+        val numCredentials = 3
+        val issuerSignedData = MdocUtil.generateIssuerSignedData(
+            nameSpacedData,
+            numCredentials,
+            Random(42),
+            16,
+            overrides,
+            Algorithm.SHA256,
+            strip = true,
+            stripExceptions = exceptions
+        )
+        assertEquals(numCredentials, issuerSignedData.size)
+
+        // The same as generating the data for one credential at a time.
+        val randomProvider = Random(42)
+        for (data in issuerSignedData) {
+            val issuerNameSpaces = generateIssuerNameSpaces(nameSpacedData, randomProvider, 16, overrides)
+            val stripped = stripIssuerNameSpaces(issuerNameSpaces, exceptions)
+            assertEquals(issuerNameSpaces.keys, data.issuerNameSpaces.keys)
+            for (nameSpaceName in issuerNameSpaces.keys) {
+                assertEquals(
+                    issuerNameSpaces[nameSpaceName]!!.map { it.toHex() },
+                    data.issuerNameSpaces[nameSpaceName]!!.map { it.toHex() }
+                )
+                assertEquals(
+                    stripped[nameSpaceName]!!.map { it.toHex() },
+                    data.digestIdMapping[nameSpaceName]!!.map { it.toHex() }
+                )
+                val digests = calculateDigestsForNameSpace(nameSpaceName, issuerNameSpaces, Algorithm.SHA256)
+                assertEquals(
+                    digests.mapValues { it.value.toHex() },
+                    data.digests[nameSpaceName]!!.mapValues { it.value.toHex() }
+                )
+            }
+        }
+    }
+
+    @Test
+    fun testGenerateIssuerSignedDataEmptyNameSpace() = runTest {
+        val nameSpacedData = NameSpacedData.fromDataItem(
+            CborMap.builder()
+                .putMap("ns1")
+                    .putTaggedEncodedCbor("foo1", Cbor.encode(Tstr("bar1")))
+                    .end()
+                .putMap("empty")
+                    .end()
+                .end()
+                .build()
+        )
+
+        val issuerSignedData = MdocUtil.generateIssuerSignedData(
+            nameSpacedData,
+            1,
+            Random(42),
+            16,
+            null,
+            Algorithm.SHA256
+        )
+        val data = issuerSignedData[0]
+        val issuerNameSpaces = generateIssuerNameSpaces(nameSpacedData, Random(42), 16, null)
+        assertEquals(issuerNameSpaces.keys, data.issuerNameSpaces.keys)
+        assertEquals(0, data.issuerNameSpaces["empty"]!!.size)
+        assertEquals(0, data.digestIdMapping["empty"]!!.size)
+        assertEquals(0, data.digests["empty"]!!.size)
+        assertEquals(1, data.issuerNameSpaces["ns1"]!!.size)
+    }
+
     @Test
     fun testGetDigestsForNameSpaceInTestVectors() {
         val deviceResponse = Cbor.decode(
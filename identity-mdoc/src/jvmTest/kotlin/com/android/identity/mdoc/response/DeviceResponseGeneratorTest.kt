@@ -301,6 +301,40 @@ class DeviceResponseGeneratorTest {
         assertEquals("foo1", doc.getIssuerEntryString("ns2", "bar1"))
     }
 
+    @Test
+    fun testPreparedIssuerNameSpacesMatchMerged() {
+        val documentData = document.applicationData.getNameSpacedData("documentData")
+        val staticAuthData = StaticAuthDataParser(mdocCredential.issuerProvidedData)
+            .parse()
+        val prepared = MdocUtil.prepareIssuerNameSpaces(documentData, staticAuthData)
+        val requests = listOf(
+            DocumentRequest(listOf(DataElement("ns2", "bar2", false, false))),
+            DocumentRequest(listOf(
+                DataElement("ns2", "bar1", false, false),
+                DataElement("ns1", "foo3", false, false),
+                DataElement("ns1", "foo1", false, true),
+                DataElement("ns2", "does_not_exist", false, false),
+                DataElement("ns_does_not_exist", "boo", false, false)
+            )),
+            DocumentRequest(documentData.nameSpaceNames.flatMap { nameSpaceName ->
+                documentData.getDataElementNames(nameSpaceName).map { dataElementName ->
+                    DataElement(nameSpaceName, dataElementName, false, false)
+                }
+            })
+        )
+        for (request in requests) {
+            val merged = MdocUtil.mergeIssuerNamesSpaces(request, documentData, staticAuthData)
+            val selected = MdocUtil.selectIssuerNameSpaces(request, prepared)
+            assertEquals(merged.keys.toList(), selected.keys.toList())
+            for (nameSpaceName in merged.keys) {
+                assertEquals(
+                    merged[nameSpaceName]!!.map { it.toList() },
+                    selected[nameSpaceName]!!.map { it.toList() }
+                )
+            }
+        }
+    }
+
     @Test
     fun testDocumentGeneratorMac() {
         // Also check that Mac authentication works. This requires creating an ephemeral
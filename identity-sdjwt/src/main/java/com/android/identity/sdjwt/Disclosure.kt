@@ -22,6 +22,10 @@ import kotlin.random.Random
  *
  * (The disclosure would be the base64 encoding of the UTF-8 representation of the JSON Array)
  *
+ * The disclosure is only decoded when [key] or [value] is first accessed, and [hash] is
+ * computed once, over the disclosure as given. This way a verifier checking signatures and
+ * hashes doesn't pay for decoding disclosures it never looks at.
+ *
  * @param disclosure the disclosure, i.e., the base64-encoding of three-element JSON array
  * @param digestAlg the algorithm to use when the disclosure needs to be hashed
  */
@@ -30,16 +34,17 @@ class Disclosure(
     private val digestAlg: Algorithm = Algorithm.SHA256
 ) {
 
-    val key: String
-    val value: JsonElement
-
-    init {
+    private val contents: JsonArray by lazy {
         val contentsString = String(disclosure.fromBase64(), Charsets.UTF_8)
-        val contents = Json.decodeFromString(JsonArray.serializer(), contentsString).jsonArray
-        key = contents[1].jsonPrimitive.content
-        value = contents[2]
+        Json.decodeFromString(JsonArray.serializer(), contentsString).jsonArray
     }
 
+    val key: String
+        get() = contents[1].jsonPrimitive.content
+
+    val value: JsonElement
+        get() = contents[2]
+
     /**
      * Public constructor for a new disclosure, given a key and value. Disclosures
      * encode key-value pairs. A salted hash of a disclosure is included in the signed
@@ -61,8 +66,9 @@ class Disclosure(
     }
     override fun toString(): String = disclosure
 
-    val hash
-        get() = Crypto.digest(digestAlg, toString().toByteArray()).toBase64()
+    val hash: String by lazy {
+        Crypto.digest(digestAlg, disclosure.toByteArray(Charsets.US_ASCII)).toBase64()
+    }
 
     companion object {
         private fun calculateDisclosure(key: String, value: JsonElement, random: Random): String {
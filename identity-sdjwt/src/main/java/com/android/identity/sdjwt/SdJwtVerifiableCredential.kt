@@ -39,6 +39,10 @@ import kotlinx.serialization.json.JsonElement
  * whose hashes are included in the body. Disclosures are delimited from each other
  * by a tilde (~)
  *
+ * When parsed with [fromString], the SD-JWT keeps the string it was parsed from, so
+ * [toString] and the `sd_hash` of a presentation don't need to re-serialize it. The body is
+ * decoded at most once and disclosures are only decoded when they're looked at.
+ *
  *  @param header the base64-encoded header of the SD-JWT
  *  @param body the base64-encoded body of the SD-JWT
  *  @param signature the base64-encoded signature (by the issuer, over the header and body)
@@ -51,7 +55,28 @@ class SdJwtVerifiableCredential(
     val signature: String,
     val disclosures: List<Disclosure>
 ) {
-    override fun toString() = "$header.$body.$signature~${disclosures.joinToString("~", postfix = "~")}"
+    // The string this was parsed from, if any, set by fromString().
+    private var encoded: String? = null
+
+    override fun toString(): String =
+        encoded ?: "$header.$body.$signature~${disclosures.joinToString("~", postfix = "~")}"
+
+    internal val jwtHeader: JwtHeader by lazy { JwtHeader.fromString(header) }
+
+    // Set by fromString(), which needs the body for the digest algorithm anyway.
+    private var parsedBody: JwtBody? = null
+
+    internal val jwtBody: JwtBody
+        get() = parsedBody ?: JwtBody.fromString(body).also { parsedBody = it }
+
+    private val disclosureHashes: Set<String> by lazy { jwtBody.disclosureHashes.toSet() }
+
+    /**
+     * The hash of this SD-JWT, as included in the `sd_hash` claim of a key binding JWT.
+     */
+    internal val sdHash: String by lazy {
+        Crypto.digest(sdHashAlg, toString().toByteArray(Charsets.US_ASCII)).toBase64()
+    }
 
     /**
      * Create a copy of this SD-JWT that discloses only certain attributes.
@@ -60,6 +85,7 @@ class SdJwtVerifiableCredential(
         val newDisclosures = disclosures
             .filter { it.key in attributes }
         return SdJwtVerifiableCredential(header, body, signature, newDisclosures)
+            .also { it.parsedBody = parsedBody }
     }
 
     /**
@@ -68,16 +94,10 @@ class SdJwtVerifiableCredential(
      * @param attribute the attribute whose value should be obtained
      */
     fun getAttributeValue(attribute: String): JsonElement {
-        val matchingDisclosures = disclosures.filter { it.key == attribute }
-        if (matchingDisclosures.isEmpty()) {
-            throw AttributeNotDisclosedException("attribute $attribute not included in disclosures")
-        }
-
-        val disclosure = matchingDisclosures[0]
+        val disclosure = disclosures.firstOrNull { it.key == attribute }
+            ?: throw AttributeNotDisclosedException("attribute $attribute not included in disclosures")
         val disclosureHash = disclosure.hash
 
-        val disclosureHashes = JwtBody.fromString(body).disclosureHashes
-
         if (!disclosureHashes.contains(disclosureHash)) {
             throw DisclosureError("attribute $attribute not included in disclosures. Looking for hash $disclosureHash, but couldn't find it")
         }
@@ -85,7 +105,7 @@ class SdJwtVerifiableCredential(
         return disclosure.value
     }
 
-    val sdHashAlg get() = JwtBody.fromString(body).sdHashAlg
+    val sdHashAlg get() = jwtBody.sdHashAlg
 
     /**
      * Verify the issuer signature on this SD-JWT. This method constructs the right
@@ -106,8 +126,8 @@ class SdJwtVerifiableCredential(
      *        The lambda must return true if the signature verifies, and false otherwise.
      */
     fun verifyIssuerSignature(verify: (JwtHeader, JwtBody, ByteArray, EcSignature) -> Boolean) {
-        val headerObj = JwtHeader.fromString(header)
-        val bodyObj = JwtBody.fromString(body)
+        val headerObj = jwtHeader
+        val bodyObj = jwtBody
 
         val toBeVerified = "$header.$body".toByteArray(Charsets.US_ASCII)
         val signature = EcSignature.fromCoseEncoded(signature.fromBase64())
@@ -140,7 +160,6 @@ class SdJwtVerifiableCredential(
 
         val keyBindingHeaderStr = KeyBindingHeader(alg).toString()
 
-        val sdHash = Crypto.digest(this.sdHashAlg, toString().toByteArray()).toBase64()
         val keyBindingBodyStr = KeyBindingBody(nonce, audience, creationTime, sdHash).toString()
 
         val toBeSigned = "$keyBindingHeaderStr.$keyBindingBodyStr".toByteArray(Charsets.US_ASCII)
@@ -157,24 +176,43 @@ class SdJwtVerifiableCredential(
 
     companion object {
         fun fromString(sdJwt: String): SdJwtVerifiableCredential {
-            val splits = sdJwt.split("~")
-
-            // first item is a JWT
-            val jwtSplits = splits[0].split(".")
-            if (jwtSplits.size != 3) {
-                throw MalformedJwtError("JWT in SD-JWT didn't consist of three parts: ${splits[0]}")
+            // first item is a JWT, the parts of which are found by scanning for the
+            // separators rather than splitting the entire string.
+            val jwtEnd = sdJwt.indexOf('~').let { if (it == -1) sdJwt.length else it }
+            val firstDot = sdJwt.indexOf('.')
+            val secondDot = if (firstDot == -1) -1 else sdJwt.indexOf('.', firstDot + 1)
+            if (firstDot == -1 || secondDot == -1 || secondDot >= jwtEnd ||
+                sdJwt.indexOf('.', secondDot + 1).let { it != -1 && it < jwtEnd }) {
+                throw MalformedJwtError(
+                    "JWT in SD-JWT didn't consist of three parts: ${sdJwt.substring(0, jwtEnd)}")
             }
 
-            val (header, body, signature) = jwtSplits
-
-            val digestAlg = JwtBody.fromString(body).sdHashAlg
-
-            val disclosures = splits
-                .drop(1) // drop the JWT preceding the disclosures
-                .dropLast(1) // drop the last empty segment, created by the trailing ~
-                .map { Disclosure(it, digestAlg) }
+            val header = sdJwt.substring(0, firstDot)
+            val body = sdJwt.substring(firstDot + 1, secondDot)
+            val signature = sdJwt.substring(secondDot + 1, jwtEnd)
+
+            val bodyObj = JwtBody.fromString(body)
+            val digestAlg = bodyObj.sdHashAlg
+
+            // Every disclosure is terminated by a tilde, anything after the last one
+            // isn't a disclosure.
+            val disclosures = mutableListOf<Disclosure>()
+            var start = jwtEnd + 1
+            while (start < sdJwt.length) {
+                val end = sdJwt.indexOf('~', start)
+                if (end == -1) {
+                    break
+                }
+                disclosures.add(Disclosure(sdJwt.substring(start, end), digestAlg))
+                start = end + 1
+            }
 
-            return SdJwtVerifiableCredential(header, body, signature, disclosures)
+            return SdJwtVerifiableCredential(header, body, signature, disclosures).apply {
+                if (disclosures.isNotEmpty()) {
+                    encoded = if (start == sdJwt.length) sdJwt else sdJwt.substring(0, start)
+                }
+                parsedBody = bodyObj
+            }
         }
     }
 
@@ -5,8 +5,8 @@ import com.android.identity.crypto.EcPublicKey
 import com.android.identity.crypto.EcSignature
 import com.android.identity.sdjwt.SdJwtVerifiableCredential
 import com.android.identity.sdjwt.vc.JwtBody
+import com.android.identity.sdjwt.vc.JwtHeader
 import com.android.identity.util.fromBase64
-import com.android.identity.util.toBase64
 import kotlinx.datetime.Instant
 
 /**
@@ -35,8 +35,7 @@ class SdJwtVerifiablePresentation(
         val keyBindingBodyObj = KeyBindingBody.fromString(keyBindingBody)
 
         // compare the hash of the VC against what's in the key binding JWT
-        val sdHash = Crypto.digest(sdJwtVc.sdHashAlg, sdJwtVc.toString().toByteArray()).toBase64()
-        if (sdHash != keyBindingBodyObj.sdHash) {
+        if (sdJwtVc.sdHash != keyBindingBodyObj.sdHash) {
             throw IllegalStateException("hash in key binding JWT didn't match SD-JWT")
         }
 
@@ -63,7 +62,7 @@ class SdJwtVerifiablePresentation(
         checkAudience: (String) -> Boolean,
         checkCreationTime: (Instant) -> Boolean,
     ) {
-        val key = JwtBody.fromString(sdJwtVc.body).publicKey?.asEcPublicKey ?:
+        val key = sdJwtVc.jwtBody.publicKey?.asEcPublicKey ?:
             throw MalformedSdJwtPresentationError("couldn't parse public holder key from JWT: ${sdJwtVc.body}")
         val keyBindingBodyObj = verifyHolderSignature(key)
 
@@ -95,21 +94,79 @@ class SdJwtVerifiablePresentation(
 
             val sdJwt = SdJwtVerifiableCredential.fromString(sdJwtString)
 
-            val keyBindingJwtParts = keyBindingJwtString.split(".")
-
-            if (keyBindingJwtParts.size != 3) {
+            val firstDot = keyBindingJwtString.indexOf('.')
+            val secondDot = if (firstDot == -1) -1 else keyBindingJwtString.indexOf('.', firstDot + 1)
+            if (firstDot == -1 || secondDot == -1 || keyBindingJwtString.indexOf('.', secondDot + 1) != -1) {
                 throw MalformedSdJwtPresentationError("key binding JWT didn't consist of three parts: $keyBindingJwtString")
             }
 
-            val (keyBindingHeader, keyBindingBody, keyBindingSignature) = keyBindingJwtParts
-
             return SdJwtVerifiablePresentation(
                 sdJwt,
-                keyBindingHeader,
-                keyBindingBody,
-                keyBindingSignature)
+                keyBindingJwtString.substring(0, firstDot),
+                keyBindingJwtString.substring(firstDot + 1, secondDot),
+                keyBindingJwtString.substring(secondDot + 1))
+        }
+
+        /**
+         * Parses and verifies presentations in bulk, e.g. on a server handling many of them.
+         *
+         * For each presentation the issuer signature is checked with the key returned by
+         * [getIssuerKey] and the key binding is checked as in [verifyKeyBinding]. The
+         * SD-JWT body is parsed once per presentation and shared by both checks, disclosures
+         * aren't decoded, and [getIssuerKey] is called only once for presentations sharing
+         * the same header and issuer.
+         *
+         * A presentation failing verification doesn't affect the others, failures are
+         * reported in the returned list instead of being thrown.
+         *
+         * @param presentations the presentations to verify, as strings.
+         * @param getIssuerKey a function returning the key to check the issuer signature,
+         *   given the header and body of the SD-JWT.
+         * @param checkNonce checks the nonce in the key binding JWT.
+         * @param checkAudience checks the audience in the key binding JWT.
+         * @param checkCreationTime checks the creation time of the key binding JWT.
+         * @return a [VerificationResult] for each element of [presentations], in order.
+         */
+        fun verify(
+            presentations: List<String>,
+            getIssuerKey: (JwtHeader, JwtBody) -> EcPublicKey,
+            checkNonce: (String) -> Boolean,
+            checkAudience: (String) -> Boolean,
+            checkCreationTime: (Instant) -> Boolean,
+        ): List<VerificationResult> {
+            val issuerKeys = mutableMapOf<Pair<String, String>, EcPublicKey>()
+            return presentations.map { input ->
+                var presentation: SdJwtVerifiablePresentation? = null
+                try {
+                    presentation = fromString(input)
+                    val sdJwtVc = presentation.sdJwtVc
+                    val issuerKey = issuerKeys.getOrPut(Pair(sdJwtVc.header, sdJwtVc.jwtBody.issuer)) {
+                        getIssuerKey(sdJwtVc.jwtHeader, sdJwtVc.jwtBody)
+                    }
+                    sdJwtVc.verifyIssuerSignature(issuerKey)
+                    presentation.verifyKeyBinding(checkNonce, checkAudience, checkCreationTime)
+                    VerificationResult(presentation, null)
+                } catch (e: Exception) {
+                    VerificationResult(presentation, e)
+                }
+            }
         }
     }
 
+    /**
+     * The result of verifying a presentation using [SdJwtVerifiablePresentation.verify].
+     *
+     * @param presentation the parsed presentation or `null` if it couldn't be parsed.
+     * @param error the reason verification failed or `null` if it succeeded.
+     */
+    class VerificationResult(
+        val presentation: SdJwtVerifiablePresentation?,
+        val error: Exception?
+    ) {
+        /** Whether the presentation was verified. */
+        val isVerified: Boolean
+            get() = error == null
+    }
+
     class MalformedSdJwtPresentationError(message: String): Exception(message)
 }
\ No newline at end of file
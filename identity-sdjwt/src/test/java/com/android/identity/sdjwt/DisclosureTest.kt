@@ -1,11 +1,13 @@
 package com.android.identity.sdjwt
 
 import com.android.identity.crypto.Algorithm
+import kotlinx.serialization.SerializationException
 import kotlinx.serialization.json.buildJsonObject
 import kotlinx.serialization.json.jsonPrimitive
 import kotlinx.serialization.json.put
 import org.junit.Assert.assertEquals
 import org.junit.Test
+import kotlin.test.assertFailsWith
 import kotlin.random.Random
 
 class DisclosureTest {
@@ -35,4 +37,13 @@ class DisclosureTest {
         assertEquals("address", d.key)
         assertEquals(address, d.value)
     }
+
+    @Test
+    fun test_disclosure_decoded_lazily() {
+        // Hashing doesn't need the disclosure to be decoded, only accessing the contents does.
+        val d = Disclosure("bm90LWpzb24", digestAlg = Algorithm.SHA256)
+        assertEquals("bm90LWpzb24", d.toString())
+        assertEquals(d.hash, Disclosure("bm90LWpzb24").hash)
+        assertFailsWith<SerializationException> { d.key }
+    }
 }
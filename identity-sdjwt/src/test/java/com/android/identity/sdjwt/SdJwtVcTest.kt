@@ -25,6 +25,9 @@ import kotlinx.serialization.json.jsonPrimitive
 import kotlinx.serialization.json.put
 import org.bouncycastle.jce.provider.BouncyCastleProvider
 import org.junit.Assert.assertEquals
+import org.junit.Assert.assertFalse
+import org.junit.Assert.assertNotNull
+import org.junit.Assert.assertNull
 import org.junit.Assert.assertTrue
 import org.junit.Before
 import org.junit.Test
@@ -225,6 +228,55 @@ class SdJwtVcTest {
         assertEquals(true, presentation.sdJwtVc.getAttributeValue("over_18").jsonPrimitive.boolean)
     }
 
+    @Test
+    fun testBatchVerification() {
+        val sdJwtString = String(credential.issuerProvidedData, Charsets.US_ASCII)
+        val sdJwt = SdJwtVerifiableCredential.fromString(sdJwtString)
+
+        // The parsed SD-JWT serializes to exactly what it was parsed from.
+        assertEquals(sdJwtString, sdJwt.toString())
+        assertEquals(
+            sdJwtString,
+            SdJwtVerifiableCredential(sdJwt.header, sdJwt.body, sdJwt.signature, sdJwt.disclosures)
+                .toString()
+        )
+
+        val presentations = listOf("nonce-1", "nonce-2").map { nonce ->
+            sdJwt.discloseOnly(setOf("over_18")).createPresentation(
+                credential.secureArea,
+                credential.alias,
+                null,
+                Algorithm.ES256,
+                nonce,
+                "https://example-verifier.com"
+            ).toString()
+        } + "not-a-presentation"
+
+        var numIssuerKeyLookups = 0
+        val results = SdJwtVerifiablePresentation.verify(
+            presentations,
+            getIssuerKey = { _, body ->
+                assertEquals("https://example-issuer.com", body.issuer)
+                numIssuerKeyLookups += 1
+                issuerCert.ecPublicKey
+            },
+            checkNonce = { it == "nonce-1" },
+            checkAudience = { it == "https://example-verifier.com" },
+            checkCreationTime = { it <= Clock.System.now() }
+        )
+
+        assertEquals(3, results.size)
+        assertTrue(results[0].isVerified)
+        assertEquals(true, results[0].presentation!!.getAttributeValue("over_18").jsonPrimitive.boolean)
+        // The second presentation parses but has the wrong nonce.
+        assertFalse(results[1].isVerified)
+        assertNotNull(results[1].presentation)
+        assertFalse(results[2].isVerified)
+        assertNull(results[2].presentation)
+        // Both presentations are for the same issuer.
+        assertEquals(1, numIssuerKeyLookups)
+    }
+
     @Test
     @Ignore
     fun testParseSection6Example1() {
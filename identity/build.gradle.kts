@@ -49,7 +49,7 @@ kotlin {
             dependencies {
                 implementation(projects.processorAnnotations)
                 implementation(libs.kotlinx.io.bytestring)
-                implementation(libs.kotlinx.io.core)
+                api(libs.kotlinx.io.core)
                 implementation(libs.kotlinx.datetime)
                 implementation(libs.kotlinx.coroutines.core)
                 implementation(libs.kotlinx.serialization.json)
@@ -1,18 +1,18 @@
 package com.android.identity.cbor
 
-import kotlinx.io.bytestring.ByteStringBuilder
-
 /**
  * Byte String (major type 2).
  *
  * @param value the [ByteArray] for the value of the byte string.
  */
 data class Bstr(val value: ByteArray) : DataItem(MajorType.BYTE_STRING) {
-    override fun encode(builder: ByteStringBuilder) {
+    override fun encode(builder: EncodeBuffer) {
         Cbor.encodeLength(builder, majorType, value.size)
         builder.append(value)
     }
 
+    override fun encodedSize(): Int = Cbor.encodedLengthSize(value.size.toULong()) + value.size
+
     companion object {
         internal fun decode(encodedCbor: ByteArray, offset: Int): Pair<Int, Bstr> {
             val (payloadBegin, length) = Cbor.decodeLength(encodedCbor, offset)
@@ -1,7 +1,7 @@
 package com.android.identity.cbor
 
+import kotlinx.io.Sink
 import kotlin.math.pow
-import kotlinx.io.bytestring.ByteStringBuilder
 import kotlin.experimental.or
 
 /**
@@ -14,13 +14,13 @@ object Cbor {
     private val HEX_DIGITS = "0123456789abcdef".toCharArray()
 
     internal fun encodeLength(
-        builder: ByteStringBuilder,
+        builder: EncodeBuffer,
         majorType: MajorType,
         length: Int
     ) = encodeLength(builder, majorType, length.toULong())
 
     internal fun encodeLength(
-        builder: ByteStringBuilder,
+        builder: EncodeBuffer,
         majorType: MajorType,
         length: ULong
     ) {
@@ -35,7 +35,7 @@ object Cbor {
                 append(majorTypeShifted.or(25))
                 append((length shr 8).and(0xffU).toByte())
                 append((length shr 0).and(0xffU).toByte())
-            } else if (length < (1U shl 32)) {
+            } else if (length < (1UL shl 32)) {
                 append(majorTypeShifted.or(26))
                 append((length shr 24).and(0xffU).toByte())
                 append((length shr 16).and(0xffU).toByte())
@@ -55,16 +55,87 @@ object Cbor {
         }
     }
 
+    // Returns the number of bytes used by encodeLength() for the given length.
+    internal fun encodedLengthSize(length: ULong): Int =
+        if (length < 24U) {
+            1
+        } else if (length < (1U shl 8)) {
+            2
+        } else if (length < (1U shl 16)) {
+            3
+        } else if (length < (1UL shl 32)) {
+            5
+        } else {
+            9
+        }
+
+    /**
+     * Calculates the size of the encoding of a data item.
+     *
+     * This can be used to allocate a buffer of the right size for [encode].
+     *
+     * @param item the [DataItem] to calculate the encoded size for.
+     * @return the exact number of bytes needed to encode [item].
+     */
+    fun encodedSize(item: DataItem): Int = item.encodedSize()
+
     /**
      * Encodes a data item to CBOR.
      *
+     * The exact size of the encoding is calculated before encoding so the returned
+     * array is allocated once and written to exactly once.
+     *
      * @param item the [DataItem] to encode.
      * @returns the bytes of the item.
      */
     fun encode(item: DataItem): ByteArray {
-        val builder = ByteStringBuilder()
-        item.encode(builder)
-        return builder.toByteString().toByteArray()
+        val encoded = ByteArray(item.encodedSize())
+        val buffer = EncodeBuffer(encoded)
+        item.encode(buffer)
+        check(buffer.position == encoded.size)
+        return encoded
+    }
+
+    /**
+     * Encodes a data item to CBOR into a caller-supplied buffer.
+     *
+     * Use [encodedSize] to find out how big the buffer needs to be. This can be used to
+     * reuse a single buffer for encoding many data items.
+     *
+     * @param item the [DataItem] to encode.
+     * @param destination the array to write the encoded data item to.
+     * @param offset the offset in [destination] to start writing at.
+     * @return the number of bytes written.
+     * @throws IllegalArgumentException if [destination] is too small.
+     */
+    fun encode(item: DataItem, destination: ByteArray, offset: Int = 0): Int {
+        val size = item.encodedSize()
+        require(offset >= 0 && size <= destination.size - offset) {
+            "Need $size bytes at offset $offset but buffer is ${destination.size} bytes"
+        }
+        val buffer = EncodeBuffer(destination, offset)
+        item.encode(buffer)
+        check(buffer.position == offset + size)
+        return size
+    }
+
+    /**
+     * Encodes a data item to CBOR and writes it to a [Sink].
+     *
+     * @param item the [DataItem] to encode.
+     * @param sink the sink to write the encoded data item to.
+     * @param scratch an optional buffer to encode into before writing to [sink]. If
+     *   it's not big enough a new buffer of the exact size is allocated.
+     * @return the number of bytes written.
+     */
+    fun encode(item: DataItem, sink: Sink, scratch: ByteArray? = null): Int {
+        val size = item.encodedSize()
+        val buffer = if (scratch != null && scratch.size >= size) scratch else ByteArray(size)
+        val encodeBuffer = EncodeBuffer(buffer)
+        item.encode(encodeBuffer)
+        check(encodeBuffer.position == size)
+        sink.write(buffer, 0, size)
+        return size
     }
 
     // returns the new offset, then the length/value encoded in the decoded content
@@ -240,6 +311,35 @@ object Cbor {
         return item
     }
 
+    /**
+     * Decodes CBOR lazily.
+     *
+     * This is like [decode] except that the children of [CborArray], [CborMap], and [Tagged]
+     * data items are only decoded when first accessed. These data items also keep a reference
+     * to the bytes they were decoded from, available via [DataItem.originalEncoding], and
+     * [encode] will use those bytes as long as the children of the data item haven't been
+     * accessed. This gives byte-exact re-encoding, for example for computing digests over
+     * `IssuerSignedItemBytes`, and avoids decoding data nobody reads.
+     *
+     * The data is checked to be well-formed when decoding but the returned data items hold a
+     * reference to [encodedCbor] so it must not be modified afterwards. Returned data items
+     * should also be treated as read-only.
+     *
+     * @param encodedCbor the bytes of the CBOR to decode.
+     * @return a [DataItem] with the decoded data.
+     * @throws IllegalArgumentException if bytes are left over or the data isn't valid CBOR.
+     */
+    fun decodeLazily(encodedCbor: ByteArray): DataItem {
+        val reader = CborReader(encodedCbor)
+        val item = reader.readDataItemLazily()
+        if (reader.hasMore) {
+            throw IllegalArgumentException(
+                "${encodedCbor.size - reader.offset} bytes leftover after decoding"
+            )
+        }
+        return item
+    }
+
     // Returns true iff all elements in |items| are not compound (e.g. an array or a map).
     private fun allDataItemsNonCompound(
         items: List<DataItem>,
@@ -1,7 +1,5 @@
 package com.android.identity.cbor
 
-import kotlinx.io.bytestring.ByteStringBuilder
-
 /**
  * Array (major type 4).
  *
@@ -9,10 +7,43 @@ import kotlinx.io.bytestring.ByteStringBuilder
  * @param indefiniteLength whether the array is to be encoded or was encoded using indefinite length.
  */
 class CborArray(
-    val items: MutableList<DataItem>,
+    items: MutableList<DataItem>,
     val indefiniteLength: Boolean = false
 ) : DataItem(MajorType.ARRAY) {
-    override fun encode(builder: ByteStringBuilder) {
+    private var _items: MutableList<DataItem>? = items
+    private var encodedSlice: CborReader.Slice? = null
+
+    // Used by Cbor.decodeLazily(), the items are decoded from the slice on first access.
+    internal constructor(encodedSlice: CborReader.Slice) : this(
+        mutableListOf(),
+        encodedSlice[0].toInt().and(0x1f) == 31
+    ) {
+        _items = null
+        this.encodedSlice = encodedSlice
+    }
+
+    /**
+     * The items in the array.
+     */
+    val items: MutableList<DataItem>
+        get() {
+            _items?.let { return it }
+            val decodedItems = decodeItemsLazily(encodedSlice!!)
+            _items = decodedItems
+            return decodedItems
+        }
+
+    override val originalEncoding: ByteArray?
+        get() = encodedSlice?.toByteArray()
+
+    override fun encode(builder: EncodeBuffer) {
+        // If the items haven't been accessed they can't have been modified so it's safe
+        // to just use the bytes we were decoded from.
+        val slice = encodedSlice
+        if (_items == null && slice != null) {
+            builder.append(slice.bytes, slice.offset, slice.offset + slice.size)
+            return
+        }
         if (indefiniteLength) {
             val majorTypeShifted = (majorType.type shl 5)
             builder.append((majorTypeShifted + 31).toByte())
@@ -24,6 +55,19 @@ class CborArray(
         }
     }
 
+    override fun encodedSize(): Int {
+        val slice = encodedSlice
+        if (_items == null && slice != null) {
+            return slice.size
+        }
+        val headerSize = if (indefiniteLength) {
+            2
+        } else {
+            Cbor.encodedLengthSize(items.size.toULong())
+        }
+        return headerSize + items.sumOf { it.encodedSize() }
+    }
+
     companion object {
         /**
          * Creates a new builder.
@@ -36,6 +80,13 @@ class CborArray(
             return ArrayBuilder(CborBuilder(dataItem), dataItem)
         }
 
+        private fun decodeItemsLazily(encodedSlice: CborReader.Slice): MutableList<DataItem> {
+            val reader = encodedSlice.reader()
+            val items = mutableListOf<DataItem>()
+            reader.readArray { items.add(readDataItemLazily()) }
+            return items
+        }
+
         internal fun decode(encodedCbor: ByteArray, offset: Int): Pair<Int, CborArray> {
             val lowBits = encodedCbor[offset].toInt().and(0x1f)
             if (lowBits == 31) {
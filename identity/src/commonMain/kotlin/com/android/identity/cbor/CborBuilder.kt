@@ -10,4 +10,32 @@ class CborBuilder(private val item: DataItem) {
      * @return a [DataItem]
      */
     fun build(): DataItem = item
+
+    /**
+     * Builds the CBOR data items and encodes them.
+     *
+     * This is equivalent to calling [Cbor.encode] on the result of [build].
+     *
+     * @return the bytes of the encoded data item.
+     */
+    fun encode(): ByteArray = Cbor.encode(item)
+
+    /**
+     * Builds the CBOR data items and encodes them into a caller-supplied buffer.
+     *
+     * This is equivalent to calling [Cbor.encode] on the result of [build].
+     *
+     * @param destination the array to write the encoded data item to.
+     * @param offset the offset in [destination] to start writing at.
+     * @return the number of bytes written.
+     * @throws IllegalArgumentException if [destination] is too small.
+     */
+    fun encode(destination: ByteArray, offset: Int = 0): Int =
+        Cbor.encode(item, destination, offset)
+
+    /**
+     * The exact size of the encoding of the built data item.
+     */
+    val encodedSize: Int
+        get() = Cbor.encodedSize(item)
 }
\ No newline at end of file
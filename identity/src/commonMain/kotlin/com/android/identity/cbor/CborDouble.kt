@@ -1,6 +1,5 @@
 package com.android.identity.cbor
 
-import kotlinx.io.bytestring.ByteStringBuilder
 import kotlin.experimental.or
 
 /**
@@ -10,7 +9,7 @@ import kotlin.experimental.or
  */
 class CborDouble(val value: Double) : DataItem(MajorType.SPECIAL) {
 
-    override fun encode(builder: ByteStringBuilder) =
+    override fun encode(builder: EncodeBuffer) =
         builder.run {
             val majorTypeShifted = (majorType.type shl 5).toByte()
             append(majorTypeShifted.or(27))
@@ -26,6 +25,8 @@ class CborDouble(val value: Double) : DataItem(MajorType.SPECIAL) {
             append((raw shr 0).and(0xff).toByte())
         }
 
+    override fun encodedSize(): Int = 9
+
 
     companion object {
         internal fun decode(encodedCbor: ByteArray, offset: Int): Pair<Int, CborDouble> {
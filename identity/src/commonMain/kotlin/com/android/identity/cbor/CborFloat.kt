@@ -1,6 +1,5 @@
 package com.android.identity.cbor
 
-import kotlinx.io.bytestring.ByteStringBuilder
 import kotlin.experimental.or
 
 /**
@@ -10,7 +9,7 @@ import kotlin.experimental.or
  */
 class CborFloat(val value: Float) : DataItem(MajorType.SPECIAL) {
 
-    override fun encode(builder: ByteStringBuilder) {
+    override fun encode(builder: EncodeBuffer) {
         builder.run {
             val majorTypeShifted = (majorType.type shl 5).toByte()
             append(majorTypeShifted.or(26))
@@ -24,6 +23,8 @@ class CborFloat(val value: Float) : DataItem(MajorType.SPECIAL) {
 
     }
 
+    override fun encodedSize(): Int = 5
+
     companion object {
         internal fun decode(encodedCbor: ByteArray, offset: Int): Pair<Int, CborFloat> {
             val raw = (encodedCbor[offset + 1].toInt().and(0xff) shl 24) +
@@ -1,7 +1,5 @@
 package com.android.identity.cbor
 
-import kotlinx.io.bytestring.ByteStringBuilder
-
 /**
  * Map (major type 5).
  *
@@ -9,10 +7,43 @@ import kotlinx.io.bytestring.ByteStringBuilder
  * @param indefiniteLength whether the map is to be encoded or was encoded using indefinite length.
  */
 class CborMap(
-    val items: MutableMap<DataItem, DataItem>,
+    items: MutableMap<DataItem, DataItem>,
     val indefiniteLength: Boolean = false
 ) : DataItem(MajorType.MAP) {
-    override fun encode(builder: ByteStringBuilder) {
+    private var _items: MutableMap<DataItem, DataItem>? = items
+    private var encodedSlice: CborReader.Slice? = null
+
+    // Used by Cbor.decodeLazily(), the items are decoded from the slice on first access.
+    internal constructor(encodedSlice: CborReader.Slice) : this(
+        mutableMapOf(),
+        encodedSlice[0].toInt().and(0x1f) == 31
+    ) {
+        _items = null
+        this.encodedSlice = encodedSlice
+    }
+
+    /**
+     * The key/value pairs in the map.
+     */
+    val items: MutableMap<DataItem, DataItem>
+        get() {
+            _items?.let { return it }
+            val decodedItems = decodeItemsLazily(encodedSlice!!)
+            _items = decodedItems
+            return decodedItems
+        }
+
+    override val originalEncoding: ByteArray?
+        get() = encodedSlice?.toByteArray()
+
+    override fun encode(builder: EncodeBuffer) {
+        // If the items haven't been accessed they can't have been modified so it's safe
+        // to just use the bytes we were decoded from.
+        val slice = encodedSlice
+        if (_items == null && slice != null) {
+            builder.append(slice.bytes, slice.offset, slice.offset + slice.size)
+            return
+        }
         if (indefiniteLength) {
             val majorTypeShifted = (majorType.type shl 5)
             builder.append((majorTypeShifted + 31).toByte())
@@ -30,6 +61,22 @@ class CborMap(
         }
     }
 
+    override fun encodedSize(): Int {
+        val slice = encodedSlice
+        if (_items == null && slice != null) {
+            return slice.size
+        }
+        var size = if (indefiniteLength) {
+            2
+        } else {
+            Cbor.encodedLengthSize(items.size.toULong())
+        }
+        for ((keyItem, valueItem) in items) {
+            size += keyItem.encodedSize() + valueItem.encodedSize()
+        }
+        return size
+    }
+
     companion object {
         /**
          * Creates a new builder.
@@ -42,6 +89,27 @@ class CborMap(
             return MapBuilder(CborBuilder(dataItem), dataItem)
         }
 
+        private fun decodeItemsLazily(
+            encodedSlice: CborReader.Slice
+        ): MutableMap<DataItem, DataItem> {
+            val reader = encodedSlice.reader()
+            val items = mutableMapOf<DataItem, DataItem>()
+            val numPairs = reader.readMapLength()
+            if (numPairs == null) {
+                while (!reader.peekBreak()) {
+                    val keyItem = reader.readDataItemLazily()
+                    items.put(keyItem, reader.readDataItemLazily())
+                }
+                reader.readBreak()
+            } else {
+                for (n in 0 until numPairs) {
+                    val keyItem = reader.readDataItemLazily()
+                    items.put(keyItem, reader.readDataItemLazily())
+                }
+            }
+            return items
+        }
+
         internal fun decode(encodedCbor: ByteArray, offset: Int): Pair<Int, CborMap> {
             val lowBits = encodedCbor[offset].toInt().and(0x1f)
             if (lowBits == 31) {
@@ -0,0 +1,531 @@
+package com.android.identity.cbor
+
+import kotlinx.io.Source
+import kotlinx.io.readByteArray
+
+/**
+ * A pull-style reader for CBOR.
+ *
+ * Unlike [Cbor.decode] which builds a full tree of [DataItem] instances, this reads data items
+ * one at a time directly from the underlying [ByteArray]. This allows callers to only look at
+ * the parts of the CBOR they care about and skip the rest without allocating anything. Byte
+ * strings can be accessed as [Slice] instances which refer to the underlying data without
+ * copying it.
+ *
+ * The reader only checks well-formedness of the data items it reads or skips, not of the
+ * data beyond that.
+ *
+ * @param encodedCbor the bytes of the CBOR to read.
+ * @param offset the offset of the first byte to read.
+ * @param endOffset the offset right after the last byte which may be read.
+ */
+class CborReader(
+    val encodedCbor: ByteArray,
+    offset: Int = 0,
+    val endOffset: Int = encodedCbor.size
+) {
+    init {
+        require(offset >= 0 && offset <= endOffset && endOffset <= encodedCbor.size) {
+            "Invalid range $offset..$endOffset for data of size ${encodedCbor.size}"
+        }
+    }
+
+    /**
+     * The offset of the next byte to be read.
+     */
+    var offset: Int = offset
+        private set
+
+    /**
+     * Whether there is more data to read.
+     */
+    val hasMore: Boolean
+        get() = offset < endOffset
+
+    /**
+     * A range of bytes in a [ByteArray].
+     *
+     * @param bytes the underlying data.
+     * @param offset the offset of the first byte of the slice.
+     * @param size the number of bytes in the slice.
+     */
+    class Slice(
+        val bytes: ByteArray,
+        val offset: Int,
+        val size: Int
+    ) {
+        /**
+         * Gets a byte in the slice.
+         *
+         * @param index the index of the byte, relative to the start of the slice.
+         * @return the byte.
+         */
+        operator fun get(index: Int): Byte {
+            if (index < 0 || index >= size) {
+                throw IndexOutOfBoundsException("Index $index out of bounds for size $size")
+            }
+            return bytes[offset + index]
+        }
+
+        /**
+         * Copies the bytes of the slice into a new [ByteArray].
+         *
+         * @return a newly allocated array with the data of the slice.
+         */
+        fun toByteArray(): ByteArray = bytes.copyOfRange(offset, offset + size)
+
+        /**
+         * Compares the slice to a [ByteArray] without copying.
+         *
+         * @param other the array to compare with.
+         * @return `true` if the content of the slice is the same as [other].
+         */
+        fun contentEquals(other: ByteArray): Boolean {
+            if (other.size != size) {
+                return false
+            }
+            for (n in 0 until size) {
+                if (bytes[offset + n] != other[n]) {
+                    return false
+                }
+            }
+            return true
+        }
+
+        /**
+         * Creates a [CborReader] for the data in the slice.
+         *
+         * This is useful for walking embedded CBOR, for example the byte string in a
+         * [Tagged.ENCODED_CBOR] tag, without copying it.
+         *
+         * @return a new [CborReader] limited to the slice.
+         */
+        fun reader(): CborReader = CborReader(bytes, offset, offset + size)
+    }
+
+    private fun byteAt(position: Int): Int {
+        if (position >= endOffset) {
+            throw IllegalArgumentException("Out of data at offset $position")
+        }
+        return encodedCbor[position].toInt().and(0xff)
+    }
+
+    // Reads the head of a data item, advances the offset past it and returns the argument.
+    //
+    // The argument is 0 when the item is using indefinite length.
+    //
+    private fun readHead(): ULong {
+        val additionalInformation = byteAt(offset).and(0x1f)
+        if (additionalInformation < 24) {
+            offset += 1
+            return additionalInformation.toULong()
+        }
+        val numBytes = when (additionalInformation) {
+            24 -> 1
+            25 -> 2
+            26 -> 4
+            27 -> 8
+            31 -> {
+                offset += 1
+                return 0UL
+            }
+            else -> throw IllegalArgumentException(
+                "Illegal additional information value $additionalInformation at offset $offset"
+            )
+        }
+        var value = 0UL
+        for (n in 1..numBytes) {
+            value = (value shl 8) or byteAt(offset + n).toULong()
+        }
+        offset += 1 + numBytes
+        return value
+    }
+
+    private fun expectMajorType(majorType: MajorType) {
+        val actual = peekMajorType()
+        if (actual != majorType) {
+            throw IllegalArgumentException("Expected $majorType at offset $offset, got $actual")
+        }
+    }
+
+    private fun ULong.toLengthInt(): Int {
+        if (this > Int.MAX_VALUE.toULong()) {
+            throw IllegalArgumentException("Length $this at offset $offset is too large")
+        }
+        return this.toInt()
+    }
+
+    /**
+     * Gets the major type of the next data item without consuming it.
+     *
+     * @return the [MajorType] of the next data item.
+     * @throws IllegalArgumentException if there is no more data.
+     */
+    fun peekMajorType(): MajorType = MajorType.fromInt(byteAt(offset) ushr 5)
+
+    /**
+     * Gets the additional information of the next data item without consuming it.
+     *
+     * @return the value of the low five bits of the initial byte of the next data item.
+     * @throws IllegalArgumentException if there is no more data.
+     */
+    fun peekAdditionalInformation(): Int = byteAt(offset).and(0x1f)
+
+    /**
+     * Checks whether the next byte is the BREAK stop code.
+     *
+     * @return `true` if the next byte is BREAK, `false` otherwise.
+     * @throws IllegalArgumentException if there is no more data.
+     */
+    fun peekBreak(): Boolean = byteAt(offset) == 0xff
+
+    /**
+     * Consumes the BREAK stop code.
+     *
+     * @throws IllegalArgumentException if the next byte isn't BREAK.
+     */
+    fun readBreak() {
+        require(peekBreak()) { "Expected BREAK at offset $offset" }
+        offset += 1
+    }
+
+    /**
+     * Reads the head of the next data item.
+     *
+     * For integers this is the value (without the sign for negative integers), for strings
+     * this is the length in bytes, for arrays and maps the number of items or pairs, and for
+     * tags the tag number. The content of the data item, if any, is not consumed.
+     *
+     * @return the argument of the head of the data item.
+     * @throws IllegalArgumentException if the data item is using indefinite length or the data
+     * isn't valid CBOR.
+     */
+    fun readLength(): ULong {
+        require(peekAdditionalInformation() != 31) {
+            "Unexpected indefinite length item at offset $offset"
+        }
+        return readHead()
+    }
+
+    /**
+     * Reads the head of an array.
+     *
+     * The items in the array should be read individually after calling this. If the array is
+     * using indefinite length, [peekBreak] and [readBreak] should be used to detect and consume
+     * the end of the array.
+     *
+     * @return the number of items in the array or `null` if the array is using indefinite length.
+     * @throws IllegalArgumentException if the next data item isn't an array.
+     */
+    fun readArrayLength(): Long? {
+        expectMajorType(MajorType.ARRAY)
+        if (peekAdditionalInformation() == 31) {
+            offset += 1
+            return null
+        }
+        return readHead().toLengthInt().toLong()
+    }
+
+    /**
+     * Reads the head of a map.
+     *
+     * The keys and values in the map should be read individually after calling this. If the map
+     * is using indefinite length, [peekBreak] and [readBreak] should be used to detect and consume
+     * the end of the map.
+     *
+     * @return the number of pairs in the map or `null` if the map is using indefinite length.
+     * @throws IllegalArgumentException if the next data item isn't a map.
+     */
+    fun readMapLength(): Long? {
+        expectMajorType(MajorType.MAP)
+        if (peekAdditionalInformation() == 31) {
+            offset += 1
+            return null
+        }
+        return readHead().toLengthInt().toLong()
+    }
+
+    /**
+     * Reads an array, calling [onItem] for each item.
+     *
+     * The [onItem] lambda is invoked with the reader positioned at the item and must consume
+     * exactly one data item, for example using [readTstr], [readDataItem], or [skip].
+     *
+     * @param onItem the lambda to call for each item in the array.
+     * @throws IllegalArgumentException if the next data item isn't an array.
+     */
+    fun readArray(onItem: CborReader.() -> Unit) {
+        val numItems = readArrayLength()
+        if (numItems == null) {
+            while (!peekBreak()) {
+                onItem()
+            }
+            readBreak()
+        } else {
+            for (n in 0 until numItems) {
+                onItem()
+            }
+        }
+    }
+
+    /**
+     * Reads a map where all keys are text strings, calling [onEntry] for each key.
+     *
+     * The [onEntry] lambda is invoked with the reader positioned at the value for the key and
+     * must consume exactly one data item, for example using [readTstr], [readDataItem], or
+     * [skip].
+     *
+     * @param onEntry the lambda to call for each key in the map.
+     * @throws IllegalArgumentException if the next data item isn't a map or if one of the keys
+     * isn't a text string.
+     */
+    fun readMapWithTstrKeys(onEntry: CborReader.(key: String) -> Unit) {
+        val numPairs = readMapLength()
+        if (numPairs == null) {
+            while (!peekBreak()) {
+                onEntry(readTstr())
+            }
+            readBreak()
+        } else {
+            for (n in 0 until numPairs) {
+                onEntry(readTstr())
+            }
+        }
+    }
+
+    /**
+     * Reads the head of a tag.
+     *
+     * The tagged item should be read after calling this.
+     *
+     * @return the tag number.
+     * @throws IllegalArgumentException if the next data item isn't a tag.
+     */
+    fun readTag(): Long {
+        expectMajorType(MajorType.TAG)
+        return readLength().toLong()
+    }
+
+    /**
+     * Reads an unsigned or negative integer.
+     *
+     * @return the value.
+     * @throws IllegalArgumentException if the next data item isn't an integer or its value
+     * doesn't fit in a [Long].
+     */
+    fun readNumber(): Long {
+        val startOffset = offset
+        val majorType = peekMajorType()
+        if (majorType != MajorType.UNSIGNED_INTEGER && majorType != MajorType.NEGATIVE_INTEGER) {
+            throw IllegalArgumentException("Expected integer at offset $startOffset")
+        }
+        val value = readLength()
+        require(value <= Long.MAX_VALUE.toULong()) {
+            "Integer at offset $startOffset doesn't fit in a Long"
+        }
+        return if (majorType == MajorType.UNSIGNED_INTEGER) {
+            value.toLong()
+        } else {
+            -1L - value.toLong()
+        }
+    }
+
+    /**
+     * Reads a boolean.
+     *
+     * @return the value.
+     * @throws IllegalArgumentException if the next data item isn't `true` or `false`.
+     */
+    fun readBoolean(): Boolean {
+        return when (byteAt(offset)) {
+            0xf4 -> { offset += 1; false }
+            0xf5 -> { offset += 1; true }
+            else -> throw IllegalArgumentException("Expected boolean at offset $offset")
+        }
+    }
+
+    /**
+     * Reads a definite-length byte string without copying it.
+     *
+     * The returned slice refers to the underlying data passed to the reader.
+     *
+     * @return a [Slice] for the content of the byte string.
+     * @throws IllegalArgumentException if the next data item isn't a definite-length byte string.
+     */
+    fun readBstrSlice(): Slice {
+        expectMajorType(MajorType.BYTE_STRING)
+        val length = readLength().toLengthInt()
+        if (length > endOffset - offset) {
+            throw IllegalArgumentException("Out of data reading $length bytes at offset $offset")
+        }
+        val slice = Slice(encodedCbor, offset, length)
+        offset += length
+        return slice
+    }
+
+    /**
+     * Reads a definite-length byte string.
+     *
+     * @return a newly allocated array with the content of the byte string.
+     * @throws IllegalArgumentException if the next data item isn't a definite-length byte string.
+     */
+    fun readBstr(): ByteArray = readBstrSlice().toByteArray()
+
+    /**
+     * Reads a definite-length text string.
+     *
+     * @return the value of the string.
+     * @throws IllegalArgumentException if the next data item isn't a definite-length text string.
+     */
+    fun readTstr(): String {
+        expectMajorType(MajorType.UNICODE_STRING)
+        val length = readLength().toLengthInt()
+        if (length > endOffset - offset) {
+            throw IllegalArgumentException("Out of data reading $length bytes at offset $offset")
+        }
+        val value = encodedCbor.decodeToString(offset, offset + length)
+        offset += length
+        return value
+    }
+
+    /**
+     * Reads the next data item as a [DataItem].
+     *
+     * This is equivalent to calling [Cbor.decode] for the next data item and can be used for
+     * parts of the data where a full tree is needed.
+     *
+     * @return the decoded data item.
+     * @throws IllegalArgumentException if the data isn't valid CBOR.
+     */
+    fun readDataItem(): DataItem {
+        val start = offset
+        skip()
+        val (newOffset, item) = Cbor.decode(encodedCbor, start)
+        check(newOffset == offset)
+        return item
+    }
+
+    /**
+     * Reads the next data item as a lazily decoded [DataItem].
+     *
+     * See [Cbor.decodeLazily] for details.
+     *
+     * @return the data item.
+     * @throws IllegalArgumentException if the data isn't valid CBOR.
+     */
+    fun readDataItemLazily(): DataItem {
+        return when (peekMajorType()) {
+            MajorType.ARRAY -> CborArray(readRawSlice())
+            MajorType.MAP -> CborMap(readRawSlice())
+            MajorType.TAG -> {
+                val slice = readRawSlice()
+                Tagged(slice.reader().readTag(), slice)
+            }
+            else -> readDataItem()
+        }
+    }
+
+    /**
+     * Skips the next data item and returns its encoded bytes without copying them.
+     *
+     * @return a [Slice] with the encoded bytes of the data item, including its head.
+     * @throws IllegalArgumentException if the data isn't valid CBOR.
+     */
+    fun readRawSlice(): Slice {
+        val start = offset
+        skip()
+        return Slice(encodedCbor, start, offset - start)
+    }
+
+    /**
+     * Skips the next data item, including all nested data items.
+     *
+     * @throws IllegalArgumentException if the data isn't valid CBOR.
+     */
+    fun skip() {
+        val majorType = peekMajorType()
+        val additionalInformation = peekAdditionalInformation()
+        when (majorType) {
+            MajorType.UNSIGNED_INTEGER,
+            MajorType.NEGATIVE_INTEGER -> {
+                readLength()
+            }
+
+            MajorType.BYTE_STRING,
+            MajorType.UNICODE_STRING -> {
+                if (additionalInformation == 31) {
+                    offset += 1
+                    while (!peekBreak()) {
+                        expectMajorType(majorType)
+                        skipDefiniteLengthString()
+                    }
+                    readBreak()
+                } else {
+                    skipDefiniteLengthString()
+                }
+            }
+
+            MajorType.ARRAY -> {
+                val numItems = readArrayLength()
+                if (numItems == null) {
+                    while (!peekBreak()) {
+                        skip()
+                    }
+                    readBreak()
+                } else {
+                    for (n in 0 until numItems) {
+                        skip()
+                    }
+                }
+            }
+
+            MajorType.MAP -> {
+                val numPairs = readMapLength()
+                if (numPairs == null) {
+                    while (!peekBreak()) {
+                        skip()
+                        skip()
+                    }
+                    readBreak()
+                } else {
+                    for (n in 0 until numPairs) {
+                        skip()
+                        skip()
+                    }
+                }
+            }
+
+            MajorType.TAG -> {
+                readLength()
+                skip()
+            }
+
+            MajorType.SPECIAL -> {
+                if (additionalInformation == 31) {
+                    throw IllegalArgumentException("BREAK outside indefinite-length item")
+                }
+                readLength()
+            }
+        }
+    }
+
+    private fun skipDefiniteLengthString() {
+        val length = readLength().toLengthInt()
+        if (length > endOffset - offset) {
+            throw IllegalArgumentException("Out of data skipping $length bytes at offset $offset")
+        }
+        offset += length
+    }
+
+    companion object {
+        /**
+         * Creates a reader for the remaining data in a [Source].
+         *
+         * Note that this reads all the remaining data from [source] into memory.
+         *
+         * @param source the source to read from.
+         * @return a [CborReader] for the data.
+         */
+        fun fromSource(source: Source): CborReader = CborReader(source.readByteArray())
+    }
+}
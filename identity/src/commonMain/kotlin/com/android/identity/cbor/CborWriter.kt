@@ -0,0 +1,169 @@
+package com.android.identity.cbor
+
+/**
+ * A push-style writer for CBOR.
+ *
+ * This is the counterpart of [CborReader]. Instead of building a tree of [DataItem] instances
+ * and encoding it using [Cbor.encode], data items are written one at a time directly into a
+ * growing buffer. The resulting bytes are the same as [Cbor.encode] produces for the
+ * equivalent data items, that is, integers and lengths use the shortest form and arrays and
+ * maps use definite length.
+ *
+ * Arrays and maps are written by writing their head using [writeArrayHeader] or
+ * [writeMapHeader] followed by their items or keys and values. The writer doesn't check that
+ * the number of data items written matches the head.
+ *
+ * @param initialCapacity the initial size of the buffer.
+ */
+class CborWriter(initialCapacity: Int = 64) {
+    private var buffer = ByteArray(maxOf(initialCapacity, 16))
+
+    /**
+     * The number of bytes written so far.
+     */
+    var size: Int = 0
+        private set
+
+    private fun ensureCapacity(numBytes: Int) {
+        if (size + numBytes > buffer.size) {
+            buffer = buffer.copyOf(maxOf(buffer.size * 2, size + numBytes))
+        }
+    }
+
+    private fun append(value: Int) {
+        buffer[size++] = value.toByte()
+    }
+
+    private fun writeHead(majorType: MajorType, argument: ULong) {
+        ensureCapacity(9)
+        val majorTypeShifted = majorType.type shl 5
+        if (argument < 24U) {
+            append(majorTypeShifted or argument.toInt())
+            return
+        }
+        val numBytes = if (argument < (1U shl 8)) {
+            append(majorTypeShifted or 24)
+            1
+        } else if (argument < (1U shl 16)) {
+            append(majorTypeShifted or 25)
+            2
+        } else if (argument < (1UL shl 32)) {
+            append(majorTypeShifted or 26)
+            4
+        } else {
+            append(majorTypeShifted or 27)
+            8
+        }
+        for (n in numBytes - 1 downTo 0) {
+            append((argument shr (n * 8)).and(0xffU).toInt())
+        }
+    }
+
+    /**
+     * Writes the head of a definite-length array.
+     *
+     * @param numItems the number of items in the array, to be written next.
+     */
+    fun writeArrayHeader(numItems: Int) {
+        require(numItems >= 0) { "numItems cannot be negative" }
+        writeHead(MajorType.ARRAY, numItems.toULong())
+    }
+
+    /**
+     * Writes the head of a definite-length map.
+     *
+     * @param numPairs the number of pairs in the map, the keys and values of which are to be
+     *   written next.
+     */
+    fun writeMapHeader(numPairs: Int) {
+        require(numPairs >= 0) { "numPairs cannot be negative" }
+        writeHead(MajorType.MAP, numPairs.toULong())
+    }
+
+    /**
+     * Writes the head of a tag.
+     *
+     * @param tagNumber the tag number, the tagged data item is to be written next.
+     */
+    fun writeTag(tagNumber: Long) {
+        require(tagNumber >= 0) { "tagNumber cannot be negative" }
+        writeHead(MajorType.TAG, tagNumber.toULong())
+    }
+
+    /**
+     * Writes an unsigned or negative integer.
+     *
+     * @param value the value.
+     */
+    fun writeNumber(value: Long) {
+        if (value >= 0) {
+            writeHead(MajorType.UNSIGNED_INTEGER, value.toULong())
+        } else {
+            writeHead(MajorType.NEGATIVE_INTEGER, (-1L - value).toULong())
+        }
+    }
+
+    /**
+     * Writes a boolean.
+     *
+     * @param value the value.
+     */
+    fun writeBoolean(value: Boolean) {
+        writeHead(MajorType.SPECIAL, if (value) 21U else 20U)
+    }
+
+    /**
+     * Writes a definite-length text string.
+     *
+     * @param value the value.
+     */
+    fun writeTstr(value: String) {
+        val encoded = value.encodeToByteArray()
+        writeHead(MajorType.UNICODE_STRING, encoded.size.toULong())
+        writeRaw(encoded)
+    }
+
+    /**
+     * Writes a definite-length byte string.
+     *
+     * @param value the value.
+     */
+    fun writeBstr(value: ByteArray) {
+        writeHead(MajorType.BYTE_STRING, value.size.toULong())
+        writeRaw(value)
+    }
+
+    /**
+     * Writes a data item.
+     *
+     * This can be used for parts of the data which are available as [DataItem] instances.
+     *
+     * @param item the data item to write.
+     */
+    fun writeDataItem(item: DataItem) {
+        val itemSize = Cbor.encodedSize(item)
+        ensureCapacity(itemSize)
+        size += Cbor.encode(item, buffer, size)
+    }
+
+    /**
+     * Writes bytes as is.
+     *
+     * The bytes must be the encoding of complete data items, for example a constant map key
+     * that was encoded ahead of time.
+     *
+     * @param encodedCbor the bytes to write.
+     */
+    fun writeRaw(encodedCbor: ByteArray) {
+        ensureCapacity(encodedCbor.size)
+        encodedCbor.copyInto(buffer, size)
+        size += encodedCbor.size
+    }
+
+    /**
+     * Gets the bytes written so far.
+     *
+     * @return a newly allocated array with the encoded data items.
+     */
+    fun toByteArray(): ByteArray = buffer.copyOf(size)
+}
@@ -10,7 +10,6 @@ import com.android.identity.securearea.KeyAttestation
 import com.android.identity.securearea.fromDataItem
 import kotlinx.datetime.Instant
 import kotlinx.datetime.LocalDate
-import kotlinx.io.bytestring.ByteStringBuilder
 
 /**
  * Abstract base class for CBOR data items.
@@ -33,7 +32,19 @@ import kotlinx.io.bytestring.ByteStringBuilder
 sealed class DataItem(
     val majorType: MajorType
 ) {
-    internal abstract fun encode(builder: ByteStringBuilder)
+    internal abstract fun encode(builder: EncodeBuffer)
+
+    // Returns the exact number of bytes written by encode().
+    internal abstract fun encodedSize(): Int
+
+    /**
+     * The bytes this data item was decoded from, if available.
+     *
+     * This is available for [CborArray], [CborMap], and [Tagged] data items obtained using
+     * [Cbor.decodeLazily] and for [RawCbor]. For all other data items it is `null`.
+     */
+    open val originalEncoding: ByteArray?
+        get() = null
 
     /**
      * The value of a [Bstr] data item.
@@ -164,7 +175,11 @@ sealed class DataItem(
             require(this.tagNumber == Tagged.ENCODED_CBOR)
             val child = this.taggedItem
             require(child is Bstr)
-            return Cbor.decode(child.value)
+            return if (isLazilyDecoded) {
+                Cbor.decodeLazily(child.value)
+            } else {
+                Cbor.decode(child.value)
+            }
         }
 
     /**
@@ -177,8 +192,9 @@ sealed class DataItem(
         get() {
             require(this is Tagged)
             require(this.tagNumber == Tagged.DATE_TIME_STRING)
-            require(this.taggedItem is Tstr)
-            return Instant.parse(this.taggedItem.value)
+            val child = this.taggedItem
+            require(child is Tstr)
+            return Instant.parse(child.value)
         }
 
     /**
@@ -191,8 +207,9 @@ sealed class DataItem(
         get() {
             require(this is Tagged)
             require(this.tagNumber == Tagged.FULL_DATE_STRING)
-            require(this.taggedItem is Tstr)
-            return LocalDate.parse(this.taggedItem.value)
+            val child = this.taggedItem
+            require(child is Tstr)
+            return LocalDate.parse(child.value)
         }
 
     /**
@@ -0,0 +1,25 @@
+package com.android.identity.cbor
+
+/**
+ * Fixed-size output buffer used when encoding data items.
+ *
+ * The size of the buffer is computed up front using [DataItem.encodedSize] so the
+ * bytes are written exactly once and no bounds checks or reallocations are needed
+ * beyond the ones done by the array itself.
+ *
+ * @param buffer the array to write to.
+ * @param position the offset in [buffer] to start writing at.
+ */
+internal class EncodeBuffer(
+    val buffer: ByteArray,
+    var position: Int = 0
+) {
+    fun append(value: Byte) {
+        buffer[position++] = value
+    }
+
+    fun append(value: ByteArray, startIndex: Int = 0, endIndex: Int = value.size) {
+        value.copyInto(buffer, position, startIndex, endIndex)
+        position += endIndex - startIndex
+    }
+}
@@ -1,14 +1,12 @@
 package com.android.identity.cbor
 
-import kotlinx.io.bytestring.ByteStringBuilder
-
 /**
  * Byte String (major type 2), indefinite length.
  *
  * @param chunks the chunks in the byte string.
  */
 data class IndefLengthBstr(val chunks: List<ByteArray>) : DataItem(MajorType.BYTE_STRING) {
-    override fun encode(builder: ByteStringBuilder) {
+    override fun encode(builder: EncodeBuffer) {
         val majorTypeShifted = (majorType.type shl 5)
         builder.append((majorTypeShifted + 31).toByte())
         chunks.forEach {
@@ -18,6 +16,9 @@ data class IndefLengthBstr(val chunks: List<ByteArray>) : DataItem(MajorType.BYT
         builder.append(0xff.toByte())
     }
 
+    override fun encodedSize(): Int =
+        2 + chunks.sumOf { Cbor.encodedLengthSize(it.size.toULong()) + it.size }
+
     companion object {
         internal fun decode(encodedCbor: ByteArray, offset: Int): Pair<Int, IndefLengthBstr> {
             val majorTypeShifted = (MajorType.BYTE_STRING.type shl 5)
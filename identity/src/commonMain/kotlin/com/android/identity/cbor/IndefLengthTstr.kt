@@ -1,7 +1,5 @@
 package com.android.identity.cbor
 
-import kotlinx.io.bytestring.ByteStringBuilder
-
 /**
  * Unicode String (major type 3), indefinite length.
  *
@@ -9,7 +7,7 @@ import kotlinx.io.bytestring.ByteStringBuilder
  */
 data class IndefLengthTstr(val chunks: List<String>) : DataItem(MajorType.UNICODE_STRING) {
 
-    override fun encode(builder: ByteStringBuilder) {
+    override fun encode(builder: EncodeBuffer) {
 
         val majorTypeShifted = (majorType.type shl 5)
         builder.append((majorTypeShifted + 31).toByte())
@@ -21,6 +19,11 @@ data class IndefLengthTstr(val chunks: List<String>) : DataItem(MajorType.UNICOD
         builder.append(0xff.toByte())
     }
 
+    override fun encodedSize(): Int = 2 + chunks.sumOf {
+        val encodedStrSize = it.encodeToByteArray().size
+        Cbor.encodedLengthSize(encodedStrSize.toULong()) + encodedStrSize
+    }
+
     companion object {
         internal fun decode(encodedCbor: ByteArray, offset: Int): Pair<Int, IndefLengthTstr> {
             val majorTypeShifted = (MajorType.UNICODE_STRING.type shl 5)
@@ -1,6 +1,5 @@
 package com.android.identity.cbor
 
-
 /**
  * CBOR major types.
  */
@@ -1,16 +1,16 @@
 package com.android.identity.cbor
 
-import kotlinx.io.bytestring.ByteStringBuilder
-
 /**
  * Negative Integer (major type 1).
  *
  * @param value the value, without the sign.
  */
 class Nint(val value: ULong) : CborInt(MajorType.NEGATIVE_INTEGER) {
-    override fun encode(builder: ByteStringBuilder) =
+    override fun encode(builder: EncodeBuffer) =
         Cbor.encodeLength(builder, majorType, value - 1UL)
 
+    override fun encodedSize(): Int = Cbor.encodedLengthSize(value - 1UL)
+
 
     companion object {
         internal fun decode(encodedCbor: ByteArray, offset: Int): Pair<Int, Nint> {
@@ -1,7 +1,5 @@
 package com.android.identity.cbor
 
-import kotlinx.io.bytestring.ByteStringBuilder
-
 /**
  * Data item for raw CBOR.
  *
@@ -17,10 +15,15 @@ import kotlinx.io.bytestring.ByteStringBuilder
 class RawCbor(val encodedCbor: ByteArray)
     : DataItem(MajorType.fromInt(encodedCbor[0].toInt().and(0xff) ushr 5)) {
 
-    override fun encode(builder: ByteStringBuilder) {
+    override fun encode(builder: EncodeBuffer) {
         builder.append(encodedCbor)
     }
 
+    override fun encodedSize(): Int = encodedCbor.size
+
+    override val originalEncoding: ByteArray?
+        get() = encodedCbor
+
     override fun equals(other: Any?): Boolean = other is RawCbor &&
             encodedCbor.contentEquals(other.encodedCbor)
 
@@ -1,6 +1,5 @@
 package com.android.identity.cbor
 
-import kotlinx.io.bytestring.ByteStringBuilder
 import kotlin.experimental.or
 
 /**
@@ -13,11 +12,13 @@ class Simple(val value: UInt) : DataItem(MajorType.SPECIAL) {
         check(value < 24U || (value in 32U..255U))
     }
 
-    override fun encode(builder: ByteStringBuilder) {
+    override fun encode(builder: EncodeBuffer) {
         val majorTypeShifted = (majorType.type shl 5).toByte()
         builder.append(majorTypeShifted.or(value.toByte()))
     }
 
+    override fun encodedSize(): Int = 1
+
     companion object {
         /** The [Simple] value for FALSE */
         val FALSE = Simple(20U)
@@ -1,19 +1,67 @@
 package com.android.identity.cbor
 
-import kotlinx.io.bytestring.ByteStringBuilder
-
 /**
  * Tag (major type 6).
  *
  * @param tagNumber the tag number, for example [Tagged.ENCODED_CBOR].
  * @param taggedItem the tagged item.
  */
-class Tagged(val tagNumber: Long, val taggedItem: DataItem) : DataItem(MajorType.TAG) {
-    override fun encode(builder: ByteStringBuilder) {
-        Cbor.encodeLength(builder, majorType, tagNumber.toInt())
+class Tagged private constructor(
+    val tagNumber: Long,
+    private var _taggedItem: DataItem?,
+    private val encodedSlice: CborReader.Slice?
+) : DataItem(MajorType.TAG) {
+
+    constructor(tagNumber: Long, taggedItem: DataItem) : this(tagNumber, taggedItem, null)
+
+    // Used by Cbor.decodeLazily(), the tagged item is decoded from the slice on first access.
+    internal constructor(
+        tagNumber: Long,
+        encodedSlice: CborReader.Slice
+    ) : this(tagNumber, null, encodedSlice)
+
+    /**
+     * The tagged item.
+     */
+    val taggedItem: DataItem
+        get() {
+            _taggedItem?.let { return it }
+            val reader = encodedSlice!!.reader()
+            reader.readTag()
+            val decodedItem = reader.readDataItemLazily()
+            _taggedItem = decodedItem
+            return decodedItem
+        }
+
+    /**
+     * Whether this tag was obtained using [Cbor.decodeLazily].
+     */
+    internal val isLazilyDecoded: Boolean
+        get() = encodedSlice != null
+
+    override val originalEncoding: ByteArray?
+        get() = encodedSlice?.toByteArray()
+
+    override fun encode(builder: EncodeBuffer) {
+        // If the tagged item hasn't been accessed it can't have been modified, for example
+        // when it's an array or a map, so it's safe to just use the bytes we were decoded from.
+        val slice = encodedSlice
+        if (_taggedItem == null && slice != null) {
+            builder.append(slice.bytes, slice.offset, slice.offset + slice.size)
+            return
+        }
+        Cbor.encodeLength(builder, majorType, tagNumber.toULong())
         taggedItem.encode(builder)
     }
 
+    override fun encodedSize(): Int {
+        val slice = encodedSlice
+        if (_taggedItem == null && slice != null) {
+            return slice.size
+        }
+        return Cbor.encodedLengthSize(tagNumber.toULong()) + taggedItem.encodedSize()
+    }
+
     companion object {
         /**
          * Standard date/time string.
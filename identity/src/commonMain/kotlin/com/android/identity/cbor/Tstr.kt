@@ -1,17 +1,31 @@
 package com.android.identity.cbor
 
-import kotlinx.io.bytestring.ByteStringBuilder
-
 /**
  * Unicode String (major type 3).
  *
  * @param value the [String] for the value of the byte string.
  */
 class Tstr(val value: String) : DataItem(MajorType.UNICODE_STRING) {
-    override fun encode(builder: ByteStringBuilder) {
-        val encodedValue = value.encodeToByteArray()
-        Cbor.encodeLength(builder, majorType, encodedValue.size)
-        builder.append(value.encodeToByteArray())
+    // The UTF-8 encoding of the value, computed on first use. This is needed both for
+    // calculating the size and for writing the encoded data item.
+    private var _encodedValue: ByteArray? = null
+
+    private constructor(value: String, encodedValue: ByteArray) : this(value) {
+        _encodedValue = encodedValue
+    }
+
+    private val encodedValue: ByteArray
+        get() = _encodedValue ?: value.encodeToByteArray().also { _encodedValue = it }
+
+    override fun encode(builder: EncodeBuffer) {
+        val bytes = encodedValue
+        Cbor.encodeLength(builder, majorType, bytes.size)
+        builder.append(bytes)
+    }
+
+    override fun encodedSize(): Int {
+        val bytes = encodedValue
+        return Cbor.encodedLengthSize(bytes.size.toULong()) + bytes.size
     }
 
     companion object {
@@ -19,7 +33,7 @@ class Tstr(val value: String) : DataItem(MajorType.UNICODE_STRING) {
             val (payloadBegin, length) = Cbor.decodeLength(encodedCbor, offset)
             val payloadEnd = payloadBegin + length.toInt()
             val slice = encodedCbor.sliceArray(IntRange(payloadBegin, payloadEnd - 1))
-            return Pair(payloadEnd, Tstr(slice.decodeToString()))
+            return Pair(payloadEnd, Tstr(slice.decodeToString(), slice))
         }
     }
 
@@ -1,17 +1,17 @@
 package com.android.identity.cbor
 
-import kotlinx.io.bytestring.ByteStringBuilder
-
 /**
  * Unsigned Integer (major type 0).
  *
  * @param value the value.
  */
 class Uint(val value: ULong) : CborInt(MajorType.UNSIGNED_INTEGER) {
-    override fun encode(builder: ByteStringBuilder) {
+    override fun encode(builder: EncodeBuffer) {
         Cbor.encodeLength(builder, majorType, value)
     }
 
+    override fun encodedSize(): Int = Cbor.encodedLengthSize(value)
+
     companion object {
         internal fun decode(encodedCbor: ByteArray, offset: Int): Pair<Int, Uint> {
             val (newOffset, value) = Cbor.decodeLength(encodedCbor, offset)
@@ -101,7 +101,7 @@ open class Credential {
         this.document = document
         replacementForIdentifier = asReplacementFor?.identifier
         asReplacementFor?.replacementIdentifier = this.identifier
-        _applicationData = SimpleApplicationData { document.saveDocument() }
+        _applicationData = SimpleApplicationData { document.saveCredential(this) }
         // Only the leaf constructor should add the credential to the document.
         if (this::class == Credential::class) {
             addToDocument()
@@ -118,7 +118,7 @@ open class Credential {
     //
     protected fun addToDocument() {
         credentialCounter = document.addCredential(this)
-        document.saveDocument()
+        document.saveAddedCredential(this)
     }
 
     /**
@@ -136,7 +136,7 @@ open class Credential {
         this.document = document
         _applicationData = SimpleApplicationData
             .decodeFromCbor(applicationDataDataItem.value) {
-                document.saveDocument()
+                document.saveCredential(this)
             }
 
         identifier = dataItem["identifier"].asTstr
@@ -297,8 +297,10 @@ open class Credential {
      * This should be called when a crdential has been presented to a verifier.
      */
     fun increaseUsageCount() {
+        val oldUsageCount = usageCount
         usageCount += 1
-        document.saveDocument()
+        document.credentialUsageCountChanged(this, oldUsageCount)
+        document.saveCredential(this)
     }
 
     /**
@@ -319,10 +321,13 @@ open class Credential {
         _validFrom = validFrom
         _validUntil = validUntil
 
-        replacementFor?.delete()
-        replacementForIdentifier = null
+        // Deleting the replaced credential and certifying this one must be stored together.
+        document.batchWrites {
+            replacementFor?.delete()
+            replacementForIdentifier = null
 
-        document.certifyPendingCredential(this)
+            document.certifyPendingCredential(this)
+        }
     }
 
     /**
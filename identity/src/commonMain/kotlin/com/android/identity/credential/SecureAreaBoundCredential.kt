@@ -53,7 +53,8 @@ open class SecureAreaBoundCredential : Credential {
     ) : super(document, asReplacementFor, domain) {
         this.secureArea = secureArea
         this.alias = SECURE_AREA_ALIAS_PREFIX + identifier
-        this.secureArea.createKey(alias, createKeySettings)
+        // Deferred when the credential is created by DocumentUtil.managedCredentialHelper().
+        document.createCredentialKey(this, createKeySettings)
         // Only the leaf constructor should add the credential to the document.
         if (this::class == SecureAreaBoundCredential::class) {
             addToDocument()
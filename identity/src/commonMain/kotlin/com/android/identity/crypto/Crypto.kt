@@ -62,6 +62,23 @@ expect object Crypto {
         messagePlaintext: ByteArray,
     ): ByteArray
 
+    /**
+     * Creates a [StreamingEncryptor] for encrypting a message which isn't available in its
+     * entirety, for example one read from a stream, without holding it all in memory.
+     *
+     * @param algorithm must be one of [Algorithm.A128GCM], [Algorithm.A192GCM],
+     * [Algorithm.A256GCM].
+     * @param key the encryption key.
+     * @param nonce the nonce/IV.
+     * @return a [StreamingEncryptor].
+     * @throws IllegalArgumentException if the given algorithm is not supported.
+     */
+    fun createStreamingEncryptor(
+        algorithm: Algorithm,
+        key: ByteArray,
+        nonce: ByteArray,
+    ): StreamingEncryptor
+
     /**
      * Message decryption.
      *
@@ -0,0 +1,29 @@
+package com.android.identity.crypto
+
+/**
+ * Encrypts a message piece by piece, see [Crypto.createStreamingEncryptor].
+ *
+ * The result of concatenating all the data returned by [update] and [finish] is the same as
+ * that returned by [Crypto.encrypt] for the whole message. Platforms which can't encrypt
+ * incrementally return empty arrays from [update] and the whole cipher text from [finish].
+ */
+interface StreamingEncryptor {
+    /**
+     * Encrypts the next part of the message.
+     *
+     * @param data the array holding the plaintext.
+     * @param offset offset of the plaintext in [data].
+     * @param length length of the plaintext.
+     * @return the cipher text produced so far, possibly empty.
+     */
+    fun update(data: ByteArray, offset: Int = 0, length: Int = data.size): ByteArray
+
+    /**
+     * Finishes encryption.
+     *
+     * The encryptor cannot be used after this has been called.
+     *
+     * @return the remaining cipher text, with the tag appended to it.
+     */
+    fun finish(): ByteArray
+}
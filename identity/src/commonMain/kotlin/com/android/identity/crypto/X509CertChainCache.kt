@@ -0,0 +1,180 @@
+package com.android.identity.crypto
+
+import com.android.identity.cbor.CborArray
+import com.android.identity.cbor.DataItem
+import com.android.identity.util.Lock
+import com.android.identity.util.toHex
+import com.android.identity.util.withLock
+import kotlinx.datetime.Clock
+import kotlinx.datetime.Instant
+
+/**
+ * A bounded, thread-safe cache for parsing and verifying X.509 certificate chains.
+ *
+ * Readers see the same few issuer certificate chains over and over again. This cache is keyed
+ * by a hash of the encoded certificates in a chain. It keeps the parsed [X509CertChain] and
+ * the public key of its leaf certificate, and, if a [verifier] is set, the result of a
+ * successful verification of the chain.
+ *
+ * The [verifier] returns the point in time until which a successful verification holds,
+ * normally the earliest expiration date of the certificates used. The cache re-verifies a
+ * chain after that point. Failed verifications aren't remembered, so they are re-checked
+ * every time. When the cache is full, the least recently used entry is evicted.
+ *
+ * If the set of trusted certificates used by [verifier] changes, call [clear].
+ *
+ * @param maxEntries the maximum number of certificate chains to keep in the cache.
+ * @param verifier a function to verify a certificate chain, returning the point in time until
+ * which the verification holds or `null` if the chain isn't trusted. If `null`, chains are
+ * only parsed, not verified.
+ * @param clock a function to get the current time.
+ */
+class X509CertChainCache(
+    val maxEntries: Int = DEFAULT_MAX_ENTRIES,
+    private val verifier: ((X509CertChain) -> Instant?)? = null,
+    private val clock: () -> Instant = { Clock.System.now() }
+) {
+    init {
+        require(maxEntries > 0) { "maxEntries must be positive" }
+    }
+
+    /**
+     * The result of a cache lookup.
+     *
+     * @param certificateChain the parsed certificate chain.
+     * @param leafPublicKey the public key of the first certificate in the chain.
+     * @param verified whether the chain was successfully verified, or `null` if the cache has
+     * no verifier.
+     */
+    class Result(
+        val certificateChain: X509CertChain,
+        val leafPublicKey: EcPublicKey,
+        val verified: Boolean?
+    )
+
+    private class Entry(
+        val certificateChain: X509CertChain,
+        val leafPublicKey: EcPublicKey,
+        val verifiedUntil: Instant?
+    )
+
+    private val lock = Lock()
+
+    // Kept in least recently used order, entries are moved to the end when used.
+    private val entries = LinkedHashMap<String, Entry>()
+
+    private var _hits = 0L
+    private var _misses = 0L
+
+    /**
+     * The number of lookups which didn't require parsing or verifying the chain.
+     */
+    val hits: Long
+        get() = lock.withLock { _hits }
+
+    /**
+     * The number of lookups which required parsing or verifying the chain.
+     */
+    val misses: Long
+        get() = lock.withLock { _misses }
+
+    /**
+     * The number of certificate chains in the cache.
+     */
+    val size: Int
+        get() = lock.withLock { entries.size }
+
+    /**
+     * Looks up a certificate chain, parsing and verifying it if needed.
+     *
+     * @param encodedCertificates the encoded certificates in the chain, leaf first.
+     * @return a [Result] for the chain.
+     */
+    fun lookup(encodedCertificates: List<ByteArray>): Result {
+        require(encodedCertificates.isNotEmpty()) { "Certificate chain is empty" }
+        val key = cacheKey(encodedCertificates)
+        val now = clock()
+        val cached = lock.withLock {
+            entries.remove(key)?.also { entry ->
+                entries[key] = entry
+                if (verifier == null || (entry.verifiedUntil != null && now < entry.verifiedUntil)) {
+                    _hits++
+                    return Result(
+                        entry.certificateChain,
+                        entry.leafPublicKey,
+                        if (verifier != null) true else null
+                    )
+                }
+            }
+        }
+
+        // Do the expensive work without holding the lock.
+        val certificateChain = cached?.certificateChain
+            ?: X509CertChain(encodedCertificates.map { X509Cert(it) })
+        val leafPublicKey = cached?.leafPublicKey
+            ?: certificateChain.certificates[0].ecPublicKey
+        val verifiedUntil = verifier?.invoke(certificateChain)?.takeIf { now < it }
+        lock.withLock {
+            _misses++
+            entries.remove(key)
+            entries[key] = Entry(certificateChain, leafPublicKey, verifiedUntil)
+            while (entries.size > maxEntries) {
+                entries.remove(entries.keys.first())
+            }
+        }
+        return Result(
+            certificateChain,
+            leafPublicKey,
+            if (verifier != null) verifiedUntil != null else null
+        )
+    }
+
+    /**
+     * Looks up a certificate chain encoded as CBOR, for example in a COSE `x5chain` header.
+     *
+     * See [X509CertChain.fromDataItem] for the expected encoding.
+     *
+     * @param dataItem the CBOR data item with the chain.
+     * @return a [Result] for the chain.
+     */
+    fun lookup(dataItem: DataItem): Result =
+        lookup(
+            if (dataItem is CborArray) {
+                dataItem.items.map { it.asBstr }
+            } else {
+                listOf(dataItem.asBstr)
+            }
+        )
+
+    /**
+     * Removes all entries from the cache.
+     */
+    fun clear() {
+        lock.withLock { entries.clear() }
+    }
+
+    private fun cacheKey(encodedCertificates: List<ByteArray>): String {
+        var totalSize = 0
+        encodedCertificates.forEach { totalSize += 4 + it.size }
+        val data = ByteArray(totalSize)
+        var offset = 0
+        for (encodedCertificate in encodedCertificates) {
+            // Prefix each certificate with its size so the boundaries are part of the key.
+            val size = encodedCertificate.size
+            data[offset++] = (size ushr 24).toByte()
+            data[offset++] = (size ushr 16).toByte()
+            data[offset++] = (size ushr 8).toByte()
+            data[offset++] = size.toByte()
+            encodedCertificate.copyInto(data, offset)
+            offset += size
+        }
+        return Crypto.digest(Algorithm.SHA256, data).toHex()
+    }
+
+    companion object {
+        /**
+         * The default maximum number of certificate chains in the cache.
+         */
+        const val DEFAULT_MAX_ENTRIES = 64
+    }
+}
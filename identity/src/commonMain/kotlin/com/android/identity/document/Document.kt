@@ -19,12 +19,15 @@ import com.android.identity.cbor.Cbor
 import com.android.identity.cbor.CborMap
 import com.android.identity.credential.Credential
 import com.android.identity.credential.CredentialFactory
+import com.android.identity.credential.SecureAreaBoundCredential
+import com.android.identity.securearea.CreateKeySettings
 import com.android.identity.securearea.SecureArea
 import com.android.identity.securearea.SecureAreaRepository
 import com.android.identity.storage.StorageEngine
 import com.android.identity.util.ApplicationData
 import com.android.identity.util.Logger
 import com.android.identity.util.SimpleApplicationData
+import com.android.identity.util.Tracing
 import kotlinx.datetime.Clock
 import kotlinx.datetime.Instant
 
@@ -102,6 +105,12 @@ class Document private constructor(
         saveDocument()
     }
 
+    // Called by DocumentStore.preload() to read everything which is otherwise loaded lazily.
+    internal fun loadContents() {
+        applicationData
+        loadCredentials()
+    }
+
     /**
      * Application specific data.
      *
@@ -109,22 +118,41 @@ class Document private constructor(
      * with the credential. Setters and associated getters are
      * enumerated in the [ApplicationData] interface.
      */
-    private var _applicationData = SimpleApplicationData { saveDocument() }
+    private var _applicationData: SimpleApplicationData? = SimpleApplicationData {
+        saveApplicationData()
+    }
     val applicationData: ApplicationData
-        get() = _applicationData
+        get() = _applicationData ?: loadApplicationData()
+
+    // Identifiers of credentials which are in storage but haven't been instantiated yet. These
+    // are only set after loading the document and until the first access to its credentials.
+    private var unloadedPendingCredentials: List<String>? = null
+    private var unloadedCertifiedCredentials: List<String>? = null
+
+    private val loadedPendingCredentials = mutableListOf<Credential>()
+    private val _pendingCredentials: MutableList<Credential>
+        get() {
+            loadCredentials()
+            return loadedPendingCredentials
+        }
 
     /**
      * Credentials which still need to be certified
      */
-    private var _pendingCredentials = mutableListOf<Credential>()
     val pendingCredentials: List<Credential>
         // Return shallow copy b/c backing field may get modified if certify() or delete() is called.
         get() = _pendingCredentials.toList()
 
+    private val loadedCertifiedCredentials = mutableListOf<Credential>()
+    private val _certifiedCredentials: MutableList<Credential>
+        get() {
+            loadCredentials()
+            return loadedCertifiedCredentials
+        }
+
     /**
      * Certified credentials.
      */
-    private var _certifiedCredentials = mutableListOf<Credential>()
     val certifiedCredentials: List<Credential>
         // Return shallow copy b/c backing field may get modified if certify() or delete() is called.
         get() = _certifiedCredentials.toList()
@@ -137,66 +165,382 @@ class Document private constructor(
     var credentialCounter: Long = 0
         private set
 
-    internal fun saveDocument() {
+    // The document is persisted as several records so that a change only rewrites what was
+    // changed instead of the whole document:
+    //
+    //  - DOCUMENT_PREFIX + name: the credential counter and identifiers of all credentials,
+    //  - APPLICATION_DATA_PREFIX + name: the application data of the document,
+    //  - credentialKey(identifier): a single credential, as serialized by Credential.toCbor().
+    //
+    private fun credentialKey(identifier: String) = "$CREDENTIAL_PREFIX${name}_$identifier"
+
+    // Runs [block], which writes one or more records, as a single transaction and, if [notify]
+    // is set, notifies collectors of the store's event flow.
+    private fun save(what: String, notify: Boolean = true, block: () -> Unit) {
         if (!addedToStore) {
             return
         }
         val t0 = Clock.System.now()
+        Tracing.span("document.save") { span ->
+            span.setAttribute("what", what)
+            storageEngine.transaction(block)
+        }
+        val t1 = Clock.System.now()
+        val durationMillis = t1.toEpochMilliseconds() - t0.toEpochMilliseconds()
+        Logger.d(TAG, "Saved $what of document '$name' in $durationMillis msec")
+        if (notify) {
+            store.emitOnDocumentChanged(this)
+        }
+    }
+
+    private fun putDocumentRecord() {
+        val pendingIdentifiers = unloadedPendingCredentials
+            ?: loadedPendingCredentials.map { it.identifier }
+        val certifiedIdentifiers = unloadedCertifiedCredentials
+            ?: loadedCertifiedCredentials.map { it.identifier }
         val mapBuilder = CborMap.builder().apply {
-            put("applicationData", _applicationData.encodeAsCbor())
             val pendingCredentialsArrayBuilder = putArray("pendingCredentials")
-            for (pendingCredential in _pendingCredentials) {
-                pendingCredentialsArrayBuilder.add(pendingCredential.toCbor())
+            for (identifier in pendingIdentifiers) {
+                pendingCredentialsArrayBuilder.add(identifier)
             }
             val certifiedCredentialsArrayBuilder = putArray("certifiedCredentials")
-            for (certifiedCredential in _certifiedCredentials) {
-                certifiedCredentialsArrayBuilder.add(certifiedCredential.toCbor())
+            for (identifier in certifiedIdentifiers) {
+                certifiedCredentialsArrayBuilder.add(identifier)
             }
             put("credentialCounter", credentialCounter)
         }
         storageEngine.put(DOCUMENT_PREFIX + name, Cbor.encode(mapBuilder.end().build()))
-        val t1 = Clock.System.now()
+    }
 
-        // Saving a document is a costly affair (often more than 100ms) so log when we're doing
-        // this so application developers are aware. This is to deter applications from storing
-        // ephemeral data in the ApplicationData instances of the document and our associated
-        // credentials.
-        val durationMillis = t1.toEpochMilliseconds() - t0.toEpochMilliseconds()
-        Logger.i(TAG, "Saved document '$name' to disk in $durationMillis msec")
-        store.emitOnDocumentChanged(this)
+    private fun putCredential(credential: Credential) {
+        storageEngine.put(credentialKey(credential.identifier), Cbor.encode(credential.toCbor()))
     }
 
-    private fun loadDocument(): Boolean {
-        val data = storageEngine[DOCUMENT_PREFIX + name] ?: return false
-        val map = Cbor.decode(data)
+    // Writes all records of the document. Only used when adding the document to the store,
+    // which emits its own event.
+    private fun saveDocument() = save("all records", notify = false) {
+        putDocumentRecord()
+        _applicationData?.let {
+            storageEngine.put(APPLICATION_DATA_PREFIX + name, it.encodeAsCbor())
+        }
+        loadedPendingCredentials.forEach { putCredential(it) }
+        loadedCertifiedCredentials.forEach { putCredential(it) }
+    }
 
-        _applicationData = SimpleApplicationData
-            .decodeFromCbor(map["applicationData"].asBstr) {
-                saveDocument()
-            }
+    private fun saveApplicationData() = save("application data") {
+        storageEngine.put(APPLICATION_DATA_PREFIX + name, _applicationData!!.encodeAsCbor())
+    }
 
-        _pendingCredentials = ArrayList()
-        for (item in map["pendingCredentials"].asArray) {
-            _pendingCredentials.add(credentialFactory.createCredential(this, item))
+    // Called by [Credential] when its state or application data changes.
+    internal fun saveCredential(credential: Credential) {
+        if (!loadedPendingCredentials.contains(credential) &&
+            !loadedCertifiedCredentials.contains(credential)) {
+            // Not yet added to the document, or already removed.
+            return
         }
-        _certifiedCredentials = ArrayList()
-        for (item in map["certifiedCredentials"].asArray) {
-            _certifiedCredentials.add(credentialFactory.createCredential(this, item))
+        save("credential ${credential.identifier}") {
+            putCredential(credential)
         }
+    }
+
+    private fun loadDocument(): Boolean {
+        var data = storageEngine[DOCUMENT_PREFIX + name] ?: return false
+        if (Cbor.decode(data).getOrNull("applicationData") != null) {
+            data = convertLegacyDocument(data)
+        }
+        val map = Cbor.decode(data)
+        _applicationData = null
+        unloadedPendingCredentials = map["pendingCredentials"].asArray.map { it.asTstr }
+        unloadedCertifiedCredentials = map["certifiedCredentials"].asArray.map { it.asTstr }
         credentialCounter = map["credentialCounter"].asNumber
         addedToStore = true
         return true
     }
 
+    // Documents used to be stored as a single map holding the application data and all
+    // credentials. Splits such a document into the individual records, returning the new
+    // document record.
+    private fun convertLegacyDocument(legacyData: ByteArray): ByteArray {
+        Logger.i(TAG, "Converting document '$name' to per-credential records")
+        val map = Cbor.decode(legacyData)
+        val mapBuilder = CborMap.builder()
+        return storageEngine.transaction {
+            storageEngine.put(APPLICATION_DATA_PREFIX + name, map["applicationData"].asBstr)
+            for (listName in listOf("pendingCredentials", "certifiedCredentials")) {
+                val arrayBuilder = mapBuilder.putArray(listName)
+                for (item in map[listName].asArray) {
+                    val identifier = item["identifier"].asTstr
+                    storageEngine.put(credentialKey(identifier), Cbor.encode(item))
+                    arrayBuilder.add(identifier)
+                }
+            }
+            mapBuilder.put("credentialCounter", map["credentialCounter"].asNumber)
+            Cbor.encode(mapBuilder.end().build()).also {
+                storageEngine.put(DOCUMENT_PREFIX + name, it)
+            }
+        }
+    }
+
+    private fun loadApplicationData(): SimpleApplicationData {
+        val encoded = storageEngine[APPLICATION_DATA_PREFIX + name]
+        val applicationData = if (encoded != null) {
+            SimpleApplicationData.decodeFromCbor(encoded) { saveApplicationData() }
+        } else {
+            SimpleApplicationData { saveApplicationData() }
+        }
+        _applicationData = applicationData
+        return applicationData
+    }
+
+    // Instantiates credentials of a loaded document with [CredentialFactory.createCredential].
+    // This is deferred until they are first needed since it may be costly, e.g. for
+    // credentials carrying large issuer-provided data.
+    private fun loadCredentials() {
+        val pendingIdentifiers = unloadedPendingCredentials ?: return
+        val certifiedIdentifiers = unloadedCertifiedCredentials!!
+        val pending = pendingIdentifiers.map { loadCredential(it) }
+        val certified = certifiedIdentifiers.map { loadCredential(it) }
+        loadedPendingCredentials.addAll(pending)
+        loadedCertifiedCredentials.addAll(certified)
+        unloadedPendingCredentials = null
+        unloadedCertifiedCredentials = null
+    }
+
+    private fun loadCredential(identifier: String): Credential {
+        val data = checkNotNull(storageEngine[credentialKey(identifier)]) {
+            "No record for credential $identifier of document '$name'"
+        }
+        return credentialFactory.createCredential(this, Cbor.decode(data))
+    }
+
+    // Runs [block] with all writes to storage, including ones from saving the document, batched.
+    internal fun <T> batchWrites(block: () -> T): T = storageEngine.transaction(block)
+
+    // Credentials whose keys are to be created at the end of batchCreateKeys(), by secure area
+    // and key settings, or null if not in batchCreateKeys().
+    private var credentialsAwaitingKeys:
+            MutableMap<Pair<SecureArea, CreateKeySettings>, MutableList<SecureAreaBoundCredential>>? =
+        null
+
+    // Runs [block] with the keys of [SecureAreaBoundCredential]s created in it created at the
+    // end, with one [SecureArea.batchCreateKey] call per secure area and settings. If [block]
+    // or creating the keys fails, the credentials created in [block] are deleted.
+    internal fun <T> batchCreateKeys(block: () -> T): T {
+        if (credentialsAwaitingKeys != null) {
+            return block()
+        }
+        val credentialsByKeySettings =
+            mutableMapOf<Pair<SecureArea, CreateKeySettings>, MutableList<SecureAreaBoundCredential>>()
+        credentialsAwaitingKeys = credentialsByKeySettings
+        try {
+            val result = block()
+            credentialsAwaitingKeys = null
+            for ((secureAreaAndSettings, credentials) in credentialsByKeySettings) {
+                val (secureArea, createKeySettings) = secureAreaAndSettings
+                secureArea.batchCreateKey(credentials.map { it.alias }, createKeySettings)
+            }
+            return result
+        } catch (e: Throwable) {
+            credentialsAwaitingKeys = null
+            credentialsByKeySettings.values.flatten().forEach { it.delete() }
+            throw e
+        }
+    }
+
+    // Called by [SecureAreaBoundCredential] to create the key of a new credential.
+    internal fun createCredentialKey(
+        credential: SecureAreaBoundCredential,
+        createKeySettings: CreateKeySettings
+    ) {
+        val credentialsByKeySettings = credentialsAwaitingKeys
+        if (credentialsByKeySettings == null) {
+            credential.secureArea.createKey(credential.alias, createKeySettings)
+        } else {
+            credentialsByKeySettings
+                .getOrPut(Pair(credential.secureArea, createKeySettings)) { mutableListOf() }
+                .add(credential)
+        }
+    }
+
     internal fun deleteDocument() {
-        _pendingCredentials.clear()
-        _certifiedCredentials.clear()
-        storageEngine.delete(DOCUMENT_PREFIX + name)
+        // Changes made through stale references to the document must not be persisted.
+        addedToStore = false
+        val identifiers =
+            (unloadedPendingCredentials ?: loadedPendingCredentials.map { it.identifier }) +
+                    (unloadedCertifiedCredentials ?: loadedCertifiedCredentials.map { it.identifier })
+        unloadedPendingCredentials = null
+        unloadedCertifiedCredentials = null
+        loadedPendingCredentials.clear()
+        loadedCertifiedCredentials.clear()
+        invalidateCredentialIndex()
+        storageEngine.transaction {
+            for (identifier in identifiers) {
+                storageEngine.delete(credentialKey(identifier))
+            }
+            storageEngine.delete(APPLICATION_DATA_PREFIX + name)
+            storageEngine.delete(DOCUMENT_PREFIX + name)
+        }
+    }
+
+    // The certified credentials which findCredential() considers valid at all points in time
+    // t for which [holdsAt] returns true, grouped by domain and ordered by usage count and
+    // then by the order in which they were certified. Which credentials are valid only changes
+    // at their validFrom and validUntil times, so this is built again only when the time
+    // passed crosses one of those, or after a certified credential is added or removed, see
+    // [invalidateCredentialIndex]. A change of usage count only moves that credential.
+    private class ValidCredentials(
+        val byDomain: Map<String, MutableList<Credential>>,
+        // Position in the list of certified credentials, by credential identifier.
+        private val certificationOrder: Map<String, Int>,
+        private val latestValidFromBefore: Instant,
+        private val latestValidUntilBefore: Instant,
+        private val earliestValidFromAfter: Instant,
+        private val earliestValidUntilAfter: Instant
+    ) {
+        fun holdsAt(t: Instant): Boolean =
+            t >= latestValidFromBefore && t > latestValidUntilBefore &&
+                    t < earliestValidFromAfter && t <= earliestValidUntilAfter
+
+        // Moves [credential] from where it was ordered with [oldUsageCount] to where it's
+        // ordered with its current usage count.
+        fun reposition(credential: Credential, oldUsageCount: Int) {
+            val credentials = byDomain[credential.domain] ?: return
+            val order = certificationOrder[credential.identifier] ?: return
+            val index = credentials.binarySearch { compareOrder(it, oldUsageCount, order) }
+            if (index < 0 || credentials[index] !== credential) {
+                // Not valid in this window.
+                return
+            }
+            credentials.removeAt(index)
+            val insertionPoint = credentials.binarySearch {
+                compareOrder(it, credential.usageCount, order)
+            }
+            credentials.add(-insertionPoint - 1, credential)
+        }
+
+        private fun compareOrder(credential: Credential, usageCount: Int, order: Int): Int {
+            val result = credential.usageCount.compareTo(usageCount)
+            if (result != 0) {
+                return result
+            }
+            return certificationOrder[credential.identifier]!!.compareTo(order)
+        }
+    }
+    private var validCredentials: ValidCredentials? = null
+
+    // The result of the last countUsableCredentials() call, which stays valid for all points
+    // in time in the [windowStart, windowEnd) interval.
+    private class UsabilitySummary(
+        val numCredentials: Int,
+        val numCredentialsValid: Int,
+        // Identifiers of the valid credentials which haven't been used yet.
+        val availableCredentials: MutableSet<String>,
+        val windowStart: Instant,
+        val windowEnd: Instant
+    )
+    private var usabilitySummary: UsabilitySummary? = null
+
+    private fun invalidateCredentialIndex() {
+        validCredentials = null
+        usabilitySummary = null
+    }
+
+    // Called by [Credential.increaseUsageCount].
+    internal fun credentialUsageCountChanged(credential: Credential, oldUsageCount: Int) {
+        validCredentials?.reposition(credential, oldUsageCount)
+        if (credential.usageCount != 0) {
+            usabilitySummary?.availableCredentials?.remove(credential.identifier)
+        }
+    }
+
+    private fun getValidCredentials(now: Instant): ValidCredentials {
+        validCredentials?.let {
+            if (it.holdsAt(now)) {
+                return it
+            }
+        }
+        val byDomain = mutableMapOf<String, MutableList<Credential>>()
+        val certificationOrder = mutableMapOf<String, Int>()
+        var latestValidFromBefore = Instant.DISTANT_PAST
+        var latestValidUntilBefore = Instant.DISTANT_PAST
+        var earliestValidFromAfter = Instant.DISTANT_FUTURE
+        var earliestValidUntilAfter = Instant.DISTANT_FUTURE
+        for ((n, credential) in _certifiedCredentials.withIndex()) {
+            certificationOrder[credential.identifier] = n
+            val validFrom = credential.validFrom
+            val validUntil = credential.validUntil
+            if (validFrom <= now) {
+                latestValidFromBefore = maxOf(latestValidFromBefore, validFrom)
+            } else {
+                earliestValidFromAfter = minOf(earliestValidFromAfter, validFrom)
+            }
+            if (validUntil < now) {
+                latestValidUntilBefore = maxOf(latestValidUntilBefore, validUntil)
+            } else {
+                earliestValidUntilAfter = minOf(earliestValidUntilAfter, validUntil)
+            }
+            if (now >= validFrom && now <= validUntil) {
+                byDomain.getOrPut(credential.domain) { mutableListOf() }.add(credential)
+            }
+        }
+        // The sort is stable so credentials with the same usage count stay in certification order.
+        byDomain.values.forEach { credentials -> credentials.sortBy { it.usageCount } }
+        return ValidCredentials(
+            byDomain,
+            certificationOrder,
+            latestValidFromBefore,
+            latestValidUntilBefore,
+            earliestValidFromAfter,
+            earliestValidUntilAfter
+        ).also { validCredentials = it }
+    }
+
+    // Whether a credential is usable at [at] only changes at its validFrom and validUntil
+    // times, so a summary computed for [at] holds until the closest of those on either side.
+    private fun getUsabilitySummary(at: Instant): UsabilitySummary {
+        usabilitySummary?.let {
+            if (at >= it.windowStart && at < it.windowEnd) {
+                return it
+            }
+        }
+        var numCredentials = 0
+        var numCredentialsValid = 0
+        val availableCredentials = mutableSetOf<String>()
+        var windowStart = Instant.DISTANT_PAST
+        var windowEnd = Instant.DISTANT_FUTURE
+        for (credential in _certifiedCredentials) {
+            numCredentials++
+            val validFrom = credential.validFrom
+            val validUntil = credential.validUntil
+            if (at >= validFrom && at < validUntil) {
+                numCredentialsValid++
+                if (credential.usageCount == 0) {
+                    availableCredentials.add(credential.identifier)
+                }
+            }
+            for (boundary in listOf(validFrom, validUntil)) {
+                if (boundary <= at) {
+                    windowStart = maxOf(windowStart, boundary)
+                } else {
+                    windowEnd = minOf(windowEnd, boundary)
+                }
+            }
+        }
+        return UsabilitySummary(
+            numCredentials,
+            numCredentialsValid,
+            availableCredentials,
+            windowStart,
+            windowEnd
+        ).also { usabilitySummary = it }
     }
 
     /**
      * Finds a suitable certified credential to use.
      *
+     * Of the credentials valid at [now], the one with the lowest usage count is returned, and of
+     * those with the same usage count the one certified first.
+     *
      * @param domain The domain to pick the credential from.
      * @param now Pass current time to ensure that the selected slot's validity period or
      * `null` to not consider validity times.
@@ -206,25 +550,14 @@ class Document private constructor(
         domain: String,
         now: Instant?
     ): Credential? {
-        var candidate: Credential? = null
-        _certifiedCredentials.filter {
-            it.domain == domain && (
-                    now != null
-                            && (now >= it.validFrom)
-                            && (now <= it.validUntil)
-                    )
-        }.forEach { credential ->
-            // If we already have a candidate, prefer this one if its usage count is lower
-            candidate?.let { candidateCredential ->
-                if (credential.usageCount < candidateCredential.usageCount) {
-                    candidate = credential
-                }
-            } ?: run {
-                candidate = credential
-            }
-
+        if (now == null) {
+            return null
+        }
+        // Valid credentials are ordered by usage count so the first one is the best candidate.
+        return Tracing.span("document.findCredential") { span ->
+            span.setAttribute("domain", domain)
+            getValidCredentials(now).byDomain[domain]?.firstOrNull()
         }
-        return candidate
     }
 
     // Adds a newly created [Credential] to the document, returns the assigned credential counter
@@ -236,6 +569,17 @@ class Document private constructor(
         return assignedCounter
     }
 
+    // Called by [Credential] once a credential added with [addCredential] is fully constructed.
+    internal fun saveAddedCredential(credential: Credential) {
+        save("new credential ${credential.identifier}") {
+            putDocumentRecord()
+            putCredential(credential)
+            // The credential being replaced now refers to the new one.
+            _certifiedCredentials.firstOrNull { it.identifier == credential.replacementForIdentifier }
+                ?.let { putCredential(it) }
+        }
+    }
+
     /**
      * Goes through all credentials and deletes the ones which are invalidated.
      */
@@ -260,18 +604,8 @@ class Document private constructor(
      * @param at the point in time to check for.
      * @returns `true` if an usable credential exists for the given time, `false` otherwise
      */
-    fun hasUsableCredential(at: Instant = Clock.System.now()): Boolean {
-        val credentials = certifiedCredentials
-        if (credentials.isEmpty()) {
-            return false
-        }
-        for (credential in credentials) {
-            if (at >= credential.validFrom && at < credential.validUntil) {
-                return true
-            }
-        }
-        return false
-    }
+    fun hasUsableCredential(at: Instant = Clock.System.now()): Boolean =
+        getUsabilitySummary(at).numCredentialsValid > 0
 
     data class UsableCredentialResult(
         val numCredentials: Int,
@@ -281,38 +615,30 @@ class Document private constructor(
     /**
      * Returns whether an usable credential exists at a given point in time.
      *
+     * The result is cached until the set of certified credentials changes, or until [at] crosses
+     * the validity boundary of a credential, so this is cheap to call repeatedly, for example
+     * when displaying a list of documents.
+     *
      * @param at the point in time to check for.
      * @returns `true` if an usable credential exists for the given time, `false` otherwise
      */
-    fun countUsableCredentials(at: Instant = Clock.System.now()): UsableCredentialResult {
-        val credentials = certifiedCredentials
-        if (credentials.isEmpty()) {
-            return UsableCredentialResult(0, 0)
+    fun countUsableCredentials(at: Instant = Clock.System.now()): UsableCredentialResult =
+        getUsabilitySummary(at).let {
+            UsableCredentialResult(it.numCredentials, it.availableCredentials.size)
         }
-        var numCredentials = 0
-        var numCredentialsAvailable = 0
-        for (credential in credentials) {
-            numCredentials++
-            val validFrom = credential.validFrom
-            val validUntil = credential.validUntil
-            if (at >= validFrom && at < validUntil) {
-                if (credential.usageCount == 0) {
-                    numCredentialsAvailable++
-                }
-            }
-        }
-        return UsableCredentialResult(numCredentials, numCredentialsAvailable)
-    }
 
     internal fun removeCredential(credential: Credential) {
         val listToModify = if (credential.isCertified) _certifiedCredentials
             else _pendingCredentials
         check(listToModify.remove(credential)) { "Error removing credential" }
+        invalidateCredentialIndex()
 
+        val modifiedCredentials = mutableListOf<Credential>()
         if (credential.replacementForIdentifier != null) {
             for (cred in _certifiedCredentials) {
                 if (cred.identifier == credential.replacementForIdentifier) {
                     cred.replacementIdentifier = null
+                    modifiedCredentials.add(cred)
                     break
                 }
             }
@@ -322,11 +648,16 @@ class Document private constructor(
             for (pendingCred in _pendingCredentials) {
                 if (pendingCred.identifier == credential.replacementIdentifier) {
                     pendingCred.replacementForIdentifier = null
+                    modifiedCredentials.add(pendingCred)
                     break
                 }
             }
         }
-        saveDocument()
+        save("removal of credential ${credential.identifier}") {
+            putDocumentRecord()
+            storageEngine.delete(credentialKey(credential.identifier))
+            modifiedCredentials.forEach { putCredential(it) }
+        }
     }
 
     /**
@@ -339,13 +670,19 @@ class Document private constructor(
     ): Credential {
         check(_pendingCredentials.remove(credential)) { "Error removing credential from pending list" }
         _certifiedCredentials.add(credential)
-        saveDocument()
+        invalidateCredentialIndex()
+        save("certification of credential ${credential.identifier}") {
+            putDocumentRecord()
+            putCredential(credential)
+        }
         return credential
     }
 
     companion object {
         private const val TAG = "Document"
         internal const val DOCUMENT_PREFIX = "IC_Document_"
+        internal const val APPLICATION_DATA_PREFIX = "IC_DocumentApplicationData_"
+        internal const val CREDENTIAL_PREFIX = "IC_DocumentCredential_"
         internal const val AUTHENTICATION_KEY_ALIAS_PREFIX = "IC_Credential_"
 
         // Called by DocumentStore.createDocument().
@@ -356,7 +693,7 @@ class Document private constructor(
             store: DocumentStore,
             credentialFactory: CredentialFactory
         ): Document =
-            Document(name, storageEngine, secureAreaRepository, store, credentialFactory).apply { saveDocument() }
+            Document(name, storageEngine, secureAreaRepository, store, credentialFactory)
 
         // Called by DocumentStore.lookupDocument().
         internal fun lookup(
@@ -15,14 +15,20 @@
  */
 package com.android.identity.document
 
+import com.android.identity.cbor.Cbor
+import com.android.identity.cbor.CborArray
+import com.android.identity.credential.Credential
 import com.android.identity.credential.CredentialFactory
 import com.android.identity.securearea.SecureArea
 import com.android.identity.securearea.SecureAreaRepository
 import com.android.identity.storage.StorageEngine
+import com.android.identity.util.Lock
+import com.android.identity.util.withLock
 import kotlinx.coroutines.flow.MutableSharedFlow
 import kotlinx.coroutines.flow.SharedFlow
 import kotlinx.coroutines.flow.asSharedFlow
 import kotlinx.coroutines.runBlocking
+import kotlinx.coroutines.yield
 
 /**
  * Class for storing real-world identity documents.
@@ -39,7 +45,14 @@ import kotlinx.coroutines.runBlocking
  *
  * It is guaranteed that once a document is created with [createDocument],
  * each subsequent call to [lookupDocument] will return the same
- * [Document] instance.
+ * [Document] instance, unless the cache of documents is bounded using
+ * [maxCachedDocuments]. In that case a document evicted from the cache is loaded
+ * again as a new instance and applications must not hold on to [Document] instances
+ * across lookups.
+ *
+ * The names of all documents are kept in an index in the [StorageEngine] so listing
+ * documents doesn't require enumerating all keys in storage. Use [preload] to load
+ * documents before they are needed, for example at application start.
  *
  * For more details about documents stored in a [DocumentStore] see the
  * [Document] class.
@@ -49,14 +62,69 @@ import kotlinx.coroutines.runBlocking
  * be used.
  * @param credentialFactory the [CredentialFactory] to use for retrieving serialized credentials
  * associated with documents.
+ * @param maxCachedDocuments the maximum number of [Document] instances to keep in memory.
+ * When exceeded, the least recently used document is evicted. The default is no limit.
  */
 class DocumentStore(
     private val storageEngine: StorageEngine,
     private val secureAreaRepository: SecureAreaRepository,
-    private val credentialFactory: CredentialFactory
+    private val credentialFactory: CredentialFactory,
+    val maxCachedDocuments: Int = Int.MAX_VALUE
 ) {
-    // Use a cache so the same instance is returned by multiple lookupDocument() calls.
-    private val documentCache = mutableMapOf<String, Document>()
+    init {
+        require(maxCachedDocuments > 0) { "maxCachedDocuments must be positive" }
+    }
+
+    private val lock = Lock()
+
+    // Use a cache so the same instance is returned by multiple lookupDocument() calls. Kept
+    // in least recently used order, documents are moved to the end when looked up.
+    private val documentCache = LinkedHashMap<String, Document>()
+
+    private var cacheHits = 0L
+    private var cacheMisses = 0L
+    private var cacheEvictions = 0L
+
+    /**
+     * Statistics for the cache of [Document] instances.
+     *
+     * @param hits the number of lookups which were served from the cache.
+     * @param misses the number of lookups which required loading the document from storage.
+     * @param evictions the number of documents evicted from the cache.
+     * @param size the number of documents currently in the cache.
+     */
+    data class CacheStatistics(
+        val hits: Long,
+        val misses: Long,
+        val evictions: Long,
+        val size: Int
+    )
+
+    /**
+     * The current [CacheStatistics] for this store.
+     */
+    val cacheStatistics: CacheStatistics
+        get() = lock.withLock {
+            CacheStatistics(cacheHits, cacheMisses, cacheEvictions, documentCache.size)
+        }
+
+    // Puts [document] in the cache unless a document of the same name got there first, and
+    // returns the cached one.
+    private fun putInCache(document: Document, replace: Boolean = false): Document =
+        lock.withLock {
+            val existing = documentCache.remove(document.name)
+            val result = if (existing != null && !replace) existing else document
+            documentCache[document.name] = result
+            while (documentCache.size > maxCachedDocuments) {
+                documentCache.remove(documentCache.keys.first())
+                cacheEvictions++
+            }
+            result
+        }
+
+    private fun removeFromCache(name: String) {
+        lock.withLock { documentCache.remove(name) }
+    }
 
     /**
      * Creates a new document.
@@ -73,11 +141,7 @@ class DocumentStore(
      * @return A newly created document.
      */
     fun createDocument(name: String): Document {
-        lookupDocument(name)?.let { document ->
-            documentCache.remove(name)
-            emitOnDocumentDeleted(document)
-            document.deleteDocument()
-        }
+        lookupDocument(name)?.let { document -> deleteDocument(document) }
         val transientDocument = Document.create(
             storageEngine,
             secureAreaRepository,
@@ -96,8 +160,15 @@ class DocumentStore(
      * @param document the document.
      */
     fun addDocument(document: Document) {
-        document.addToStore()
-        documentCache[document.name] = document
+        storageEngine.transaction {
+            document.addToStore()
+            updateNameIndex { names ->
+                if (!names.contains(document.name)) {
+                    names.add(document.name)
+                }
+            }
+        }
+        putInCache(document, replace = true)
         emitOnDocumentAdded(document)
     }
 
@@ -108,12 +179,56 @@ class DocumentStore(
      * @return the document or `null` if not found.
      */
     fun lookupDocument(name: String): Document? {
-        val result =
-            documentCache[name]
-                ?: Document.lookup(storageEngine, secureAreaRepository, name, this, credentialFactory)
+        lock.withLock {
+            documentCache.remove(name)?.let { document ->
+                documentCache[name] = document
+                cacheHits++
+                return document
+            }
+            cacheMisses++
+        }
+        // Load without holding the lock, another thread may be doing the same.
+        val document =
+            Document.lookup(storageEngine, secureAreaRepository, name, this, credentialFactory)
                 ?: return null
-        documentCache[name] = result
-        return result
+        return putInCache(document)
+    }
+
+    /**
+     * Loads documents into the cache ahead of time.
+     *
+     * This reads the documents along with their application data and credentials from
+     * storage so subsequent calls to [lookupDocument] for these documents, and use of the
+     * returned [Document] instances, don't need to. Documents which are already cached or
+     * don't exist are skipped.
+     *
+     * [StorageEngine] implementations aren't thread-safe, so documents are loaded in the
+     * caller's context, which should be the one the store is otherwise used from, e.g. the
+     * main thread. The coroutine yields after each document so other work in that context,
+     * e.g. drawing the UI, isn't held up until all documents are loaded.
+     *
+     * Nothing is gained from preloading more than [maxCachedDocuments] documents.
+     *
+     * @param names the names of the documents to load, for example from [listDocuments].
+     */
+    suspend fun preload(names: Collection<String>) {
+        for (name in names) {
+            if (lock.withLock { documentCache.containsKey(name) }) {
+                continue
+            }
+            val document = Document.lookup(
+                storageEngine,
+                secureAreaRepository,
+                name,
+                this,
+                credentialFactory
+            ) ?: continue
+            // The document isn't visible to other callers until it's put in the cache so
+            // it's safe to populate it here.
+            document.loadContents()
+            putInCache(document)
+            yield()
+        }
     }
 
     /**
@@ -121,11 +236,33 @@ class DocumentStore(
      *
      * @return list of all the document names in the store.
      */
-    fun listDocuments(): List<String> = mutableListOf<String>().apply {
-        storageEngine.enumerate()
-            .filter { name -> name.startsWith(Document.DOCUMENT_PREFIX) }
-            .map { name -> name.substring(Document.DOCUMENT_PREFIX.length) }
-            .forEach { name -> add(name) }
+    fun listDocuments(): List<String> = lock.withLock { readNameIndex() }
+
+    // The names of all documents in the store, in the order they were added. Stores written
+    // before the index was introduced don't have one, it's built from the keys in storage
+    // the first time it's needed.
+    private fun readNameIndex(): MutableList<String> {
+        val encodedIndex = storageEngine[NAME_INDEX_KEY]
+            ?: return storageEngine.enumerate()
+                .filter { key -> key.startsWith(Document.DOCUMENT_PREFIX) }
+                .map { key -> key.substring(Document.DOCUMENT_PREFIX.length) }
+                .toMutableList()
+                .also { writeNameIndex(it) }
+        return Cbor.decode(encodedIndex).asArray.map { it.asTstr }.toMutableList()
+    }
+
+    private fun writeNameIndex(names: List<String>) {
+        val builder = CborArray.builder()
+        names.forEach { builder.add(it) }
+        storageEngine.put(NAME_INDEX_KEY, Cbor.encode(builder.end().build()))
+    }
+
+    private fun updateNameIndex(block: (MutableList<String>) -> Unit) {
+        lock.withLock {
+            val names = readNameIndex()
+            block(names)
+            writeNameIndex(names)
+        }
     }
 
     /**
@@ -136,13 +273,30 @@ class DocumentStore(
      * @param name the identifier of the document.
      */
     fun deleteDocument(name: String) {
-        lookupDocument(name)?.let { document ->
-            documentCache.remove(name)
-            emitOnDocumentDeleted(document)
+        lookupDocument(name)?.let { document -> deleteDocument(document) }
+    }
+
+    private fun deleteDocument(document: Document) {
+        removeFromCache(document.name)
+        emitOnDocumentDeleted(document)
+        storageEngine.transaction {
             document.deleteDocument()
+            updateNameIndex { names -> names.remove(document.name) }
         }
     }
 
+    /**
+     * Runs a block of code with all writes to the [StorageEngine] batched.
+     *
+     * Creating, certifying, or deleting a [Credential] each cause one or more records of its
+     * [Document] to be written, so operations on many credentials at once should be done inside
+     * this block to persist them using a single write, see [StorageEngine.transaction].
+     *
+     * @param block the code to run.
+     * @return the value returned by [block].
+     */
+    fun <T> batchUpdate(block: () -> T): T = storageEngine.transaction(block)
+
     /**
      * Types of events used in the [eventFlow] property.
      */
@@ -187,10 +341,6 @@ class DocumentStore(
 
     // Called by code in Document class
     internal fun emitOnDocumentChanged(document: Document) {
-        if (documentCache[document.name] == null) {
-            // This is to prevent emitting onChanged when creating a document.
-            return
-        }
         runBlocking {
             _eventFlow.emit(Pair(EventType.DOCUMENT_UPDATED, document))
         }
@@ -198,5 +348,8 @@ class DocumentStore(
 
     companion object {
         const val TAG = "DocumentStore"
+
+        // Deliberately not starting with Document.DOCUMENT_PREFIX.
+        private const val NAME_INDEX_KEY = "IC_DocumentStore_Names"
     }
 }
\ No newline at end of file
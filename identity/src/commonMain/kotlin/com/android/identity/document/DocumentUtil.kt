@@ -42,6 +42,10 @@ object DocumentUtil {
      * and then call [Credential.certify] when receiving the certification
      * from the issuer.
      *
+     * The keys of [SecureAreaBoundCredential]s returned by `createCredential` are created once
+     * all credentials are, with [com.android.identity.securearea.SecureArea.batchCreateKey], so
+     * `createCredential` must not use the key of the credential it creates.
+     *
      * @param document the document to manage credentials for.
      * @param domain the domain to use for created credentials.
      * @param createCredential a lambda for creating the credential which only takes in an optional
@@ -64,51 +68,57 @@ object DocumentUtil {
         dryRun: Boolean
     ): Int {
         check(dryRun || createCredential != null)
-        // First determine which of the existing credentials need a replacement...
-        var numCredentialsNotNeedingReplacement = 0
-        var numReplacementsGenerated = 0
-        for (authCredential in document.certifiedCredentials.filter { it.domain == domain}) {
-            var credentialExceededUseCount = false
-            var credentialBeyondExpirationDate = false
-            if (authCredential.usageCount >= maxUsesPerCredential) {
-                credentialExceededUseCount = true
-            }
-            val expirationDate = Instant.fromEpochMilliseconds(
-                authCredential.validUntil.toEpochMilliseconds() - minValidTimeMillis
-            )
-            if (now > expirationDate) {
-                credentialBeyondExpirationDate = true
-            }
-            if (credentialExceededUseCount || credentialBeyondExpirationDate) {
-                if (authCredential.replacement == null) {
-                    if (!dryRun) {
-                        createCredential!!.invoke(authCredential)
+        // Creating a credential saves the document several times, batch all of it. Keys are
+        // created together at the end through SecureArea.batchCreateKey().
+        return document.batchWrites {
+            document.batchCreateKeys {
+                // First determine which of the existing credentials need a replacement...
+                var numCredentialsNotNeedingReplacement = 0
+                var numReplacementsGenerated = 0
+                for (authCredential in document.certifiedCredentials.filter { it.domain == domain}) {
+                    var credentialExceededUseCount = false
+                    var credentialBeyondExpirationDate = false
+                    if (authCredential.usageCount >= maxUsesPerCredential) {
+                        credentialExceededUseCount = true
+                    }
+                    val expirationDate = Instant.fromEpochMilliseconds(
+                        authCredential.validUntil.toEpochMilliseconds() - minValidTimeMillis
+                    )
+                    if (now > expirationDate) {
+                        credentialBeyondExpirationDate = true
+                    }
+                    if (credentialExceededUseCount || credentialBeyondExpirationDate) {
+                        if (authCredential.replacement == null) {
+                            if (!dryRun) {
+                                createCredential!!.invoke(authCredential)
+                            }
+                            numReplacementsGenerated++
+                            continue
+                        }
                     }
-                    numReplacementsGenerated++
-                    continue
+                    numCredentialsNotNeedingReplacement++
                 }
-            }
-            numCredentialsNotNeedingReplacement++
-        }
 
-        var numExistingPendingCredentials =
-            document.pendingCredentials.filter { it.domain == domain }.size
-        if (dryRun) {
-            numExistingPendingCredentials += numReplacementsGenerated
-        }
+                var numExistingPendingCredentials =
+                    document.pendingCredentials.filter { it.domain == domain }.size
+                if (dryRun) {
+                    numExistingPendingCredentials += numReplacementsGenerated
+                }
 
-        // It's possible we need to generate pending credentials that aren't replacements
-        val numNonReplacementsToGenerate = (numCredentials
-                - numCredentialsNotNeedingReplacement
-                - numExistingPendingCredentials)
-        if (!dryRun) {
-            if (numNonReplacementsToGenerate > 0) {
-                for (n in 0 until numNonReplacementsToGenerate) {
-                    val pendingCredential = createCredential!!.invoke(null)
-                    pendingCredential.applicationData.setBoolean(domain, true)
+                // It's possible we need to generate pending credentials that aren't replacements
+                val numNonReplacementsToGenerate = (numCredentials
+                        - numCredentialsNotNeedingReplacement
+                        - numExistingPendingCredentials)
+                if (!dryRun) {
+                    if (numNonReplacementsToGenerate > 0) {
+                        for (n in 0 until numNonReplacementsToGenerate) {
+                            val pendingCredential = createCredential!!.invoke(null)
+                            pendingCredential.applicationData.setBoolean(domain, true)
+                        }
+                    }
                 }
+                numReplacementsGenerated + numNonReplacementsToGenerate
             }
         }
-        return numReplacementsGenerated + numNonReplacementsToGenerate
     }
 }
@@ -71,6 +71,30 @@ interface SecureArea {
      */
     fun createKey(alias: String, createKeySettings: CreateKeySettings)
 
+    /**
+     * Creates several new keys with the same settings.
+     *
+     * This is equivalent to calling [createKey] for each alias but implementations may
+     * be able to do it faster, for example by generating keys in parallel or persisting
+     * metadata for all keys at once. This is useful when creating many keys at a time, for
+     * example when replenishing credentials.
+     *
+     * If any of the keys can't be created an exception is thrown and some of the keys may
+     * have been created.
+     *
+     * The default implementation calls [createKey] for each alias.
+     *
+     * @param aliases the unique strings to identify the newly created keys.
+     * @param createKeySettings A [CreateKeySettings] object.
+     * @throws IllegalArgumentException if the underlying Secure Area Implementation
+     * does not support the requested creation settings, for example the EC curve to use.
+     */
+    fun batchCreateKey(aliases: List<String>, createKeySettings: CreateKeySettings) {
+        for (alias in aliases) {
+            createKey(alias, createKeySettings)
+        }
+    }
+
     /**
      * Deletes a previously created key.
      *
@@ -33,6 +33,9 @@ import com.android.identity.securearea.fromDataItem
 import com.android.identity.securearea.keyPurposeSet
 import com.android.identity.securearea.toDataItem
 import com.android.identity.storage.StorageEngine
+import com.android.identity.util.Logger
+import com.android.identity.util.Tracing
+import kotlinx.datetime.Clock
 import kotlin.random.Random
 
 /**
@@ -60,12 +63,57 @@ class SoftwareSecureArea(private val storageEngine: StorageEngine) : SecureArea
         alias: String,
         createKeySettings: com.android.identity.securearea.CreateKeySettings
     ) {
-        val settings = if (createKeySettings is SoftwareCreateKeySettings) {
+        val settings = toSoftwareCreateKeySettings(createKeySettings)
+        storageEngine.put(PREFIX + alias, encodeNewKey(settings, null))
+    }
+
+    /**
+     * Creates several new keys with the same settings.
+     *
+     * All keys are persisted in a single [StorageEngine.transaction]. For passphrase-protected
+     * keys the encryption key is derived from the passphrase once for the whole batch, using
+     * a salt shared by the keys in the batch, instead of once per key.
+     */
+    override fun batchCreateKey(
+        aliases: List<String>,
+        createKeySettings: com.android.identity.securearea.CreateKeySettings
+    ) {
+        val settings = toSoftwareCreateKeySettings(createKeySettings)
+        val startMillis = Clock.System.now().toEpochMilliseconds()
+        val encryptionKey = if (settings.passphraseRequired) {
+            val salt = Random.Default.nextBytes(32)
+            PrivateKeyEncryptionKey(salt, derivePrivateKeyEncryptionKey(salt, settings.passphrase!!))
+        } else {
+            null
+        }
+        storageEngine.transaction {
+            for (alias in aliases) {
+                storageEngine.put(PREFIX + alias, encodeNewKey(settings, encryptionKey))
+            }
+        }
+        val durationMillis = Clock.System.now().toEpochMilliseconds() - startMillis
+        Logger.i(TAG, "Created ${aliases.size} keys in $durationMillis ms")
+    }
+
+    private fun toSoftwareCreateKeySettings(
+        createKeySettings: com.android.identity.securearea.CreateKeySettings
+    ): SoftwareCreateKeySettings =
+        if (createKeySettings is SoftwareCreateKeySettings) {
             createKeySettings
         } else {
             // Use default settings if user passed in a generic SecureArea.CreateKeySettings.
             SoftwareCreateKeySettings.Builder().build()
         }
+
+    // A key used for encrypting private keys and the salt it was derived with.
+    private class PrivateKeyEncryptionKey(val salt: ByteArray, val secretKey: ByteArray)
+
+    // Creates a new key and returns its encoded data for storage. For passphrase-protected
+    // keys, encryptionKey is used if set, otherwise it's derived using the public key as salt.
+    private fun encodeNewKey(
+        settings: SoftwareCreateKeySettings,
+        encryptionKey: PrivateKeyEncryptionKey?
+    ): ByteArray {
         try {
             val privateKey = Crypto.createEcPrivateKey(settings.ecCurve)
             val mapBuilder = CborMap.builder().apply {
@@ -78,7 +126,7 @@ class SoftwareSecureArea(private val storageEngine: StorageEngine) : SecureArea
                 mapBuilder.put("privateKey", privateKey.toCoseKey().toDataItem())
             } else {
                 val encodedPublicKey = Cbor.encode(privateKey.publicKey.toCoseKey().toDataItem())
-                val secretKey = derivePrivateKeyEncryptionKey(
+                val secretKey = encryptionKey?.secretKey ?: derivePrivateKeyEncryptionKey(
                     encodedPublicKey,
                     settings.passphrase!!
                 )
@@ -94,13 +142,16 @@ class SoftwareSecureArea(private val storageEngine: StorageEngine) : SecureArea
                     put("encodedPublicKey", encodedPublicKey)
                     put("encryptedPrivateKey", encryptedPrivateKey)
                     put("encryptedPrivateKeyIv", iv)
+                    if (encryptionKey != null) {
+                        put("encryptionKeySalt", encryptionKey.salt)
+                    }
                 }
             }
             mapBuilder.put("publicKey", privateKey.publicKey.toCoseKey().toDataItem())
             if (settings.passphraseConstraints != null) {
                 mapBuilder.put("passphraseConstraints", settings.passphraseConstraints.toDataItem())
             }
-            storageEngine.put(PREFIX + alias, Cbor.encode(mapBuilder.end().build()))
+            return Cbor.encode(mapBuilder.end().build())
         } catch (e: Exception) {
             // such as NoSuchAlgorithmException, CertificateException, InvalidAlgorithmParameterException, OperatorCreationException, IOException, NoSuchProviderException
             throw IllegalStateException("Unexpected exception", e)
@@ -108,14 +159,14 @@ class SoftwareSecureArea(private val storageEngine: StorageEngine) : SecureArea
     }
 
     private fun derivePrivateKeyEncryptionKey(
-        encodedPublicKey: ByteArray,
+        salt: ByteArray,
         passphrase: String
     ): ByteArray {
         val info = "ICPrivateKeyEncryption1".encodeToByteArray()
         return Crypto.hkdf(
             Algorithm.HMAC_SHA256,
             passphrase.encodeToByteArray(),
-            encodedPublicKey,
+            salt,
             info,
             32
         )
@@ -150,7 +201,9 @@ class SoftwareSecureArea(private val storageEngine: StorageEngine) : SecureArea
             val encodedPublicKey = map["encodedPublicKey"].asBstr
             val encryptedPrivateKey = map["encryptedPrivateKey"].asBstr
             val iv = map["encryptedPrivateKeyIv"].asBstr
-            val secretKey = derivePrivateKeyEncryptionKey(encodedPublicKey, passphrase)
+            // Keys created by batchCreateKey() share a salt, otherwise the public key is used.
+            val salt = map.getOrNull("encryptionKeySalt")?.asBstr ?: encodedPublicKey
+            val secretKey = derivePrivateKeyEncryptionKey(salt, passphrase)
             val encodedPrivateKey = try {
                 Crypto.decrypt(Algorithm.A128GCM, secretKey, iv, encryptedPrivateKey)
             } catch (e: Exception) {
@@ -181,9 +234,12 @@ class SoftwareSecureArea(private val storageEngine: StorageEngine) : SecureArea
         signatureAlgorithm: Algorithm,
         dataToSign: ByteArray,
         keyUnlockData: KeyUnlockData?
-    ): EcSignature = loadKey(PREFIX, alias, keyUnlockData).run {
-        require(keyPurposes.contains(KeyPurpose.SIGN)) { "Key does not have purpose SIGN" }
-        Crypto.sign(privateKey, signatureAlgorithm, dataToSign)
+    ): EcSignature = Tracing.span("securearea.sign") { span ->
+        span.setAttribute("secureArea", identifier)
+        loadKey(PREFIX, alias, keyUnlockData).run {
+            require(keyPurposes.contains(KeyPurpose.SIGN)) { "Key does not have purpose SIGN" }
+            Crypto.sign(privateKey, signatureAlgorithm, dataToSign)
+        }
     }
 
     override fun keyAgreement(
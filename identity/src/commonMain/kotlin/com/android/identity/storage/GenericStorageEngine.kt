@@ -15,8 +15,10 @@
  */
 package com.android.identity.storage
 
+import com.android.identity.cbor.ArrayBuilder
 import com.android.identity.cbor.Cbor
-import com.android.identity.cbor.CborMap
+import com.android.identity.cbor.CborArray
+import com.android.identity.cbor.DataItem
 import com.android.identity.util.Logger
 import kotlinx.io.buffered
 import kotlinx.io.files.FileNotFoundException
@@ -27,6 +29,18 @@ import kotlinx.io.readByteArray
 /**
  * An storage engine implemented by storing data in a file.
  *
+ * The file is an append-only log of records, one per [put] or [delete], so the cost of a
+ * write is proportional to the size of the value being written rather than the size of the
+ * store. Each record is framed with its length and a CRC-32 checksum and a record which was
+ * only partially written (for example because the process was killed) is discarded when the
+ * file is loaded, so every write is still atomic.
+ *
+ * Writes made in a [transaction] are persisted as a single record.
+ *
+ * When superseded records take up more than half of the file it's compacted by writing all
+ * live records to a new file and atomically moving it in place. Files written in the previous
+ * format, a single CBOR map, are read and converted on the next write.
+ *
  * @param storageFile the file to store the data in.
  */
 open class GenericStorageEngine(
@@ -35,6 +49,57 @@ open class GenericStorageEngine(
 
     companion object {
         private const val TAG = "GenericStorageEngine"
+
+        // The file starts with this magic and is followed by zero or more records
+        // framed in the following way
+        //
+        //   uint32 length, big endian
+        //   byte[length] transformed, encoded record
+        //   uint32 CRC-32 of the transformed, encoded record, big endian
+        //
+        // where the record is encoded using CBOR as
+        //
+        //   Record = Put / Delete / Batch
+        //   Put = [tstr, bstr]
+        //   Delete = [tstr]
+        //   Batch = [+ (Put / Delete)]
+        //
+        // where a Batch is used for the writes made in a transaction.
+        //
+        private val LOG_MAGIC = "ICsl".encodeToByteArray()
+        private const val FRAME_OVERHEAD = 8
+
+        // Don't bother compacting files smaller than this.
+        private const val COMPACTION_MIN_SIZE = 64 * 1024
+
+        private val CRC32_TABLE = IntArray(256) { n ->
+            var c = n
+            repeat(8) {
+                c = if (c and 1 != 0) (c ushr 1) xor 0xedb88320.toInt() else c ushr 1
+            }
+            c
+        }
+
+        private fun crc32(data: ByteArray, offset: Int, size: Int): Int {
+            var crc = -1
+            for (n in offset until offset + size) {
+                crc = CRC32_TABLE[(crc xor data[n].toInt()) and 0xff] xor (crc ushr 8)
+            }
+            return crc.inv()
+        }
+
+        private fun readInt(data: ByteArray, offset: Int): Int =
+            (data[offset].toInt() and 0xff shl 24) or
+                    (data[offset + 1].toInt() and 0xff shl 16) or
+                    (data[offset + 2].toInt() and 0xff shl 8) or
+                    (data[offset + 3].toInt() and 0xff)
+
+        private fun writeInt(data: ByteArray, offset: Int, value: Int) {
+            data[offset] = (value ushr 24).toByte()
+            data[offset + 1] = (value ushr 16).toByte()
+            data[offset + 2] = (value ushr 8).toByte()
+            data[offset + 3] = value.toByte()
+        }
     }
 
     /**
@@ -42,6 +107,8 @@ open class GenericStorageEngine(
      *
      * This can be used for encryption/decryption. By defualt this is the identity function.
      *
+     * This is applied to each record individually, not to the file as a whole.
+     *
      * @param data the data to transform.
      * @param isLoading set to `true` when loading data, `false` when saving data.
      */
@@ -51,49 +118,223 @@ open class GenericStorageEngine(
 
     private var data: MutableMap<String, ByteArray>? = null
 
+    // The size of the record currently holding the value for each key.
+    private val recordSizes = mutableMapOf<String, Int>()
+
+    // The size of the file and how much of it is taken up by the records in [recordSizes].
+    private var fileSize = 0L
+    private var liveSize = 0L
+
+    // Set if records can't be appended to the file because it doesn't exist, is in the
+    // legacy format, or ends with a partially written record.
+    private var needsRewrite = true
+
+    // Writes made in a transaction which haven't yet been persisted.
+    private var transactionDepth = 0
+    private val pendingKeys = mutableSetOf<String>()
+    private var pendingDeleteAll = false
+
     private fun ensureData() {
         if (data != null) {
             return
         }
         val path = Path(storageFile)
         try {
-            val nonTransformedData = SystemFileSystem.source(path).buffered().readByteArray()
-            val encodedData = transform(nonTransformedData, true)
+            val fileData = SystemFileSystem.source(path).buffered().readByteArray()
             data = mutableMapOf()
-            if (encodedData.size > 0) {
-                try {
-                    val map = Cbor.decode(encodedData).asMap
-                    for ((key, value) in map) {
-                        data!!.put(key.asTstr, value.asBstr)
-                    }
-                } catch (e: Throwable) {
-                    Logger.w(TAG, "Error decoding data at $path - treating as zeroed data", e)
-                }
+            if (fileData.size >= LOG_MAGIC.size &&
+                fileData.copyOfRange(0, LOG_MAGIC.size) contentEquals LOG_MAGIC) {
+                loadLog(path, fileData)
+            } else {
+                loadLegacy(path, fileData)
             }
         } catch (e: FileNotFoundException) {
             // No problem, we all start from zero at some point...
             data = mutableMapOf()
         } catch (e: Throwable) {
+            data = null
             throw IllegalStateException("Error loading data", e)
         }
     }
 
-    private fun saveData() {
-        check(data != null)
-        val builder = CborMap.builder()
-        for ((key, value) in data!!) {
-            builder.put(key, value)
+    private fun loadLegacy(path: Path, fileData: ByteArray) {
+        val encodedData = transform(fileData, true)
+        if (encodedData.size > 0) {
+            try {
+                val map = Cbor.decode(encodedData).asMap
+                for ((key, value) in map) {
+                    data!!.put(key.asTstr, value.asBstr)
+                }
+            } catch (e: Throwable) {
+                Logger.w(TAG, "Error decoding data at $path - treating as zeroed data", e)
+            }
+        }
+        needsRewrite = true
+    }
+
+    private fun loadLog(path: Path, fileData: ByteArray) {
+        var offset = LOG_MAGIC.size
+        while (offset < fileData.size) {
+            if (fileData.size - offset < FRAME_OVERHEAD) {
+                break
+            }
+            val length = readInt(fileData, offset)
+            if (length < 0 || length > fileData.size - offset - FRAME_OVERHEAD) {
+                break
+            }
+            val crc = readInt(fileData, offset + 4 + length)
+            if (crc != crc32(fileData, offset + 4, length)) {
+                break
+            }
+            val encodedRecord =
+                transform(fileData.copyOfRange(offset + 4, offset + 4 + length), true)
+            try {
+                applyRecord(encodedRecord, length + FRAME_OVERHEAD)
+            } catch (e: Throwable) {
+                Logger.w(TAG, "Error decoding record at offset $offset in $path", e)
+                break
+            }
+            offset += length + FRAME_OVERHEAD
+        }
+        fileSize = offset.toLong()
+        needsRewrite = offset < fileData.size
+        if (needsRewrite) {
+            Logger.w(TAG, "Ignoring ${fileData.size - offset} bytes of partially written " +
+                    "data at the end of $path")
+        }
+    }
+
+    private fun applyRecord(encodedRecord: ByteArray, size: Int) {
+        val record = Cbor.decode(encodedRecord).asArray
+        if (record[0] is CborArray) {
+            // Apportion the size of a batch evenly among its entries.
+            for (entry in record) {
+                applyEntry(entry.asArray, size / record.size)
+            }
+        } else {
+            applyEntry(record, size)
+        }
+    }
+
+    private fun applyEntry(entry: List<DataItem>, size: Int) {
+        val key = entry[0].asTstr
+        val value = if (entry.size > 1) entry[1].asBstr else null
+        recordSizes.remove(key)?.let { liveSize -= it }
+        if (value != null) {
+            data!![key] = value
+            recordSizes[key] = size
+            liveSize += size
+        } else {
+            data!!.remove(key)
+        }
+    }
+
+    private fun encodeEntry(builder: ArrayBuilder<*>, key: String, value: ByteArray?) {
+        builder.add(key)
+        if (value != null) {
+            builder.add(value)
         }
-        val nonTransformedData = Cbor.encode(builder.end().build())
-        val transformedData = transform(nonTransformedData, false)
+    }
+
+    private fun encodeFrame(keys: Collection<String>): ByteArray {
+        val record = CborArray.builder()
+        if (keys.size == 1) {
+            val key = keys.first()
+            encodeEntry(record, key, data!![key])
+        } else {
+            for (key in keys) {
+                val entry = record.addArray()
+                encodeEntry(entry, key, data!![key])
+                entry.end()
+            }
+        }
+        val payload = transform(record.end().encode(), false)
+        val frame = ByteArray(payload.size + FRAME_OVERHEAD)
+        writeInt(frame, 0, payload.size)
+        payload.copyInto(frame, 4)
+        writeInt(frame, 4 + payload.size, crc32(payload, 0, payload.size))
+        return frame
+    }
+
+    // Persists the current values for the given keys, a missing value means the key was deleted.
+    private fun appendRecord(keys: Collection<String>) {
+        if (needsRewrite) {
+            rewrite()
+            return
+        }
+        val frame = encodeFrame(keys)
+        try {
+            appendToFile(frame)
+        } catch (e: Throwable) {
+            // Part of the frame may have been written, new records can't be appended after
+            // it. Since [data] already has the new values, the next write persists them.
+            needsRewrite = true
+            throw e
+        }
+        fileSize += frame.size
+        for (key in keys) {
+            recordSizes.remove(key)?.let { liveSize -= it }
+            if (data!!.containsKey(key)) {
+                recordSizes[key] = frame.size / keys.size
+                liveSize += frame.size / keys.size
+            }
+        }
+        if (fileSize > COMPACTION_MIN_SIZE && fileSize > 2 * liveSize) {
+            rewrite()
+        }
+    }
+
+    // Appends a frame to the end of the file.
+    internal open fun appendToFile(frame: ByteArray) {
+        val sink = SystemFileSystem.sink(Path(storageFile), append = true).buffered()
+        try {
+            sink.write(frame)
+            sink.flush()
+        } finally {
+            sink.close()
+        }
+    }
+
+    private fun write(key: String) {
+        if (transactionDepth > 0) {
+            pendingKeys.add(key)
+        } else {
+            appendRecord(listOf(key))
+        }
+    }
+
+    private fun rewrite() {
+        check(data != null)
+        recordSizes.clear()
+        liveSize = 0
         // TODO: would be better if something like mkstemp(3) was available... but it's not.
         val newPath = Path("$storageFile.tmp")
         val path = Path(storageFile)
         val sink = SystemFileSystem.sink(newPath).buffered()
-        sink.write(transformedData)
+        sink.write(LOG_MAGIC)
+        for (key in data!!.keys) {
+            val frame = encodeFrame(listOf(key))
+            sink.write(frame)
+            recordSizes[key] = frame.size
+            liveSize += frame.size
+        }
         sink.flush()
         sink.close()
         SystemFileSystem.atomicMove(newPath, path)
+        fileSize = LOG_MAGIC.size + liveSize
+        needsRewrite = false
+    }
+
+    /**
+     * Writes all data to a new file, applying [transform] to every record anew.
+     *
+     * This can be used by subclasses to re-encrypt all data, for example after changing
+     * the key used in [transform].
+     */
+    protected fun rewriteAll() {
+        ensureData()
+        check(transactionDepth == 0) { "Cannot rewrite in a transaction" }
+        rewrite()
     }
 
     override fun get(key: String): ByteArray? {
@@ -104,19 +345,26 @@ open class GenericStorageEngine(
     override fun put(key: String, data: ByteArray) {
         ensureData()
         this.data!![key] = data
-        saveData()
+        write(key)
     }
 
     override fun delete(key: String) {
         ensureData()
-        data!!.remove(key)
-        saveData()
+        if (this.data!!.remove(key) == null) {
+            return
+        }
+        write(key)
     }
 
     override fun deleteAll() {
         ensureData()
         data!!.clear()
-        saveData()
+        if (transactionDepth > 0) {
+            pendingKeys.clear()
+            pendingDeleteAll = true
+        } else {
+            rewrite()
+        }
     }
 
     override fun enumerate(): Collection<String> {
@@ -124,4 +372,24 @@ open class GenericStorageEngine(
         return data!!.keys
     }
 
+    override fun <T> transaction(block: () -> T): T {
+        ensureData()
+        transactionDepth++
+        try {
+            return block()
+        } finally {
+            if (--transactionDepth == 0) {
+                if (pendingDeleteAll) {
+                    pendingDeleteAll = false
+                    pendingKeys.clear()
+                    rewrite()
+                } else if (pendingKeys.isNotEmpty()) {
+                    val keys = pendingKeys.toList()
+                    pendingKeys.clear()
+                    appendRecord(keys)
+                }
+            }
+        }
+    }
+
 }
\ No newline at end of file
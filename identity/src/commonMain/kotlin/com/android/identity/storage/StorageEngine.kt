@@ -61,4 +61,22 @@ interface StorageEngine {
      * @return A collection of keys.
      */
     fun enumerate(): Collection<String>
+
+    /**
+     * Runs a block of code as a single batch of writes.
+     *
+     * Calls to [put], [delete] and [deleteAll] made while [block] runs may be deferred and
+     * persisted together when it returns, for example using a single write to the backing
+     * file. Calls to [get] and [enumerate] made while [block] runs reflect the writes made
+     * so far. Transactions may be nested, in which case data is persisted when the outermost
+     * transaction completes.
+     *
+     * If [block] throws, the writes made until that point are still persisted.
+     *
+     * The default implementation simply runs [block].
+     *
+     * @param block the code to run.
+     * @return the value returned by [block].
+     */
+    fun <T> transaction(block: () -> T): T = block()
 }
\ No newline at end of file
@@ -0,0 +1,24 @@
+package com.android.identity.util
+
+/**
+ * A simple mutual-exclusion lock usable from common code.
+ *
+ * The lock is reentrant.
+ */
+internal expect class Lock() {
+    fun lock()
+
+    fun unlock()
+}
+
+/**
+ * Runs [block] while holding the lock.
+ */
+internal inline fun <T> Lock.withLock(block: () -> T): T {
+    lock()
+    try {
+        return block()
+    } finally {
+        unlock()
+    }
+}
@@ -0,0 +1,151 @@
+package com.android.identity.cbor
+
+import com.android.identity.util.fromHex
+import kotlin.test.Test
+import kotlin.test.assertContentEquals
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+import kotlin.test.assertFalse
+import kotlin.test.assertNull
+import kotlin.test.assertTrue
+
+class CborReaderTests {
+
+    private val encodedMap = Cbor.encode(
+        CborMap.builder()
+            .put("version", "1.0")
+            .putArray("numbers")
+                .add(1)
+                .add(-42)
+                .add(0x100000000)
+                .end()
+            .put("data", byteArrayOf(1, 2, 3))
+            .putTaggedEncodedCbor("embedded", Cbor.encode("foo".toDataItem()))
+            .put("flag", true)
+            .put("nested", CborMap.builder().put("a", 1).end().build())
+            .end()
+            .build()
+    )
+
+    @Test
+    fun readMapWithTstrKeys() {
+        val keys = mutableListOf<String>()
+        var version: String? = null
+        val numbers = mutableListOf<Long>()
+        var data: CborReader.Slice? = null
+        var embedded: String? = null
+        var flag: Boolean? = null
+        val reader = CborReader(encodedMap)
+        reader.readMapWithTstrKeys { key ->
+            keys.add(key)
+            when (key) {
+                "version" -> version = readTstr()
+                "numbers" -> readArray { numbers.add(readNumber()) }
+                "data" -> data = readBstrSlice()
+                "embedded" -> {
+                    assertEquals(Tagged.ENCODED_CBOR, readTag())
+                    embedded = readBstrSlice().reader().readTstr()
+                }
+                "flag" -> flag = readBoolean()
+                else -> skip()
+            }
+        }
+        assertFalse(reader.hasMore)
+        assertEquals(listOf("version", "numbers", "data", "embedded", "flag", "nested"), keys)
+        assertEquals("1.0", version)
+        assertEquals(listOf(1L, -42L, 0x100000000L), numbers)
+        assertContentEquals(byteArrayOf(1, 2, 3), data!!.toByteArray())
+        assertTrue(data!!.contentEquals(byteArrayOf(1, 2, 3)))
+        assertEquals("foo", embedded)
+        assertEquals(true, flag)
+    }
+
+    @Test
+    fun peekAndLengths() {
+        val reader = CborReader(encodedMap)
+        assertEquals(MajorType.MAP, reader.peekMajorType())
+        assertEquals(6L, reader.readMapLength())
+        assertEquals(MajorType.UNICODE_STRING, reader.peekMajorType())
+        assertEquals(7UL, reader.readLength())
+    }
+
+    @Test
+    fun readRawSliceMatchesEncoding() {
+        val nested = CborArray.builder()
+            .add(CborMap.builder().put("a", "b").end().build())
+            .addTaggedEncodedCbor(Cbor.encode(42.toDataItem()))
+            .end()
+            .build()
+        val encoded = Cbor.encode(
+            CborArray.builder().add(1).add(nested).add(2).end().build()
+        )
+        val reader = CborReader(encoded)
+        assertEquals(3L, reader.readArrayLength())
+        assertEquals(1L, reader.readNumber())
+        val slice = reader.readRawSlice()
+        assertContentEquals(Cbor.encode(nested), slice.toByteArray())
+        assertEquals(nested, slice.reader().readDataItem())
+        assertEquals(2L, reader.readNumber())
+        assertFalse(reader.hasMore)
+    }
+
+    @Test
+    fun skipIndefiniteLength() {
+        // [_ (_ h'0102', h'03'), {_ "a": 1}, [_ ], 1.5, "x"]
+        val encoded = "9f5f42010241 03ffbf616101ff9fff f93e00 6178ff"
+            .replace(" ", "").fromHex()
+        val reader = CborReader(encoded)
+        assertNull(reader.readArrayLength())
+        var count = 0
+        while (!reader.peekBreak()) {
+            reader.skip()
+            count++
+        }
+        reader.readBreak()
+        assertEquals(5, count)
+        assertFalse(reader.hasMore)
+    }
+
+    @Test
+    fun readDataItem() {
+        val reader = CborReader(encodedMap)
+        assertEquals(Cbor.decode(encodedMap), reader.readDataItem())
+        assertFalse(reader.hasMore)
+    }
+
+    @Test
+    fun wrongTypeThrows() {
+        assertFailsWith<IllegalArgumentException> {
+            CborReader(encodedMap).readArrayLength()
+        }
+        assertFailsWith<IllegalArgumentException> {
+            CborReader(Cbor.encode("foo".toDataItem())).readBstrSlice()
+        }
+        assertFailsWith<IllegalArgumentException> {
+            CborReader(Cbor.encode(42.toDataItem())).readBoolean()
+        }
+    }
+
+    @Test
+    fun numberRange() {
+        assertEquals(Long.MAX_VALUE, CborReader("1b7fffffffffffffff".fromHex()).readNumber())
+        assertEquals(Long.MIN_VALUE, CborReader("3b7fffffffffffffff".fromHex()).readNumber())
+        assertFailsWith<IllegalArgumentException> {
+            CborReader("1b8000000000000000".fromHex()).readNumber()
+        }
+        assertFailsWith<IllegalArgumentException> {
+            CborReader("3b8000000000000000".fromHex()).readNumber()
+        }
+    }
+
+    @Test
+    fun truncatedDataThrows() {
+        val truncated = encodedMap.copyOfRange(0, encodedMap.size - 1)
+        assertFailsWith<IllegalArgumentException> {
+            CborReader(truncated).skip()
+        }
+        assertFailsWith<IllegalArgumentException> {
+            CborReader("43010203".fromHex(), 0, 3).readBstrSlice()
+        }
+    }
+}
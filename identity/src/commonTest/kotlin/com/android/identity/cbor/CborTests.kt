@@ -1,7 +1,10 @@
 package com.android.identity.cbor
 
 import com.android.identity.util.fromHex
+import com.android.identity.util.toHex
 import kotlinx.datetime.Instant
+import kotlinx.io.Buffer
+import kotlinx.io.readByteArray
 import kotlin.test.Test
 import kotlin.test.assertContentEquals
 import kotlin.test.assertEquals
@@ -961,4 +964,145 @@ class CborTests {
             "0(\"2001-09-09T01:46:40Z\")",
             Cbor.toDiagnostics(Instant.fromEpochMilliseconds(1000000000000).toDataItemDateTimeString()))
     }
-}
\ No newline at end of file
+
+    @Test
+    fun decodeLazily() {
+        val encoded = Cbor.encode(
+            CborMap.builder()
+                .put("a", "b")
+                .putArray("array")
+                    .add(1)
+                    .addTaggedEncodedCbor(Cbor.encode("foo".toDataItem()))
+                    .end()
+                .putMap("map")
+                    .put(1, true)
+                    .end()
+                .end()
+                .build()
+        )
+        val item = Cbor.decodeLazily(encoded)
+        assertContentEquals(encoded, item.originalEncoding)
+        assertContentEquals(encoded, Cbor.encode(item))
+        assertEquals(Cbor.decode(encoded), item)
+        assertEquals("foo", item["array"][1].asTaggedEncodedCbor.asTstr)
+        assertEquals(true, item["map"][1].asBoolean)
+    }
+
+    @Test
+    fun decodeLazilyRetainsOriginalEncoding() {
+        // [{"a": 1}] where 1 is encoded using a non-preferred serialization.
+        val encoded = "81a161611801".fromHex()
+        assertEquals("81a1616101", Cbor.encode(Cbor.decode(encoded)).toHex())
+
+        val item = Cbor.decodeLazily(encoded)
+        assertContentEquals(encoded, Cbor.encode(item))
+
+        // Accessing the array doesn't change how the untouched map is encoded.
+        val map = item[0]
+        assertContentEquals("a161611801".fromHex(), map.originalEncoding)
+        assertContentEquals(encoded, Cbor.encode(item))
+
+        // So does accessing the item in a tag.
+        val taggedEncoded = "d8184581a1616101".fromHex()
+        val tagged = Cbor.decodeLazily(taggedEncoded)
+        assertEquals(1L, tagged.asTaggedEncodedCbor[0]["a"].asNumber)
+        assertContentEquals(taggedEncoded, Cbor.encode(tagged))
+        val taggedMap = Cbor.decodeLazily("c1a161611801".fromHex()) as Tagged
+        assertContentEquals("a161611801".fromHex(), taggedMap.taggedItem.originalEncoding)
+        assertEquals("c1a161611801", Cbor.encode(taggedMap).toHex())
+    }
+
+    @Test
+    fun decodeLazilyTaggedModified() {
+        val encoded = Cbor.encode(Tagged(1000L, CborArray.builder().add(1).end().build()))
+        val item = Cbor.decodeLazily(encoded) as Tagged
+        (item.taggedItem as CborArray).items.add(2.toDataItem())
+        assertEquals("1000([1, 2])", Cbor.toDiagnostics(Cbor.encode(item)))
+        assertContentEquals(
+            Cbor.encode(Tagged(1000L, CborArray.builder().add(1).add(2).end().build())),
+            Cbor.encode(item)
+        )
+    }
+
+    @Test
+    fun decodeLazilyModified() {
+        val encoded = Cbor.encode(CborArray.builder().add(1).end().build())
+        val item = Cbor.decodeLazily(encoded) as CborArray
+        item.items.add(2.toDataItem())
+        assertEquals("[1, 2]", Cbor.toDiagnostics(Cbor.encode(item)))
+    }
+
+    @Test
+    fun decodeLazilyMalformed() {
+        assertFailsWith<IllegalArgumentException> { Cbor.decodeLazily("82a1616101".fromHex()) }
+        assertFailsWith<IllegalArgumentException> { Cbor.decodeLazily("8101ff".fromHex()) }
+    }
+
+    @Test
+    fun encodeUsesPreferredLengths() {
+        assertEquals("19ffff", Cbor.encode(0xffff.toDataItem()).toHex())
+        assertEquals("1a00010000", Cbor.encode(0x10000.toDataItem()).toHex())
+        assertEquals("1affffffff", Cbor.encode(0xffffffff.toDataItem()).toHex())
+        assertEquals("1b0000000100000000", Cbor.encode(0x100000000.toDataItem()).toHex())
+        assertEquals("3a0000ffff", Cbor.encode((-0x10000).toDataItem()).toHex())
+    }
+
+    @Test
+    fun encodedSize() {
+        val items = listOf(
+            "tstr".toDataItem(),
+            "\u00e6\u00f8\u00e5 \ud83d\ude00".toDataItem(),
+            ByteArray(300).toDataItem(),
+            0x10000.toDataItem(),
+            (-42).toDataItem(),
+            1.5f.toDataItem(),
+            1.5.toDataItem(),
+            Simple.NULL,
+            IndefLengthBstr(listOf(byteArrayOf(1, 2), byteArrayOf(3))),
+            IndefLengthTstr(listOf("a", "bc")),
+            RawCbor(Cbor.encode(42.toDataItem())),
+            CborMap.builder()
+                .put("a", "b")
+                .putArray("array")
+                    .add(1)
+                    .addTaggedEncodedCbor(Cbor.encode("foo".toDataItem()))
+                    .end()
+                .end()
+                .build(),
+            CborArray(mutableListOf(1.toDataItem(), 2.toDataItem()), true),
+        )
+        for (item in items) {
+            val encoded = Cbor.encode(item)
+            assertEquals(encoded.size, Cbor.encodedSize(item), "for $item")
+            assertContentEquals(encoded, Cbor.encode(Cbor.decode(encoded)))
+        }
+    }
+
+    @Test
+    fun encodeToBuffer() {
+        val builder = CborMap.builder().put("a", 1).put("b", "foo").end()
+        val expected = Cbor.encode(builder.build())
+        assertContentEquals(expected, builder.encode())
+        assertEquals(expected.size, builder.encodedSize)
+
+        val buffer = ByteArray(expected.size + 2)
+        assertEquals(expected.size, builder.encode(buffer, 1))
+        assertContentEquals(expected, buffer.copyOfRange(1, 1 + expected.size))
+        assertEquals(0, buffer[0])
+        assertEquals(0, buffer[buffer.size - 1])
+
+        assertFailsWith<IllegalArgumentException> {
+            Cbor.encode(builder.build(), ByteArray(expected.size - 1))
+        }
+    }
+
+    @Test
+    fun encodeToSink() {
+        val item = CborArray.builder().add("foo").add(42).end().build()
+        val buffer = Buffer()
+        assertEquals(Cbor.encodedSize(item), Cbor.encode(item, buffer))
+        assertEquals(Cbor.encodedSize(item), Cbor.encode(item, buffer, ByteArray(1024)))
+        val expected = Cbor.encode(item)
+        assertContentEquals(expected + expected, buffer.readByteArray())
+    }
+}
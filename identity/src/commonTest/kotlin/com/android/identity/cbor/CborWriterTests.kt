@@ -0,0 +1,79 @@
+package com.android.identity.cbor
+
+import kotlin.test.Test
+import kotlin.test.assertContentEquals
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+
+class CborWriterTests {
+
+    @Test
+    fun numbers() {
+        val values = listOf(0L, 1L, 23L, 24L, 255L, 256L, 65535L, 65536L, 0xffffffffL,
+            0x100000000L, Long.MAX_VALUE, -1L, -24L, -25L, -256L, -257L, -65537L, Long.MIN_VALUE)
+        for (value in values) {
+            val writer = CborWriter()
+            writer.writeNumber(value)
+            assertContentEquals(Cbor.encode(value.toDataItem()), writer.toByteArray(), "$value")
+        }
+    }
+
+    @Test
+    fun map() {
+        val writer = CborWriter(initialCapacity = 1)
+        writer.writeMapHeader(6)
+        writer.writeTstr("version")
+        writer.writeTstr("1.0")
+        writer.writeTstr("numbers")
+        writer.writeArrayHeader(3)
+        writer.writeNumber(1)
+        writer.writeNumber(-42)
+        writer.writeNumber(0x100000000)
+        writer.writeTstr("data")
+        writer.writeBstr(ByteArray(300) { it.toByte() })
+        writer.writeTstr("embedded")
+        writer.writeTag(Tagged.ENCODED_CBOR)
+        writer.writeBstr(Cbor.encode("foo".toDataItem()))
+        writer.writeTstr("flag")
+        writer.writeBoolean(true)
+        writer.writeRaw(Cbor.encode("nested".toDataItem()))
+        writer.writeDataItem(CborMap.builder().put("a", 1.5).end().build())
+
+        val expected = Cbor.encode(
+            CborMap.builder()
+                .put("version", "1.0")
+                .putArray("numbers")
+                    .add(1)
+                    .add(-42)
+                    .add(0x100000000)
+                    .end()
+                .put("data", ByteArray(300) { it.toByte() })
+                .putTaggedEncodedCbor("embedded", Cbor.encode("foo".toDataItem()))
+                .put("flag", true)
+                .put("nested", CborMap.builder().put("a", 1.5).end().build())
+                .end()
+                .build()
+        )
+        assertEquals(expected.size, writer.size)
+        assertContentEquals(expected, writer.toByteArray())
+    }
+
+    @Test
+    fun readBack() {
+        val writer = CborWriter()
+        writer.writeArrayHeader(2)
+        writer.writeBoolean(false)
+        writer.writeTstr("ünïcödé")
+        val reader = CborReader(writer.toByteArray())
+        val items = mutableListOf<DataItem>()
+        reader.readArray { items.add(readDataItem()) }
+        assertEquals(listOf(false.toDataItem(), "ünïcödé".toDataItem()), items)
+    }
+
+    @Test
+    fun negativeLength() {
+        assertFailsWith(IllegalArgumentException::class) {
+            CborWriter().writeArrayHeader(-1)
+        }
+    }
+}
@@ -15,6 +15,8 @@
  */
 package com.android.identity.document
 
+import com.android.identity.cbor.Cbor
+import com.android.identity.cbor.CborMap
 import com.android.identity.credential.Credential
 import com.android.identity.credential.CredentialFactory
 import com.android.identity.credential.SecureAreaBoundCredential
@@ -26,6 +28,7 @@ import com.android.identity.securearea.SecureAreaRepository
 import com.android.identity.securearea.software.SoftwareSecureArea
 import com.android.identity.storage.EphemeralStorageEngine
 import com.android.identity.storage.StorageEngine
+import com.android.identity.util.SimpleApplicationData
 import kotlinx.coroutines.ExperimentalCoroutinesApi
 import kotlinx.coroutines.flow.toList
 import kotlinx.coroutines.launch
@@ -779,4 +782,413 @@ class DocumentStoreTest {
         toBeReplaced.delete()
         assertNull(replacement.replacementFor)
     }
+
+    @Test
+    fun testUsableCredentialCounts() {
+        val documentStore = DocumentStore(
+            storageEngine,
+            secureAreaRepository,
+            credentialFactory
+        )
+        val document = documentStore.createDocument("testDocument")
+        documentStore.addDocument(document)
+        assertEquals(
+            Document.UsableCredentialResult(0, 0),
+            document.countUsableCredentials(Instant.fromEpochMilliseconds(100))
+        )
+
+        // Three credentials, valid in [100, 200), [150, 250) and [300, 400).
+        val credentials = listOf(100L, 150L, 300L).map { validFrom ->
+            Credential(document, null, CREDENTIAL_DOMAIN).apply {
+                certify(
+                    byteArrayOf(),
+                    Instant.fromEpochMilliseconds(validFrom),
+                    Instant.fromEpochMilliseconds(validFrom + 100)
+                )
+            }
+        }
+        fun countAt(millis: Long) =
+            document.countUsableCredentials(Instant.fromEpochMilliseconds(millis))
+
+        assertEquals(Document.UsableCredentialResult(3, 0), countAt(50))
+        assertFalse(document.hasUsableCredential(Instant.fromEpochMilliseconds(50)))
+        assertEquals(Document.UsableCredentialResult(3, 1), countAt(100))
+        assertEquals(Document.UsableCredentialResult(3, 1), countAt(149))
+        assertEquals(Document.UsableCredentialResult(3, 2), countAt(150))
+        assertEquals(Document.UsableCredentialResult(3, 1), countAt(200))
+        assertEquals(Document.UsableCredentialResult(3, 0), countAt(250))
+        assertEquals(Document.UsableCredentialResult(3, 0), countAt(299))
+        assertEquals(Document.UsableCredentialResult(3, 1), countAt(300))
+        assertTrue(document.hasUsableCredential(Instant.fromEpochMilliseconds(300)))
+        assertEquals(Document.UsableCredentialResult(3, 0), countAt(400))
+
+        // Usage and removal of credentials are reflected in the counts.
+        assertEquals(Document.UsableCredentialResult(3, 2), countAt(175))
+        assertEquals(
+            credentials[0],
+            document.findCredential(CREDENTIAL_DOMAIN, Instant.fromEpochMilliseconds(175))
+        )
+        credentials[0].increaseUsageCount()
+        assertEquals(Document.UsableCredentialResult(3, 1), countAt(175))
+        assertTrue(document.hasUsableCredential(Instant.fromEpochMilliseconds(175)))
+        assertEquals(
+            credentials[1],
+            document.findCredential(CREDENTIAL_DOMAIN, Instant.fromEpochMilliseconds(175))
+        )
+        credentials[1].delete()
+        assertEquals(Document.UsableCredentialResult(2, 0), countAt(175))
+        assertEquals(
+            credentials[0],
+            document.findCredential(CREDENTIAL_DOMAIN, Instant.fromEpochMilliseconds(175))
+        )
+        assertNull(document.findCredential("otherDomain", Instant.fromEpochMilliseconds(175)))
+    }
+
+    @Test
+    fun testFindCredentialRotatesByUsageCount() {
+        val documentStore = DocumentStore(
+            storageEngine,
+            secureAreaRepository,
+            credentialFactory
+        )
+        val document = documentStore.createDocument("testDocument")
+        documentStore.addDocument(document)
+
+        // Four credentials valid in [100, 200] and one valid in [300, 400].
+        val credentials = listOf(100L, 100L, 100L, 100L, 300L).map { validFrom ->
+            Credential(document, null, CREDENTIAL_DOMAIN).apply {
+                certify(
+                    byteArrayOf(),
+                    Instant.fromEpochMilliseconds(validFrom),
+                    Instant.fromEpochMilliseconds(validFrom + 100)
+                )
+            }
+        }
+        fun findAt(millis: Long) =
+            document.findCredential(CREDENTIAL_DOMAIN, Instant.fromEpochMilliseconds(millis))
+
+        // Using the selected credential makes the next one with the lowest usage count, in
+        // certification order, the one selected.
+        for (n in 0 until 10) {
+            val credential = findAt(150L + n)
+            assertEquals(credentials[n % 4], credential)
+            credential!!.increaseUsageCount()
+        }
+        assertEquals(credentials[2], findAt(200))
+        assertNull(findAt(201))
+        assertEquals(credentials[4], findAt(300))
+
+        // Going back to the first window still reflects the usage counts.
+        credentials[2].increaseUsageCount()
+        assertEquals(credentials[3], findAt(100))
+        credentials[0].delete()
+        assertEquals(credentials[3], findAt(100))
+        credentials[3].increaseUsageCount()
+        assertEquals(credentials[1], findAt(100))
+    }
+
+    // A StorageEngine which records the keys written to it.
+    private class RecordingStorageEngine(val delegate: StorageEngine) : StorageEngine by delegate {
+        val keysWritten = mutableListOf<String>()
+        var numEnumerateCalls = 0
+        var numTransactions = 0
+        private var transactionDepth = 0
+
+        override fun put(key: String, data: ByteArray) {
+            keysWritten.add(key)
+            delegate.put(key, data)
+        }
+
+        override fun enumerate(): Collection<String> {
+            numEnumerateCalls++
+            return delegate.enumerate()
+        }
+
+        override fun <T> transaction(block: () -> T): T {
+            if (transactionDepth++ == 0) {
+                numTransactions++
+            }
+            try {
+                return delegate.transaction(block)
+            } finally {
+                transactionDepth--
+            }
+        }
+    }
+
+    @Test
+    fun testBoundedCache() {
+        val documentStore = DocumentStore(
+            storageEngine,
+            secureAreaRepository,
+            credentialFactory,
+            maxCachedDocuments = 2
+        )
+        for (name in listOf("a", "b", "c")) {
+            documentStore.addDocument(documentStore.createDocument(name))
+        }
+        // Adding "c" evicted "a", the least recently used document.
+        assertEquals(DocumentStore.CacheStatistics(0, 3, 1, 2), documentStore.cacheStatistics)
+
+        val b = documentStore.lookupDocument("b")
+        assertEquals(DocumentStore.CacheStatistics(1, 3, 1, 2), documentStore.cacheStatistics)
+        val a = documentStore.lookupDocument("a")
+        assertNotNull(a)
+        assertEquals(DocumentStore.CacheStatistics(1, 4, 2, 2), documentStore.cacheStatistics)
+        // "c" was evicted since "b" was used more recently.
+        assertEquals(b, documentStore.lookupDocument("b"))
+        assertEquals(a, documentStore.lookupDocument("a"))
+        assertEquals(DocumentStore.CacheStatistics(3, 4, 2, 2), documentStore.cacheStatistics)
+
+        // Changes are persisted when a document is evicted and loaded again.
+        a!!.applicationData.setString("foo", "bar")
+        documentStore.lookupDocument("c")
+        documentStore.lookupDocument("b")
+        assertEquals("bar", documentStore.lookupDocument("a")!!.applicationData.getString("foo"))
+    }
+
+    @Test
+    fun testNameIndex() {
+        val recordingStorageEngine = RecordingStorageEngine(storageEngine)
+        val documentStore = DocumentStore(
+            recordingStorageEngine,
+            secureAreaRepository,
+            credentialFactory
+        )
+        for (n in 0..4) {
+            val document = documentStore.createDocument("doc$n")
+            documentStore.addDocument(document)
+            Credential(document, null, CREDENTIAL_DOMAIN)
+        }
+        documentStore.deleteDocument("doc2")
+        assertEquals(listOf("doc0", "doc1", "doc3", "doc4"), documentStore.listDocuments())
+
+        // Only the first access to a store without an index enumerates storage.
+        assertEquals(1, recordingStorageEngine.numEnumerateCalls)
+
+        // A store written before the index was introduced has its index rebuilt.
+        storageEngine.delete("IC_DocumentStore_Names")
+        val documentStore2 = DocumentStore(
+            recordingStorageEngine,
+            secureAreaRepository,
+            credentialFactory
+        )
+        assertEquals(
+            setOf("doc0", "doc1", "doc3", "doc4"),
+            documentStore2.listDocuments().toSet()
+        )
+        assertEquals(
+            setOf("doc0", "doc1", "doc3", "doc4"),
+            documentStore2.listDocuments().toSet()
+        )
+        assertEquals(2, recordingStorageEngine.numEnumerateCalls)
+    }
+
+    @Test
+    fun testPreload() = runTest {
+        var numCredentialsCreated = 0
+        val countingCredentialFactory = CredentialFactory()
+        countingCredentialFactory.addCredentialImplementation(
+            Credential::class
+        ) { document, dataItem ->
+            numCredentialsCreated++
+            Credential(document, dataItem)
+        }
+        val documentStore = DocumentStore(
+            storageEngine,
+            secureAreaRepository,
+            countingCredentialFactory
+        )
+        for (n in 0..2) {
+            val document = documentStore.createDocument("doc$n")
+            documentStore.addDocument(document)
+            Credential(document, null, CREDENTIAL_DOMAIN)
+        }
+
+        val documentStore2 = DocumentStore(
+            storageEngine,
+            secureAreaRepository,
+            countingCredentialFactory
+        )
+        documentStore2.preload(documentStore2.listDocuments() + "doesNotExist")
+        assertEquals(3, numCredentialsCreated)
+        assertEquals(3, documentStore2.cacheStatistics.size)
+        for (n in 0..2) {
+            assertEquals(1, documentStore2.lookupDocument("doc$n")!!.pendingCredentials.size)
+        }
+        assertEquals(3, numCredentialsCreated)
+        assertEquals(DocumentStore.CacheStatistics(3, 0, 0, 3), documentStore2.cacheStatistics)
+    }
+
+    @Test
+    fun testOnlyChangedRecordsAreWritten() {
+        val recordingStorageEngine = RecordingStorageEngine(storageEngine)
+        val documentStore = DocumentStore(
+            recordingStorageEngine,
+            secureAreaRepository,
+            credentialFactory
+        )
+        val document = documentStore.createDocument("testDocument")
+        documentStore.addDocument(document)
+        for (n in 0..9) {
+            Credential(document, null, CREDENTIAL_DOMAIN).certify(
+                byteArrayOf(n.toByte()),
+                Instant.fromEpochMilliseconds(100),
+                Instant.fromEpochMilliseconds(200)
+            )
+        }
+
+        val credential = document.certifiedCredentials[5]
+        recordingStorageEngine.keysWritten.clear()
+        credential.increaseUsageCount()
+        assertEquals(
+            listOf("IC_DocumentCredential_testDocument_${credential.identifier}"),
+            recordingStorageEngine.keysWritten
+        )
+
+        recordingStorageEngine.keysWritten.clear()
+        document.applicationData.setString("foo", "bar")
+        assertEquals(
+            listOf("IC_DocumentApplicationData_testDocument"),
+            recordingStorageEngine.keysWritten
+        )
+    }
+
+    @Test
+    fun testCertifyReplacementIsOneTransaction() {
+        val recordingStorageEngine = RecordingStorageEngine(storageEngine)
+        val documentStore = DocumentStore(
+            recordingStorageEngine,
+            secureAreaRepository,
+            credentialFactory
+        )
+        val document = documentStore.createDocument("testDocument")
+        documentStore.addDocument(document)
+        val toBeReplaced = Credential(document, null, CREDENTIAL_DOMAIN)
+        toBeReplaced.certify(
+            byteArrayOf(1),
+            Instant.fromEpochMilliseconds(100),
+            Instant.fromEpochMilliseconds(200)
+        )
+        val replacement = Credential(document, toBeReplaced, CREDENTIAL_DOMAIN)
+
+        recordingStorageEngine.numTransactions = 0
+        replacement.certify(
+            byteArrayOf(2),
+            Instant.fromEpochMilliseconds(150),
+            Instant.fromEpochMilliseconds(250)
+        )
+        assertEquals(1, recordingStorageEngine.numTransactions)
+        assertEquals(listOf(replacement), document.certifiedCredentials)
+
+        val document2 = DocumentStore(storageEngine, secureAreaRepository, credentialFactory)
+            .lookupDocument("testDocument")!!
+        assertEquals(
+            listOf(replacement.identifier),
+            document2.certifiedCredentials.map { it.identifier }
+        )
+        assertTrue(document2.pendingCredentials.isEmpty())
+    }
+
+    @Test
+    fun testCredentialsAreLoadedOnFirstAccess() {
+        var numCredentialsCreated = 0
+        val countingCredentialFactory = CredentialFactory()
+        countingCredentialFactory.addCredentialImplementation(
+            Credential::class
+        ) { document, dataItem ->
+            numCredentialsCreated++
+            Credential(document, dataItem)
+        }
+        val documentStore = DocumentStore(
+            storageEngine,
+            secureAreaRepository,
+            countingCredentialFactory
+        )
+        val document = documentStore.createDocument("testDocument")
+        documentStore.addDocument(document)
+        document.applicationData.setString("foo", "bar")
+        for (n in 0..4) {
+            Credential(document, null, CREDENTIAL_DOMAIN)
+        }
+
+        val documentStore2 = DocumentStore(
+            storageEngine,
+            secureAreaRepository,
+            countingCredentialFactory
+        )
+        val document2 = documentStore2.lookupDocument("testDocument")!!
+        assertEquals("bar", document2.applicationData.getString("foo"))
+        assertEquals(0, numCredentialsCreated)
+        assertEquals(5, document2.pendingCredentials.size)
+        assertEquals(5, numCredentialsCreated)
+        assertEquals(
+            document.pendingCredentials.map { it.identifier },
+            document2.pendingCredentials.map { it.identifier }
+        )
+    }
+
+    @Test
+    fun testLegacyDocumentFormat() {
+        val documentStore = DocumentStore(
+            storageEngine,
+            secureAreaRepository,
+            credentialFactory
+        )
+        val document = documentStore.createDocument("testDocument")
+        documentStore.addDocument(document)
+        val pendingCredential = Credential(document, null, CREDENTIAL_DOMAIN)
+        val certifiedCredential = Credential(document, null, CREDENTIAL_DOMAIN)
+        certifiedCredential.certify(
+            byteArrayOf(1, 2, 3),
+            Instant.fromEpochMilliseconds(100),
+            Instant.fromEpochMilliseconds(200)
+        )
+
+        // Write the document the way it used to be stored, as a single map.
+        val applicationData = SimpleApplicationData {}
+        applicationData.setString("foo", "bar")
+        val legacyDocument = CborMap.builder().apply {
+            put("applicationData", applicationData.encodeAsCbor())
+            putArray("pendingCredentials").add(pendingCredential.toCbor())
+            putArray("certifiedCredentials").add(certifiedCredential.toCbor())
+            put("credentialCounter", 2L)
+        }.end().build()
+        storageEngine.deleteAll()
+        storageEngine.put("IC_Document_legacyDocument", Cbor.encode(legacyDocument))
+
+        val documentStore2 = DocumentStore(
+            storageEngine,
+            secureAreaRepository,
+            credentialFactory
+        )
+        val loadedDocument = documentStore2.lookupDocument("legacyDocument")!!
+        assertEquals("bar", loadedDocument.applicationData.getString("foo"))
+        assertEquals(2L, loadedDocument.credentialCounter)
+        assertEquals(
+            listOf(pendingCredential.identifier),
+            loadedDocument.pendingCredentials.map { it.identifier }
+        )
+        assertEquals(
+            listOf(certifiedCredential.identifier),
+            loadedDocument.certifiedCredentials.map { it.identifier }
+        )
+        assertContentEquals(
+            byteArrayOf(1, 2, 3),
+            loadedDocument.certifiedCredentials[0].issuerProvidedData
+        )
+
+        // The document was converted to per-credential records.
+        assertNull(Cbor.decode(storageEngine["IC_Document_legacyDocument"]!!)
+            .getOrNull("applicationData"))
+        assertNotNull(storageEngine["IC_DocumentApplicationData_legacyDocument"])
+        assertNotNull(
+            storageEngine["IC_DocumentCredential_legacyDocument_${pendingCredential.identifier}"]
+        )
+        assertEquals(listOf("legacyDocument"), documentStore2.listDocuments())
+
+        // Only the (now empty) name index of the store remains.
+        documentStore2.deleteDocument("legacyDocument")
+        assertEquals(listOf("IC_DocumentStore_Names"), storageEngine.enumerate().toList())
+    }
 }
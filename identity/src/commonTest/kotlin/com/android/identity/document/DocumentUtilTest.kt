@@ -30,6 +30,7 @@ import kotlin.test.BeforeTest
 import kotlin.test.Test
 import kotlin.test.assertContentEquals
 import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
 import kotlin.test.assertTrue
 
 class DocumentUtilTest {
@@ -261,4 +262,96 @@ class DocumentUtilTest {
             assertContentEquals(expectedData[count++], credential.issuerProvidedData)
         }
     }
+
+    // Records how keys are created, optionally failing batches.
+    private class RecordingSecureArea(
+        private val delegate: SecureArea,
+        private val failBatches: Boolean = false
+    ) : SecureArea by delegate {
+        val createdKeys = mutableListOf<String>()
+        val batches = mutableListOf<List<String>>()
+
+        override fun createKey(alias: String, createKeySettings: CreateKeySettings) {
+            createdKeys.add(alias)
+            delegate.createKey(alias, createKeySettings)
+        }
+
+        override fun batchCreateKey(aliases: List<String>, createKeySettings: CreateKeySettings) {
+            batches.add(aliases)
+            check(!failBatches) { "Failing batch" }
+            delegate.batchCreateKey(aliases, createKeySettings)
+        }
+    }
+
+    @Test
+    fun managedCredentialHelperBatchesKeyCreation() {
+        val recordingSecureArea = RecordingSecureArea(secureArea)
+        val document = DocumentStore(storageEngine, secureAreaRepository, credentialFactory)
+            .createDocument("testDocument")
+        val authKeySettings = CreateKeySettings(setOf(KeyPurpose.SIGN), EcCurve.P256)
+        val managedCredDomain = "managedCredentials"
+
+        val numCredsCreated = DocumentUtil.managedCredentialHelper(
+            document,
+            managedCredDomain,
+            createCredential = {credentialToReplace -> SecureAreaBoundCredential(
+                document,
+                credentialToReplace,
+                managedCredDomain,
+                recordingSecureArea,
+                authKeySettings
+            )},
+            Instant.fromEpochMilliseconds(100),
+            5,
+            1,
+            10L,
+            false
+        )
+        assertEquals(5, numCredsCreated)
+        assertEquals(0, recordingSecureArea.createdKeys.size)
+        assertEquals(1, recordingSecureArea.batches.size)
+        assertEquals(
+            document.pendingCredentials.map { (it as SecureAreaBoundCredential).alias },
+            recordingSecureArea.batches[0]
+        )
+        for (credential in document.pendingCredentials) {
+            credential as SecureAreaBoundCredential
+            secureArea.getKeyInfo(credential.alias)
+        }
+
+        // Credentials created outside of the helper still create their key right away.
+        val credential = SecureAreaBoundCredential(
+            document, null, "other", recordingSecureArea, authKeySettings)
+        assertEquals(listOf(credential.alias), recordingSecureArea.createdKeys)
+    }
+
+    @Test
+    fun managedCredentialHelperFailedKeyCreation() {
+        val recordingSecureArea = RecordingSecureArea(secureArea, failBatches = true)
+        val document = DocumentStore(storageEngine, secureAreaRepository, credentialFactory)
+            .createDocument("testDocument")
+        val authKeySettings = CreateKeySettings(setOf(KeyPurpose.SIGN), EcCurve.P256)
+        val managedCredDomain = "managedCredentials"
+
+        assertFailsWith(IllegalStateException::class) {
+            DocumentUtil.managedCredentialHelper(
+                document,
+                managedCredDomain,
+                createCredential = {credentialToReplace -> SecureAreaBoundCredential(
+                    document,
+                    credentialToReplace,
+                    managedCredDomain,
+                    recordingSecureArea,
+                    authKeySettings
+                )},
+                Instant.fromEpochMilliseconds(100),
+                5,
+                1,
+                10L,
+                false
+            )
+        }
+        // No credentials without keys are left behind.
+        assertEquals(0, document.pendingCredentials.size)
+    }
 }
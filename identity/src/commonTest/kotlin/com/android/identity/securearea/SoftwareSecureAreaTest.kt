@@ -18,6 +18,7 @@ package com.android.identity.securearea
 import com.android.identity.crypto.Algorithm
 import com.android.identity.crypto.Crypto
 import com.android.identity.crypto.EcCurve
+import com.android.identity.crypto.EcPublicKey
 import com.android.identity.securearea.software.SoftwareCreateKeySettings
 import com.android.identity.securearea.software.SoftwareKeyUnlockData
 import com.android.identity.securearea.software.SoftwareSecureArea
@@ -328,6 +329,43 @@ class SoftwareSecureAreaTest {
         )
     }
 
+    @Test
+    fun testBatchCreateKey() {
+        val storage = EphemeralStorageEngine()
+        val ks = SoftwareSecureArea(storage)
+        val passphrase = "verySekrit"
+        val aliases = listOf("testKey1", "testKey2", "testKey3")
+        ks.batchCreateKey(
+            aliases,
+            SoftwareCreateKeySettings.Builder()
+                .setPassphraseRequired(true, passphrase, PassphraseConstraints.PIN_SIX_DIGITS)
+                .build()
+        )
+        val publicKeys = mutableSetOf<EcPublicKey>()
+        val dataToSign = byteArrayOf(4, 5, 6)
+        for (alias in aliases) {
+            val keyInfo = ks.getKeyInfo(alias)
+            assertTrue(keyInfo.isPassphraseProtected)
+            publicKeys.add(keyInfo.publicKey)
+
+            // The keys share a salt for the passphrase but must still check it.
+            try {
+                ks.sign(alias, Algorithm.ES256, dataToSign, SoftwareKeyUnlockData("wrongPassphrase"))
+                fail()
+            } catch (e: KeyLockedException) {
+                // This is the expected path.
+            }
+            val signature = ks.sign(alias, Algorithm.ES256, dataToSign, SoftwareKeyUnlockData(passphrase))
+            assertTrue(Crypto.checkSignature(keyInfo.publicKey, dataToSign, Algorithm.ES256, signature))
+        }
+        assertEquals(aliases.size, publicKeys.size)
+
+        // Keys without a passphrase can be created in a batch too.
+        ks.batchCreateKey(listOf("testKey4", "testKey5"), CreateKeySettings(setOf(KeyPurpose.SIGN), EcCurve.P256))
+        assertFalse(ks.getKeyInfo("testKey4").isPassphraseProtected)
+        assertNotEquals(ks.getKeyInfo("testKey4").publicKey, ks.getKeyInfo("testKey5").publicKey)
+    }
+
     @Test
     fun testEcKeyCreationOverridesExistingAlias() {
         val storage = EphemeralStorageEngine()
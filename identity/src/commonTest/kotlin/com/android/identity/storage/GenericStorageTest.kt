@@ -15,13 +15,20 @@
  */
 package com.android.identity.storage
 
+import com.android.identity.cbor.Cbor
+import com.android.identity.cbor.CborMap
+import kotlinx.io.IOException
+import kotlinx.io.buffered
 import kotlinx.io.files.Path
 import kotlinx.io.files.SystemFileSystem
+import kotlinx.io.readByteArray
 import kotlin.test.Test
 import kotlin.test.assertContentEquals
 import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
 import kotlin.test.assertNotNull
 import kotlin.test.assertNull
+import kotlin.test.assertTrue
 
 class GenericStorageTest {
     @Test
@@ -67,4 +74,142 @@ class GenericStorageTest {
         val storage2 = GenericStorageEngine(storageFile)
         assertContentEquals(data, storage2["foo"])
     }
+
+    private fun readFile(path: Path): ByteArray =
+        SystemFileSystem.source(path).buffered().readByteArray()
+
+    @Test
+    fun testManyWritesAreCompacted() {
+        val storageFile = Path("/tmp/ic-test")
+        val storage = GenericStorageEngine(storageFile)
+        storage.deleteAll()
+        for (n in 0 until 1000) {
+            storage.put("key${n % 10}", ByteArray(1024) { n.toByte() })
+        }
+        storage.delete("key0")
+
+        // 10 keys, 1 KiB each, only a few generations of superseded records should remain.
+        assertTrue(readFile(storageFile).size < 64 * 1024 + 16 * 1024)
+
+        val storage2 = GenericStorageEngine(storageFile)
+        assertEquals(9, storage2.enumerate().size)
+        assertNull(storage2["key0"])
+        for (n in 1 until 10) {
+            assertContentEquals(ByteArray(1024) { (990 + n).toByte() }, storage2["key$n"])
+        }
+    }
+
+    @Test
+    fun testPartiallyWrittenRecordIsIgnored() {
+        val storageFile = Path("/tmp/ic-test")
+        val storage = GenericStorageEngine(storageFile)
+        storage.deleteAll()
+        storage.put("foo", byteArrayOf(1, 2, 3))
+        storage.put("bar", byteArrayOf(4, 5, 6))
+
+        // Simulate a crash in the middle of writing a record.
+        val fileData = readFile(storageFile)
+        val sink = SystemFileSystem.sink(storageFile, append = true).buffered()
+        sink.write(byteArrayOf(0, 0, 0, 42, 1, 2))
+        sink.close()
+
+        val storage2 = GenericStorageEngine(storageFile)
+        assertEquals(2, storage2.enumerate().size)
+        assertContentEquals(byteArrayOf(1, 2, 3), storage2["foo"])
+        assertContentEquals(byteArrayOf(4, 5, 6), storage2["bar"])
+        storage2.put("baz", byteArrayOf(7, 8, 9))
+
+        val storage3 = GenericStorageEngine(storageFile)
+        assertEquals(3, storage3.enumerate().size)
+        assertContentEquals(byteArrayOf(7, 8, 9), storage3["baz"])
+        assertTrue(readFile(storageFile).size > fileData.size)
+    }
+
+    @Test
+    fun testFailedAppend() {
+        val storageFile = Path("/tmp/ic-test")
+        var failNextAppend = false
+        val storage = object : GenericStorageEngine(storageFile) {
+            override fun appendToFile(frame: ByteArray) {
+                if (failNextAppend) {
+                    // Simulate running out of space in the middle of writing a record.
+                    failNextAppend = false
+                    super.appendToFile(frame.copyOf(frame.size / 2))
+                    throw IOException("No space left on device")
+                }
+                super.appendToFile(frame)
+            }
+        }
+        storage.deleteAll()
+        storage.put("foo", byteArrayOf(1, 2, 3))
+        failNextAppend = true
+        assertFailsWith(IOException::class) {
+            storage.put("bar", byteArrayOf(4, 5, 6))
+        }
+        storage.put("baz", byteArrayOf(7, 8, 9))
+
+        // The records written after the failure must not be lost behind the partial one.
+        val storage2 = GenericStorageEngine(storageFile)
+        assertContentEquals(byteArrayOf(1, 2, 3), storage2["foo"])
+        assertContentEquals(byteArrayOf(7, 8, 9), storage2["baz"])
+        storage2.put("qux", byteArrayOf(10))
+        val storage3 = GenericStorageEngine(storageFile)
+        assertContentEquals(byteArrayOf(10), storage3["qux"])
+    }
+
+    @Test
+    fun testLegacyFormat() {
+        val storageFile = Path("/tmp/ic-test")
+        val sink = SystemFileSystem.sink(storageFile).buffered()
+        sink.write(Cbor.encode(CborMap.builder().put("foo", byteArrayOf(1, 2, 3)).end().build()))
+        sink.close()
+
+        val storage = GenericStorageEngine(storageFile)
+        assertContentEquals(byteArrayOf(1, 2, 3), storage["foo"])
+        storage.put("bar", byteArrayOf(4, 5, 6))
+
+        val storage2 = GenericStorageEngine(storageFile)
+        assertEquals(2, storage2.enumerate().size)
+        assertContentEquals(byteArrayOf(1, 2, 3), storage2["foo"])
+        assertContentEquals(byteArrayOf(4, 5, 6), storage2["bar"])
+    }
+
+    @Test
+    fun testTransaction() {
+        val storageFile = Path("/tmp/ic-test")
+        val storage = GenericStorageEngine(storageFile)
+        storage.deleteAll()
+        storage.put("foo", byteArrayOf(1, 2, 3))
+        val sizeBefore = readFile(storageFile).size
+
+        val result = storage.transaction {
+            for (n in 0 until 50) {
+                storage.put("key$n", byteArrayOf(n.toByte()))
+            }
+            storage.transaction {
+                storage.delete("foo")
+                storage.put("key0", byteArrayOf(42))
+            }
+            assertNull(storage["foo"])
+            assertContentEquals(byteArrayOf(42), storage["key0"])
+            // Nothing is written until the outermost transaction completes.
+            assertEquals(sizeBefore, readFile(storageFile).size)
+            storage.enumerate().size
+        }
+        assertEquals(50, result)
+        assertTrue(readFile(storageFile).size > sizeBefore)
+
+        val storage2 = GenericStorageEngine(storageFile)
+        assertEquals(50, storage2.enumerate().size)
+        assertNull(storage2["foo"])
+        assertContentEquals(byteArrayOf(42), storage2["key0"])
+        assertContentEquals(byteArrayOf(49), storage2["key49"])
+
+        storage2.transaction {
+            storage2.deleteAll()
+            storage2.put("bar", byteArrayOf(4, 5, 6))
+        }
+        val storage3 = GenericStorageEngine(storageFile)
+        assertEquals(listOf("bar"), storage3.enumerate().toList())
+    }
 }
@@ -0,0 +1,105 @@
+package com.android.identity.util
+
+import com.android.identity.crypto.Algorithm
+import com.android.identity.crypto.EcCurve
+import com.android.identity.securearea.CreateKeySettings
+import com.android.identity.securearea.KeyPurpose
+import com.android.identity.securearea.software.SoftwareSecureArea
+import com.android.identity.storage.EphemeralStorageEngine
+import kotlin.test.AfterTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+import kotlin.test.assertFalse
+import kotlin.test.assertSame
+import kotlin.test.assertTrue
+
+class TracingTest {
+
+    private class RecordedSpan(val name: String) : Tracing.Span {
+        val attributes = mutableMapOf<String, Any>()
+        var ended = 0
+        var error: Throwable? = null
+
+        override fun setAttribute(key: String, value: String) {
+            attributes[key] = value
+        }
+
+        override fun setAttribute(key: String, value: Long) {
+            attributes[key] = value
+        }
+
+        override fun end(error: Throwable?) {
+            ended++
+            this.error = error
+        }
+    }
+
+    private class RecordingTracer : Tracing.Tracer {
+        val spans = mutableListOf<RecordedSpan>()
+        val counters = mutableMapOf<String, Long>()
+
+        override fun startSpan(name: String): Tracing.Span =
+            RecordedSpan(name).also { spans.add(it) }
+
+        override fun addToCounter(name: String, delta: Long) {
+            counters[name] = (counters[name] ?: 0) + delta
+        }
+    }
+
+    @AfterTest
+    fun tearDown() {
+        Tracing.setTracer(null)
+    }
+
+    @Test
+    fun disabled() {
+        assertFalse(Tracing.isEnabled)
+        val result = Tracing.span("test.span") { span ->
+            assertSame(Tracing.NoopSpan, span)
+            42
+        }
+        assertEquals(42, result)
+        assertSame(Tracing.NoopSpan, Tracing.startSpan("test.span"))
+        Tracing.count("test.counter")
+    }
+
+    @Test
+    fun spansAndCounters() {
+        val tracer = RecordingTracer()
+        Tracing.setTracer(tracer)
+        assertTrue(Tracing.isEnabled)
+
+        val result = Tracing.span("test.span") { span ->
+            span.setAttribute("size", 3)
+            span.setAttribute("what", "test")
+            "done"
+        }
+        assertEquals("done", result)
+        val error = assertFailsWith(IllegalStateException::class) {
+            Tracing.span("test.failing") { throw IllegalStateException("failed") }
+        }
+        Tracing.count("test.counter")
+        Tracing.count("test.counter", 41)
+
+        assertEquals(listOf("test.span", "test.failing"), tracer.spans.map { it.name })
+        assertEquals(mapOf<String, Any>("size" to 3L, "what" to "test"), tracer.spans[0].attributes)
+        assertEquals(1, tracer.spans[0].ended)
+        assertEquals(null, tracer.spans[0].error)
+        assertEquals(1, tracer.spans[1].ended)
+        assertSame(error, tracer.spans[1].error)
+        assertEquals(mapOf("test.counter" to 42L), tracer.counters)
+    }
+
+    @Test
+    fun secureAreaSign() {
+        val secureArea = SoftwareSecureArea(EphemeralStorageEngine())
+        secureArea.createKey("key", CreateKeySettings(setOf(KeyPurpose.SIGN), EcCurve.P256))
+        val tracer = RecordingTracer()
+        Tracing.setTracer(tracer)
+        secureArea.sign("key", Algorithm.ES256, byteArrayOf(1, 2, 3), null)
+        assertEquals(listOf("securearea.sign"), tracer.spans.map { it.name })
+        assertEquals("SoftwareSecureArea", tracer.spans[0].attributes["secureArea"])
+        assertEquals(1, tracer.spans[0].ended)
+    }
+}
@@ -10,6 +10,8 @@ import kotlinx.cinterop.addressOf
 import kotlinx.cinterop.allocArrayOf
 import kotlinx.cinterop.memScoped
 import kotlinx.cinterop.usePinned
+import kotlinx.io.Buffer
+import kotlinx.io.readByteArray
 import platform.Foundation.NSData
 import platform.Foundation.create
 import platform.posix.memcpy
@@ -67,6 +69,26 @@ actual object Crypto {
         ).toByteArray()
     }
 
+    // CryptoKit has no incremental AES-GCM so the message is buffered until finish().
+    actual fun createStreamingEncryptor(
+        algorithm: Algorithm,
+        key: ByteArray,
+        nonce: ByteArray
+    ): StreamingEncryptor = object : StreamingEncryptor {
+        // The caller may reuse its arrays before finish() is called.
+        private val key = key.copyOf()
+        private val nonce = nonce.copyOf()
+        private val plaintext = Buffer()
+
+        override fun update(data: ByteArray, offset: Int, length: Int): ByteArray {
+            plaintext.write(data, offset, offset + length)
+            return ByteArray(0)
+        }
+
+        override fun finish(): ByteArray =
+            encrypt(algorithm, key, nonce, plaintext.readByteArray())
+    }
+
     actual fun decrypt(
         algorithm: Algorithm,
         key: ByteArray,
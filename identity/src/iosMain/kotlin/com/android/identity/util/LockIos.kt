@@ -0,0 +1,11 @@
+package com.android.identity.util
+
+import platform.Foundation.NSRecursiveLock
+
+internal actual class Lock actual constructor() {
+    private val lock = NSRecursiveLock()
+
+    actual fun lock() = lock.lock()
+
+    actual fun unlock() = lock.unlock()
+}
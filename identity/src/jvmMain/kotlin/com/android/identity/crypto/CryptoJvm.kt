@@ -189,6 +189,30 @@ actual object Crypto {
         }
     }
 
+    actual fun createStreamingEncryptor(
+        algorithm: Algorithm,
+        key: ByteArray,
+        nonce: ByteArray,
+    ): StreamingEncryptor {
+        when (algorithm) {
+            Algorithm.A128GCM -> {}
+            Algorithm.A192GCM -> {}
+            Algorithm.A256GCM -> {}
+            else -> {
+                throw IllegalArgumentException("Unsupported algorithm $algorithm")
+            }
+        }
+        val cipher = Cipher.getInstance("AES/GCM/NoPadding").apply {
+            init(Cipher.ENCRYPT_MODE, SecretKeySpec(key, "AES"), GCMParameterSpec(128, nonce))
+        }
+        return object : StreamingEncryptor {
+            override fun update(data: ByteArray, offset: Int, length: Int): ByteArray =
+                cipher.update(data, offset, length) ?: ByteArray(0)
+
+            override fun finish(): ByteArray = cipher.doFinal()
+        }
+    }
+
     /**
      * Message decryption.
      *
@@ -15,6 +15,10 @@
  */
 package com.android.identity.trustmanagement
 
+import com.android.identity.crypto.X509CertChain
+import com.android.identity.crypto.X509CertChainCache
+import com.android.identity.crypto.javaX509Certificates
+import kotlinx.datetime.Instant
 import java.security.cert.CertificateException
 import java.security.cert.PKIXCertPathChecker
 import java.security.cert.X509Certificate
@@ -118,6 +122,28 @@ class TrustManager {
         }
 
 
+    /**
+     * Gets a function for verifying certificate chains suitable for [X509CertChainCache].
+     *
+     * The returned function verifies the chain using [verify] and if trusted, returns the
+     * earliest expiration date of the certificates in the complete trust chain.
+     *
+     * Note that the cache must be cleared if trust points are added or removed.
+     *
+     * @param [customValidators] optional parameter with custom validators
+     * @return a function which can be passed to [X509CertChainCache].
+     */
+    fun chainVerifier(
+        customValidators: List<PKIXCertPathChecker> = emptyList()
+    ): (X509CertChain) -> Instant? = { chain ->
+        val result = verify(chain.javaX509Certificates, customValidators)
+        if (result.isTrusted) {
+            Instant.fromEpochMilliseconds(result.trustChain.minOf { it.notAfter.time })
+        } else {
+            null
+        }
+    }
+
     private fun getAllTrustPoints(chain: List<X509Certificate>): List<TrustPoint> {
         val result = mutableListOf<TrustPoint>()
 
@@ -0,0 +1,11 @@
+package com.android.identity.util
+
+import java.util.concurrent.locks.ReentrantLock
+
+internal actual class Lock actual constructor() {
+    private val lock = ReentrantLock()
+
+    actual fun lock() = lock.lock()
+
+    actual fun unlock() = lock.unlock()
+}
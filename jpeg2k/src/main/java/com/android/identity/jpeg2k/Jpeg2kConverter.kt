@@ -4,10 +4,18 @@ import android.content.Context
 import android.graphics.Bitmap
 import android.graphics.BitmapFactory
 import android.graphics.pdf.PdfRenderer
+import android.os.Build
 import android.os.ParcelFileDescriptor
+import android.system.ErrnoException
+import android.system.Os
+import android.system.OsConstants
 import android.util.Log
 import java.io.ByteArrayOutputStream
 import java.io.File
+import java.io.FileOutputStream
+import java.io.IOException
+import java.security.MessageDigest
+import kotlin.math.max
 import kotlin.math.min
 
 /**
@@ -16,40 +24,73 @@ import kotlin.math.min
  * This utilizes the fact that PDF rendering is a part of standard Android API and JPEG2000 is
  * a standard part of PDF. JPEG2000 file is wrapped in PDF and rendered using PDF renderer.
  *
- * @param tmpDir a folder for temporary files (PDF can be rendered only from a file).
+ * This is the default [Jpeg2kDecoder] used by [decodeByteArray], a native decoder can be
+ * selected instead by setting [decoder].
+ *
+ * @param tmpDir a folder for temporary files (PDF can be rendered only from a file), only
+ *   used on Android versions where the PDF cannot be kept in memory.
  */
-class Jpeg2kConverter(private val tmpDir: File) {
+class Jpeg2kConverter(private val tmpDir: File) : Jpeg2kDecoder {
 
     /** Parses JPEG2000 file and returns a Bitmap. */
-    fun convertToBitmap(j2k: ByteArray): Bitmap {
+    fun convertToBitmap(j2k: ByteArray): Bitmap = decode(j2k, 0)
+
+    /**
+     * Decodes a JPEG2000 image, see [Jpeg2kDecoder.decode].
+     *
+     * The PDF renderer always decodes the codestream at full resolution, [reduction] only
+     * makes the bitmap it renders into smaller.
+     */
+    override fun decode(j2k: ByteArray, reduction: Int): Bitmap {
+        require(reduction in 0..MAX_REDUCTION) { "Invalid reduction: $reduction" }
         val pdf = convertToPdfData(j2k)
-        tmpDir.mkdirs()
-        val pdfFile = File.createTempFile("tmp_conv", ".pdf", tmpDir)
-        val out = pdfFile.outputStream()
-        out.write(pdf.bytes)
-        out.close()
-        val input = ParcelFileDescriptor.open(pdfFile, ParcelFileDescriptor.MODE_READ_ONLY)
+        val input = openPdf(pdf.bytes)
         val renderer = PdfRenderer(input)
         val page = renderer.openPage(0)
-        val bitmap = Bitmap.createBitmap(pdf.width, pdf.height, Bitmap.Config.ARGB_8888)
+        // The page is scaled to fit the bitmap, so only the output is allocated at the
+        // reduced size, the image itself is still decoded at full resolution.
+        val bitmap = Bitmap.createBitmap(
+            reducedSize(pdf.width, reduction),
+            reducedSize(pdf.height, reduction),
+            Bitmap.Config.ARGB_8888
+        )
         page.render(bitmap, null, null, PdfRenderer.Page.RENDER_MODE_FOR_DISPLAY)
         page.close()
         renderer.close()
-        pdfFile.delete()
         return bitmap
     }
 
-    internal fun convertToPdfData(j2k: ByteArray): PDFData {
-        if (j2k.size < 20) {
-            throw IllegalArgumentException("Not Jpeg2K")
+    // PdfRenderer needs a seekable file descriptor; use an in-memory file where possible.
+    private fun openPdf(pdf: ByteArray): ParcelFileDescriptor {
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.R) {
+            try {
+                val fd = Os.memfd_create("tmp_conv", 0)
+                try {
+                    FileOutputStream(fd).write(pdf)
+                    Os.lseek(fd, 0, OsConstants.SEEK_SET)
+                    return ParcelFileDescriptor.dup(fd)
+                } finally {
+                    Os.close(fd)
+                }
+            } catch (err: ErrnoException) {
+                Log.w(TAG, "memfd_create failed, falling back to a temporary file", err)
+            }
+        }
+        tmpDir.mkdirs()
+        val pdfFile = File.createTempFile("tmp_conv", ".pdf", tmpDir)
+        try {
+            pdfFile.outputStream().use { out -> out.write(pdf) }
+            return ParcelFileDescriptor.open(pdfFile, ParcelFileDescriptor.MODE_READ_ONLY)
+        } finally {
+            // The open descriptor keeps the data readable.
+            pdfFile.delete()
         }
-        val width: Int
-        val height: Int
+    }
+
+    internal fun convertToPdfData(j2k: ByteArray): PDFData {
+        val (width, height) = readSize(j2k)
         val prefix = ByteArrayOutputStream()
-        if ((j2k[0].toInt() and 0xFF) == 0xFF && (j2k[1].toInt() and 0xFF) == 0x4F
-            && (j2k[2].toInt() and 0xFF) == 0xFF && (j2k[3].toInt() and 0xFF) == 0x51) {
-            width = readInt(j2k, 8)
-            height = readInt(j2k, 12)
+        if (isCodestream(j2k)) {
             // signature
             prefix.write(byteArrayOf(0, 0, 0, 0x0C, 0x6A, 0x50, 0x20, 0x20, 0x0D, 0x0A,
                 (0x87).toByte(), 0x0A))
@@ -67,29 +108,6 @@ class Jpeg2kConverter(private val tmpDir: File) {
             prefix.write(byteArrayOf(0, 0, 0, 0x0F, 0x63, 0x6F, 0x6C, 0x72, 1, 0, 0, 0, 0, 0, 0x10))
             // jp2c
             prefix.write(byteArrayOf(0, 0, 0, 0, 0x6a, 0x70, 0x32, 0x63))
-        } else {
-            // Scan to find dimensions
-            val tag = byteArrayOf(105, 104, 100, 114)
-            var offset = 0
-            var matchOffset = 0
-            val size = min(j2k.size, 256)
-            while (offset < size) {
-                if (j2k[offset] == tag[matchOffset]) {
-                    matchOffset++
-                    if (matchOffset == tag.size) {
-                        offset++
-                        break
-                    }
-                } else {
-                    matchOffset = 0
-                }
-                offset++
-            }
-            if (matchOffset != tag.size || offset + 8 > j2k.size) {
-                throw IllegalArgumentException("Not J2K")
-            }
-            width = readInt(j2k, offset + 4)
-            height = readInt(j2k, offset)
         }
         val widthStr = width.toString().padStart(8, ' ')
         val heightStr = height.toString().padStart(9, ' ')
@@ -133,22 +151,179 @@ class Jpeg2kConverter(private val tmpDir: File) {
     }
 
     companion object {
+        private const val TAG = "JPEG2K_CONV"
+
+        /** The largest reduction supported, JPEG2000 allows at most 32 decomposition levels. */
+        const val MAX_REDUCTION = 32
+
+        private const val CACHE_JPEG_QUALITY = 90
+
+        /**
+         * The [Jpeg2kDecoder] used by [decodeByteArray] or `null` to use [Jpeg2kConverter].
+         *
+         * Applications bundling a native JPEG2000 decoder, such as OpenJPEG, should set this
+         * at startup, as that is much faster than rendering a PDF.
+         */
+        @Volatile
+        var decoder: Jpeg2kDecoder? = null
+
         /**
          * Replacement for [BitmapFactory.decodeByteArray]
+         *
+         * If [maxSize] is given, the image is decoded at the lowest resolution at which both
+         * its width and height are still at least [maxSize] (or at full resolution if it is
+         * smaller than that), halving the resolution as many times as possible. This keeps the
+         * returned bitmap small, e.g. for a thumbnail. For JPEG2000 images decoded with
+         * [Jpeg2kConverter] the image is still decoded at full resolution and only rendered
+         * into the smaller bitmap, decoding just the needed resolution levels, and so being
+         * faster, requires a native [decoder].
+         *
+         * If [cacheDir] is given, JPEG2000 images are transcoded to JPEG the first time they
+         * are decoded and stored there, so decoding the same image again is as fast as for
+         * a JPEG. The cached files are not encrypted, only pass a [cacheDir] for images that
+         * may be kept on the device.
+         *
+         * @param context the context.
+         * @param data the image, in any format supported by [BitmapFactory] or JPEG2000.
+         * @param maxSize the size needed in pixels, or 0 for the full resolution.
+         * @param cacheDir the folder to cache transcoded JPEG2000 images in, or `null`.
          */
-        fun decodeByteArray(context: Context, data: ByteArray): Bitmap? {
-            val bitmap = BitmapFactory.decodeByteArray(data, 0, data.size)
+        fun decodeByteArray(
+            context: Context,
+            data: ByteArray,
+            maxSize: Int = 0,
+            cacheDir: File? = null
+        ): Bitmap? {
+            val options = BitmapFactory.Options()
+            if (maxSize > 0) {
+                options.inJustDecodeBounds = true
+                BitmapFactory.decodeByteArray(data, 0, data.size, options)
+                if (options.outWidth > 0 && options.outHeight > 0) {
+                    options.inSampleSize = 1 shl reductionFor(
+                        options.outWidth, options.outHeight, maxSize)
+                }
+                options.inJustDecodeBounds = false
+            }
+            val bitmap = BitmapFactory.decodeByteArray(data, 0, data.size, options)
             if (bitmap != null) {
                 return bitmap
             }
             return try {
-                Jpeg2kConverter(File(context.cacheDir, "j2k_conv")).convertToBitmap(data)
+                val reduction = if (maxSize > 0) {
+                    val (width, height) = readSize(data)
+                    reductionFor(width, height, maxSize)
+                } else {
+                    0
+                }
+                if (cacheDir != null) {
+                    decodeCached(context, data, reduction, cacheDir)
+                } else {
+                    decode(context, data, reduction)
+                }
             } catch (err: IllegalArgumentException) {
-                Log.e("JPEG2K_CONV", "JPEFG2000 parsing failed", err)
+                Log.e(TAG, "JPEFG2000 parsing failed", err)
                 null
             }
         }
 
+        private fun decode(context: Context, data: ByteArray, reduction: Int): Bitmap {
+            val decoder = this.decoder ?: Jpeg2kConverter(File(context.cacheDir, "j2k_conv"))
+            return decoder.decode(data, reduction)
+        }
+
+        private fun decodeCached(
+            context: Context,
+            data: ByteArray,
+            reduction: Int,
+            cacheDir: File
+        ): Bitmap {
+            val digest = MessageDigest.getInstance("SHA-256").digest(data)
+            val name = digest.joinToString("") { "%02x".format(it) } + "-$reduction.jpg"
+            val file = File(cacheDir, name)
+            if (file.exists()) {
+                val cached = BitmapFactory.decodeFile(file.path)
+                if (cached != null) {
+                    return cached
+                }
+                Log.w(TAG, "Ignoring unreadable cached image $name")
+            }
+            val bitmap = decode(context, data, reduction)
+            try {
+                cacheDir.mkdirs()
+                // Written under a temporary name, so that a partial file is never used.
+                val tmpFile = File.createTempFile("tmp_", ".jpg", cacheDir)
+                tmpFile.outputStream().use { out ->
+                    bitmap.compress(Bitmap.CompressFormat.JPEG, CACHE_JPEG_QUALITY, out)
+                }
+                if (!tmpFile.renameTo(file)) {
+                    tmpFile.delete()
+                }
+            } catch (err: IOException) {
+                Log.w(TAG, "Failed to cache image $name", err)
+            }
+            return bitmap
+        }
+
+        /**
+         * Returns the width and height of a JPEG2000 image, either a JP2 file or a bare
+         * codestream.
+         */
+        internal fun readSize(j2k: ByteArray): Pair<Int, Int> {
+            if (j2k.size < 20) {
+                throw IllegalArgumentException("Not Jpeg2K")
+            }
+            if (isCodestream(j2k)) {
+                return Pair(readInt(j2k, 8), readInt(j2k, 12))
+            }
+            // Scan to find dimensions
+            val tag = byteArrayOf(105, 104, 100, 114)
+            var offset = 0
+            var matchOffset = 0
+            val size = min(j2k.size, 256)
+            while (offset < size) {
+                if (j2k[offset] == tag[matchOffset]) {
+                    matchOffset++
+                    if (matchOffset == tag.size) {
+                        offset++
+                        break
+                    }
+                } else {
+                    matchOffset = 0
+                }
+                offset++
+            }
+            if (matchOffset != tag.size || offset + 8 > j2k.size) {
+                throw IllegalArgumentException("Not J2K")
+            }
+            return Pair(readInt(j2k, offset + 4), readInt(j2k, offset))
+        }
+
+        /**
+         * Returns the number of times the resolution of an image of the given size can be
+         * halved with both dimensions staying at least [maxSize].
+         */
+        internal fun reductionFor(width: Int, height: Int, maxSize: Int): Int {
+            var reduction = 0
+            while (reduction < MAX_REDUCTION &&
+                min(reducedSize(width, reduction + 1), reducedSize(height, reduction + 1))
+                    >= maxSize) {
+                reduction++
+            }
+            return reduction
+        }
+
+        /** The size of a dimension of an image reduced by the given number of levels. */
+        internal fun reducedSize(size: Int, reduction: Int): Int =
+            max(1, ((size.toLong() + (1L shl reduction) - 1) shr reduction).toInt())
+
+        private fun isCodestream(j2k: ByteArray): Boolean =
+            (j2k[0].toInt() and 0xFF) == 0xFF && (j2k[1].toInt() and 0xFF) == 0x4F
+                    && (j2k[2].toInt() and 0xFF) == 0xFF && (j2k[3].toInt() and 0xFF) == 0x51
+
+        private fun readInt(bytes: ByteArray, offset: Int): Int {
+            return bytes[offset].toInt() and 0xFF shl 24 or (bytes[offset + 1].toInt() and 0xFF shl 16) or (bytes[offset + 2].toInt() and 0xFF shl 8) or (bytes[offset + 3].toInt() and 0xFF shl 0)
+        }
+
         private const val PDF_TEMPLATE = """%PDF-1.5
 1 0 obj
 << /Pages 2 0 R /Type /Catalog >>
@@ -208,10 +383,6 @@ startxref
         buffer.write(v)
     }
 
-    private fun readInt(bytes: ByteArray, offset: Int): Int {
-        return bytes[offset].toInt() and 0xFF shl 24 or (bytes[offset + 1].toInt() and 0xFF shl 16) or (bytes[offset + 2].toInt() and 0xFF shl 8) or (bytes[offset + 3].toInt() and 0xFF shl 0)
-    }
-
     data class PDFData(
         val bytes: ByteArray, val width: Int, val height: Int
     ) {
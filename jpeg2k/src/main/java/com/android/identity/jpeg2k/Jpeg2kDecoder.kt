@@ -0,0 +1,29 @@
+package com.android.identity.jpeg2k
+
+import android.graphics.Bitmap
+
+/**
+ * A JPEG2000 decoder.
+ *
+ * [Jpeg2kConverter] implements this using the PDF renderer which is part of Android. Native
+ * decoders, e.g. wrapping OpenJPEG through JNI, can implement this too and be selected at
+ * runtime through [Jpeg2kConverter.decoder].
+ */
+interface Jpeg2kDecoder {
+    /**
+     * Decodes a JPEG2000 image, either a JP2 file or a bare codestream.
+     *
+     * The image may be decoded at a lower resolution, each level of [reduction] halving its
+     * width and height, rounding up. JPEG2000 stores images as a series of resolution levels,
+     * so decoders can do this without decoding the full image. Not all do though, e.g.
+     * [Jpeg2kConverter] decodes the full image and only renders it into a smaller bitmap,
+     * so only native decoders make a reduction cheaper to decode. Decoders may decode at a
+     * higher resolution than requested if the image has fewer levels.
+     *
+     * @param j2k the image.
+     * @param reduction the number of resolution levels to drop, 0 for the full resolution.
+     * @return the decoded image.
+     * @throws IllegalArgumentException if the image cannot be decoded.
+     */
+    fun decode(j2k: ByteArray, reduction: Int = 0): Bitmap
+}
@@ -29,4 +29,24 @@ class Jpeg2kConverterTest {
         // out.write(pdf.bytes)
         // out.close()
     }
-}
\ No newline at end of file
+
+    @Test
+    fun readSize() {
+        val flavor1 = javaClass.classLoader!!.getResource("flavor1.j2").readBytes()
+        assertEquals(Pair(520, 390), Jpeg2kConverter.readSize(flavor1))
+        val flavor2 = javaClass.classLoader!!.getResource("flavor2.j2").readBytes()
+        assertEquals(Pair(480, 360), Jpeg2kConverter.readSize(flavor2))
+    }
+
+    @Test
+    fun reduction() {
+        assertEquals(0, Jpeg2kConverter.reductionFor(520, 390, 390))
+        assertEquals(0, Jpeg2kConverter.reductionFor(520, 390, 1000))
+        assertEquals(1, Jpeg2kConverter.reductionFor(520, 390, 195))
+        assertEquals(1, Jpeg2kConverter.reductionFor(520, 390, 100))
+        assertEquals(2, Jpeg2kConverter.reductionFor(520, 390, 96))
+        assertEquals(130, Jpeg2kConverter.reducedSize(520, 2))
+        assertEquals(98, Jpeg2kConverter.reducedSize(390, 2))
+        assertEquals(1, Jpeg2kConverter.reducedSize(390, 32))
+    }
+}
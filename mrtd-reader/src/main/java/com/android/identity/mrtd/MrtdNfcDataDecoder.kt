@@ -17,16 +17,121 @@ private const val TAG = "MrtdNfcDataDecoder"
 
 /**
  * Decoder that validates [MrtdNfcData] and converts it to [MrtdDecodedData].
+ *
+ * Data groups can be handed to [prepareDataGroup] as soon as they are read, e.g. from
+ * [MrtdNfcDataReader.Listener.onDataGroupRead], so that by the time all of the data is read
+ * only validation is left for [decode].
+ *
+ * The parsed data groups hold the personal data of the document holder, so they're only kept
+ * until the next [decode] call, which uses them, or until [clear] is called, e.g. when the data
+ * turns out not to be decoded here.
  */
 class MrtdNfcDataDecoder() {
+    // Data groups parsed by prepareDataGroup, along with the bytes they were parsed from.
+    private val prepared = mutableMapOf<Int, Pair<ByteString, Any>>()
+
+    /**
+     * Drops the data groups parsed by [prepareDataGroup].
+     */
+    fun clear() {
+        synchronized(prepared) {
+            prepared.clear()
+        }
+    }
+
+    /**
+     * Parses a data group ahead of [decode].
+     *
+     * The data group is not validated until [decode] is called. This may be called from
+     * a different thread than [decode].
+     *
+     * @param dataGroup the number of the data group.
+     * @param data the data group, as in [MrtdNfcData.dataGroups].
+     */
+    fun prepareDataGroup(dataGroup: Int, data: ByteString) {
+        val parsed: Any = when (dataGroup) {
+            1 -> decodeDg1(data.toByteArray())
+            2 -> decodeDg2(data.toByteArray())
+            7 -> decodeDg7(data.toByteArray())
+            else -> return
+        }
+        synchronized(prepared) {
+            prepared[dataGroup] = Pair(data, parsed)
+        }
+    }
+
+    // Returns what prepareDataGroup parsed from the same bytes, or parses them now.
+    private fun <T : Any> parsed(
+        preparedDataGroups: Map<Int, Pair<ByteString, Any>>,
+        dataGroup: Int,
+        bytes: ByteArray,
+        parse: (ByteArray) -> T
+    ): T {
+        val entry = preparedDataGroups[dataGroup]
+        if (entry != null && entry.first.toByteArray().contentEquals(bytes)) {
+            @Suppress("UNCHECKED_CAST")
+            return entry.second as T
+        }
+        return parse(bytes)
+    }
+
+    private fun decodeDg1(bytes: ByteArray): DG1File {
+        mrtdLogI(TAG, "Decoding DG1")
+        val dg1 = DG1File(ByteArrayInputStream(bytes))
+        mrtdLogI(TAG, "Done with DG1")
+        return dg1
+    }
+
+    private fun decodeDg2(bytes: ByteArray): DecodedImage {
+        mrtdLogI(TAG, "Decoding DG2")
+        val dg2 = DG2File(ByteArrayInputStream(bytes))
+        var photo: ByteString? = null
+        var photoMediaType: String? = null
+        for (faceInfo in dg2.faceInfos) {
+            for (faceImageInfo in faceInfo.faceImageInfos) {
+                mrtdLogI(TAG, "reading face image from DG2")
+                photo = readImageBytes(faceImageInfo)
+                if (photo != null) {
+                    photoMediaType = faceImageInfo.mimeType
+                    break
+                }
+            }
+        }
+        mrtdLogI(TAG, "Done with DG2")
+        return DecodedImage(photo, photoMediaType)
+    }
+
+    private fun decodeDg7(bytes: ByteArray): DecodedImage {
+        mrtdLogI(TAG, "Decoding DG7")
+        val dg7 = DG7File(ByteArrayInputStream(bytes))
+        var signature: ByteString? = null
+        var signatureMediaType: String? = null
+        for (image in dg7.images) {
+            mrtdLogI(TAG, "reading signature from DG7")
+            signature = readImageBytes(image)
+            if (signature != null) {
+                signatureMediaType = image.mimeType
+                break
+            }
+        }
+        mrtdLogI(TAG, "Done with DG7")
+        return DecodedImage(signature, signatureMediaType)
+    }
+
+    private class DecodedImage(val bytes: ByteString?, val mediaType: String?)
+
     /**
      * Validates and decodes [MrtdNfcData].
      *
-     * This should generally be called on a background thread.
+     * This should generally be called on a background thread. The data groups parsed by
+     * [prepareDataGroup] so far are used and then dropped.
      *
      * TODO: validate certificate used for data signing
      */
     fun decode(data: MrtdNfcData): MrtdDecodedData {
+        val preparedDataGroups = synchronized(prepared) {
+            prepared.toMap().also { prepared.clear() }
+        }
         mrtdLogI(TAG, "Decoding SOD")
         val sod = SODFile(ByteArrayInputStream(data.sod.toByteArray()))
         mrtdLogI(TAG, "SOD decoded, digest algorithm: ${sod.digestAlgorithm}")
@@ -36,9 +141,7 @@ class MrtdNfcDataDecoder() {
             mrtdLogE(TAG, "DG1 digest mismatch")
             throw Exception("DG1 stream did not pass validation")
         }
-        mrtdLogI(TAG, "Decoding DG1")
-        val dg1 = DG1File(ByteArrayInputStream(bytes1))
-        mrtdLogI(TAG, "Done with DG1")
+        val dg1 = parsed(preparedDataGroups, 1, bytes1, ::decodeDg1)
 
         var photo: ByteString? = null
         var photoMediaType: String? = null
@@ -53,19 +156,9 @@ class MrtdNfcDataDecoder() {
                 throw Exception("DG2 stream did not pass validation")
             }
 
-            mrtdLogI(TAG, "Decoding DG2")
-            val dg2 = DG2File(ByteArrayInputStream(bytes))
-            for (faceInfo in dg2.faceInfos) {
-                for (faceImageInfo in faceInfo.faceImageInfos) {
-                    mrtdLogI(TAG, "reading face image from DG2")
-                    photo = readImageBytes(faceImageInfo)
-                    if (photo != null) {
-                        photoMediaType = faceImageInfo.mimeType
-                        break
-                    }
-                }
-            }
-            mrtdLogI(TAG, "Done with DG2")
+            val image = parsed(preparedDataGroups, 2, bytes, ::decodeDg2)
+            photo = image.bytes
+            photoMediaType = image.mediaType
         }
 
         var signature: ByteString? = null
@@ -77,18 +170,9 @@ class MrtdNfcDataDecoder() {
                 mrtdLogE(TAG, "DG7 digest mismatch")
                 throw Exception("DG7 stream did not pass validation")
             }
-            mrtdLogI(TAG, "Decoding DG7")
-            val dg7 = DG7File(ByteArrayInputStream(bytes))
-
-            for (image in dg7.images) {
-                mrtdLogI(TAG, "reading signature from DG7")
-                signature = readImageBytes(image)
-                if (signature != null) {
-                    signatureMediaType = image.mimeType
-                    break
-                }
-            }
-            mrtdLogI(TAG, "Done with DG7")
+            val image = parsed(preparedDataGroups, 7, bytes, ::decodeDg7)
+            signature = image.bytes
+            signatureMediaType = image.mediaType
         }
 
         mrtdLogI(TAG, "SOD signature algorithm: ${sod.digestEncryptionAlgorithm}")
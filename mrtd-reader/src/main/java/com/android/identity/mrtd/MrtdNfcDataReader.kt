@@ -2,6 +2,7 @@ package com.android.identity.mrtd
 
 import kotlinx.io.bytestring.ByteString
 import kotlinx.io.bytestring.ByteStringBuilder
+import net.sf.scuba.smartcards.CardFileInputStream
 import net.sf.scuba.smartcards.CardService
 import net.sf.scuba.smartcards.CardServiceException
 import org.jmrtd.PassportService
@@ -10,40 +11,125 @@ import kotlin.IllegalArgumentException
 
 private const val TAG = "MrtdNfcDataReader"
 
-class MrtdNfcDataReader(private val dataGroups: List<Int>) : MrtdNfcReader<MrtdNfcData> {
+/**
+ * Reads the given data groups and the SOD from the card.
+ *
+ * The reader keeps the data it has read, so if [read] fails part-way, for example because
+ * the card was moved out of the NFC field, calling [read] again with a new connection to the
+ * same card resumes reading where it stopped instead of starting over. Use a new reader to
+ * read a different card.
+ *
+ * Reading is faster with bigger blocks, larger than [PassportService.DEFAULT_MAX_BLOCKSIZE]
+ * requires both the card and the NFC controller to support extended length APDUs. Bigger
+ * blocks are only used if [CardService.isExtendedAPDULengthSupported] says so for the
+ * connection (on Android this is `IsoDep.isExtendedLengthApduSupported`). If reading fails
+ * with a bigger block size, the reader falls back to the default block size when resumed.
+ *
+ * @param dataGroups the numbers of the data groups to read.
+ * @param maxBlockSize the maximum number of bytes to read with one command, e.g.
+ *   [EXTENDED_MAX_BLOCKSIZE].
+ * @param listener gets notified as data is read, or `null`.
+ */
+class MrtdNfcDataReader(
+    private val dataGroups: List<Int>,
+    private val maxBlockSize: Int = PassportService.DEFAULT_MAX_BLOCKSIZE,
+    private val listener: Listener? = null
+) : MrtdNfcReader<MrtdNfcData> {
+    init {
+        for (dgIndex in dataGroups) {
+            if (dgIndex < 1 || dgIndex > 16) {
+                throw IllegalArgumentException("Illegal data group: $dgIndex")
+            }
+        }
+    }
+
+    /**
+     * Receives the data as it is read, e.g. to show progress for each data group or to start
+     * processing data groups while the remaining ones are still being read.
+     *
+     * The methods are called on the thread calling [read].
+     */
+    interface Listener {
+        /**
+         * Called when more of a file was read.
+         *
+         * @param dataGroup the number of the data group, or 0 for the SOD.
+         * @param bytesRead the number of bytes of the file read so far.
+         * @param bytesTotal the size of the file.
+         */
+        fun onFileProgress(dataGroup: Int, bytesRead: Int, bytesTotal: Int) {}
+
+        /**
+         * Called when a data group was completely read.
+         *
+         * @param dataGroup the number of the data group.
+         * @param data the data group, as in [MrtdNfcData.dataGroups].
+         */
+        fun onDataGroupRead(dataGroup: Int, data: ByteString) {}
+    }
+
+    // Data read so far, by data group number, SOD being 0.
+    private val partialFiles = mutableMapOf<Int, PartialFile>()
+    private var blockSize = maxBlockSize
+
     override fun read(rawConnection: CardService, connection: PassportService?,
                       onStatus: (MrtdNfc.Status) -> Unit): MrtdNfcData {
         if (connection == null) {
             throw IllegalArgumentException("PassportService is null, card access was not performed")
         }
+        if (blockSize > PassportService.DEFAULT_MAX_BLOCKSIZE &&
+            !rawConnection.isExtendedAPDULengthSupported) {
+            mrtdLogI(TAG, "Extended length APDUs not supported, using default block size")
+            blockSize = PassportService.DEFAULT_MAX_BLOCKSIZE
+        }
+        try {
+            return readFiles(connection, onStatus)
+        } catch (err: Exception) {
+            if (blockSize > PassportService.DEFAULT_MAX_BLOCKSIZE) {
+                mrtdLogI(TAG, "Reading with block size $blockSize failed, falling back")
+                blockSize = PassportService.DEFAULT_MAX_BLOCKSIZE
+            }
+            throw err
+        }
+    }
+
+    private fun readFiles(connection: PassportService,
+                          onStatus: (MrtdNfc.Status) -> Unit): MrtdNfcData {
         var totalLength = 0
         var groupsRead = 0
         mrtdLogI(TAG, "Examining DGs")
         // report 1% progress per group info read (as it does not come free)
-        val streams = dataGroups.associateBy({ dgIndex -> dgIndex }) {dgIndex ->
-            if (dgIndex < 1 || dgIndex > 16) {
-                throw IllegalArgumentException("Illegal data group: $dgIndex")
+        val streams = mutableMapOf<Int, CardFileInputStream?>()
+        for (dgIndex in dataGroups) {
+            val partialFile = partialFiles[dgIndex]
+            if (partialFile != null && partialFile.isComplete) {
+                // Read before reconnecting.
+                totalLength += partialFile.length
+                groupsRead++
+                streams[dgIndex] = null
+                continue
             }
             try {
-                val stream = connection.getInputStream(
-                    (PassportService.EF_DG1 + dgIndex - 1).toShort(),
-                    PassportService.DEFAULT_MAX_BLOCKSIZE
-                )
+                val stream = openStream(connection,
+                    (PassportService.EF_DG1 + dgIndex - 1).toShort(), dgIndex)
                 val length = stream.length
                 mrtdLogI(TAG, "DG$dgIndex length = $length")
                 totalLength += length
                 groupsRead++
                 mrtdLogI(TAG, "Progress: $groupsRead%")
                 onStatus(MrtdNfc.ReadingData(groupsRead))
-                stream
+                streams[dgIndex] = stream
             } catch (err: CardServiceException) {
-                null
+                // Data group not present on the card.
             }
-        }.filterValues { it != null }
+        }
         mrtdLogI(TAG, "Examining SOD")
-        val sodStream =
-            connection.getInputStream(PassportService.EF_SOD, PassportService.DEFAULT_MAX_BLOCKSIZE)
-        val sodLength = sodStream.length
+        val sodStream = if (partialFiles[0]?.isComplete == true) {
+            null
+        } else {
+            openStream(connection, PassportService.EF_SOD, 0)
+        }
+        val sodLength = sodStream?.length ?: partialFiles[0]!!.length
         mrtdLogI(TAG, "SOD length = $sodLength")
         totalLength += sodLength
         val onProgress = { progress: Int ->
@@ -52,19 +138,92 @@ class MrtdNfcDataReader(private val dataGroups: List<Int>) : MrtdNfcReader<MrtdN
             onStatus(MrtdNfc.ReadingData(adjustedProgress))
         }
         mrtdLogI(TAG, "Reading SOD")
-        val sod = readStream(0, totalLength, sodStream, onProgress)
+        val sod = readFile(0, sodStream, 0, totalLength, onProgress)
         var bytesRead = sodLength
         val dataGroupMap = streams.mapValues { entry ->
             mrtdLogI(TAG, "Reading DG${entry.key}")
-            val bytes = readStream(bytesRead, totalLength, entry.value!!, onProgress)
-            bytesRead += entry.value!!.length
+            val bytes = readFile(entry.key, entry.value, bytesRead, totalLength, onProgress)
+            bytesRead += bytes.size
+            if (entry.value != null) {
+                listener?.onDataGroupRead(entry.key, bytes)
+            }
             bytes
         }
         mrtdLogI(TAG, "Finished reading")
         return MrtdNfcData(dataGroupMap, sod)
     }
 
+    // Opens the file and skips the part which was already read.
+    private fun openStream(
+        connection: PassportService,
+        fid: Short,
+        dataGroup: Int
+    ): CardFileInputStream {
+        val stream = connection.getInputStream(fid, blockSize)
+        var partialFile = partialFiles[dataGroup]
+        if (partialFile == null || partialFile.length != stream.length) {
+            partialFile = PartialFile(stream.length)
+            partialFiles[dataGroup] = partialFile
+        }
+        if (partialFile.bytesRead > 0) {
+            mrtdLogI(TAG, "Resuming file $dataGroup at ${partialFile.bytesRead}")
+            var toSkip = partialFile.bytesRead.toLong()
+            while (toSkip > 0) {
+                val skipped = stream.skip(toSkip)
+                check(skipped > 0) { "Cannot skip to resume file $dataGroup" }
+                toSkip -= skipped
+            }
+        }
+        return stream
+    }
+
+    // Reads the rest of the file, or returns it if it's already read completely.
+    private fun readFile(
+        dataGroup: Int,
+        inputStream: InputStream?,
+        bytesReadInitial: Int,
+        bytesTotal: Int,
+        onProgress: (Int) -> Unit
+    ): ByteString {
+        val partialFile = partialFiles[dataGroup]!!
+        if (inputStream != null) {
+            val buffer = ByteArray(maxOf(blockSize, 1024))
+            while (true) {
+                val len = inputStream.read(buffer)
+                if (len <= 0) {
+                    break
+                }
+                partialFile.append(buffer, len)
+                onProgress((bytesReadInitial + partialFile.bytesRead) * 100 / bytesTotal)
+                listener?.onFileProgress(dataGroup, partialFile.bytesRead, partialFile.length)
+            }
+        }
+        return partialFile.toByteString()
+    }
+
+    private class PartialFile(val length: Int) {
+        private val bytes = ByteStringBuilder()
+
+        val bytesRead: Int
+            get() = bytes.size
+
+        val isComplete: Boolean
+            get() = bytes.size >= length
+
+        fun append(buffer: ByteArray, len: Int) {
+            bytes.append(buffer, 0, len)
+        }
+
+        fun toByteString(): ByteString = bytes.toByteString()
+    }
+
     companion object {
+        /**
+         * A block size for cards and NFC controllers that support extended length APDUs,
+         * leaving room for secure messaging in the response.
+         */
+        const val EXTENDED_MAX_BLOCKSIZE = 0xFF00
+
         fun readStream(
             bytesReadInitial: Int,
             bytesTotal: Int,
@@ -86,4 +245,4 @@ class MrtdNfcDataReader(private val dataGroups: List<Int>) : MrtdNfcReader<MrtdN
             return bytes.toByteString()
         }
     }
-}
\ No newline at end of file
+}
@@ -1,9 +1,11 @@
 package com.android.identity.mrtd
 
 import net.sf.scuba.smartcards.CardService
+import net.sf.scuba.smartcards.CardServiceException
 import net.sf.scuba.smartcards.CommandAPDU
 import net.sf.scuba.smartcards.ISO7816
 import net.sf.scuba.smartcards.ResponseAPDU
+import org.jmrtd.PassportService
 import org.jmrtd.Util
 import org.jmrtd.protocol.SecureMessagingWrapper
 import org.junit.Assert
@@ -17,14 +19,26 @@ import javax.crypto.spec.IvParameterSpec
 class MrtdNfcReaderTest {
     data class Request(val command: CommandAPDU, val wrapper: SecureMessagingWrapper?)
 
+    /**
+     * Plays [responses] back, or once secure messaging is established and [files] are given,
+     * serves SELECT and READ BINARY commands from [files], by file id.
+     *
+     * Simulates the card leaving the field by failing after [maxReads] READ BINARY commands.
+     */
     class MockCardService(
         private val reader: MrtdNfcChipAccess,
-        private val responses: List<ResponseAPDU>
+        private val responses: List<ResponseAPDU>,
+        private val files: Map<Short, ByteArray>? = null,
+        private val maxReads: Int = Int.MAX_VALUE,
+        private val extendedLengthSupported: Boolean = false
     ) : CardService() {
         private var opened = false
         private var secureSendCounter: Long = 0
         val received = ArrayList<Request>()
         private val responseIt = responses.iterator()
+        private var selectedFile: Short? = null
+        val selectedFiles = ArrayList<Short>()
+        val readLengths = ArrayList<Int>()
 
         override fun open() {
             opened = true
@@ -37,7 +51,11 @@ class MrtdNfcReaderTest {
         override fun transmit(commandAPDU: CommandAPDU?): ResponseAPDU {
             val wrapper = reader.service?.wrapper
             received.add(Request(commandAPDU!!, wrapper))
-            val response = responseIt.next()
+            val response = if (wrapper != null && files != null) {
+                serveFile(commandAPDU, wrapper)
+            } else {
+                responseIt.next()
+            }
             val wrapped = if (wrapper != null) {
                 wrap(response, wrapper)
             } else {
@@ -46,6 +64,62 @@ class MrtdNfcReaderTest {
             return wrapped
         }
 
+        private fun serveFile(command: CommandAPDU, wrapper: SecureMessagingWrapper): ResponseAPDU {
+            val dataObjects = parseDataObjects(command.data)
+            when (command.ins) {
+                ISO7816.INS_SELECT_FILE.toInt() and 0xFF -> {
+                    val cipher = Util.getCipher("DESede/CBC/NoPadding")
+                    val zeroIV = IvParameterSpec(byteArrayOf(0, 0, 0, 0, 0, 0, 0, 0))
+                    cipher.init(Cipher.DECRYPT_MODE, wrapper.encryptionKey, zeroIV)
+                    val encrypted = dataObjects[0x87]!!
+                    val fid = cipher.doFinal(encrypted, 1, encrypted.size - 1)
+                    val file = (((fid[0].toInt() and 0xFF) shl 8) or (fid[1].toInt() and 0xFF)).toShort()
+                    selectedFiles.add(file)
+                    if (!files!!.containsKey(file)) {
+                        selectedFile = null
+                        return fileNotFound
+                    }
+                    selectedFile = file
+                    return noError
+                }
+                ISO7816.INS_READ_BINARY.toInt() and 0xFF -> {
+                    val expectedLength = dataObjects[0x97]!!
+                    var le = expectedLength.fold(0) { acc, b -> (acc shl 8) or (b.toInt() and 0xFF) }
+                    if (le == 0) {
+                        le = if (expectedLength.size == 1) 0x100 else 0x10000
+                    }
+                    readLengths.add(le)
+                    if (readLengths.size > maxReads) {
+                        throw CardServiceException("Card removed")
+                    }
+                    val file = files!![selectedFile!!]!!
+                    val offset = (command.p1 shl 8) or command.p2
+                    return responseWithBody(file.copyOfRange(offset, minOf(offset + le, file.size)))
+                }
+                else -> throw RuntimeException("Unexpected command")
+            }
+        }
+
+        // Parses the BER-TLV data objects of a command with secure messaging, by tag.
+        private fun parseDataObjects(data: ByteArray): Map<Int, ByteArray> {
+            val dataObjects = mutableMapOf<Int, ByteArray>()
+            var offset = 0
+            while (offset < data.size) {
+                val tag = data[offset++].toInt() and 0xFF
+                var length = data[offset++].toInt() and 0xFF
+                if (length > 0x80) {
+                    val numBytes = length - 0x80
+                    length = 0
+                    repeat(numBytes) {
+                        length = (length shl 8) or (data[offset++].toInt() and 0xFF)
+                    }
+                }
+                dataObjects[tag] = data.copyOfRange(offset, offset + length)
+                offset += length
+            }
+            return dataObjects
+        }
+
         private fun wrap(response: ResponseAPDU, wrapper: SecureMessagingWrapper): ResponseAPDU {
             val cipher = Util.getCipher("DESede/CBC/NoPadding")
             val zeroIV = IvParameterSpec(byteArrayOf(0, 0, 0, 0, 0, 0, 0, 0))
@@ -103,6 +177,10 @@ class MrtdNfcReaderTest {
         override fun isConnectionLost(e: Exception?): Boolean {
             return false
         }
+
+        override fun isExtendedAPDULengthSupported(): Boolean {
+            return extendedLengthSupported
+        }
     }
 
     private val chipAccess = MrtdNfcChipAccess(false)  // Don't check mac
@@ -184,6 +262,76 @@ class MrtdNfcReaderTest {
         Assert.assertArrayEquals(expectedDG2, data.dataGroups[2]!!.toByteArray())
         Assert.assertArrayEquals(expectedSOD, data.sod.toByteArray())
     }
+
+    // The card is removed while DG2 is read with extended length APDUs, reading it again
+    // resumes DG2 with the default block size and doesn't read the SOD and DG1 again.
+    @Test
+    fun resume_with_default_block_size() {
+        val expectedDG1 = tlv(5, byteArrayOf(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11))
+        val expectedDG2 = tlv(6, ByteArray(1000) { it.toByte() })
+        val expectedSOD = tlv(7, byteArrayOf(34, 35, 36, 37, 1, 1, 2, 3, 8, 15))
+        val files = mapOf(
+            PassportService.EF_DG1 to expectedDG1,
+            PassportService.EF_DG2 to expectedDG2,
+            PassportService.EF_SOD to expectedSOD
+        )
+        val handshake = listOf(
+            fileNotFound,  // refuse to do PACE
+            noError,  // sending applet
+            responseWithBody(byteArrayOf(1, 2, 3, 4, 5, 6, 7, 8)),  // BAC challenge
+            responseWithBody(ByteArray(40)),  // BAC response
+        )
+        val accessData = MrtdAccessDataMrz("0000", "940506", "280808")
+        val reader = MrtdNfcDataReader(
+            listOf(1, 2), MrtdNfcDataReader.EXTENDED_MAX_BLOCKSIZE)
+
+        // Fails on the first read of DG2 after the headers, the SOD and DG1.
+        val firstChipAccess = MrtdNfcChipAccess(false)
+        val firstCardService = MockCardService(
+            firstChipAccess, handshake, files, maxReads = 5, extendedLengthSupported = true)
+        val firstService = firstChipAccess.open(firstCardService, accessData) {}
+        Assert.assertThrows(Exception::class.java) {
+            reader.read(firstCardService, firstService) {}
+        }
+        Assert.assertTrue(firstCardService.readLengths.last() > PassportService.DEFAULT_MAX_BLOCKSIZE)
+
+        val secondChipAccess = MrtdNfcChipAccess(false)
+        val secondCardService = MockCardService(
+            secondChipAccess, handshake, files, extendedLengthSupported = true)
+        val secondService = secondChipAccess.open(secondCardService, accessData) {}
+        val data = reader.read(secondCardService, secondService) {}
+
+        Assert.assertEquals(listOf(PassportService.EF_DG2), secondCardService.selectedFiles)
+        Assert.assertTrue(
+            secondCardService.readLengths.all { it <= PassportService.DEFAULT_MAX_BLOCKSIZE })
+        Assert.assertArrayEquals(expectedDG1, data.dataGroups[1]!!.toByteArray())
+        Assert.assertArrayEquals(expectedDG2, data.dataGroups[2]!!.toByteArray())
+        Assert.assertArrayEquals(expectedSOD, data.sod.toByteArray())
+    }
+
+    // Without extended length APDU support the default block size is used from the start.
+    @Test
+    fun default_block_size_without_extended_length() {
+        val expectedDG1 = tlv(5, ByteArray(500) { it.toByte() })
+        val expectedSOD = tlv(7, byteArrayOf(34, 35, 36, 37, 1, 1, 2, 3, 8, 15))
+        val cardService = MockCardService(
+            chipAccess,
+            listOf(
+                fileNotFound,  // refuse to do PACE
+                noError,  // sending applet
+                responseWithBody(byteArrayOf(1, 2, 3, 4, 5, 6, 7, 8)),  // BAC challenge
+                responseWithBody(ByteArray(40)),  // BAC response
+            ),
+            mapOf(PassportService.EF_DG1 to expectedDG1, PassportService.EF_SOD to expectedSOD)
+        )
+        val service = chipAccess.open(cardService, MrtdAccessDataMrz("0000", "940506", "280808")) {}
+        val data = MrtdNfcDataReader(listOf(1), MrtdNfcDataReader.EXTENDED_MAX_BLOCKSIZE)
+            .read(cardService, service) {}
+
+        Assert.assertTrue(cardService.readLengths.all { it <= PassportService.DEFAULT_MAX_BLOCKSIZE })
+        Assert.assertArrayEquals(expectedDG1, data.dataGroups[1]!!.toByteArray())
+        Assert.assertArrayEquals(expectedSOD, data.sod.toByteArray())
+    }
 }
 
 private val noError = responseFromCode(ISO7816.SW_NO_ERROR)
@@ -32,6 +32,8 @@ class CborSymbolProcessor(
         const val TSTR_TYPE = "com.android.identity.cbor.Tstr"
         const val CBOR_MAP_TYPE = "com.android.identity.cbor.CborMap"
         const val CBOR_ARRAY_TYPE = "com.android.identity.cbor.CborArray"
+        const val CBOR_READER_TYPE = "com.android.identity.cbor.CborReader"
+        const val CBOR_WRITER_TYPE = "com.android.identity.cbor.CborWriter"
         const val DATA_ITEM_CLASS = "com.android.identity.cbor.DataItem"
         const val BYTESTRING_TYPE = "kotlinx.io.bytestring.ByteString"
         const val TO_DATAITEM_DATETIMESTRING_FUN = "com.android.identity.cbor.toDataItemDateTimeString"
@@ -107,6 +109,184 @@ class CborSymbolProcessor(
             }
         }
 
+        /**
+         * Generates code that reads a value of the given type using a
+         * [com.android.identity.cbor.CborReader], without going through a [DataItem] when
+         * possible.
+         *
+         * The generated code must run with the reader as the receiver, the returned string is
+         * an expression for the value.
+         */
+        fun decodeValue(
+            codeBuilder: CodeBuilder,
+            type: KSType
+        ): String {
+            val declaration = type.declaration
+            val qualifiedName = declaration.qualifiedName!!.asString()
+            return when (qualifiedName) {
+                "kotlin.collections.Map", "kotlin.collections.MutableMap" -> {
+                    val keyType = type.arguments[0].type!!.resolve()
+                    if (keyType.declaration.qualifiedName!!.asString() != "kotlin.String") {
+                        return deserializeValue(codeBuilder, "readDataItem()", type)
+                    }
+                    with(codeBuilder) {
+                        val map = varName("map")
+                        val key = varName("key")
+                        line("val $map = mutableMapOf<${typeArguments(this, type)}>()")
+                        block("readMapWithTstrKeys", lambdaParameters = key) {
+                            val value = decodeValue(this, type.arguments[1].type!!.resolve())
+                            line("$map.put($key, $value)")
+                        }
+                        map
+                    }
+                }
+
+                "kotlin.collections.List", "kotlin.collections.MutableList",
+                "kotlin.collections.Set", "kotlin.collections.MutableSet" ->
+                    with(codeBuilder) {
+                        val array = varName("array")
+                        val builder = if (qualifiedName.endsWith("Set")) {
+                            "mutableSetOf"
+                        } else {
+                            "mutableListOf"
+                        }
+                        line("val $array = $builder<${typeArguments(this, type)}>()")
+                        block("readArray") {
+                            val value = decodeValue(this, type.arguments[0].type!!.resolve())
+                            line("$array.add($value)")
+                        }
+                        array
+                    }
+
+                "kotlin.String" -> "readTstr()"
+                "kotlin.ByteArray" -> "readBstr()"
+                BYTESTRING_TYPE -> {
+                    codeBuilder.importQualifiedName(BYTESTRING_TYPE)
+                    "ByteString(readBstr())"
+                }
+                "kotlin.Long" -> "readNumber()"
+                "kotlin.Int" -> "readNumber().toInt()"
+                "kotlin.Boolean" -> "readBoolean()"
+                DATA_ITEM_CLASS -> "readDataItem()"
+                else -> if (declaration is KSClassDeclaration &&
+                    declaration.classKind == ClassKind.ENUM_CLASS
+                ) {
+                    "${typeRef(codeBuilder, type)}.valueOf(readTstr())"
+                } else if (declaration is KSClassDeclaration &&
+                    findAnnotation(declaration, ANNOTATION_SERIALIZABLE) != null
+                ) {
+                    codeBuilder.importQualifiedName(qualifiedName)
+                    val decoder = decoderName(declaration, false)
+                    codeBuilder.importFunctionName(
+                        decoder.substring(decoder.lastIndexOf(".") + 1),
+                        declaration.packageName.asString()
+                    )
+                    "$decoder(this)"
+                } else {
+                    // Floating point numbers, dates and types with handwritten serialization.
+                    deserializeValue(codeBuilder, "readDataItem()", type)
+                }
+            }
+        }
+
+        /**
+         * Generates code that writes a value of the given type to the
+         * [com.android.identity.cbor.CborWriter] [writer], without going through a [DataItem]
+         * when possible.
+         *
+         * The bytes written are the same as the encoding of the data item produced by
+         * [serializeValue].
+         */
+        fun encodeValue(
+            codeBuilder: CodeBuilder,
+            writer: String,
+            code: String,
+            type: KSType
+        ) {
+            val declaration = type.declaration
+            val qualifiedName = declaration.qualifiedName!!.asString()
+            with(codeBuilder) {
+                when (qualifiedName) {
+                    "kotlin.collections.Map", "kotlin.collections.MutableMap" -> {
+                        val entry = varName("entry")
+                        line("$writer.writeMapHeader($code.size)")
+                        block("for ($entry in $code.entries)") {
+                            encodeValue(this, writer, "$entry.key",
+                                type.arguments[0].type!!.resolve())
+                            encodeValue(this, writer, "$entry.value",
+                                type.arguments[1].type!!.resolve())
+                        }
+                    }
+
+                    "kotlin.collections.List", "kotlin.collections.MutableList",
+                    "kotlin.collections.Set", "kotlin.collections.MutableSet" -> {
+                        val value = varName("value")
+                        line("$writer.writeArrayHeader($code.size)")
+                        block("for ($value in $code)") {
+                            encodeValue(this, writer, value,
+                                type.arguments[0].type!!.resolve())
+                        }
+                    }
+
+                    "kotlin.String" -> line("$writer.writeTstr($code)")
+                    "kotlin.ByteArray" -> line("$writer.writeBstr($code)")
+                    BYTESTRING_TYPE -> line("$writer.writeBstr($code.toByteArray())")
+                    "kotlin.Long" -> line("$writer.writeNumber($code)")
+                    "kotlin.Int" -> line("$writer.writeNumber($code.toLong())")
+                    "kotlin.Boolean" -> line("$writer.writeBoolean($code)")
+                    DATA_ITEM_CLASS -> line("$writer.writeDataItem($code)")
+                    else -> if (declaration is KSClassDeclaration &&
+                        declaration.classKind == ClassKind.ENUM_CLASS
+                    ) {
+                        line("$writer.writeTstr($code.name)")
+                    } else if (declaration is KSClassDeclaration &&
+                        findAnnotation(declaration, ANNOTATION_SERIALIZABLE) != null
+                    ) {
+                        importQualifiedName(qualifiedName)
+                        importFunctionName("encodeTo", declaration.packageName.asString())
+                        line("$code.encodeTo($writer)")
+                    } else {
+                        // Floating point numbers, dates and types with handwritten serialization.
+                        line("$writer.writeDataItem(${serializeValue(this, code, type)})")
+                    }
+                }
+            }
+        }
+
+        // Type of a variable holding a value of the given type, including type arguments.
+        private fun declaredType(codeBuilder: CodeBuilder, type: KSType): String {
+            val base = when (type.declaration.qualifiedName!!.asString()) {
+                "kotlin.collections.Map", "kotlin.collections.MutableMap",
+                "kotlin.collections.List", "kotlin.collections.MutableList",
+                "kotlin.collections.Set", "kotlin.collections.MutableSet" ->
+                    type.declaration.simpleName.asString()
+                else -> typeRef(codeBuilder, type)
+            }
+            if (type.arguments.isEmpty()) {
+                return base
+            }
+            return type.arguments.joinToString(", ", "$base<", ">") { argument ->
+                val argumentType = argument.type?.resolve() ?: return@joinToString "*"
+                declaredType(codeBuilder, argumentType) +
+                        if (argumentType.isMarkedNullable) "?" else ""
+            }
+        }
+
+        // The encoding of a text string as a byteArrayOf() expression.
+        private fun encodedTstrLiteral(value: String): String {
+            val utf8 = value.toByteArray(Charsets.UTF_8)
+            val length = utf8.size
+            val head = when {
+                length < 24 -> listOf(0x60 or length)
+                length < 0x100 -> listOf(0x78, length)
+                length < 0x10000 -> listOf(0x79, length shr 8, length and 0xff)
+                else -> listOf(0x7a, length ushr 24, (length shr 16) and 0xff,
+                    (length shr 8) and 0xff, length and 0xff)
+            }
+            val bytes = head.map { it.toByte() } + utf8.toList()
+            return bytes.joinToString(", ", "byteArrayOf(", ")")
+        }
+
         private fun addDeserializedMapValues(
             codeBuilder: CodeBuilder,
             targetCode: String, sourceCode: String, targetType: KSType,
@@ -158,6 +338,21 @@ class CborSymbolProcessor(
             }
         }
 
+        private fun decoderName(
+            classDeclaration: KSClassDeclaration, forDeclaration: Boolean): String {
+            val baseName = classDeclaration.simpleName.asString()
+            return if (hasCompanion(classDeclaration)) {
+                if (forDeclaration) {
+                    "${baseName}.Companion.decodeFrom"
+                } else {
+                    // for call
+                    "${baseName}.decodeFrom"
+                }
+            } else {
+                "${baseName}_decodeFrom"
+            }
+        }
+
         private fun hasCompanion(declaration: KSClassDeclaration): Boolean {
             return getCompanion(declaration) != null
         }
@@ -397,6 +592,8 @@ class CborSymbolProcessor(
                 }
             }
 
+            generateSuperclassDirectCodecs(this, classDeclaration, subclasses)
+
             writeToFile(
                 codeGenerator = codeGenerator,
                 dependencies = Dependencies(false, containingFile!!),
@@ -533,6 +730,8 @@ class CborSymbolProcessor(
                 line(")")
             }
 
+            generateDirectCodecs(this, classDeclaration, typeKey, typeId)
+
             writeToFile(
                 codeGenerator = codeGenerator,
                 dependencies = Dependencies(false, containingFile!!),
@@ -583,17 +782,182 @@ class CborSymbolProcessor(
         codeBuilder.importQualifiedName("com.android.identity.cbor.Cbor")
         val baseName = classDeclaration.simpleName.asString()
 
+        codeBuilder.importQualifiedName(CBOR_READER_TYPE)
+        codeBuilder.importQualifiedName(CBOR_WRITER_TYPE)
+
         codeBuilder.block("fun $baseName.toCbor(): ByteArray") {
-            line("return Cbor.encode(toDataItem())")
+            line("val writer = CborWriter()")
+            line("encodeTo(writer)")
+            line("return writer.toByteArray()")
         }
         codeBuilder.emptyLine()
 
         if (hasCompanion(classDeclaration)) {
             codeBuilder.block("fun $baseName.Companion.fromCbor(data: ByteArray): $baseName") {
-                line("return $baseName.fromDataItem(Cbor.decode(data))")
+                line("val reader = CborReader(data)")
+                line("val result = $baseName.decodeFrom(reader)")
+                line("require(!reader.hasMore) { \"Leftover data after decoding\" }")
+                line("return result")
             }
             codeBuilder.emptyLine()
         }
     }
+
+    // Generates encodeTo() and decodeFrom() for a data class. These write and read CBOR
+    // directly, producing and accepting the same encoding as toDataItem() and fromDataItem().
+    // Map keys are encoded ahead of time.
+    private fun generateDirectCodecs(
+        codeBuilder: CodeBuilder,
+        classDeclaration: KSClassDeclaration,
+        typeKey: String?, typeId: String?
+    ) = with(codeBuilder) {
+        val baseName = classDeclaration.simpleName.asString()
+        val decoder = decoderName(classDeclaration, true)
+        val properties = classDeclaration.getAllProperties().filter { property ->
+            // Skip cause for exceptions, like toDataItem() does
+            property.simpleName.asString() != "cause" ||
+                    property.type.resolve().declaration.qualifiedName?.asString() != "kotlin.Throwable"
+        }.toList()
+
+        if (properties.any { findAnnotation(it, ANNOTATION_MERGE) != null }) {
+            // A merged map can hold any keys, so go through DataItem.
+            emptyLine()
+            block("fun $baseName.encodeTo(writer: CborWriter)") {
+                line("writer.writeDataItem(toDataItem())")
+            }
+            emptyLine()
+            block("fun $decoder(reader: CborReader): $baseName") {
+                line("return ${deserializerName(classDeclaration, false)}(reader.readDataItem())")
+            }
+            return
+        }
+
+        val keyConstants = mutableMapOf<String, String>()
+        fun keyConstant(key: String) = keyConstants.getOrPut(key) { "cborKey${keyConstants.size}" }
+
+        emptyLine()
+        block("fun $baseName.encodeTo(writer: CborWriter)") {
+            val nullableProperties = properties.filter { it.type.resolve().isMarkedNullable }
+            val numRequired = properties.size - nullableProperties.size + (if (typeKey != null) 1 else 0)
+            val numPairs = if (nullableProperties.isEmpty()) {
+                "$numRequired"
+            } else {
+                val numPairs = varName("numPairs")
+                line("var $numPairs = $numRequired")
+                nullableProperties.forEach { property ->
+                    line("if (this.${property.simpleName.asString()} != null) $numPairs++")
+                }
+                numPairs
+            }
+            line("writer.writeMapHeader($numPairs)")
+            if (typeKey != null) {
+                line("writer.writeRaw(${keyConstant(typeKey)})")
+                line("writer.writeTstr(\"$typeId\")")
+            }
+            properties.forEach { property ->
+                val name = property.simpleName.asString()
+                val type = property.type.resolve()
+                val (source, condition) = if (type.isMarkedNullable) {
+                    val valueVar = varName(name)
+                    line("val $valueVar = this.$name")
+                    Pair(valueVar, "if ($valueVar != null)")
+                } else {
+                    Pair("this.$name", null)
+                }
+                optionalBlock(condition) {
+                    line("writer.writeRaw(${keyConstant(name)})")
+                    encodeValue(this, "writer", source, type)
+                }
+            }
+        }
+
+        emptyLine()
+        block("fun $decoder(reader: CborReader): $baseName") {
+            val fieldVars = properties.map { property ->
+                val type = property.type.resolve()
+                val fieldVar = varName(property.simpleName.asString())
+                line("var $fieldVar: ${declaredType(this, type)}? = null")
+                fieldVar
+            }
+            val key = varName("key")
+            block("reader.readMapWithTstrKeys", lambdaParameters = key) {
+                block("when ($key)") {
+                    if (typeKey != null) {
+                        line("\"$typeKey\" -> skip()")
+                    }
+                    properties.zip(fieldVars).forEach { (property, fieldVar) ->
+                        block("\"${property.simpleName.asString()}\" ->") {
+                            line("$fieldVar = ${decodeValue(this, property.type.resolve())}")
+                        }
+                    }
+                    line("else -> skip()")
+                }
+            }
+            line {
+                append("return $baseName(")
+                properties.zip(fieldVars).forEachIndexed { index, (property, fieldVar) ->
+                    if (index > 0) {
+                        append(", ")
+                    }
+                    append(fieldVar)
+                    if (!property.type.resolve().isMarkedNullable) {
+                        val name = property.simpleName.asString()
+                        append(" ?: throw IllegalArgumentException(\"Missing $name\")")
+                    }
+                }
+                append(")")
+            }
+        }
+
+        emptyLine()
+        keyConstants.forEach { (key, constant) ->
+            line("private val $constant = ${encodedTstrLiteral(key)}")
+        }
+    }
+
+    // Generates encodeTo() and decodeFrom() for a sealed class, dispatching on the type.
+    private fun generateSuperclassDirectCodecs(
+        codeBuilder: CodeBuilder,
+        classDeclaration: KSClassDeclaration,
+        subclasses: Sequence<KSClassDeclaration>
+    ) = with(codeBuilder) {
+        val baseName = classDeclaration.simpleName.asString()
+        val typeKey = getTypeKey(findAnnotation(classDeclaration, ANNOTATION_SERIALIZABLE))
+
+        emptyLine()
+        block("fun $baseName.encodeTo(writer: CborWriter)") {
+            block("when (this)") {
+                for (subclass in subclasses) {
+                    val subclassName = subclass.simpleName.asString()
+                    line("is $subclassName -> (this as $subclassName).encodeTo(writer)")
+                }
+            }
+        }
+
+        emptyLine()
+        block("fun ${decoderName(classDeclaration, true)}(reader: CborReader): $baseName") {
+            // Look for the type with a separate reader, so the map can then be decoded by
+            // the subclass.
+            line("var type: String? = null")
+            block(
+                "CborReader(reader.encodedCbor, reader.offset, reader.endOffset).readMapWithTstrKeys",
+                lambdaParameters = "key"
+            ) {
+                block("if (key == \"$typeKey\")", hasBlockAfter = true) {
+                    line("type = readTstr()")
+                }
+                block("else", hasBlockBefore = true) {
+                    line("skip()")
+                }
+            }
+            block("return when (type)") {
+                for (subclass in subclasses) {
+                    val typeId = getTypeId(classDeclaration, subclass)
+                    line("\"$typeId\" -> ${decoderName(subclass, false)}(reader)")
+                }
+                line("else -> throw IllegalArgumentException(\"wrong type: \$type\")")
+            }
+        }
+    }
 }
 
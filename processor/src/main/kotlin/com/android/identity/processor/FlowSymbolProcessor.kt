@@ -641,6 +641,17 @@ class FlowSymbolProcessor(
                 }
             }
 
+            // States are encrypted and decrypted as bytes, so skip building DataItem for them.
+            emptyLine()
+            block("private fun encode(state: $baseName): ByteArray") {
+                line("return state.toCbor()")
+            }
+
+            emptyLine()
+            block("private fun decode(data: ByteArray): $baseName") {
+                line("return $baseName.fromCbor(data)")
+            }
+
             if (flowInfo.notificationType != null) {
                 emptyLine()
                 importQualifiedName(FLOW_ENVIRONMENT)
@@ -660,7 +671,16 @@ class FlowSymbolProcessor(
 
             emptyLine()
             block("fun $baseName.Companion.register(dispatcherBuilder: FlowDispatcherLocal.Builder)") {
-                block("dispatcherBuilder.addFlow(\"${flowInfo.path}\", $baseName::class, ::serialize, ::deserialize)") {
+                line("dispatcherBuilder.addFlow(")
+                withIndent {
+                    line("flowName = \"${flowInfo.path}\",")
+                    line("stateClass = $baseName::class,")
+                    line("stateSerializer = ::serialize,")
+                    line("stateDeserializer = ::deserialize,")
+                    line("stateEncoder = ::encode,")
+                    line("stateDecoder = ::decode")
+                }
+                block(")") {
                     if (creatable) {
                         line("creatable()")
                     }
@@ -30,6 +30,7 @@ dependencies {
     implementation(libs.bouncy.castle.bcprov)
     implementation(libs.hsqldb)
     implementation(libs.mysql)
+    implementation(libs.opentelemetry.api)
     implementation(libs.ktor.client.core)
     implementation(libs.ktor.client.java)
 
@@ -6,34 +6,49 @@ import com.android.identity.crypto.Crypto
 import com.android.identity.flow.handler.AesGcmCipher
 import com.android.identity.flow.handler.FlowDispatcherLocal
 import com.android.identity.flow.handler.FlowExceptionMap
+import com.android.identity.flow.handler.FlowNotificationBusStorage
 import com.android.identity.flow.handler.FlowNotificationsLocalPoll
 import com.android.identity.flow.handler.HttpHandler
 import com.android.identity.flow.handler.SimpleCipher
+import com.android.identity.flow.server.Configuration
 import com.android.identity.flow.server.FlowEnvironment
 import com.android.identity.flow.server.Resources
 import com.android.identity.flow.server.Storage
 import com.android.identity.flow.transport.HttpTransport
 import com.android.identity.issuance.hardcoded.IssuerDocument
 import com.android.identity.issuance.hardcoded.IssuingAuthorityState
+import com.android.identity.issuance.WalletServerSettings
 import com.android.identity.issuance.hardcoded.WalletServerState
 import com.android.identity.util.Logger
+import com.android.identity.util.Tracing
+import io.opentelemetry.api.GlobalOpenTelemetry
 import io.ktor.utils.io.core.toByteArray
 import jakarta.servlet.ServletConfig
 import jakarta.servlet.http.Cookie
 import jakarta.servlet.http.HttpServlet
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.SupervisorJob
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.launch
 import kotlinx.coroutines.runBlocking
+import kotlinx.coroutines.sync.Mutex
+import kotlinx.coroutines.sync.withLock
 import jakarta.servlet.http.HttpServletRequest
 import jakarta.servlet.http.HttpServletResponse
 import kotlinx.datetime.Clock
 import kotlinx.io.bytestring.ByteString
 import org.bouncycastle.jce.provider.BouncyCastleProvider
 import org.bouncycastle.util.encoders.Base64
+import java.io.IOException
 import java.lang.UnsupportedOperationException
 import java.net.URLEncoder
 import java.nio.charset.Charset
 import java.security.Security
 import kotlin.random.Random
 import kotlin.time.Duration.Companion.days
+import kotlin.time.Duration.Companion.seconds
 import kotlin.time.DurationUnit
 
 // To run this servlet for development, use this command:
@@ -43,12 +58,19 @@ import kotlin.time.DurationUnit
 // To get the Wallet App to use it, go into Settings and make it point to the machine
 // you are running the server on.
 //
+// Several instances of the server may run behind a load balancer, as long as they share the
+// database and set notificationBus to "storage". All state is either kept in the database
+// or passed to the client encrypted with a key from the database, so any instance can serve
+// any request.
+//
 class FlowServlet : HttpServlet() {
     companion object {
         private const val TAG = "FlowServlet"
 
         private const val PASSWORD_SALT = "1CxCucFhcIzcbMnSrIgB"
         private val AUTH_VALIDITY_DURATION = 7.days
+        // Well below the idle timeouts of clients and proxies.
+        private val STREAM_KEEPALIVE_INTERVAL = 15.seconds
         private val LIST_HEAD = "<!DOCTYPE html><html><head></head><body><ul>"
         private val LIST_TAIL = "</ul></body></html>"
         private val TABLE_HEAD = "<!DOCTYPE html><html><head><link rel='stylesheet' href='table.css'/></head><body><table>"
@@ -57,7 +79,8 @@ class FlowServlet : HttpServlet() {
         private lateinit var serverEnvironment: FlowEnvironment
         private lateinit var httpHandler: HttpHandler
         private lateinit var stateCipher: SimpleCipher
-        private lateinit var adminPasswordHash: ByteString
+        private lateinit var initialAdminPasswordHash: ByteString
+        private val backgroundScope = CoroutineScope(SupervisorJob() + Dispatchers.IO)
 
         @Synchronized
         private fun initialize(servletConfig: ServletConfig) {
@@ -76,22 +99,41 @@ class FlowServlet : HttpServlet() {
                     key.toByteArray()
                 } else {
                     val newKey = Random.Default.nextBytes(16)
-                    storage.insert(
-                        "RootState",
-                        "",
-                        ByteString(newKey),
-                        "messageEncryptionKey")
-                    newKey
+                    try {
+                        storage.insert(
+                            "RootState",
+                            "",
+                            ByteString(newKey),
+                            "messageEncryptionKey")
+                        newKey
+                    } catch (err: Exception) {
+                        // Another instance of the server starting at the same time created
+                        // the key first, all instances must use the same one.
+                        storage.get("RootState", "", "messageEncryptionKey")?.toByteArray()
+                            ?: throw err
+                    }
                 }
             }
-            adminPasswordHash = runBlocking {
-                // Don't write initial password hash in the storage
-                storage.get("RootState", "", "passwordHash")
-                    ?: saltedHash(servletConfig.getInitParameter("initialAdminPassword"))
-            }
+            // Don't write initial password hash in the storage
+            initialAdminPasswordHash =
+                saltedHash(servletConfig.getInitParameter("initialAdminPassword"))
             val cipher = AesGcmCipher(messageEncryptionKey)
             stateCipher = cipher
-            val localPoll = FlowNotificationsLocalPoll(cipher)
+            val settings = WalletServerSettings(
+                serverEnvironment.getInterface(Configuration::class)!!)
+            when (val tracing = settings.tracing) {
+                null -> {}
+                "opentelemetry" -> Tracing.setTracer(OpenTelemetryTracer(GlobalOpenTelemetry.get()))
+                else -> throw IllegalArgumentException("Unknown tracing: $tracing")
+            }
+            val localPoll = when (val bus = settings.notificationBus) {
+                null -> FlowNotificationsLocalPoll(cipher)
+                "storage" -> FlowNotificationsLocalPoll(
+                    cipher = cipher,
+                    bus = FlowNotificationBusStorage(storage)
+                ).also { relayNotifications(it) }
+                else -> throw IllegalArgumentException("Unknown notificationBus: $bus")
+            }
             (serverEnvironment as ServerEnvironment).notifications = localPoll
             val localDispatcher = dispatcherBuilder.build(
                 serverEnvironment,
@@ -102,9 +144,25 @@ class FlowServlet : HttpServlet() {
             httpHandler = HttpHandler(localDispatcher, localPoll)
         }
 
-        @Synchronized
-        private fun updateAdminPasswordHash(hash: ByteString) {
-            adminPasswordHash = hash
+        private fun relayNotifications(localPoll: FlowNotificationsLocalPoll) {
+            backgroundScope.launch {
+                while (true) {
+                    try {
+                        localPoll.relay()
+                    } catch (err: Exception) {
+                        // E.g. the database is unreachable for a moment.
+                        Logger.e(TAG, "Error relaying notifications, retrying", err)
+                        delay(5.seconds)
+                    }
+                }
+            }
+        }
+
+        // Read every time rather than kept in memory, as the password may be changed through
+        // another instance of the server.
+        private suspend fun adminPasswordHash(): ByteString {
+            val storage = serverEnvironment.getInterface(Storage::class)!!
+            return storage.get("RootState", "", "passwordHash") ?: initialAdminPasswordHash
         }
 
         private fun saltedHash(password: String): ByteString {
@@ -149,6 +207,10 @@ class FlowServlet : HttpServlet() {
             return
         }
         val requestData = req.inputStream.readNBytes(requestLength)
+        if (target == "_" && action == "stream") {
+            doStream(prefix, requestData, req, resp)
+            return
+        }
         try {
             val bytes = runBlocking {
                 httpHandler.post(
@@ -179,6 +241,61 @@ class FlowServlet : HttpServlet() {
     }
 
 
+    // Pushes notifications as server-sent events, each carrying a base64-encoded message,
+    // until the client goes away. The request is processed asynchronously so that waiting for
+    // notifications doesn't hold a servlet thread, and a comment line is sent every
+    // STREAM_KEEPALIVE_INTERVAL to keep the connection from being closed as idle.
+    private fun doStream(
+        prefix: String,
+        requestData: ByteArray,
+        req: HttpServletRequest,
+        resp: HttpServletResponse
+    ) {
+        resp.contentType = "text/event-stream"
+        val asyncContext = req.startAsync()
+        asyncContext.timeout = 0
+        val writer = resp.outputStream.writer(Charset.forName("utf-8"))
+        val writeLock = Mutex()
+        backgroundScope.launch {
+            var numEvents = 0
+            try {
+                coroutineScope {
+                    val keepAlive = launch {
+                        while (true) {
+                            delay(STREAM_KEEPALIVE_INTERVAL)
+                            writeLock.withLock {
+                                writer.write(": keepalive\n\n")
+                                writer.flush()
+                            }
+                        }
+                    }
+                    try {
+                        httpHandler.stream("_/stream", ByteString(requestData)) { event ->
+                            writeLock.withLock {
+                                writer.write("data: ${Base64.toBase64String(event.toByteArray())}\n\n")
+                                writer.flush()
+                            }
+                            numEvents++
+                        }
+                    } finally {
+                        keepAlive.cancel()
+                    }
+                }
+            } catch (e: SimpleCipher.DataTamperedException) {
+                Logger.i(TAG, "$prefix: stream rejected, state tampered")
+                if (!resp.isCommitted) {
+                    resp.sendError(405, "State tampered")
+                }
+            } catch (e: IOException) {
+                Logger.i(TAG, "$prefix: stream closed after $numEvents events")
+            } catch (e: Exception) {
+                Logger.e(TAG, "$prefix: stream failed after $numEvents events", e)
+            } finally {
+                asyncContext.complete()
+            }
+        }
+    }
+
     private fun getAuthCookie(req: HttpServletRequest): Cookie? {
         if (req.cookies != null) {
             for (cookie in req.cookies) {
@@ -197,7 +314,7 @@ class FlowServlet : HttpServlet() {
                 val parsedCookie =
                     AdminAuthCookie.fromCbor(stateCipher.decrypt(Base64.decode(cookie.value)))
                 if (parsedCookie.expiration >= Clock.System.now()
-                        && parsedCookie.passwordHash == adminPasswordHash) {
+                        && parsedCookie.passwordHash == runBlocking { adminPasswordHash() }) {
                     return true
                 }
                 Logger.e(TAG, "Expired or stale Auth cookie: ${parsedCookie.expiration}")
@@ -239,6 +356,7 @@ class FlowServlet : HttpServlet() {
                 if (cookie != null) {
                     cookie.maxAge = 0  // remove existing cookie if present
                 }
+                val adminPasswordHash = runBlocking { adminPasswordHash() }
                 if (saltedHash(password) == adminPasswordHash) {
                     val expiration = Clock.System.now() + AUTH_VALIDITY_DURATION
                     val auth = Base64.toBase64String(stateCipher.encrypt(
@@ -256,7 +374,7 @@ class FlowServlet : HttpServlet() {
             }
             "password" -> {
                 val oldPassword = parameters["oldPassword"]!![0]
-                if (saltedHash(oldPassword) != adminPasswordHash) {
+                if (saltedHash(oldPassword) != runBlocking { adminPasswordHash() }) {
                     resp.contentType = "text/plain"
                     resp.writer.println("Old password is not correct")
                     return
@@ -268,7 +386,6 @@ class FlowServlet : HttpServlet() {
                     return
                 }
                 val hash = saltedHash(password)
-                adminPasswordHash = hash
                 val storage = serverEnvironment.getInterface(Storage::class)!!
                 runBlocking {
                     if (storage.get("RootState", "", "passwordHash") == null) {
@@ -277,7 +394,6 @@ class FlowServlet : HttpServlet() {
                         storage.update("RootState", "", "passwordHash", hash)
                     }
                 }
-                updateAdminPasswordHash(hash)
                 resp.sendRedirect("${req.contextPath}/login.html")
             }
             else -> {
@@ -313,11 +429,9 @@ class FlowServlet : HttpServlet() {
                 writer.write(TABLE_HEAD)
                 writer.write("<tr><th>Id</th><th>Display Name</th></tr>")
                 runBlocking {
-                    val documentIds = storage.enumerate("IssuerDocument", clientId)
-                    for (documentId in documentIds) {
+                    storage.enumerateWithData("IssuerDocument", clientId).collect { (documentId, documentData) ->
                         writer.write("<tr>")
                         writer.write("<td class='code'>${htmlEscape(documentId)}</td>")
-                        val documentData = storage.get("IssuerDocument", clientId, documentId)!!
                         val document = IssuerDocument.fromDataItem(Cbor.decode(documentData.toByteArray()))
                         writer.write("<td>${htmlEscape(document.documentConfiguration?.displayName)}</td>")
                         writer.write("<tr>")
@@ -0,0 +1,51 @@
+package com.android.identity.wallet.server
+
+import com.android.identity.util.Tracing
+import io.opentelemetry.api.OpenTelemetry
+import io.opentelemetry.api.metrics.LongCounter
+import io.opentelemetry.api.trace.Span
+import io.opentelemetry.api.trace.StatusCode
+import java.util.concurrent.ConcurrentHashMap
+
+/**
+ * [Tracing.Tracer] exporting spans and counters through OpenTelemetry.
+ *
+ * With `GlobalOpenTelemetry.get()` as [openTelemetry] the export is set up by the
+ * OpenTelemetry Java agent if the server runs with it, and nothing is exported otherwise.
+ */
+class OpenTelemetryTracer(
+    openTelemetry: OpenTelemetry
+) : Tracing.Tracer {
+    private val tracer = openTelemetry.getTracer(INSTRUMENTATION_SCOPE)
+    private val meter = openTelemetry.getMeter(INSTRUMENTATION_SCOPE)
+    private val counters = ConcurrentHashMap<String, LongCounter>()
+
+    override fun startSpan(name: String): Tracing.Span =
+        SpanAdapter(tracer.spanBuilder(name).startSpan())
+
+    override fun addToCounter(name: String, delta: Long) {
+        counters.computeIfAbsent(name) { meter.counterBuilder(it).build() }.add(delta)
+    }
+
+    private class SpanAdapter(private val span: Span) : Tracing.Span {
+        override fun setAttribute(key: String, value: String) {
+            span.setAttribute(key, value)
+        }
+
+        override fun setAttribute(key: String, value: Long) {
+            span.setAttribute(key, value)
+        }
+
+        override fun end(error: Throwable?) {
+            if (error != null) {
+                span.recordException(error)
+                span.setStatus(StatusCode.ERROR)
+            }
+            span.end()
+        }
+    }
+
+    companion object {
+        private const val INSTRUMENTATION_SCOPE = "com.android.identity"
+    }
+}
@@ -23,7 +23,8 @@ class ServerEnvironment(
     private val storage = ServerStorage(
         settings.databaseConnection ?: defaultDatabase(),
         settings.databaseUser ?: "",
-        settings.databasePassword ?: "")
+        settings.databasePassword ?: "",
+        settings.databaseConnectionPoolSize ?: ServerStorage.DEFAULT_POOL_SIZE)
     private val httpClient = HttpClient(Java)
     internal var notifications: FlowNotifications? = null
 
@@ -1,22 +1,45 @@
 package com.android.identity.wallet.server
 
 import com.android.identity.flow.server.Storage
+import kotlinx.coroutines.flow.Flow
+import kotlinx.coroutines.flow.flow
+import kotlinx.coroutines.sync.Semaphore
+import kotlinx.coroutines.sync.withPermit
 import kotlinx.io.bytestring.ByteString
 import java.sql.Connection
 import java.sql.DriverManager
+import java.sql.PreparedStatement
+import java.util.concurrent.ConcurrentHashMap
 import kotlin.io.encoding.Base64
 import kotlin.io.encoding.ExperimentalEncodingApi
 import kotlin.random.Random
 
+/**
+ * [Storage] implementation backed by a JDBC database.
+ *
+ * Connections are kept in a pool of at most [poolSize] connections, each of which caches its
+ * prepared statements. When all connections are in use, callers suspend until one is released.
+ *
+ * @param jdbc the JDBC connection string.
+ * @param user the database user.
+ * @param password the database password.
+ * @param poolSize maximum number of connections to the database opened at the same time.
+ */
 class ServerStorage(
     private val jdbc: String,
     private var user: String = "",
-    private val password: String = ""
+    private val password: String = "",
+    private val poolSize: Int = DEFAULT_POOL_SIZE
 ): Storage {
-    private val createdTables = mutableSetOf<String>()
+    private val createdTables = ConcurrentHashMap.newKeySet<String>()
     private val blobType: String
+    private val connectionPermits: Semaphore
+    private val idleConnections = ArrayDeque<PooledConnection>()
 
     init {
+        require(poolSize > 0) { "poolSize must be positive" }
+        connectionPermits = Semaphore(poolSize)
+
         // initialize appropriate drives (this also ensures that dependencies don't get
         // stripped when building WAR file).
         if (jdbc.startsWith("jdbc:hsqldb:")) {
@@ -32,33 +55,28 @@ class ServerStorage(
 
     override suspend fun get(table: String, peerId: String, key: String): ByteString? {
         val safeTable = sanitizeTable(table)
-        val connection = acquireConnection()
-        ensureTable(connection, safeTable)
-        val statement = connection.prepareStatement(
-            "SELECT data FROM $safeTable WHERE (peerId = ? AND id = ?)")
-        statement.setString(1, peerId)
-        statement.setString(2, key)
-        val resultSet = statement.executeQuery()
-        if (!resultSet.next()) {
-            return null
+        return withConnection(safeTable) { connection ->
+            val statement = connection.prepareStatement(
+                "SELECT data FROM $safeTable WHERE (peerId = ? AND id = ?)")
+            statement.setString(1, peerId)
+            statement.setString(2, key)
+            statement.executeQuery().use { resultSet ->
+                if (resultSet.next()) ByteString(resultSet.getBytes(1)) else null
+            }
         }
-        val bytes = resultSet.getBytes(1)
-        releaseConnection(connection)
-        return ByteString(bytes)
     }
 
     @OptIn(ExperimentalEncodingApi::class)
     override suspend fun insert(table: String, peerId: String, data: ByteString, key: String): String {
         val safeTable = sanitizeTable(table)
         val recordKey = key.ifEmpty { Base64.encode(Random.Default.nextBytes(18)) }
-        val connection = acquireConnection()
-        ensureTable(connection, safeTable)
-        val statement = connection.prepareStatement("INSERT INTO $safeTable VALUES(?, ?, ?)")
-        statement.setString(1, recordKey)
-        statement.setString(2, peerId)
-        statement.setBytes(3, data.toByteArray())
-        val count = statement.executeUpdate()
-        releaseConnection(connection)
+        val count = withConnection(safeTable) { connection ->
+            val statement = connection.prepareStatement("INSERT INTO $safeTable VALUES(?, ?, ?)")
+            statement.setString(1, recordKey)
+            statement.setString(2, peerId)
+            statement.setBytes(3, data.toByteArray())
+            statement.executeUpdate()
+        }
         if (count != 1) {
             throw IllegalStateException("Value was not inserted")
         }
@@ -67,15 +85,14 @@ class ServerStorage(
 
     override suspend fun update(table: String, peerId: String, key: String, data: ByteString) {
         val safeTable = sanitizeTable(table)
-        val connection = acquireConnection()
-        ensureTable(connection, safeTable)
-        val statement = connection.prepareStatement(
-            "UPDATE $safeTable SET data = ? WHERE (peerId = ? AND id = ?)")
-        statement.setBytes(1, data.toByteArray())
-        statement.setString(2, peerId)
-        statement.setString(3, key)
-        val count = statement.executeUpdate()
-        releaseConnection(connection)
+        val count = withConnection(safeTable) { connection ->
+            val statement = connection.prepareStatement(
+                "UPDATE $safeTable SET data = ? WHERE (peerId = ? AND id = ?)")
+            statement.setBytes(1, data.toByteArray())
+            statement.setString(2, peerId)
+            statement.setString(3, key)
+            statement.executeUpdate()
+        }
         if (count != 1) {
             throw IllegalStateException("Value was not updated")
         }
@@ -83,58 +100,230 @@ class ServerStorage(
 
     override suspend fun delete(table: String, peerId: String, key: String): Boolean {
         val safeTable = sanitizeTable(table)
-        val connection = acquireConnection()
-        ensureTable(connection, safeTable)
-        val statement = connection.prepareStatement(
-            "DELETE FROM $safeTable WHERE (peerId = ? AND id = ?)")
-        statement.setString(1, peerId)
-        statement.setString(2, key)
-        val count = statement.executeUpdate()
-        releaseConnection(connection)
+        val count = withConnection(safeTable) { connection ->
+            val statement = connection.prepareStatement(
+                "DELETE FROM $safeTable WHERE (peerId = ? AND id = ?)")
+            statement.setString(1, peerId)
+            statement.setString(2, key)
+            statement.executeUpdate()
+        }
         return count > 0
     }
 
     override suspend fun enumerate(table: String, peerId: String,
                                    notBeforeKey: String, limit: Int): List<String> {
         val safeTable = sanitizeTable(table)
-        val connection = acquireConnection()
-        ensureTable(connection, safeTable)
         val opt = if (limit < Int.MAX_VALUE) " LIMIT 0, $limit" else ""
-        val statement = connection.prepareStatement(
-            "SELECT id FROM $safeTable WHERE (peerId = ? AND id > ?) ORDER BY id$opt")
-        statement.setString(1, peerId)
-        statement.setString(2, notBeforeKey)
-        val resultSet = statement.executeQuery()
-        val list = mutableListOf<String>()
-        while (resultSet.next()) {
-            list.add(resultSet.getString(1))
+        return withConnection(safeTable) { connection ->
+            val statement = connection.prepareStatement(
+                "SELECT id FROM $safeTable WHERE (peerId = ? AND id > ?) ORDER BY id$opt")
+            statement.setString(1, peerId)
+            statement.setString(2, notBeforeKey)
+            val list = mutableListOf<String>()
+            statement.executeQuery().use { resultSet ->
+                while (resultSet.next()) {
+                    list.add(resultSet.getString(1))
+                }
+            }
+            list
+        }
+    }
+
+    override suspend fun getMany(
+        table: String,
+        peerId: String,
+        keys: List<String>
+    ): List<ByteString?> {
+        val safeTable = sanitizeTable(table)
+        val found = mutableMapOf<String, ByteString>()
+        for (chunk in keys.distinct().chunked(MAX_ROWS_PER_STATEMENT)) {
+            withConnection(safeTable) { connection ->
+                val placeholders = chunk.joinToString(", ") { "?" }
+                val statement = connection.prepareStatement(
+                    "SELECT id, data FROM $safeTable WHERE (peerId = ? AND id IN ($placeholders))")
+                statement.setString(1, peerId)
+                chunk.forEachIndexed { i, key -> statement.setString(i + 2, key) }
+                statement.executeQuery().use { resultSet ->
+                    while (resultSet.next()) {
+                        found[resultSet.getString(1)] = ByteString(resultSet.getBytes(2))
+                    }
+                }
+            }
+        }
+        return keys.map { key -> found[key] }
+    }
+
+    @OptIn(ExperimentalEncodingApi::class)
+    override suspend fun insertMany(
+        table: String,
+        peerId: String,
+        data: List<ByteString>,
+        keys: List<String>
+    ): List<String> {
+        require(keys.size == data.size) { "keys and data must be of the same size" }
+        val safeTable = sanitizeTable(table)
+        val recordKeys = keys.map { key ->
+            key.ifEmpty { Base64.encode(Random.Default.nextBytes(18)) }
+        }
+        var offset = 0
+        for (chunk in data.chunked(MAX_ROWS_PER_STATEMENT)) {
+            val count = withConnection(safeTable) { connection ->
+                val values = chunk.joinToString(", ") { "(?, ?, ?)" }
+                val statement = connection.prepareStatement("INSERT INTO $safeTable VALUES $values")
+                chunk.forEachIndexed { i, item ->
+                    statement.setString(3 * i + 1, recordKeys[offset + i])
+                    statement.setString(3 * i + 2, peerId)
+                    statement.setBytes(3 * i + 3, item.toByteArray())
+                }
+                statement.executeUpdate()
+            }
+            if (count != chunk.size) {
+                throw IllegalStateException("Values were not inserted")
+            }
+            offset += chunk.size
+        }
+        return recordKeys
+    }
+
+    override fun enumerateWithData(
+        table: String,
+        peerId: String,
+        notBeforeKey: String,
+        pageSize: Int
+    ): Flow<Pair<String, ByteString>> = flow {
+        require(pageSize > 0) { "pageSize must be positive" }
+        val safeTable = sanitizeTable(table)
+        var lastKey = notBeforeKey
+        while (true) {
+            val page = withConnection(safeTable) { connection ->
+                val statement = connection.prepareStatement(
+                    "SELECT id, data FROM $safeTable WHERE (peerId = ? AND id > ?) " +
+                            "ORDER BY id LIMIT 0, $pageSize")
+                statement.setString(1, peerId)
+                statement.setString(2, lastKey)
+                val list = mutableListOf<Pair<String, ByteString>>()
+                statement.executeQuery().use { resultSet ->
+                    while (resultSet.next()) {
+                        list.add(Pair(resultSet.getString(1), ByteString(resultSet.getBytes(2))))
+                    }
+                }
+                list
+            }
+            for (record in page) {
+                emit(record)
+            }
+            if (page.size < pageSize) {
+                break
+            }
+            lastKey = page.last().first
         }
-        releaseConnection(connection)
-        return list
     }
 
     private fun ensureTable(connection: Connection, safeTable: String) {
         if (!createdTables.contains(safeTable)) {
-            connection.createStatement().execute("""
-                CREATE TABLE IF NOT EXISTS $safeTable (
-                    id VARCHAR(64) PRIMARY KEY,
-                    peerId VARCHAR(64),
-                    data $blobType
-                )
-            """.trimIndent())
+            connection.createStatement().use { statement ->
+                statement.execute("""
+                    CREATE TABLE IF NOT EXISTS $safeTable (
+                        id VARCHAR(64) PRIMARY KEY,
+                        peerId VARCHAR(64),
+                        data $blobType
+                    )
+                """.trimIndent())
+            }
             createdTables.add(safeTable)
         }
     }
 
-    private fun acquireConnection(): Connection {
-        return DriverManager.getConnection(jdbc, user, password)
+    /**
+     * Runs [block] with a connection from the pool, suspending until one is available.
+     *
+     * The connection is returned to the pool when [block] completes normally. If it throws,
+     * the connection may be in a bad state, so it is closed instead.
+     */
+    private suspend fun <T> withConnection(
+        safeTable: String,
+        block: (PooledConnection) -> T
+    ): T = connectionPermits.withPermit {
+        val connection = acquireConnection()
+        var reusable = false
+        try {
+            ensureTable(connection.connection, safeTable)
+            val result = block(connection)
+            reusable = true
+            result
+        } finally {
+            if (reusable) {
+                releaseConnection(connection)
+            } else {
+                connection.close()
+            }
+        }
+    }
+
+    // Must be called with a permit from connectionPermits.
+    private fun acquireConnection(): PooledConnection {
+        while (true) {
+            val pooled = synchronized(idleConnections) {
+                idleConnections.removeLastOrNull()
+            } ?: break
+            // The server may have dropped connections that were idle for a long time.
+            if (System.currentTimeMillis() - pooled.lastUsedMillis < VALIDATE_AFTER_IDLE_MILLIS
+                || pooled.connection.isValid(VALIDATION_TIMEOUT_SECONDS)) {
+                return pooled
+            }
+            pooled.close()
+        }
+        return PooledConnection(DriverManager.getConnection(jdbc, user, password))
     }
 
-    private fun releaseConnection(connection: Connection) {
-        connection.close()
+    private fun releaseConnection(connection: PooledConnection) {
+        connection.lastUsedMillis = System.currentTimeMillis()
+        synchronized(idleConnections) {
+            idleConnections.addLast(connection)
+        }
     }
 
     private fun sanitizeTable(table: String): String {
         return "Wt$table"
     }
-}
\ No newline at end of file
+
+    /**
+     * A pooled connection along with its cached prepared statements.
+     */
+    private class PooledConnection(val connection: Connection) {
+        var lastUsedMillis = System.currentTimeMillis()
+
+        private val statements = object : LinkedHashMap<String, PreparedStatement>(
+            16, 0.75f, true) {
+            override fun removeEldestEntry(
+                eldest: MutableMap.MutableEntry<String, PreparedStatement>
+            ): Boolean {
+                if (size <= MAX_CACHED_STATEMENTS) {
+                    return false
+                }
+                eldest.value.close()
+                return true
+            }
+        }
+
+        fun prepareStatement(sql: String): PreparedStatement =
+            statements.getOrPut(sql) { connection.prepareStatement(sql) }
+
+        fun close() {
+            try {
+                connection.close()
+            } catch (err: Exception) {
+                // Nothing we can do, the connection is being discarded anyway.
+            }
+        }
+    }
+
+    companion object {
+        const val DEFAULT_POOL_SIZE = 10
+
+        private const val MAX_CACHED_STATEMENTS = 64
+        private const val MAX_ROWS_PER_STATEMENT = 100
+        private const val VALIDATE_AFTER_IDLE_MILLIS = 30_000L
+        private const val VALIDATION_TIMEOUT_SECONDS = 5
+    }
+}
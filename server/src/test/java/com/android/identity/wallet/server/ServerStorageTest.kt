@@ -1,5 +1,8 @@
 package com.android.identity.wallet.server
 
+import kotlinx.coroutines.async
+import kotlinx.coroutines.awaitAll
+import kotlinx.coroutines.flow.toList
 import kotlinx.coroutines.runBlocking
 import kotlinx.io.bytestring.ByteString
 import org.junit.Assert
@@ -68,4 +71,68 @@ class ServerStorageTest {
             Assert.assertNull(data)
         }
     }
-}
\ No newline at end of file
+
+    @Test
+    fun testConcurrentAccess() {
+        // Use a pool smaller than the number of concurrent callers.
+        val pooledStorage = ServerStorage("jdbc:hsqldb:mem:concurrentAccess", poolSize = 2)
+        runBlocking {
+            val keys = (0..19).map { i ->
+                async {
+                    pooledStorage.insert("Concurrent", "client1", ByteString("data$i".toByteArray()))
+                }
+            }.awaitAll()
+            val values = keys.map { key ->
+                async { pooledStorage.get("Concurrent", "client1", key) }
+            }.awaitAll()
+            Assert.assertEquals(
+                (0..19).map { i -> "data$i" },
+                values.map { it!!.toByteArray().toString(Charsets.UTF_8) })
+            // A miss must not leak the connection.
+            repeat(5) {
+                Assert.assertNull(pooledStorage.get("Concurrent", "client1", "fake_key"))
+            }
+        }
+    }
+
+    @Test
+    fun testInsertManyAndGetMany() {
+        runBlocking {
+            val data = (0..249).map { i -> ByteString("data$i".toByteArray()) }
+            val keys = storage.insertMany("InsertMany", "client1", data)
+            Assert.assertEquals(250, keys.toSet().size)
+            storage.insert("InsertMany", "client2", ByteString("bad".toByteArray()), "other")
+            val explicitKeys = storage.insertMany("InsertMany", "client1",
+                listOf(ByteString("a".toByteArray()), ByteString("b".toByteArray())),
+                listOf("key_a", ""))
+            Assert.assertEquals("key_a", explicitKeys[0])
+
+            val values = storage.getMany("InsertMany", "client1",
+                keys + listOf("fake_key", "other", keys[0]))
+            Assert.assertEquals(253, values.size)
+            for (i in 0..249) {
+                Assert.assertEquals("data$i", values[i]!!.toByteArray().toString(Charsets.UTF_8))
+            }
+            Assert.assertNull(values[250])
+            Assert.assertNull(values[251]) // belongs to client2
+            Assert.assertEquals("data0", values[252]!!.toByteArray().toString(Charsets.UTF_8))
+        }
+    }
+
+    @Test
+    fun testEnumerateWithData() {
+        runBlocking {
+            val keys = (0..24).map { i ->
+                storage.insert("EnumerateWithData", "client1", ByteString("good$i".toByteArray()))
+            }
+            storage.insert("EnumerateWithData", "client0", ByteString("bad".toByteArray()))
+            val records = storage.enumerateWithData("EnumerateWithData", "client1",
+                pageSize = 10).toList()
+            Assert.assertEquals(keys.sorted(), records.map { it.first })
+            for ((key, data) in records) {
+                Assert.assertEquals("good${keys.indexOf(key)}",
+                    data.toByteArray().toString(Charsets.UTF_8))
+            }
+        }
+    }
+}
@@ -48,6 +48,7 @@ include(":identityctl")
 include(":mrtd-reader")
 include(":mrtd-reader-android")
 include(":jpeg2k")
+include(":benchmarks")
 include(":samples:secure-area-test-app")
 include(":samples:preconsent-mdl")
 include(":samples:age-verifier-mdl")
@@ -8,11 +8,16 @@ import io.ktor.client.plugins.HttpRequestTimeoutException
 import io.ktor.client.plugins.HttpTimeout
 import io.ktor.client.plugins.timeout
 import io.ktor.client.request.post
+import io.ktor.client.request.preparePost
 import io.ktor.client.request.setBody
+import io.ktor.client.statement.bodyAsChannel
 import io.ktor.client.statement.readBytes
 import kotlinx.io.bytestring.ByteString
 import java.net.ConnectException
+import java.net.SocketTimeoutException
 import java.util.concurrent.CancellationException
+import kotlin.io.encoding.Base64
+import kotlin.io.encoding.ExperimentalEncodingApi
 
 class WalletHttpTransport(private val baseUrl: String): HttpTransport {
     companion object {
@@ -54,4 +59,52 @@ class WalletHttpTransport(private val baseUrl: String): HttpTransport {
         HttpTransport.processStatus(response.status.value, response.status.description)
         return ByteString(response.readBytes())
     }
+
+    @OptIn(ExperimentalEncodingApi::class)
+    override suspend fun stream(
+        url: String,
+        data: ByteString,
+        onEvent: suspend (ByteString) -> Unit
+    ) {
+        try {
+            client.preparePost("$baseUrl/$url") {
+                // The server sends an empty event when nothing happened for a while, so
+                // the connection can stay open indefinitely.
+                timeout {
+                    requestTimeoutMillis = HttpTimeout.INFINITE_TIMEOUT_MS
+                    socketTimeoutMillis = REQUEST_TIMEOUT_SECONDS.toLong()*1000
+                }
+                setBody(data.toByteArray())
+            }.execute { response ->
+                HttpTransport.processStatus(response.status.value, response.status.description)
+                val channel = response.bodyAsChannel()
+                while (true) {
+                    val line = channel.readUTF8Line(Int.MAX_VALUE) ?: break
+                    if (line.startsWith("data:")) {
+                        onEvent(ByteString(Base64.decode(line.substring(5).trim())))
+                    }
+                }
+            }
+        } catch (e: CancellationException) {
+            // important to propagate this one!
+            Logger.i("WalletHttpTransport", "Task cancelled", e)
+            throw e
+        } catch (e: HttpTransport.HttpClientException) {
+            throw e
+        } catch (e: UnsupportedOperationException) {
+            // Thrown by processStatus
+            throw e
+        } catch (e: IllegalStateException) {
+            // Thrown by processStatus
+            throw e
+        } catch (e: HttpRequestTimeoutException) {
+            throw HttpTransport.TimeoutException("Timed out", e)
+        } catch (e: SocketTimeoutException) {
+            throw HttpTransport.TimeoutException("Timed out", e)
+        } catch (e: ConnectException) {
+            throw HttpTransport.ConnectionRefusedException("Connection refused", e)
+        } catch (e: Throwable) {
+            throw HttpTransport.ConnectionException("Error", e)
+        }
+    }
 }
\ No newline at end of file
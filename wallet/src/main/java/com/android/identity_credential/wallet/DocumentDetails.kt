@@ -2,6 +2,7 @@ package com.android.identity_credential.wallet
 
 import android.content.Context
 import android.graphics.Bitmap
+import android.util.LruCache
 import com.android.identity.cbor.Cbor
 import com.android.identity.cbor.DiagnosticOption
 import com.android.identity.document.Document
@@ -13,9 +14,26 @@ import com.android.identity.jpeg2k.Jpeg2kConverter
 import com.android.identity.mdoc.credential.MdocCredential
 import com.android.identity.mdoc.mso.MobileSecurityObjectParser
 import com.android.identity.mdoc.mso.StaticAuthDataParser
+import com.android.identity.util.toHex
+import java.security.MessageDigest
 
 private const val TAG = "ViewDocumentData"
 
+// Document images are rendered each time the document list is refreshed, so decoded ones
+// are kept in memory, keyed by the SHA-256 of the image. They are PII so they're never
+// written to disk, where they would be neither encrypted nor removed with the document.
+private const val IMAGE_CACHE_MAX_BYTES = 16 * 1024 * 1024
+
+private val imageCache = object : LruCache<String, Bitmap>(IMAGE_CACHE_MAX_BYTES) {
+    override fun sizeOf(key: String, value: Bitmap): Int = value.allocationByteCount
+}
+
+private fun decodeImage(context: Context, data: ByteArray): Bitmap? {
+    val key = MessageDigest.getInstance("SHA-256").digest(data).toHex()
+    imageCache.get(key)?.let { return it }
+    return Jpeg2kConverter.decodeByteArray(context, data)?.also { imageCache.put(key, it) }
+}
+
 /**
  * A class containing human-readable information (mainly PII) about a document.
  *
@@ -150,11 +168,10 @@ private fun Document.renderDocumentDetailsForMdoc(
             digestIdMapping
         )
         if (result.portrait != null) {
-            portrait = Jpeg2kConverter.decodeByteArray(context, result.portrait)
+            portrait = decodeImage(context, result.portrait)
         }
         if (result.signatureOrUsualMark != null) {
-            signatureOrUsualMark = Jpeg2kConverter.decodeByteArray(
-                context, result.signatureOrUsualMark)
+            signatureOrUsualMark = decodeImage(context, result.signatureOrUsualMark)
         }
         kvPairs += result.keysAndValues
     }
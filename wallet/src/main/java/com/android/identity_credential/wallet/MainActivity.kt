@@ -65,6 +65,7 @@ class MainActivity : FragmentActivity() {
         super.onCreate(savedInstanceState)
 
         application = getApplication() as WalletApplication
+        provisioningViewModel.mrtdNfcDataDecoder = application.mrtdNfcDataDecoder
 
         permissionTracker.updatePermissions()
 
@@ -10,7 +10,9 @@ import com.android.identity.mrtd.MrtdAccessData
 import com.android.identity.mrtd.MrtdNfc
 import com.android.identity.mrtd.MrtdNfcChipAccess
 import com.android.identity.mrtd.MrtdNfcData
+import com.android.identity.mrtd.MrtdNfcDataDecoder
 import com.android.identity.mrtd.MrtdNfcDataReader
+import com.android.identity.util.Logger
 import kotlinx.coroutines.channels.Channel
 import kotlinx.coroutines.runBlocking
 import kotlinx.io.bytestring.ByteString
@@ -42,7 +44,13 @@ import java.security.interfaces.ECPublicKey
  * JMRTD is designed to be used in threading environment and blocking calls. Thus we create a
  * dedicated thread and do command and response dispatching.
  */
-class NfcTunnelDriver : SimpleIcaoNfcTunnelDriver {
+class NfcTunnelDriver(
+    private val decoder: MrtdNfcDataDecoder
+) : SimpleIcaoNfcTunnelDriver {
+    companion object {
+        private const val TAG = "NfcTunnelDriver"
+    }
+
     private val requestChannel = Channel<OptionalRequest>()
     private val responseChannel = Channel<EvidenceResponseIcaoNfcTunnel>()
     private var dataGroups: List<Int>? = null
@@ -215,7 +223,21 @@ class NfcTunnelDriver : SimpleIcaoNfcTunnelDriver {
         progressPercent = 0
         authenticating = false
 
-        val data = MrtdNfcDataReader(dataGroups!!).read(rawService, service) { status ->
+        // Parse data groups as they arrive so that decoding the evidence only validates them.
+        val listener = object : MrtdNfcDataReader.Listener {
+            override fun onDataGroupRead(dataGroup: Int, data: ByteString) {
+                try {
+                    decoder.prepareDataGroup(dataGroup, data)
+                } catch (e: Exception) {
+                    // Decoding parses it again and reports the error.
+                    Logger.w(TAG, "Error parsing DG$dataGroup", e)
+                }
+            }
+        }
+        val data = MrtdNfcDataReader(
+            dataGroups!!,
+            listener = listener
+        ).read(rawService, service) { status ->
             progressPercent = (status as MrtdNfc.ReadingData).progressPercent
         }
 
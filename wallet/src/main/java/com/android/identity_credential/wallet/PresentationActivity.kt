@@ -40,6 +40,7 @@ import com.android.identity.mdoc.util.MdocUtil
 import com.android.identity.trustmanagement.TrustPoint
 import com.android.identity.util.Constants
 import com.android.identity.util.Logger
+import com.android.identity_credential.wallet.presentation.MdocPresentationCache
 import com.android.identity_credential.wallet.presentation.showPresentmentFlow
 import kotlinx.coroutines.launch
 import kotlinx.datetime.Clock
@@ -166,6 +167,15 @@ class PresentationActivity : FragmentActivity() {
                         .useForwardEngagement(transport!!, deviceEngagement!!, handover!!)
                         .build()
 
+                    // prepare the likely credential while the reader sends its request, looking
+                    // it up on the main thread like the rest of the wallet does
+                    lifecycleScope.launch {
+                        try {
+                            prepareLikelyMdocCredential()
+                        } catch (exception: Exception) {
+                            Logger.w(TAG, "Unable to prepare presentation", exception)
+                        }
+                    }
                 }
 
                 State.REQUEST_AVAILABLE -> {
@@ -327,6 +337,29 @@ class PresentationActivity : FragmentActivity() {
         ) as MdocCredential
     }
 
+    /**
+     * Prepare the presentation of the [MdocCredential] most likely to be requested, the one of
+     * the on-screen Document or else of the first Document with an mdoc configuration, so it's
+     * ready by the time the request is received. See [MdocPresentationCache].
+     *
+     * This must be called on the main thread since storage isn't thread-safe, only the
+     * processing of the credential data is done in the background.
+     */
+    private suspend fun prepareLikelyMdocCredential() {
+        val documentIds = listOfNotNull(walletApp.settingsModel.focusedCardId.value) +
+                walletApp.documentStore.listDocuments()
+        val document = documentIds.firstNotNullOfOrNull { documentId ->
+            walletApp.documentStore.lookupDocument(documentId)?.takeIf {
+                it.documentConfiguration.mdocConfiguration != null
+            }
+        } ?: return
+        val mdocCredential = document.findCredential(
+            WalletApplication.CREDENTIAL_DOMAIN_MDOC,
+            Clock.System.now()
+        ) as MdocCredential? ?: return
+        walletApp.mdocPresentationCache.prepare(mdocCredential)
+    }
+
     /**
      * Perform disconnect (via DeviceRetrievalHelper) and cleanup operations (nullifying vars) and
      * a call to finish(). A new Engagement will result in a new Activity instance.
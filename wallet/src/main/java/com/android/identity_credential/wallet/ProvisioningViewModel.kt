@@ -21,6 +21,7 @@ import com.android.identity.issuance.evidence.EvidenceRequestIcaoNfcTunnel
 import com.android.identity.issuance.evidence.EvidenceResponse
 import com.android.identity.issuance.evidence.EvidenceResponseIcaoNfcTunnel
 import com.android.identity.issuance.remote.WalletServerProvider
+import com.android.identity.mrtd.MrtdNfcDataDecoder
 import com.android.identity.util.Logger
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.delay
@@ -49,7 +50,17 @@ class ProvisioningViewModel : ViewModel() {
 
     private lateinit var issuer: IssuingAuthority
 
+    /**
+     * The decoder passport data groups are parsed with while they are read.
+     *
+     * What it parsed is dropped once provisioning is over since it holds the personal data of
+     * the passport holder and is otherwise only dropped when decoded, which doesn't happen
+     * if the evidence is sent to a remote issuer.
+     */
+    var mrtdNfcDataDecoder: MrtdNfcDataDecoder? = null
+
     fun reset() {
+        mrtdNfcDataDecoder?.clear()
         state.value = State.IDLE
         error = null
         document = null
@@ -58,6 +69,10 @@ class ProvisioningViewModel : ViewModel() {
         nextEvidenceRequest.value = null
     }
 
+    override fun onCleared() {
+        mrtdNfcDataDecoder?.clear()
+    }
+
     private var proofingFlow: ProofingFlow? = null
 
     var document: Document? = null
@@ -146,6 +161,7 @@ class ProvisioningViewModel : ViewModel() {
                     documentStore.addDocument(document!!)
                     proofingFlow!!.complete()
                     document!!.refreshState(walletServerProvider)
+                    mrtdNfcDataDecoder?.clear()
                 } else {
                     nextEvidenceRequest.value = evidenceRequests!!.first()
                     state.value = State.EVIDENCE_REQUESTS_READY
@@ -156,6 +172,7 @@ class ProvisioningViewModel : ViewModel() {
                 }
                 Logger.w(TAG, "Error submitting evidence", e)
                 e.printStackTrace()
+                mrtdNfcDataDecoder?.clear()
                 error = e
                 state.value = State.FAILED
             }
@@ -28,7 +28,6 @@ import com.android.identity.storage.StorageEngine
 import com.android.identity.mrtd.MrtdAccessData
 import com.android.identity.mrtd.MrtdAccessDataCan
 import com.android.identity.mrtd.MrtdNfcData
-import com.android.identity.mrtd.MrtdNfcDataDecoder
 import kotlinx.datetime.Clock
 import kotlinx.datetime.DateTimeUnit
 import kotlinx.datetime.LocalDate
@@ -130,7 +129,7 @@ class SelfSignedEuPidIssuingAuthority(
     }
 
     override fun createNfcTunnelHandler(): SimpleIcaoNfcTunnelDriver {
-        return NfcTunnelDriver()
+        return NfcTunnelDriver(application.mrtdNfcDataDecoder)
     }
 
     override fun getMrtdAccessData(collectedEvidence: Map<String, EvidenceResponse>): MrtdAccessData? {
@@ -202,8 +201,7 @@ class SelfSignedEuPidIssuingAuthority(
                 MrtdNfcData(icaoPassiveData.dataGroups, icaoPassiveData.securityObject)
             else
                 throw IllegalStateException("Should not happen")
-            val decoder = MrtdNfcDataDecoder()
-            val decoded = decoder.decode(mrtdData)
+            val decoded = application.mrtdNfcDataDecoder.decode(mrtdData)
             val firstName = decoded.firstName
             val lastName = decoded.lastName
             val sex = when (decoded.gender) {
@@ -29,7 +29,6 @@ import com.android.identity.securearea.toDataItem
 import com.android.identity.storage.StorageEngine
 import com.android.identity.mrtd.MrtdAccessData
 import com.android.identity.mrtd.MrtdNfcData
-import com.android.identity.mrtd.MrtdNfcDataDecoder
 import kotlinx.datetime.Clock
 import kotlinx.datetime.DateTimeUnit
 import kotlinx.datetime.LocalDate
@@ -237,7 +236,7 @@ class SelfSignedMdlIssuingAuthority(
     }
 
     override fun createNfcTunnelHandler(): SimpleIcaoNfcTunnelDriver {
-        return NfcTunnelDriver()
+        return NfcTunnelDriver(application.mrtdNfcDataDecoder)
     }
 
     override fun checkEvidence(collectedEvidence: Map<String, EvidenceResponse>): Boolean {
@@ -409,8 +408,7 @@ class SelfSignedMdlIssuingAuthority(
                 MrtdNfcData(icaoPassiveData.dataGroups, icaoPassiveData.securityObject)
             else
                 throw IllegalStateException("Should not happen")
-            val decoder = MrtdNfcDataDecoder()
-            val decoded = decoder.decode(mrtdData)
+            val decoded = application.mrtdNfcDataDecoder.decode(mrtdData)
             val firstName = decoded.firstName
             val lastName = decoded.lastName
             val sex = when (decoded.gender) {
@@ -4,12 +4,15 @@ import android.app.KeyguardManager
 import android.content.Context
 import android.content.Intent
 import android.content.SharedPreferences
+import android.os.Build
 import android.util.Log
 import androidx.core.content.FileProvider
 import androidx.core.content.edit
 import androidx.lifecycle.MutableLiveData
 import com.android.identity.android.util.AndroidLogPrinter
+import com.android.identity.android.util.AndroidTracer
 import com.android.identity.util.Logger
+import com.android.identity.util.Tracing
 import com.android.identity.mrtd.mrtdSetLogger
 import kotlinx.io.files.Path
 import kotlinx.io.files.SystemFileSystem
@@ -69,6 +72,10 @@ class SettingsModel(
         }
 
         Logger.setLogPrinter(AndroidLogPrinter())
+        // Only records anything while a system trace is being captured, e.g. with Perfetto.
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.Q) {
+            Tracing.setTracer(AndroidTracer())
+        }
         this.loggingEnabled.value = sharedPreferences.getBoolean(PREFERENCE_LOGGING_ENABLED, false)
         this.loggingEnabled.observeForever { logToFile ->
             sharedPreferences.edit {
@@ -39,12 +39,14 @@ import com.android.identity.issuance.DocumentExtensions.documentConfiguration
 import com.android.identity.issuance.WalletApplicationCapabilities
 import com.android.identity.issuance.remote.WalletServerProvider
 import com.android.identity.mdoc.credential.MdocCredential
+import com.android.identity.mrtd.MrtdNfcDataDecoder
 import com.android.identity.sdjwt.credential.SdJwtVcCredential
 import com.android.identity.securearea.SecureAreaRepository
 import com.android.identity.securearea.software.SoftwareSecureArea
 import com.android.identity.trustmanagement.TrustManager
 import com.android.identity.trustmanagement.TrustPoint
 import com.android.identity.util.Logger
+import com.android.identity_credential.wallet.presentation.MdocPresentationCache
 import com.android.identity_credential.wallet.util.toByteArray
 import kotlinx.coroutines.CoroutineScope
 import kotlinx.coroutines.Dispatchers
@@ -88,6 +90,11 @@ class WalletApplication : Application() {
 
     // immediate instantiations
     val trustManager = TrustManager()
+    val mdocPresentationCache = MdocPresentationCache()
+    // Fed data groups as they are read from a passport, so they're parsed by the time the
+    // self-signed issuing authorities decode the evidence. ProvisioningViewModel clears it
+    // when provisioning is over.
+    val mrtdNfcDataDecoder = MrtdNfcDataDecoder()
 
     // lazy instantiations
     val sharedPreferences: SharedPreferences by lazy {
@@ -127,7 +134,9 @@ class WalletApplication : Application() {
 
         // init storage
         val storageFile = Path(applicationContext.noBackupFilesDir.path, "identity.bin")
-        val storageEngine = AndroidStorageEngine.Builder(applicationContext, storageFile).build()
+        val storageEngine = AndroidStorageEngine.Builder(applicationContext, storageFile)
+            .setUseDataEncryptionKey(true)
+            .build()
 
         // init AndroidKeyStoreSecureArea
         androidKeystoreSecureArea = AndroidKeystoreSecureArea(applicationContext, storageEngine)
@@ -0,0 +1,142 @@
+package com.android.identity_credential.wallet.presentation
+
+import com.android.identity.cbor.Cbor
+import com.android.identity.document.NameSpacedData
+import com.android.identity.issuance.DocumentExtensions.documentConfiguration
+import com.android.identity.mdoc.credential.MdocCredential
+import com.android.identity.mdoc.mso.MobileSecurityObjectParser
+import com.android.identity.mdoc.mso.StaticAuthDataParser
+import com.android.identity.mdoc.util.MdocUtil
+import com.android.identity.util.Logger
+import com.android.identity.util.Tracing
+import kotlinx.coroutines.CoroutineDispatcher
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.withContext
+
+/**
+ * Cache of the parts of mdoc presentations which depend neither on the request nor on the
+ * session, i.e. the docType, the IssuerAuth and the IssuerSignedItemBytes of all data
+ * elements, by credential.
+ *
+ * [prepare] is called when a reader connects for the credential likely to be presented, so
+ * that once the request is received only picking the requested data elements and signing
+ * DeviceAuth, which covers the SessionTranscript, are left to do.
+ *
+ * @param maxSize the maximum number of credentials to keep prepared data for.
+ */
+class MdocPresentationCache(private val maxSize: Int = DEFAULT_MAX_SIZE) {
+    companion object {
+        private const val TAG = "MdocPresentationCache"
+
+        private const val DEFAULT_MAX_SIZE = 4
+    }
+
+    /**
+     * The data prepared for a credential.
+     *
+     * @param docType the docType of the credential.
+     * @param issuerAuth the bytes of the `IssuerAuth` CBOR.
+     * @param issuerNameSpaces the data returned by [MdocUtil.prepareIssuerNameSpaces].
+     */
+    class PreparedCredential(
+        val docType: String,
+        val issuerAuth: ByteArray,
+        val issuerNameSpaces: Map<String, Map<String, ByteArray>>,
+        internal val issuerProvidedData: ByteArray
+    )
+
+    // Least recently used first.
+    private val preparedCredentials =
+        object : LinkedHashMap<String, PreparedCredential>(16, 0.75f, true) {
+            override fun removeEldestEntry(
+                eldest: MutableMap.MutableEntry<String, PreparedCredential>?
+            ): Boolean = size > maxSize
+        }
+
+    /**
+     * Gets the prepared data for [credential], preparing it if it's not in the cache.
+     *
+     * @param credential the credential to present.
+     * @return the prepared data.
+     */
+    fun get(credential: MdocCredential): PreparedCredential {
+        val issuerProvidedData = credential.issuerProvidedData
+        return lookup(credential.identifier, issuerProvidedData)
+            ?: store(
+                credential.identifier,
+                prepareCredential(issuerProvidedData, credential.documentData)
+            )
+    }
+
+    /**
+     * Prepares the data for presenting [credential] ahead of the request.
+     *
+     * The credential and its document are read in the caller's context, which must be the
+     * one the document store is used from since storage isn't thread-safe, and only the
+     * CBOR processing is done on [dispatcher]. This also looks up the key of the credential
+     * so that it's loaded by the time it's used to sign DeviceAuth.
+     *
+     * Errors are logged and otherwise ignored since this is only speculative, the
+     * presentation prepares what it needs itself.
+     *
+     * @param credential the credential likely to be presented.
+     * @param dispatcher the dispatcher to process the data on.
+     */
+    suspend fun prepare(
+        credential: MdocCredential,
+        dispatcher: CoroutineDispatcher = Dispatchers.Default
+    ) {
+        try {
+            val issuerProvidedData = credential.issuerProvidedData
+            if (lookup(credential.identifier, issuerProvidedData) == null) {
+                val documentData = credential.documentData
+                val prepared = withContext(dispatcher) {
+                    prepareCredential(issuerProvidedData, documentData)
+                }
+                store(credential.identifier, prepared)
+            }
+            credential.secureArea.getKeyInfo(credential.alias)
+        } catch (e: Exception) {
+            Logger.w(TAG, "Error preparing credential ${credential.identifier}", e)
+        }
+    }
+
+    private fun lookup(identifier: String, issuerProvidedData: ByteArray): PreparedCredential? =
+        synchronized(preparedCredentials) {
+            // The credential may have been certified again since it was prepared.
+            preparedCredentials[identifier]?.takeIf {
+                it.issuerProvidedData.contentEquals(issuerProvidedData)
+            }
+        }
+
+    private fun store(identifier: String, prepared: PreparedCredential): PreparedCredential {
+        synchronized(preparedCredentials) {
+            preparedCredentials[identifier] = prepared
+        }
+        return prepared
+    }
+
+    private val MdocCredential.documentData: NameSpacedData
+        get() = document.documentConfiguration.mdocConfiguration!!.staticData
+
+    // Only processes the given data, so it may run on any thread.
+    private fun prepareCredential(
+        issuerProvidedData: ByteArray,
+        documentData: NameSpacedData
+    ): PreparedCredential = Tracing.span("wallet.presentation.prepare") {
+        val staticAuthData = StaticAuthDataParser(issuerProvidedData).parse()
+        val issuerNameSpaces = MdocUtil.prepareIssuerNameSpaces(documentData, staticAuthData)
+
+        val issuerAuthCoseSign1 = Cbor.decode(staticAuthData.issuerAuth).asCoseSign1
+        val encodedMsoBytes = Cbor.decode(issuerAuthCoseSign1.payload!!)
+        val encodedMso = Cbor.encode(encodedMsoBytes.asTaggedEncodedCbor)
+        val mso = MobileSecurityObjectParser(encodedMso).parse()
+
+        PreparedCredential(
+            mso.docType,
+            staticAuthData.issuerAuth,
+            issuerNameSpaces,
+            issuerProvidedData
+        )
+    }
+}
@@ -4,15 +4,11 @@ import androidx.fragment.app.FragmentActivity
 import com.android.identity.android.securearea.AndroidKeystoreKeyUnlockData
 import com.android.identity.android.securearea.AndroidKeystoreSecureArea
 import com.android.identity.android.securearea.UserAuthenticationType
-import com.android.identity.cbor.Cbor
 import com.android.identity.crypto.Algorithm
 import com.android.identity.document.Document
 import com.android.identity.document.DocumentRequest
 import com.android.identity.document.NameSpacedData
-import com.android.identity.issuance.DocumentExtensions.documentConfiguration
 import com.android.identity.mdoc.credential.MdocCredential
-import com.android.identity.mdoc.mso.MobileSecurityObjectParser
-import com.android.identity.mdoc.mso.StaticAuthDataParser
 import com.android.identity.mdoc.response.DeviceResponseGenerator
 import com.android.identity.mdoc.response.DocumentGenerator
 import com.android.identity.mdoc.util.MdocUtil
@@ -79,6 +75,9 @@ suspend fun showPresentmentFlow(
         check(resultSuccess) { "[Consent Unsuccessful]" }
     }
 
+    // usually prepared while the reader was connecting, see MdocPresentationCache
+    val preparedCredential = walletApp.mdocPresentationCache.get(mdocCredential)
+
     // initially null and updated when catching a KeyLockedException in the while-loop below
     var keyUnlockData: KeyUnlockData? = null
 
@@ -88,8 +87,7 @@ suspend fun showPresentmentFlow(
             val documentGenerator =
                 createDocumentGenerator(
                     docRequest = documentRequest,
-                    document = mdocCredential.document,
-                    credential = mdocCredential,
+                    preparedCredential = preparedCredential,
                     sessionTranscript = encodedSessionTranscript
                 )
             // try signing the data of the document (or KeyLockedException is thrown)
@@ -166,33 +164,25 @@ suspend fun showPresentmentFlow(
  * lower-level details needed to create a [DocumentGenerator].
  *
  * @param docRequest the [DocumentRequest] containing a listing of data elements to verify.
- * @param document a suitable [Document] that satisfies the [docRequest].
- * @param credential the credential used for signing the document data.
+ * @param preparedCredential the data prepared for the credential used for signing the
+ *      document data.
  * @param sessionTranscript the bytes of the SessionTrancript CBOR.
  * @return a unique [DocumentGenerator] that is used to generate the [Document]
  * after signing the Document's data.
  */
 private fun createDocumentGenerator(
     docRequest: DocumentRequest,
-    document: Document,
-    credential: MdocCredential,
+    preparedCredential: MdocPresentationCache.PreparedCredential,
     sessionTranscript: ByteArray,
 ): DocumentGenerator {
-    val staticAuthData = StaticAuthDataParser(credential.issuerProvidedData).parse()
-    val mergedIssuerNamespaces = MdocUtil.mergeIssuerNamesSpaces(
+    val mergedIssuerNamespaces = MdocUtil.selectIssuerNameSpaces(
         docRequest,
-        document.documentConfiguration.mdocConfiguration!!.staticData,
-        staticAuthData
+        preparedCredential.issuerNameSpaces
     )
 
-    val issuerAuthCoseSign1 = Cbor.decode(staticAuthData.issuerAuth).asCoseSign1
-    val encodedMsoBytes = Cbor.decode(issuerAuthCoseSign1.payload!!)
-    val encodedMso = Cbor.encode(encodedMsoBytes.asTaggedEncodedCbor)
-    val mso = MobileSecurityObjectParser(encodedMso).parse()
-
     val documentGenerator = DocumentGenerator(
-        mso.docType,
-        staticAuthData.issuerAuth,
+        preparedCredential.docType,
+        preparedCredential.issuerAuth,
         sessionTranscript
     )
     documentGenerator.setIssuerNamespaces(mergedIssuerNamespaces)
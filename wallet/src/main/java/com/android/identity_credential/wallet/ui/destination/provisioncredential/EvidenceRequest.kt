@@ -55,17 +55,21 @@ import com.android.identity.mrtd.MrtdNfc
 import com.android.identity.mrtd.MrtdNfcDataReader
 import com.android.identity.mrtd.MrtdNfcReader
 import com.android.identity.securearea.PassphraseConstraints
+import com.android.identity.util.Logger
 import com.android.identity_credential.wallet.NfcTunnelScanner
 import com.android.identity_credential.wallet.PermissionTracker
 import com.android.identity_credential.wallet.ProvisioningViewModel
 import com.android.identity_credential.wallet.R
+import com.android.identity_credential.wallet.WalletApplication
 import com.android.identity_credential.wallet.ui.RichTextSnippet
 import com.android.identity_credential.wallet.ui.prompt.passphrase.PassphraseEntryField
 import com.google.accompanist.permissions.ExperimentalPermissionsApi
 import com.google.accompanist.permissions.isGranted
 import com.google.accompanist.permissions.rememberPermissionState
+import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.delay
 import kotlinx.coroutines.launch
+import kotlinx.io.bytestring.ByteString
 
 
 private const val TAG = "EvidenceRequest"
@@ -441,8 +445,30 @@ fun EvidenceRequestIcaoPassiveAuthenticationView(
     documentStore: DocumentStore,
     permissionTracker: PermissionTracker
 ) {
+    val decoder = (LocalContext.current.applicationContext as WalletApplication).mrtdNfcDataDecoder
+    val coroutineScope = rememberCoroutineScope()
+    // Kept across scans so that reading resumes if the passport is moved away too early.
+    val reader = remember(evidenceRequest) {
+        MrtdNfcDataReader(
+            evidenceRequest.requestedDataGroups,
+            MrtdNfcDataReader.EXTENDED_MAX_BLOCKSIZE,
+            object : MrtdNfcDataReader.Listener {
+                override fun onDataGroupRead(dataGroup: Int, data: ByteString) {
+                    // Parse the data group while the rest is read, without holding up reading.
+                    coroutineScope.launch(Dispatchers.Default) {
+                        try {
+                            decoder.prepareDataGroup(dataGroup, data)
+                        } catch (e: Exception) {
+                            // Decoding parses it again and reports the error.
+                            Logger.w(TAG, "Error parsing DG$dataGroup", e)
+                        }
+                    }
+                }
+            }
+        )
+    }
     EvidenceRequestIcaoView(
-        MrtdNfcDataReader(evidenceRequest.requestedDataGroups),
+        reader,
         permissionTracker,
         IcaoMrtdCommunicationModel.Route.CAMERA_SCAN
     ) { nfcData ->